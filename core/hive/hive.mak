@@ -71,6 +71,7 @@ LIBS += -lplugins
 LIBS += -llua
 ifeq ($(UNAME_S), Linux)
 LIBS += -lstdc++fs
+LIBS += -lrt
 endif
 #系统库
 LIBS += -lm -ldl -lstdc++ -lpthread
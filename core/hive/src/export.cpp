@@ -30,6 +30,8 @@ extern "C"
 		REGISTER_CUSTOM_LIBRARY("laoi", luaopen_laoi);
 		REGISTER_CUSTOM_LIBRARY("lrandom", luaopen_lrandom);		
 		REGISTER_CUSTOM_LIBRARY("lcache", luaopen_lcache);
+		REGISTER_CUSTOM_LIBRARY("lmetrics", luaopen_lmetrics);
+		REGISTER_CUSTOM_LIBRARY("lprof", luaopen_lprof);
 
 		//optional
 
@@ -125,6 +125,7 @@ void hive_app::init_default_log(int rtype) {
 	auto path = get_environ_def("HIVE_LOG_PATH", "./logs/");
 	
 	log_service::instance()->option(path, service_name, index);
+	log_service::instance()->set_binary((binary_mode)std::stoi(get_environ_def("HIVE_LOG_BINARY", "0")));
 	log_service::instance()->add_dest(service_name, "");
 }
 
@@ -259,12 +260,18 @@ void hive_app::run(int rtype) {
 	hive.set_function("worker_startup", [&](vstring name, vstring entry, vstring incl) {
 		return m_schedulor.startup(name, entry, incl);
 		});
+	hive.set_function("worker_pool", [&](vstring name, vstring entry, vstring incl, size_t count) {
+		return m_schedulor.startup_pool(name, entry, incl, count);
+		});
 	hive.set_function("worker_call", [&](lua_State* L, vstring name) {
-		size_t data_len;
-		uint8_t* data = m_schedulor.encode(L, data_len);
-		return m_schedulor.call(L, name, data, data_len);
+		return m_schedulor.call(L, name, lworker::encode_mail(L, 2));
 		});
 	hive.set_function("worker_names", [&]() { return m_schedulor.workers(); });
+	hive.set_function("worker_stats", [&](lua_State* L) { return m_schedulor.stats(L); });
+	hive.set_function("worker_event_fd", [&]() { return m_schedulor.event_fd(); });
+	hive.set_function("freeze", [](lua_State* L) { return lworker::frozen_mgr::instance()->freeze(L); });
+	hive.set_function("frozen", [](lua_State* L) { return lworker::frozen_mgr::instance()->frozen(L); });
+	hive.set_function("unfreeze", [](lua_State* L) { return lworker::frozen_mgr::instance()->unfreeze(L); });
 	//end worker接口
 	
 	init_default_log(rtype);
@@ -1,9 +1,9 @@
 #pragma once
 
-#include <list>
 #include <array>
 #include <ctime>
 #include <mutex>
+#include <deque>
 #include <vector>
 #include <chrono>
 #include <atomic>
@@ -12,10 +12,12 @@
 #include <iostream>
 #include <filesystem>
 #include <map>
+#include <set>
 #include <condition_variable>
 #include <assert.h>
 
 #include "fmt/core.h"
+#include "fmt/args.h"
 #include "thread_name.hpp"
 #include "lua_kit.h"
 
@@ -23,7 +25,9 @@
 #include <process.h>
 #define getpid _getpid
 #else
+#include <fcntl.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #endif
 
 using namespace std::chrono;
@@ -52,8 +56,35 @@ namespace logger {
         DAYLY = 1,
     }; //rolling_type
 
-    const size_t QUEUE_MINI      = 10;
-    const size_t QUEUE_SIZE      = 300;
+    //二进制模式
+    enum class binary_mode {
+        OFF     = 0,    //调用线程格式化
+        DEFER   = 1,    //调用线程只记录格式串id和参数, 写线程格式化
+        FILE    = 2,    //同DEFER, 文件输出为二进制段(.blog), 离线解码
+    }; //binary_mode
+
+    //日志环写满时的处理策略
+    enum class overflow_policy {
+        DROP    = 0,    //丢弃
+        BLOCK   = 1,    //等待写线程腾出空间, 超时丢弃
+        SAMPLE  = 2,    //环超过3/4时WARN以下日志按比例采样, 写满丢弃
+    }; //overflow_policy
+
+    const size_t LOG_RING_SIZE   = 4096;        //每个线程的日志环记录数
+    const size_t LOG_BATCH_SIZE  = 1024 * 1024; //单个输出的批次缓冲上限
+    const size_t LOG_BLOCK_MS    = 1000;        //阻塞策略下最长等待
+    const size_t LOG_SEGMENT_GROW = 4 * 1024 * 1024; //二进制日志段每次扩展的大小
+    const size_t LOG_FMT_MAX     = 65536;       //二进制模式的格式串数量上限
+
+    //二进制日志参数类型
+    const uint8_t LOG_ARG_INT       = 0;
+    const uint8_t LOG_ARG_NUMBER    = 1;
+    const uint8_t LOG_ARG_STRING    = 2;
+
+    //二进制日志文件: 文件头 + 记录, 记录类型为0表示结束
+    constexpr const char* LOG_BIN_MAGIC = "HLOG0001";
+    const uint8_t LOG_REC_DICT      = 'D';  //格式串: u32 id, u32 len, data
+    const uint8_t LOG_REC_MSG       = 'M';  //日志: i64 time, u8 level, u32 fmt_id, u32 line, str tag, str feature, str source, str args
     const size_t MAX_LOG_SIZE    = 50*1024*1024;//50M
     const size_t CLEAN_TIME      = 7 * 24 * 3600;
 
@@ -105,122 +136,198 @@ namespace logger {
     class log_message {
     public:
         int line() const { return line_; }
-        bool is_grow() const { return grow_; }
-        void set_grow(bool grow) { grow_ = grow; }
         log_level level() const { return level_; }
         vstring tag() const { return tag_; }
         vstring msg() const { return msg_; }
         vstring source() const { return source_; }
         vstring feature() const { return feature_; }
+        int64_t time_ms() const { return time_ms_; }
         const log_time& get_log_time()const { return log_time_; }
+        void set_log_time(const log_time& t) { log_time_ = t; }
+        uint32_t fmt_id() const { return fmt_id_; }
+        vstring args() const { return args_; }
+        void set_msg(sstring&& msg) { msg_ = std::move(msg); }
+        //调用线程只记录时间戳, 本地时间由写线程转换
         void option(log_level level, sstring&& msg, cstring& tag, cstring& feature, cstring& source, int line) {
-            log_time_ = log_time::now();
+            time_ms_ = duration_cast<milliseconds>(system_clock::now().time_since_epoch()).count();
+            fmt_id_ = 0;
             msg_ = std::move(msg);
-            tag_ = std::move(tag);
-            feature_ = std::move(feature);
-            source_ = std::move(source);
+            tag_ = tag;
+            feature_ = feature;
+            source_ = source;
             level_ = level;
             line_ = line;
         }
+        //二进制模式: 只记录格式串id和编码后的参数
+        void option(log_level level, uint32_t fmt_id, sstring&& args, cstring& tag, cstring& feature) {
+            option(level, sstring(), tag, feature, "", 0);
+            args_ = std::move(args);
+            fmt_id_ = fmt_id;
+        }
 
     private:
         int                 line_ = 0;
-        bool                grow_ = false;
+        uint32_t            fmt_id_ = 0;
+        int64_t             time_ms_ = 0;
         log_time            log_time_;
-        sstring             source_, msg_, feature_, tag_;
+        sstring             source_, msg_, feature_, tag_, args_;
         log_level           level_ = log_level::LOG_LEVEL_DEBUG;
     }; // class log_message
-    typedef std::list<sptr<log_message>> log_message_list;
 
-    class log_message_pool {
+    //单生产者单消费者日志环: 每个写日志的线程一个, 记录预分配
+    class log_ring {
     public:
-        log_message_pool(size_t msg_size) {
-            for (size_t i = 0; i < msg_size; ++i) {
-                alloc_messages_->push_back(std::make_shared<log_message>());
+        log_ring(size_t size) : messages_(size), mask_(size - 1) {}
+
+        //call by owner thread
+        log_message* peek_write() {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            if (tail - head_.load(std::memory_order_acquire) > mask_) {
+                return nullptr;
             }
-            pool_size_ = msg_size;
+            return &messages_[tail & mask_];
         }
-        ~log_message_pool() {
-            alloc_messages_->clear();
-            free_messages_->clear();
+        void commit() {
+            tail_.store(tail_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
         }
-        sptr<log_message> allocate() {
-            std::unique_lock<spin_mutex> lock(mutex_);
-            if (alloc_messages_->empty()) {                
-                alloc_messages_.swap(free_messages_);
-            }
-            if (alloc_messages_->empty()) {
-                auto logmsg = std::make_shared<log_message>();                
-                if (pool_size_ < QUEUE_SIZE) {
-                    pool_size_++;
-                }else{
-                    logmsg->set_grow(true);
-                }
-                return logmsg;
+
+        //call by writer thread
+        log_message* peek_read() {
+            size_t head = head_.load(std::memory_order_relaxed);
+            if (head == tail_.load(std::memory_order_acquire)) {
+                return nullptr;
             }
-            auto logmsg = alloc_messages_->front();
-            alloc_messages_->pop_front();
-            return logmsg;
+            return &messages_[head & mask_];
         }
-        void release(sptr<log_message> logmsg) {
-            if (!logmsg->is_grow()) {
-                std::unique_lock<spin_mutex> lock(mutex_);
-                free_messages_->push_back(logmsg);
-            }
+        void pop() {
+            head_.store(head_.load(std::memory_order_relaxed) + 1, std::memory_order_release);
         }
 
+        size_t size() { return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_relaxed); }
+        size_t capacity() { return mask_ + 1; }
+        void close() { closed_ = true; }
+        bool closed() { return closed_; }
+
+        size_t sampled = 0;
+        std::atomic<uint64_t> writes = 0;
+        std::atomic<uint64_t> drops = 0;
+        std::atomic<uint64_t> blocks = 0;
+
     private:
-        size_t pool_size_ = 0;
-        spin_mutex mutex_;
-        sptr<log_message_list> free_messages_ = std::make_shared<log_message_list>();
-        sptr<log_message_list> alloc_messages_ = std::make_shared<log_message_list>();
-    }; // class log_message_pool
+        std::vector<log_message> messages_;
+        size_t mask_;
+        std::atomic<bool> closed_ = false;
+        alignas(64) std::atomic<size_t> head_ = 0;
+        alignas(64) std::atomic<size_t> tail_ = 0;
+    }; // class log_ring
 
-    class log_message_queue {
-    public:
-        void put(sptr<log_message> logmsg, bool notify) {
-            std::unique_lock<spin_mutex> lock(spin_);
-            write_messages_->push_back(logmsg);
-            if (notify || write_messages_->size() > 10) {
-                condv_.notify_all();
+    template<typename T>
+    inline bool log_read(vstring& data, T& value) {
+        if (data.size() < sizeof(T)) return false;
+        memcpy(&value, data.data(), sizeof(T));
+        data.remove_prefix(sizeof(T));
+        return true;
+    }
+
+    inline bool log_read(vstring& data, vstring& value) {
+        uint32_t len = 0;
+        if (!log_read(data, len) || data.size() < len) return false;
+        value = data.substr(0, len);
+        data.remove_prefix(len);
+        return true;
+    }
+
+    template<typename T>
+    inline void log_append(sstring& buf, T value) {
+        static_assert(std::is_arithmetic_v<T>, "log_append only support arithmetic");
+        buf.append((const char*)&value, sizeof(T));
+    }
+
+    inline void log_append(sstring& buf, vstring value) {
+        log_append<uint32_t>(buf, value.size());
+        buf.append(value.data(), value.size());
+    }
+
+    //按格式串和编码后的参数格式化
+    inline sstring log_format(vstring vfmt, vstring args) {
+        uint8_t count = 0;
+        log_read(args, count);
+        fmt::dynamic_format_arg_store<fmt::format_context> store;
+        for (uint8_t i = 0; i < count; ++i) {
+            uint8_t type = 0;
+            if (!log_read(args, type)) break;
+            if (type == LOG_ARG_INT) {
+                int64_t value = 0;
+                log_read(args, value);
+                store.push_back(value);
+            } else if (type == LOG_ARG_NUMBER) {
+                double value = 0;
+                log_read(args, value);
+                store.push_back(value);
+            } else {
+                vstring value;
+                log_read(args, value);
+                store.push_back(value);
             }
         }
+        try {
+            return fmt::vformat(vfmt, store);
+        } catch (const std::exception& e) {
+            return fmt::format("log format failed: {}! fmt: {}", e.what(), vfmt);
+        }
+    }
 
-        sptr<log_message_list> timed_getv() {
-            {
-                read_messages_->clear();
-                std::unique_lock<spin_mutex> lock(spin_);
-                read_messages_.swap(write_messages_);
+    //格式串字典, id从1开始, 只增不删, 超过上限返回0
+    class log_fmt_dict {
+    public:
+        uint32_t intern(vstring vfmt) {
+            std::unique_lock<spin_mutex> lock(mutex_);
+            auto it = ids_.find(vfmt);
+            if (it != ids_.end()) {
+                return it->second;
             }
-            if (read_messages_->empty()) {
-                std::unique_lock<std::mutex> lock(mutex_);
-                condv_.wait_for(lock, milliseconds(5));
+            if (fmts_.size() >= LOG_FMT_MAX) {
+                return 0;
             }
-            return read_messages_;
+            fmts_.emplace_back(vfmt);
+            uint32_t id = fmts_.size();
+            ids_.emplace(fmts_.back(), id);
+            return id;
+        }
+        vstring find(uint32_t id) {
+            std::unique_lock<spin_mutex> lock(mutex_);
+            if (id == 0 || id > fmts_.size()) return "";
+            return fmts_[id - 1];
         }
 
     private:
-        spin_mutex                  spin_;
-        std::mutex                  mutex_;
-        std::condition_variable     condv_;
-        sptr<log_message_list> read_messages_   = std::make_shared<log_message_list>();
-        sptr<log_message_list> write_messages_  = std::make_shared<log_message_list>();
-    }; // class log_message_queue
+        spin_mutex mutex_;
+        std::deque<sstring> fmts_;
+        std::map<vstring, uint32_t> ids_;
+    }; // class log_fmt_dict
 
     class log_service;
     class log_dest {
     public:
-        virtual void flush() {};
-        virtual void raw_write(vstring msg, log_level lvl) = 0;
-        virtual void write(sptr<log_message> logmsg);
+        //批量写入: 本批次的日志先追加到缓冲区, flush时一次写出
+        virtual void flush() {
+            if (!buffer_.empty()) {
+                raw_write(buffer_);
+                buffer_.clear();
+            }
+        };
+        virtual void raw_write(vstring data) = 0;
+        virtual void write(log_message* logmsg);
         virtual void ignore_prefix(bool prefix) { ignore_prefix_ = prefix; }
         virtual void ignore_suffix(bool suffix) { ignore_suffix_ = suffix; }
         virtual void ignore_def(bool def) { ignore_def_ = def; }
-        virtual cstring build_prefix(sptr<log_message> logmsg);
-        virtual cstring build_suffix(sptr<log_message> logmsg);
+        virtual void build_prefix(log_message* logmsg);
+        virtual void build_suffix(log_message* logmsg);
         virtual bool log_def() { return !ignore_def_; }
+        virtual bool is_binary() { return false; }
 
     protected:
+        sstring buffer_;
         bool ignore_suffix_ = true;
         bool ignore_prefix_ = false;
         bool ignore_def_ = false;
@@ -228,12 +335,16 @@ namespace logger {
 
     class stdio_dest : public log_dest {
     public:
-        virtual void raw_write(vstring msg, log_level lvl) {
 #ifdef WIN32
+        virtual void write(log_message* logmsg) {
             auto colors = level_colors<log_level>()();
-            std::cout << colors[(int)lvl];
+            buffer_.append(colors[(int)logmsg->level()]);
+            log_dest::write(logmsg);
+        }
 #endif // WIN32
-            std::cout << msg;
+        virtual void raw_write(vstring data) {
+            std::cout.write(data.data(), data.size());
+            std::cout.flush();
         }
     }; // class stdio_dest
 
@@ -242,23 +353,29 @@ namespace logger {
         log_file_base(size_t max_logsize) : logsize_(0), max_logsize_(max_logsize) {}
         virtual ~log_file_base() {
             if (file_) {
-                file_->flush();
+                flush();
                 file_->close();
             }
         }
-        virtual void raw_write(vstring msg, log_level lvl) {
-            logsize_ += msg.size();
-            if (file_) file_->write(msg.data(), msg.size());
+        virtual void write(log_message* logmsg) {
+            size_t size = buffer_.size();
+            append(logmsg);
+            logsize_ += buffer_.size() - size;
         }
-        virtual void flush() {
-            if (file_) file_->flush();
+        virtual void raw_write(vstring data) {
+            if (file_) {
+                file_->write(data.data(), data.size());
+                file_->flush();
+            }
         }
         const log_time& file_time() const { return file_time_; }
 
     protected:
+        virtual void append(log_message* logmsg) { log_dest::write(logmsg); }
+        virtual bool opened() { return file_ != nullptr; }
         virtual void create(path file_path, vstring file_name, const log_time& file_time) {
             if (file_) {
-                file_->flush();
+                flush();
                 file_->close();
             }
             file_time_ = file_time;
@@ -273,7 +390,7 @@ namespace logger {
 
     class rolling_hourly {
     public:
-        bool eval(const log_file_base* log_file, const sptr<log_message> logmsg) const {
+        bool eval(const log_file_base* log_file, const log_message* logmsg) const {
             const log_time& ftime = log_file->file_time();
             const log_time& ltime = logmsg->get_log_time();
             return ltime.tm_year != ftime.tm_year || ltime.tm_mon != ftime.tm_mon ||
@@ -284,7 +401,7 @@ namespace logger {
 
     class rolling_daily {
     public:
-        bool eval(const log_file_base* log_file, const sptr<log_message> logmsg) const {
+        bool eval(const log_file_base* log_file, const log_message* logmsg) const {
             const log_time& ftime = log_file->file_time();
             const log_time& ltime = logmsg->get_log_time();
             return ltime.tm_year != ftime.tm_year || ltime.tm_mon != ftime.tm_mon || ltime.tm_mday != ftime.tm_mday;
@@ -301,12 +418,12 @@ namespace logger {
             clean_time_ = clean_time;
         }
 
-        virtual void write(sptr<log_message> logmsg) {
-            if (file_ == nullptr || rolling_evaler_.eval(this, logmsg) || logsize_ >= max_logsize_) {
+        virtual void write(log_message* logmsg) {
+            if (!opened() || rolling_evaler_.eval(this, logmsg) || logsize_ >= max_logsize_) {
                 create_directories(log_path_);
                 try {
                     for (auto entry : recursive_directory_iterator(log_path_)) {
-                        if (!entry.is_directory() && entry.path().extension().string() == ".log") {
+                        if (!entry.is_directory() && entry.path().extension().string() == extension()) {
                             auto ftime = last_write_time(entry.path());
                             if ((size_t)duration_cast<seconds>(file_time_type::clock::now() - ftime).count() > clean_time_) {
                                 remove(entry.path());
@@ -316,16 +433,17 @@ namespace logger {
                 }
                 catch (...) {}
                 create(log_path_, new_log_file_path(logmsg), logmsg->get_log_time());
-                assert(file_);
+                assert(opened());
                 logsize_ = 0;
             }
             log_file_base::write(logmsg);
         }
 
     protected:
-        cstring new_log_file_path(const sptr<log_message> logmsg) {
+        virtual const char* extension() { return ".log"; }
+        cstring new_log_file_path(const log_message* logmsg) {
             const log_time& t = logmsg->get_log_time();
-            return fmt::format("{}-{:4d}{:02d}{:02d}-{:02d}{:02d}{:02d}.{:03d}.p{}.log", feature_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, t.tm_usec, ::getpid());
+            return fmt::format("{}-{:4d}{:02d}{:02d}-{:02d}{:02d}{:02d}.{:03d}.p{}{}", feature_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, t.tm_usec, ::getpid(), extension());
         }
 
         path                    log_path_;
@@ -337,6 +455,116 @@ namespace logger {
     typedef log_rollingfile<rolling_hourly> log_hourlyrollingfile;
     typedef log_rollingfile<rolling_daily> log_dailyrollingfile;
 
+    //二进制日志段(.blog): 格式串在每个段内首次使用时写入字典记录, 段文件可独立解码
+    //linux下通过mmap写入, 按LOG_SEGMENT_GROW扩展, 关闭时截断到实际长度
+    template<class rolling_evaler>
+    class log_binfile : public log_rollingfile<rolling_evaler> {
+    public:
+        log_binfile(size_t max_logsize, log_fmt_dict* dict) : log_rollingfile<rolling_evaler>(max_logsize), dict_(dict) {}
+        virtual ~log_binfile() {
+            this->flush();
+            close_segment();
+        }
+        virtual bool is_binary() { return true; }
+
+#ifndef WIN32
+        virtual void raw_write(vstring data) {
+            if (!data_) return;
+            if (used_ + data.size() > mapped_) {
+                size_t size = mapped_;
+                while (used_ + data.size() > size) size += LOG_SEGMENT_GROW;
+                if (!map_segment(size)) return;
+            }
+            memcpy(data_ + used_, data.data(), data.size());
+            used_ += data.size();
+        }
+#endif
+
+    protected:
+        virtual const char* extension() { return ".blog"; }
+
+        virtual void append(log_message* logmsg) {
+            sstring& buf = this->buffer_;
+            uint32_t fmt_id = logmsg->fmt_id();
+            if (fmt_id > 0 && dict_ids_.insert(fmt_id).second) {
+                log_append(buf, LOG_REC_DICT);
+                log_append(buf, fmt_id);
+                log_append(buf, dict_->find(fmt_id));
+            }
+            log_append(buf, LOG_REC_MSG);
+            log_append(buf, logmsg->time_ms());
+            log_append(buf, (uint8_t)logmsg->level());
+            log_append(buf, fmt_id);
+            log_append<uint32_t>(buf, logmsg->line());
+            log_append(buf, logmsg->tag());
+            log_append(buf, logmsg->feature());
+            log_append(buf, logmsg->source());
+            log_append(buf, fmt_id > 0 ? logmsg->args() : logmsg->msg());
+        }
+
+#ifdef WIN32
+        virtual void create(path file_path, vstring file_name, const log_time& file_time) {
+            log_file_base::create(file_path, file_name, file_time);
+            dict_ids_.clear();
+            this->buffer_.append(LOG_BIN_MAGIC);
+        }
+#else
+        virtual bool opened() { return data_ != nullptr; }
+
+        virtual void create(path file_path, vstring file_name, const log_time& file_time) {
+            this->flush();
+            close_segment();
+            this->file_time_ = file_time;
+            dict_ids_.clear();
+            file_path.append(file_name);
+            fd_ = ::open(file_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+            if (fd_ >= 0 && map_segment(LOG_SEGMENT_GROW)) {
+                raw_write(LOG_BIN_MAGIC);
+            }
+        }
+
+        bool map_segment(size_t size) {
+            if (data_) {
+                munmap(data_, mapped_);
+                data_ = nullptr;
+            }
+            if (ftruncate(fd_, size) != 0) {
+                return false;
+            }
+            void* data = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+            if (data == MAP_FAILED) {
+                return false;
+            }
+            data_ = (char*)data;
+            mapped_ = size;
+            return true;
+        }
+#endif
+
+        void close_segment() {
+#ifndef WIN32
+            if (data_) {
+                munmap(data_, mapped_);
+                data_ = nullptr;
+            }
+            if (fd_ >= 0) {
+                [[maybe_unused]] auto ret = ftruncate(fd_, used_);
+                ::close(fd_);
+                fd_ = -1;
+            }
+            used_ = mapped_ = 0;
+#endif
+        }
+
+        log_fmt_dict*   dict_ = nullptr;
+        std::set<uint32_t> dict_ids_;
+#ifndef WIN32
+        int             fd_ = -1;
+        char*           data_ = nullptr;
+        size_t          used_ = 0, mapped_ = 0;
+#endif
+    }; // class log_binfile
+
     class log_service {
     public:
         ~log_service() { stop(); }
@@ -358,26 +586,50 @@ namespace logger {
         }
 
         log_filter* get_filter() { return &log_filter_; }
-        log_message_pool* message_pool() { return message_pool_.get(); }
+
+        //需要在添加文件输出前设置, 已创建的文件输出不受影响
+        void set_binary(binary_mode mode) { binary_ = mode; }
+        bool is_binary() { return binary_ != binary_mode::OFF && running_; }
+        uint32_t intern(vstring vfmt) { return fmt_dict_.intern(vfmt); }
+
+        void set_overflow(overflow_policy policy, size_t sample_rate) {
+            overflow_ = policy;
+            sample_rate_ = sample_rate > 0 ? sample_rate : 1;
+        }
 
         void set_max_logsize(size_t max_logsize) { max_logsize_ = max_logsize; }
         void set_clean_time(size_t clean_time) { clean_time_ = clean_time; }
         bool need_hook(log_level lvl) { return lvl >= hook_lv_; }
 
+        template<class T>
+        sptr<log_dest> make_file_dest(path& logger_path, vstring feature) {
+            sptr<T> logfile = nullptr;
+            if constexpr (std::is_constructible_v<T, size_t, log_fmt_dict*>) {
+                logfile = std::make_shared<T>(max_logsize_, &fmt_dict_);
+            } else {
+                logfile = std::make_shared<T>(max_logsize_);
+            }
+            logfile->setup(logger_path, service_, feature, clean_time_);
+            return logfile;
+        }
+
+        sptr<log_dest> new_file_dest(path logger_path, vstring feature) {
+            if (binary_ == binary_mode::FILE) {
+                if (rolling_type_ == rolling_type::DAYLY) {
+                    return make_file_dest<log_binfile<rolling_daily>>(logger_path, feature);
+                }
+                return make_file_dest<log_binfile<rolling_hourly>>(logger_path, feature);
+            }
+            if (rolling_type_ == rolling_type::DAYLY) {
+                return make_file_dest<log_dailyrollingfile>(logger_path, feature);
+            }
+            return make_file_dest<log_hourlyrollingfile>(logger_path, feature);
+        }
+
         bool add_dest(vstring feature, vstring log_path) {
             std::unique_lock<spin_mutex> lock(mutex_);
             if (dest_features_.find(feature) == dest_features_.end()) {
-                sptr<log_dest> logfile = nullptr;
-                path logger_path = build_path(feature, log_path);
-                if (rolling_type_ == rolling_type::DAYLY) {
-                    auto dlogfile = std::make_shared<log_dailyrollingfile>(max_logsize_);
-                    dlogfile->setup(logger_path, service_, feature, clean_time_);
-                    logfile = dlogfile;
-                } else {
-                    auto hlogfile = std::make_shared<log_hourlyrollingfile>(max_logsize_);
-                    hlogfile->setup(logger_path, service_, feature, clean_time_);
-                    logfile = hlogfile;
-                }
+                sptr<log_dest> logfile = new_file_dest(build_path(feature, log_path), feature);
                 if (!def_dest_) {
                     def_dest_ = logfile;
                     return true;
@@ -394,16 +646,7 @@ namespace logger {
             std::transform(feature.begin(), feature.end(), feature.begin(), [](auto c) { return std::tolower(c); });
             path logger_path = build_path(feature, "");
             std::unique_lock<spin_mutex> lock(mutex_);
-            if (rolling_type_ == rolling_type::DAYLY) {
-                auto logfile = std::make_shared<log_dailyrollingfile>(max_logsize_);
-                logfile->setup(logger_path, service_, feature, clean_time_);
-                dest_lvls_.insert(std::make_pair(log_lvl, logfile));
-            }
-            else {
-                auto logfile = std::make_shared<log_hourlyrollingfile>(max_logsize_);
-                logfile->setup(logger_path, service_, feature, clean_time_);
-                dest_lvls_.insert(std::make_pair(log_lvl, logfile));
-            }
+            dest_lvls_.insert(std::make_pair(log_lvl, new_file_dest(logger_path, feature)));
             return true;
         }
 
@@ -454,11 +697,9 @@ namespace logger {
         }
 
         void start() {
-            if (!stop_msg_ && !std_dest_) {
-                logmsgque_ = std::make_shared<log_message_queue>();
-                message_pool_ = std::make_shared<log_message_pool>(QUEUE_MINI);
+            if (!running_ && !std_dest_) {
                 std_dest_ = std::make_shared<stdio_dest>();
-                stop_msg_ = message_pool_->allocate();
+                running_ = true;
                 std::thread(&log_service::run, this).swap(thread_);
                 utility::set_thread_name(thread_, "log");
             }
@@ -467,29 +708,18 @@ namespace logger {
         void terminal() {
             if (!std_dest_) {
                 std_dest_ = std::make_shared<stdio_dest>();
-                message_pool_ = std::make_shared<log_message_pool>(QUEUE_MINI);
             }
         }
 
         void stop() {
-            if (stop_msg_) {
-                logmsgque_->put(stop_msg_,true);
+            if (running_.exchange(false)) {
+                wakeup(true);
             }
             if (thread_.joinable()) {
                 thread_.join();
             }
         }
 
-        void submit(sptr<log_message> logmsg) {
-            if (stop_msg_) {
-                logmsgque_->put(logmsg,false);
-                return;
-            }
-            if (std_dest_) {
-                std_dest_->write(logmsg);
-            }
-        }
-
         void flush() {
             std::unique_lock<spin_mutex> lock(mutex_);
             for (auto dest : dest_features_)
@@ -499,6 +729,9 @@ namespace logger {
             if (def_dest_) {
                 def_dest_->flush();
             }
+            if (std_dest_) {
+                std_dest_->flush();
+            }
         }
 
         bool is_filter(log_level lv) {
@@ -515,46 +748,222 @@ namespace logger {
         }
 
         void output(log_level level, sstring&& msg, cstring& tag, cstring& feature, cstring& source = "", int line = 0) {
-            if (!log_filter_.is_filter(level)) {
-                auto logmsg_ = message_pool_->allocate();
-                logmsg_->option(level, std::move(msg), tag, feature, source, line);
-                submit(logmsg_);
+            if (log_filter_.is_filter(level)) {
+                return;
+            }
+            if (!running_) {
+                //没有写线程时直接输出
+                if (std_dest_ && !log_daemon_) {
+                    stdio_dest dest;
+                    log_message logmsg;
+                    logmsg.option(level, std::move(msg), tag, feature, source, line);
+                    logmsg.set_log_time(log_time::now());
+                    dest.write(&logmsg);
+                    dest.flush();
+                }
+                return;
+            }
+            log_ring* ring = thread_ring();
+            if (log_message* logmsg = acquire(ring, level)) {
+                logmsg->option(level, std::move(msg), tag, feature, source, line);
+                commit(ring, level);
             }
         }
 
+        //二进制模式: 格式化推迟到写线程或离线解码, 调用前检查is_binary
+        void output(log_level level, uint32_t fmt_id, sstring&& args, cstring& tag, cstring& feature) {
+            if (log_filter_.is_filter(level)) {
+                return;
+            }
+            log_ring* ring = thread_ring();
+            if (log_message* logmsg = acquire(ring, level)) {
+                logmsg->option(level, fmt_id, std::move(args), tag, feature);
+                commit(ring, level);
+            }
+        }
+
+        //日志统计: { writes, drops, blocks, batches, rings, pending }
+        void stats(lua_State* L) {
+            uint64_t writes = 0, drops = 0, blocks = 0, pending = 0, count = 0;
+            {
+                std::unique_lock<spin_mutex> lock(ring_mutex_);
+                for (auto& ring : rings_) {
+                    writes += ring->writes.load(std::memory_order_relaxed);
+                    drops += ring->drops.load(std::memory_order_relaxed);
+                    blocks += ring->blocks.load(std::memory_order_relaxed);
+                    pending += ring->size();
+                    ++count;
+                }
+                writes += retired_writes_;
+                drops += retired_drops_;
+            }
+            lua_createtable(L, 0, 6);
+            lua_pushinteger(L, writes);
+            lua_setfield(L, -2, "writes");
+            lua_pushinteger(L, drops);
+            lua_setfield(L, -2, "drops");
+            lua_pushinteger(L, blocks);
+            lua_setfield(L, -2, "blocks");
+            lua_pushinteger(L, batches_.load(std::memory_order_relaxed));
+            lua_setfield(L, -2, "batches");
+            lua_pushinteger(L, count);
+            lua_setfield(L, -2, "rings");
+            lua_pushinteger(L, pending);
+            lua_setfield(L, -2, "pending");
+        }
+
     private:
-        void run() {
-            bool loop = true;
-            while (loop) {
-                auto logmsgs = logmsgque_->timed_getv().get();
-                for (auto logmsg : *logmsgs) {
-                    if (logmsg == stop_msg_) {
-                        loop = false;
-                        continue;
-                    }
-                    if (!log_daemon_) {
-                        std_dest_->write(logmsg);
-                    }
-                    auto itLvl = dest_lvls_.find(logmsg->level());
-                    if (itLvl != dest_lvls_.end()) {
-                        itLvl->second->write(logmsg);
+        log_message* acquire(log_ring* ring, log_level level) {
+            log_message* logmsg = ring->peek_write();
+            if (overflow_ == overflow_policy::SAMPLE && level < log_level::LOG_LEVEL_WARN && ring->size() >= ring->capacity() * 3 / 4) {
+                if (ring->sampled++ % sample_rate_ != 0) {
+                    logmsg = nullptr;
+                }
+            }
+            if (!logmsg && overflow_ == overflow_policy::BLOCK) {
+                logmsg = block_write(ring);
+            }
+            if (!logmsg) {
+                ring->drops.fetch_add(1, std::memory_order_relaxed);
+            }
+            return logmsg;
+        }
+
+        void commit(log_ring* ring, log_level level) {
+            ring->commit();
+            ring->writes.fetch_add(1, std::memory_order_relaxed);
+            if (level >= log_level::LOG_LEVEL_ERROR || ring->size() >= ring->capacity() / 2) {
+                wakeup(false);
+            }
+        }
+
+        struct ring_holder {
+            sptr<log_ring> ring = nullptr;
+            ~ring_holder() { if (ring) ring->close(); }
+        };
+
+        //当前线程的日志环, 首次使用时注册
+        log_ring* thread_ring() {
+            static thread_local ring_holder holder;
+            if (!holder.ring) {
+                holder.ring = std::make_shared<log_ring>(LOG_RING_SIZE);
+                std::unique_lock<spin_mutex> lock(ring_mutex_);
+                rings_.push_back(holder.ring);
+            }
+            return holder.ring.get();
+        }
+
+        log_message* block_write(log_ring* ring) {
+            ring->blocks.fetch_add(1, std::memory_order_relaxed);
+            auto deadline = steady_clock::now() + milliseconds(LOG_BLOCK_MS);
+            while (running_ && steady_clock::now() < deadline) {
+                wakeup(true);
+                std::this_thread::sleep_for(microseconds(50));
+                if (log_message* logmsg = ring->peek_write()) {
+                    return logmsg;
+                }
+            }
+            return nullptr;
+        }
+
+        void wakeup(bool force) {
+            if (force || sleeping_.load(std::memory_order_relaxed)) {
+                std::unique_lock<std::mutex> lock(wait_mutex_);
+                condv_.notify_one();
+            }
+        }
+
+        //本地时间转换按秒缓存, 避免逐条调用localtime
+        log_time local_time(int64_t time_ms) {
+            time_t time = time_ms / 1000;
+            if (time != last_time_) {
+                last_time_ = time;
+                last_tm_ = *std::localtime(&time);
+            }
+            return log_time(last_tm_, time_ms % 1000);
+        }
+
+        void dispatch(log_message* logmsg) {
+            logmsg->set_log_time(local_time(logmsg->time_ms()));
+            log_dest* dests[4] = {};
+            size_t count = 0;
+            if (!log_daemon_) {
+                dests[count++] = std_dest_.get();
+            }
+            auto itLvl = dest_lvls_.find(logmsg->level());
+            if (itLvl != dest_lvls_.end()) {
+                dests[count++] = itLvl->second.get();
+            }
+            auto itFea = dest_features_.find(logmsg->feature());
+            if (itFea != dest_features_.end()) {
+                dests[count++] = itFea->second.get();
+                if (itFea->second->log_def() && def_dest_) {
+                    dests[count++] = def_dest_.get();
+                }
+            } else if (def_dest_) {
+                dests[count++] = def_dest_.get();
+            }
+            //有文本输出时才格式化
+            if (logmsg->fmt_id() > 0) {
+                for (size_t i = 0; i < count; ++i) {
+                    if (!dests[i]->is_binary()) {
+                        logmsg->set_msg(log_format(fmt_dict_.find(logmsg->fmt_id()), logmsg->args()));
+                        break;
                     }
-                    auto itFea = dest_features_.find(logmsg->feature());
-                    if (itFea != dest_features_.end()) {
-                        itFea->second->write(logmsg);
-                        if (itFea->second->log_def()) {
-                            if (def_dest_) {
-                                def_dest_->write(logmsg);
-                            }
-                        }
-                    } else {
-                        if (def_dest_) {
-                            def_dest_->write(logmsg);
-                        }
+                }
+            }
+            for (size_t i = 0; i < count; ++i) {
+                dests[i]->write(logmsg);
+            }
+        }
+
+        void run() {
+            std::vector<sptr<log_ring>> rings;
+            while (true) {
+                bool loop = running_;
+                size_t count = 0;
+                {
+                    std::unique_lock<spin_mutex> lock(ring_mutex_);
+                    rings = rings_;
+                }
+                for (auto& ring : rings) {
+                    //每个环单次最多处理一圈, 避免单个线程饿死其他线程
+                    size_t limit = ring->capacity();
+                    while (limit-- > 0) {
+                        log_message* logmsg = ring->peek_read();
+                        if (!logmsg) break;
+                        dispatch(logmsg);
+                        ring->pop();
+                        ++count;
                     }
-                    message_pool_->release(logmsg);
                 }
-                flush();
+                if (count > 0) {
+                    flush();
+                    batches_.fetch_add(1, std::memory_order_relaxed);
+                }
+                retire_rings();
+                if (!loop) break;
+                if (count == 0) {
+                    std::unique_lock<std::mutex> lock(wait_mutex_);
+                    sleeping_ = true;
+                    condv_.wait_for(lock, milliseconds(5));
+                    sleeping_ = false;
+                }
+            }
+        }
+
+        //回收已退出线程的空日志环
+        void retire_rings() {
+            std::unique_lock<spin_mutex> lock(ring_mutex_);
+            for (auto it = rings_.begin(); it != rings_.end();) {
+                auto& ring = *it;
+                if (ring->closed() && ring->size() == 0) {
+                    retired_writes_ += ring->writes.load(std::memory_order_relaxed);
+                    retired_drops_ += ring->drops.load(std::memory_order_relaxed);
+                    it = rings_.erase(it);
+                    continue;
+                }
+                ++it;
             }
         }
 
@@ -567,37 +976,53 @@ namespace logger {
         sstring         service_;
         sptr<log_dest>  std_dest_ = nullptr;
         sptr<log_dest>  def_dest_ = nullptr;
-        sptr<log_message> stop_msg_ = nullptr;
-        sptr<log_message_queue> logmsgque_ = nullptr;
-        sptr<log_message_pool> message_pool_ = nullptr;
         std::map<log_level, sptr<log_dest>> dest_lvls_;
         std::map<sstring, sptr<log_dest>,std::less<>> dest_features_;
         size_t max_logsize_ = MAX_LOG_SIZE, clean_time_ = CLEAN_TIME;
         bool log_daemon_ = false;
+        //日志环
+        spin_mutex      ring_mutex_;
+        std::vector<sptr<log_ring>> rings_;
+        std::atomic<bool> running_ = false;
+        std::atomic<bool> sleeping_ = false;
+        std::atomic<uint64_t> batches_ = 0;
+        uint64_t retired_writes_ = 0, retired_drops_ = 0;
+        overflow_policy overflow_ = overflow_policy::BLOCK;
+        binary_mode     binary_ = binary_mode::OFF;
+        log_fmt_dict    fmt_dict_;
+        size_t sample_rate_ = 10;
+        std::mutex wait_mutex_;
+        std::condition_variable condv_;
+        time_t last_time_ = 0;
+        ::tm last_tm_ = {};
     }; // class log_service
 
     // class log_dest
     // --------------------------------------------------------------------------------
-    inline void log_dest::write(sptr<log_message> logmsg) {
-        auto logtxt = fmt::format("{}{}{}\n", build_prefix(logmsg), logmsg->msg(), build_suffix(logmsg));
-        raw_write(logtxt, logmsg->level());
+    inline void log_dest::write(log_message* logmsg) {
+        build_prefix(logmsg);
+        buffer_.append(logmsg->msg());
+        build_suffix(logmsg);
+        buffer_.push_back('\n');
+        //单批次过大时提前写出
+        if (buffer_.size() >= LOG_BATCH_SIZE) {
+            flush();
+        }
     }
 
-    inline cstring log_dest::build_prefix(sptr<log_message> logmsg) {
+    inline void log_dest::build_prefix(log_message* logmsg) {
         if (!ignore_prefix_) {
             auto names = level_names<log_level>()();
             const log_time& t = logmsg->get_log_time();
-            return fmt::format("[{:4d}-{:02d}-{:02d} {:02d}:{:02d}:{:02d}.{:03d}][{}][{}]",
+            fmt::format_to(std::back_inserter(buffer_), "[{:4d}-{:02d}-{:02d} {:02d}:{:02d}:{:02d}.{:03d}][{}][{}]",
                 t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, t.tm_usec, logmsg->tag(), names[(int)logmsg->level()]);
         }
-        return "";
     }
 
-    inline cstring log_dest::build_suffix(sptr<log_message> logmsg) {
+    inline void log_dest::build_suffix(log_message* logmsg) {
         if (!ignore_suffix_) {
-            return fmt::format("[{}:{}]", logmsg->source().data(), logmsg->line());
+            fmt::format_to(std::back_inserter(buffer_), "[{}:{}]", logmsg->source(), logmsg->line());
         }
-        return "";
     }
 }
 
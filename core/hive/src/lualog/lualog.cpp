@@ -1,3 +1,4 @@
+#include <unordered_map>
 #include "logger.h"
 
 using namespace std;
@@ -23,7 +24,8 @@ namespace logger {
         case LUA_TSTRING: {
             size_t len;
             const char* buf = lua_tolstring(L, index, &len);
-            return string(buf, len);
+            //超长字符串按max_len截断, 二进制模式相同; max_len为0不限制
+            return string(buf, max_len > 0 ? std::min(len, max_len) : len);
         }
         case LUA_TTABLE:
             if ((flag & LOG_FLAG_FORMAT) == LOG_FLAG_FORMAT) {
@@ -64,6 +66,103 @@ namespace logger {
         return 0;
     }
 
+    //格式串id, 按lua字符串地址缓存并校验内容
+    uint32_t fmt_id(vstring vfmt) {
+        struct fmt_cache {
+            uint32_t id = 0;
+            sstring fmt;
+        };
+        static thread_local std::unordered_map<const char*, fmt_cache> caches;
+        if (caches.size() >= LOG_FMT_MAX) {
+            caches.clear();
+        }
+        auto& cache = caches[vfmt.data()];
+        if (cache.id == 0 || cache.fmt != vfmt) {
+            cache.id = log_service::instance()->intern(vfmt);
+            cache.fmt = vfmt;
+        }
+        return cache.id;
+    }
+
+    //二进制模式: 只编码参数, 格式化推迟到写线程或离线解码
+    int bformat(lua_State* L, log_level lvl, cstring& tag, cstring& feature, int flag, uint32_t id, size_t max_len, int arg_num) {
+        sstring args;
+        log_append<uint8_t>(args, arg_num);
+        for (int i = 6; i < 6 + arg_num; ++i) {
+            int type = lua_type(L, i);
+            if (type == LUA_TNUMBER && lua_isinteger(L, i)) {
+                log_append(args, LOG_ARG_INT);
+                log_append<int64_t>(args, lua_tointeger(L, i));
+            } else if (type == LUA_TNUMBER) {
+                log_append(args, LOG_ARG_NUMBER);
+                log_append<double>(args, lua_tonumber(L, i));
+            } else if (type == LUA_TSTRING) {
+                size_t len;
+                const char* str = lua_tolstring(L, i, &len);
+                log_append(args, LOG_ARG_STRING);
+                log_append(args, vstring(str, std::min(len, max_len)));
+            } else {
+                log_append(args, LOG_ARG_STRING);
+                log_append(args, vstring(read_args(L, flag, i, max_len)));
+            }
+        }
+        log_service::instance()->output(lvl, id, std::move(args), tag, feature);
+        return 0;
+    }
+
+    //解码二进制日志段为文本, 返回日志条数, 失败返回-1
+    int64_t decode_file(cstring& input, cstring& output) {
+        std::ifstream ifs(input, std::ios::binary);
+        if (!ifs) return -1;
+        sstring data((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+        vstring view = data;
+        vstring magic = LOG_BIN_MAGIC;
+        if (view.substr(0, magic.size()) != magic) return -1;
+        view.remove_prefix(magic.size());
+        std::ofstream ofs(output, std::ios::binary | std::ios::out | std::ios::trunc);
+        if (!ofs) return -1;
+        auto names = level_names<log_level>()();
+        std::map<uint32_t, vstring> dict;
+        int64_t count = 0;
+        sstring buf;
+        uint8_t type = 0;
+        while (log_read(view, type)) {
+            if (type == LOG_REC_DICT) {
+                uint32_t id = 0;
+                vstring vfmt;
+                if (!log_read(view, id) || !log_read(view, vfmt)) break;
+                dict[id] = vfmt;
+                continue;
+            }
+            if (type != LOG_REC_MSG) break;
+            int64_t time_ms = 0;
+            uint8_t level = 0;
+            uint32_t id = 0, line = 0;
+            vstring tag, feature, source, args;
+            if (!log_read(view, time_ms) || !log_read(view, level) || !log_read(view, id) || !log_read(view, line)
+                || !log_read(view, tag) || !log_read(view, feature) || !log_read(view, source) || !log_read(view, args)) {
+                break;
+            }
+            time_t time = time_ms / 1000;
+            ::tm t = *std::localtime(&time);
+            fmt::format_to(std::back_inserter(buf), "[{:4d}-{:02d}-{:02d} {:02d}:{:02d}:{:02d}.{:03d}][{}][{}]",
+                t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, t.tm_hour, t.tm_min, t.tm_sec, (int)(time_ms % 1000), tag, names[level < names.size() ? level : 0]);
+            if (id > 0) {
+                buf.append(log_format(dict[id], args));
+            } else {
+                buf.append(args);
+            }
+            buf.push_back('\n');
+            if (buf.size() >= LOG_BATCH_SIZE) {
+                ofs.write(buf.data(), buf.size());
+                buf.clear();
+            }
+            ++count;
+        }
+        ofs.write(buf.data(), buf.size());
+        return count;
+    }
+
     template<size_t... integers>
     int fformat(lua_State* L, int flag, vstring vfmt, std::index_sequence<integers...>&&) {
         try {
@@ -120,6 +219,12 @@ namespace logger {
             replace_fmt(vfmt);          
             int arg_num = lua_gettop(L) - 5;
             auto max_len = log_limit_len(lvl);
+            auto service = log_service::instance();
+            if (arg_num > 0 && service->is_binary() && !service->need_hook(lvl) && (flag & LOG_FLAG_MONITOR) == 0) {
+                if (uint32_t id = fmt_id(vfmt); id > 0) {
+                    return bformat(L, lvl, tag, feature, flag, id, max_len, arg_num);
+                }
+            }
             switch (arg_num) {
             case 0: return zformat(L, lvl, tag, feature, flag, string(vfmt.data(), vfmt.size()));
             case 1: return tformat(L, lvl, tag, feature, flag, vfmt, max_len, make_index_sequence<1>{});
@@ -161,6 +266,25 @@ namespace logger {
             return 0;
             });
 
+        lualog.new_enum("OVERFLOW",
+            "DROP", overflow_policy::DROP,
+            "BLOCK", overflow_policy::BLOCK,
+            "SAMPLE", overflow_policy::SAMPLE
+        );
+        lualog.new_enum("BINARY",
+            "OFF", binary_mode::OFF,
+            "DEFER", binary_mode::DEFER,
+            "FILE", binary_mode::FILE
+        );
+        lualog.set_function("set_binary", [](int mode) { log_service::instance()->set_binary((binary_mode)mode); });
+        lualog.set_function("decode", [](cstring input, cstring output) { return decode_file(input, output); });
+        lualog.set_function("stats", [](lua_State* L) {
+            log_service::instance()->stats(L);
+            return 1;
+            });
+        lualog.set_function("set_overflow", [](int policy, size_t sample_rate) {
+            log_service::instance()->set_overflow((overflow_policy)policy, sample_rate);
+            });
         lualog.set_function("daemon", [](bool status) { log_service::instance()->daemon(status); });
         lualog.set_function("set_max_logsize", [](size_t logsize) { log_service::instance()->set_max_logsize(logsize); });
         lualog.set_function("set_clean_time", [](size_t time) { log_service::instance()->set_clean_time(time); });
@@ -0,0 +1,304 @@
+#ifndef __FROZEN_H__
+#define __FROZEN_H__
+#include <map>
+#include <new>
+#include <memory>
+#include <vector>
+#include <string>
+#include "lua_kit.h"
+
+namespace lworker {
+
+    //冻结表: 只读数据在进程内只保存一份, 所有线程通过代理对象直接读取, 不再逐条消息序列化
+    struct frozen_table;
+    struct frozen_value {
+        int type = LUA_TNIL;
+        bool boolean = false;
+        bool isint = false;
+        int64_t integer = 0;
+        double number = 0;
+        std::string str;
+        std::unique_ptr<frozen_table> table;
+    };
+
+    struct frozen_table {
+        std::vector<frozen_value> array;    //1..n连续整数键
+        std::map<int64_t, frozen_value> ints;
+        std::map<std::string, frozen_value, std::less<>> strs;
+    };
+
+    //代理对象引用根节点, 保证替换或删除后已取得的代理仍然有效
+    struct frozen_proxy {
+        std::shared_ptr<frozen_table> root;
+        frozen_table* node;
+    };
+
+    constexpr const char* FROZEN_META = "_frozen_table";
+
+    inline void frozen_build(lua_State* L, int index, frozen_table* node, int depth);
+
+    inline void frozen_build_value(lua_State* L, int index, frozen_value& value, int depth) {
+        value.type = lua_type(L, index);
+        switch (value.type) {
+        case LUA_TBOOLEAN:
+            value.boolean = lua_toboolean(L, index);
+            break;
+        case LUA_TNUMBER:
+            value.isint = lua_isinteger(L, index);
+            if (value.isint) {
+                value.integer = lua_tointeger(L, index);
+            } else {
+                value.number = lua_tonumber(L, index);
+            }
+            break;
+        case LUA_TSTRING: {
+            size_t len;
+            const char* str = lua_tolstring(L, index, &len);
+            value.str.assign(str, len);
+            break;
+        }
+        case LUA_TTABLE:
+            value.table = std::make_unique<frozen_table>();
+            frozen_build(L, index, value.table.get(), depth + 1);
+            break;
+        default:
+            luaL_error(L, "freeze can't support value type: %s", lua_typename(L, value.type));
+        }
+    }
+
+    inline void frozen_build(lua_State* L, int index, frozen_table* node, int depth) {
+        if (depth > luakit::max_encode_depth) {
+            luaL_error(L, "freeze can't support too depth table");
+        }
+        index = lua_absindex(L, index);
+        lua_Integer rawlen = lua_rawlen(L, index);
+        for (lua_Integer i = 1; i <= rawlen; ++i) {
+            lua_rawgeti(L, index, i);
+            if (lua_isnil(L, -1)) {
+                lua_pop(L, 1);
+                break;
+            }
+            frozen_build_value(L, -1, node->array.emplace_back(), depth);
+            lua_pop(L, 1);
+        }
+        lua_Integer asize = node->array.size();
+        lua_pushnil(L);
+        while (lua_next(L, index) != 0) {
+            if (lua_type(L, -2) == LUA_TSTRING) {
+                size_t len;
+                const char* key = lua_tolstring(L, -2, &len);
+                frozen_build_value(L, -1, node->strs[std::string(key, len)], depth);
+            } else if (lua_isinteger(L, -2)) {
+                lua_Integer key = lua_tointeger(L, -2);
+                if (key < 1 || key > asize) {
+                    frozen_build_value(L, -1, node->ints[key], depth);
+                }
+            } else {
+                luaL_error(L, "freeze only support string or integer key");
+            }
+            lua_pop(L, 1);
+        }
+    }
+
+    inline void frozen_push_proxy(lua_State* L, const std::shared_ptr<frozen_table>& root, frozen_table* node) {
+        void* ud = lua_newuserdata(L, sizeof(frozen_proxy));
+        new (ud) frozen_proxy{ root, node };
+        luaL_setmetatable(L, FROZEN_META);
+    }
+
+    inline void frozen_push_value(lua_State* L, frozen_proxy* proxy, const frozen_value* value) {
+        if (!value) {
+            lua_pushnil(L);
+            return;
+        }
+        switch (value->type) {
+        case LUA_TBOOLEAN:
+            lua_pushboolean(L, value->boolean);
+            break;
+        case LUA_TNUMBER:
+            value->isint ? lua_pushinteger(L, value->integer) : lua_pushnumber(L, value->number);
+            break;
+        case LUA_TSTRING:
+            lua_pushlstring(L, value->str.data(), value->str.size());
+            break;
+        case LUA_TTABLE:
+            frozen_push_proxy(L, proxy->root, value->table.get());
+            break;
+        default:
+            lua_pushnil(L);
+            break;
+        }
+    }
+
+    inline const frozen_value* frozen_find(frozen_table* node, lua_State* L, int index) {
+        if (lua_type(L, index) == LUA_TSTRING) {
+            size_t len;
+            const char* key = lua_tolstring(L, index, &len);
+            auto it = node->strs.find(std::string_view(key, len));
+            return it != node->strs.end() ? &it->second : nullptr;
+        }
+        int isnum = 0;
+        lua_Integer key = lua_tointegerx(L, index, &isnum);
+        if (!isnum) return nullptr;
+        if (key >= 1 && key <= (lua_Integer)node->array.size()) {
+            return &node->array[key - 1];
+        }
+        auto it = node->ints.find(key);
+        return it != node->ints.end() ? &it->second : nullptr;
+    }
+
+    inline int frozen_index(lua_State* L) {
+        frozen_proxy* proxy = (frozen_proxy*)luaL_checkudata(L, 1, FROZEN_META);
+        frozen_push_value(L, proxy, frozen_find(proxy->node, L, 2));
+        return 1;
+    }
+
+    inline int frozen_newindex(lua_State* L) {
+        return luaL_error(L, "frozen table is readonly");
+    }
+
+    inline int frozen_len(lua_State* L) {
+        frozen_proxy* proxy = (frozen_proxy*)luaL_checkudata(L, 1, FROZEN_META);
+        lua_pushinteger(L, proxy->node->array.size());
+        return 1;
+    }
+
+    inline int frozen_gc(lua_State* L) {
+        frozen_proxy* proxy = (frozen_proxy*)luaL_checkudata(L, 1, FROZEN_META);
+        proxy->~frozen_proxy();
+        return 0;
+    }
+
+    //遍历顺序: 数组部分, 整数键, 字符串键
+    inline int frozen_next(lua_State* L) {
+        frozen_proxy* proxy = (frozen_proxy*)luaL_checkudata(L, 1, FROZEN_META);
+        frozen_table* node = proxy->node;
+        lua_Integer asize = node->array.size();
+        if (lua_isnil(L, 2)) {
+            if (asize > 0) {
+                lua_pushinteger(L, 1);
+                frozen_push_value(L, proxy, &node->array[0]);
+                return 2;
+            }
+            if (!node->ints.empty()) {
+                auto it = node->ints.begin();
+                lua_pushinteger(L, it->first);
+                frozen_push_value(L, proxy, &it->second);
+                return 2;
+            }
+        } else if (lua_type(L, 2) == LUA_TNUMBER) {
+            lua_Integer key = lua_tointeger(L, 2);
+            if (key >= 1 && key < asize) {
+                lua_pushinteger(L, key + 1);
+                frozen_push_value(L, proxy, &node->array[key]);
+                return 2;
+            }
+            auto it = (key >= 1 && key <= asize) ? node->ints.begin() : node->ints.upper_bound(key);
+            if (it != node->ints.end()) {
+                lua_pushinteger(L, it->first);
+                frozen_push_value(L, proxy, &it->second);
+                return 2;
+            }
+        } else {
+            size_t len;
+            const char* key = lua_tolstring(L, 2, &len);
+            auto it = node->strs.upper_bound(std::string_view(key, len));
+            if (it != node->strs.end()) {
+                lua_pushlstring(L, it->first.data(), it->first.size());
+                frozen_push_value(L, proxy, &it->second);
+                return 2;
+            }
+            return 0;
+        }
+        auto it = node->strs.begin();
+        if (it != node->strs.end()) {
+            lua_pushlstring(L, it->first.data(), it->first.size());
+            frozen_push_value(L, proxy, &it->second);
+            return 2;
+        }
+        return 0;
+    }
+
+    inline int frozen_pairs(lua_State* L) {
+        luaL_checkudata(L, 1, FROZEN_META);
+        lua_pushcfunction(L, frozen_next);
+        lua_pushvalue(L, 1);
+        lua_pushnil(L);
+        return 3;
+    }
+
+    //进程内的冻结表注册中心
+    class frozen_mgr {
+    public:
+        static frozen_mgr* instance() {
+            static frozen_mgr mgr;
+            return &mgr;
+        }
+
+        //hive.freeze(name, tab): 构建只读副本, 同名时替换
+        int freeze(lua_State* L) {
+            size_t len;
+            const char* name = luaL_checklstring(L, 1, &len);
+            luaL_checktype(L, 2, LUA_TTABLE);
+            auto root = std::make_shared<frozen_table>();
+            frozen_build(L, 2, root.get(), 0);
+            std::unique_lock<luakit::spin_mutex> lock(m_mutex);
+            m_tables[std::string(name, len)] = root;
+            lua_pushboolean(L, true);
+            return 1;
+        }
+
+        //hive.frozen(name): 返回只读代理, 不存在时返回nil
+        int frozen(lua_State* L) {
+            size_t len;
+            const char* name = luaL_checklstring(L, 1, &len);
+            std::shared_ptr<frozen_table> root;
+            {
+                std::unique_lock<luakit::spin_mutex> lock(m_mutex);
+                auto it = m_tables.find(std::string_view(name, len));
+                if (it == m_tables.end()) {
+                    lua_pushnil(L);
+                    return 1;
+                }
+                root = it->second;
+            }
+            open_meta(L);
+            frozen_push_proxy(L, root, root.get());
+            return 1;
+        }
+
+        //hive.unfreeze(name): 删除注册, 已取得的代理在释放前仍可读取
+        int unfreeze(lua_State* L) {
+            size_t len;
+            const char* name = luaL_checklstring(L, 1, &len);
+            std::unique_lock<luakit::spin_mutex> lock(m_mutex);
+            auto it = m_tables.find(std::string_view(name, len));
+            if (it != m_tables.end()) {
+                m_tables.erase(it);
+            }
+            return 0;
+        }
+
+    protected:
+        void open_meta(lua_State* L) {
+            if (luaL_newmetatable(L, FROZEN_META)) {
+                luaL_Reg meta[] = {
+                    { "__index", frozen_index },
+                    { "__newindex", frozen_newindex },
+                    { "__len", frozen_len },
+                    { "__pairs", frozen_pairs },
+                    { "__gc", frozen_gc },
+                    { NULL, NULL }
+                };
+                luaL_setfuncs(L, meta, 0);
+            }
+            lua_pop(L, 1);
+        }
+
+    private:
+        luakit::spin_mutex m_mutex;
+        std::map<std::string, std::shared_ptr<frozen_table>, std::less<>> m_tables;
+    };
+}
+
+#endif
@@ -0,0 +1,288 @@
+#ifndef __MAILBOX_H__
+#define __MAILBOX_H__
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <condition_variable>
+#include "lua_kit.h"
+#ifdef __linux
+#include <unistd.h>
+#include <sys/eventfd.h>
+#endif
+
+namespace lworker {
+
+    //线程消息
+    struct mail {
+        size_t len;
+        size_t size;    //移交的编码缓冲区大小, 0表示按len分配
+        uint8_t* data() { return (uint8_t*)(this + 1); }
+
+        static mail* create(const uint8_t* data, size_t data_len) {
+            mail* m = (mail*)malloc(sizeof(mail) + data_len);
+            m->len = data_len;
+            m->size = 0;
+            memcpy(m->data(), data, data_len);
+            return m;
+        }
+
+        //释放消息, 移交的编码缓冲区回收复用
+        static void release(mail* m);
+    };
+
+    constexpr size_t MAIL_MOVE_BYTES = luakit::BUFFER_DEF;  //超过该长度的消息直接移交编码缓冲区
+    constexpr size_t MAIL_POOL_COUNT = 16;                  //回收的编码缓冲区个数上限
+    constexpr size_t MAIL_POOL_BYTES = 4 * 1024 * 1024;     //超过该大小的编码缓冲区不回收
+
+    //移交给消费线程的编码缓冲区, 释放后回收给编码线程复用, 避免下次大消息从16K重新扩容
+    //进程退出时其他线程可能仍在释放消息, 不析构
+    class mail_pool {
+    public:
+        static mail_pool& instance() {
+            static mail_pool* pool = new mail_pool();
+            return *pool;
+        }
+
+        //call by consumer thread
+        void recycle(mail* m) {
+            if (m->size > 0 && m->size <= MAIL_POOL_BYTES) {
+                std::unique_lock<luakit::spin_mutex> lock(m_mutex);
+                if (m_count < MAIL_POOL_COUNT) {
+                    m_mails[m_count++] = m;
+                    return;
+                }
+            }
+            free(m);
+        }
+
+        //call by encode thread, 没有时返回nullptr
+        mail* take() {
+            std::unique_lock<luakit::spin_mutex> lock(m_mutex);
+            return m_count > 0 ? m_mails[--m_count] : nullptr;
+        }
+
+    private:
+        luakit::spin_mutex m_mutex;
+        mail* m_mails[MAIL_POOL_COUNT];
+        size_t m_count = 0;
+    };
+
+    inline void mail::release(mail* m) {
+        mail_pool::instance().recycle(m);
+    }
+
+    //编码lua参数(index之后)为线程消息, 格式与luacodec一致
+    //编码缓冲区在头部预留mail, 大消息直接移交缓冲区所有权, 不再拷贝, 并换上回收的缓冲区
+    inline mail* encode_mail(lua_State* L, int index) {
+        static thread_local luakit::luabuf buf;
+        buf.clean();
+        buf.pop_space(sizeof(mail));
+        int n = lua_gettop(L);
+        if (n - index + 1 > UCHAR_MAX) {
+            luaL_error(L, "encode can't pack too many args");
+        }
+        buf.write<uint8_t>(n - index + 1);
+        for (int i = index; i <= n; i++) {
+            luakit::encode_one(L, &buf, i, 0);
+        }
+        size_t total;
+        uint8_t* data = buf.data(&total);
+        if (total < MAIL_MOVE_BYTES) {
+            return mail::create(data + sizeof(mail), total - sizeof(mail));
+        }
+        size_t size = buf.capacity();
+        mail* spare = mail_pool::instance().take();
+        mail* m = (mail*)buf.detach(&total, (uint8_t*)spare, spare ? spare->size : 0);
+        m->len = total - sizeof(mail);
+        m->size = size;
+        return m;
+    }
+
+    inline uint64_t steady_us() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    //有界无锁多生产者单消费者邮箱(Vyukov环形队列)
+    //满时生产者可等待消费者腾出空间, 投递时通过eventfd唤醒消费线程的epoll
+    class mailbox {
+    public:
+        mailbox(size_t capacity, size_t max_bytes) : m_max_bytes(max_bytes) {
+            size_t size = 1;
+            while (size < capacity) size <<= 1;
+            m_mask = size - 1;
+            m_cells = new cell[size];
+            for (size_t i = 0; i < size; ++i) {
+                m_cells[i].seq.store(i, std::memory_order_relaxed);
+            }
+#ifdef __linux
+            m_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+#endif
+        }
+
+        ~mailbox() {
+            while (mail* m = pop()) {
+                mail::release(m);
+            }
+            delete[] m_cells;
+#ifdef __linux
+            if (m_event >= 0) {
+                ::close(m_event);
+            }
+#endif
+        }
+
+        //call by any thread, 满时最多等待wait_ms
+        bool push(const uint8_t* data, size_t data_len, int wait_ms = 0) {
+            return push(mail::create(data, data_len), wait_ms);
+        }
+
+        //call by any thread, 接管m的所有权, 失败时释放
+        bool push(mail* m, int wait_ms = 0) {
+            if (!try_push(m)) {
+                if (wait_ms <= 0 || !wait_push(m, wait_ms)) {
+                    mail::release(m);
+                    return false;
+                }
+            }
+            notify();
+            return true;
+        }
+
+        //call by self thread, 使用后调用release
+        mail* pop() {
+            cell* c = &m_cells[m_dequeue & m_mask];
+            size_t seq = c->seq.load(std::memory_order_acquire);
+            if (seq != m_dequeue + 1) {
+                return nullptr;
+            }
+            mail* m = c->data;
+            c->seq.store(m_dequeue + m_mask + 1, std::memory_order_release);
+            ++m_dequeue;
+            m_bytes.fetch_sub(m->len, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            if (m_blocking.load(std::memory_order_relaxed) > 0) {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_writable.notify_all();
+            }
+            return m;
+        }
+
+        void release(mail* m) {
+            mail::release(m);
+        }
+
+        //call by self thread, 开始消费前调用, 之后的投递会再次唤醒
+        void reset_notify() {
+            m_notified.store(false, std::memory_order_seq_cst);
+        }
+
+        //可读时表示有新消息, 由消费线程的socket_mgr监听(仅linux)
+        int event_fd() { return m_event; }
+        uint64_t notifies() { return m_notifies.load(std::memory_order_relaxed); }
+
+        bool empty() {
+            cell* c = &m_cells[m_dequeue & m_mask];
+            return c->seq.load(std::memory_order_acquire) != m_dequeue + 1;
+        }
+
+        size_t size() {
+            size_t enqueue = m_enqueue.load(std::memory_order_relaxed);
+            return enqueue > m_dequeue ? enqueue - m_dequeue : 0;
+        }
+
+        size_t bytes() { return m_bytes.load(std::memory_order_relaxed); }
+        size_t capacity() { return m_mask + 1; }
+
+        //唤醒消费线程
+        void notify() {
+            if (m_event < 0) return;
+            if (!m_notified.exchange(true, std::memory_order_seq_cst)) {
+                m_notifies.fetch_add(1, std::memory_order_relaxed);
+#ifdef __linux
+                uint64_t value = 1;
+                [[maybe_unused]] auto ret = ::write(m_event, &value, sizeof(value));
+#endif
+            }
+        }
+
+    protected:
+        bool try_push(mail* m) {
+            if (m_bytes.fetch_add(m->len, std::memory_order_relaxed) + m->len > m_max_bytes) {
+                m_bytes.fetch_sub(m->len, std::memory_order_relaxed);
+                return false;
+            }
+            size_t pos = m_enqueue.load(std::memory_order_relaxed);
+            while (true) {
+                cell* c = &m_cells[pos & m_mask];
+                size_t seq = c->seq.load(std::memory_order_acquire);
+                intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+                if (diff == 0) {
+                    if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                        c->data = m;
+                        c->seq.store(pos + 1, std::memory_order_release);
+                        return true;
+                    }
+                } else if (diff < 0) {
+                    m_bytes.fetch_sub(m->len, std::memory_order_relaxed);
+                    return false;
+                } else {
+                    pos = m_enqueue.load(std::memory_order_relaxed);
+                }
+            }
+        }
+
+        bool wait_push(mail* m, int wait_ms) {
+            auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(wait_ms);
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_blocking.fetch_add(1, std::memory_order_seq_cst);
+            bool ok = m_writable.wait_until(lock, deadline, [&] { return try_push(m); });
+            m_blocking.fetch_sub(1, std::memory_order_relaxed);
+            return ok;
+        }
+
+    private:
+        struct cell {
+            std::atomic<size_t> seq;
+            mail* data = nullptr;
+        };
+        cell* m_cells = nullptr;
+        size_t m_mask = 0;
+        size_t m_max_bytes = 0;
+        size_t m_dequeue = 0;
+        alignas(64) std::atomic<size_t> m_enqueue = 0;
+        alignas(64) std::atomic<size_t> m_bytes = 0;
+        std::atomic<int> m_blocking = 0;
+        std::atomic<bool> m_notified = false;
+        std::atomic<uint64_t> m_notifies = 0;
+        int m_event = -1;
+        std::mutex m_mutex;
+        std::condition_variable m_writable;
+    };
+
+    //线程运行统计, 由其他线程读取
+    struct mailbox_stats {
+        std::atomic<uint64_t> frames = 0;   //run调用次数
+        std::atomic<uint64_t> mails = 0;    //处理的消息数
+        std::atomic<uint64_t> mail_us = 0;  //处理消息的lua耗时
+
+        void push(lua_State* L, mailbox& box) {
+            lua_createtable(L, 0, 8);
+            lua_pushinteger(L, frames.load(std::memory_order_relaxed));
+            lua_setfield(L, -2, "frames");
+            lua_pushinteger(L, mails.load(std::memory_order_relaxed));
+            lua_setfield(L, -2, "mails");
+            lua_pushinteger(L, mail_us.load(std::memory_order_relaxed));
+            lua_setfield(L, -2, "mail_us");
+            lua_pushinteger(L, box.notifies());
+            lua_setfield(L, -2, "wakeups");
+            lua_pushinteger(L, box.size());
+            lua_setfield(L, -2, "pending");
+            lua_pushinteger(L, box.bytes());
+            lua_setfield(L, -2, "pending_bytes");
+        }
+    };
+}
+
+#endif
@@ -0,0 +1,152 @@
+#ifndef __POOL_H__
+#define __POOL_H__
+#include <deque>
+#include <vector>
+
+#include "worker.h"
+
+namespace lworker {
+
+    //无状态任务池: N个相同入口的worker, 每个成员一个任务队列
+    //投递轮询分配, 成员空闲时从最长的队列尾部窃取
+    class worker_pool : public ijob_source
+    {
+    public:
+        worker_pool(ischeduler* schedulor, vstring name, vstring entry, vstring incl, vstring service, size_t count) : m_name(name) {
+            for (size_t i = 0; i < count; ++i) {
+                auto workor = std::make_shared<worker>(schedulor, fmt::format("{}_{}", name, i + 1), entry, incl, service);
+                workor->set_jobs(this, i);
+                m_workers.push_back(workor);
+                m_queues.push_back(std::make_unique<job_queue>());
+            }
+        }
+
+        ~worker_pool() {
+            m_workers.clear();
+            for (auto& queue : m_queues) {
+                for (mail* job : queue->jobs) {
+                    mail::release(job);
+                }
+            }
+        }
+
+        void startup() {
+            for (auto& workor : m_workers) {
+                workor->startup();
+            }
+        }
+
+        void stop() {
+            for (auto& workor : m_workers) {
+                workor->stop();
+            }
+        }
+
+        //call by any thread, 接管job的所有权
+        bool submit(mail* job) {
+            size_t count = m_queues.size();
+            if (m_pending.load(std::memory_order_relaxed) >= MAILBOX_CAPACITY) {
+                mail::release(job);
+                LOG_ERROR(fmt::format("[{}] pool jobs is full!,pending:{}", m_name, m_pending.load()));
+                return false;
+            }
+            size_t index = m_next.fetch_add(1, std::memory_order_relaxed) % count;
+            auto& queue = m_queues[index];
+            size_t backlog = 0;
+            {
+                std::unique_lock<spin_mutex> lock(queue->mutex);
+                queue->jobs.push_back(job);
+                backlog = queue->jobs.size();
+                queue->size.store(backlog, std::memory_order_relaxed);
+            }
+            m_pending.fetch_add(1, std::memory_order_relaxed);
+            m_submits.fetch_add(1, std::memory_order_relaxed);
+            m_workers[index]->wakeup();
+            //目标成员已有积压, 唤醒下一个成员来窃取
+            if (backlog > 1 && count > 1) {
+                m_workers[(index + 1) % count]->wakeup();
+            }
+            return true;
+        }
+
+        //call by member thread
+        mail* take(size_t index) override {
+            auto& queue = m_queues[index];
+            {
+                std::unique_lock<spin_mutex> lock(queue->mutex);
+                if (!queue->jobs.empty()) {
+                    mail* job = queue->jobs.front();
+                    queue->jobs.pop_front();
+                    queue->size.store(queue->jobs.size(), std::memory_order_relaxed);
+                    return job;
+                }
+            }
+            return steal(index);
+        }
+
+        //call by member thread
+        void done(size_t index, mail* job) override {
+            mail::release(job);
+            m_pending.fetch_sub(1, std::memory_order_relaxed);
+            m_queues[index]->dones.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        //任务池统计: { workers, submits, steals, pending, dones = { n1, n2, ... } }
+        void stats(lua_State* L) {
+            lua_createtable(L, 0, 6);
+            lua_pushinteger(L, m_workers.size());
+            lua_setfield(L, -2, "workers");
+            lua_pushinteger(L, m_submits.load(std::memory_order_relaxed));
+            lua_setfield(L, -2, "submits");
+            lua_pushinteger(L, m_steals.load(std::memory_order_relaxed));
+            lua_setfield(L, -2, "steals");
+            lua_pushinteger(L, m_pending.load(std::memory_order_relaxed));
+            lua_setfield(L, -2, "pending");
+            lua_createtable(L, (int)m_queues.size(), 0);
+            for (size_t i = 0; i < m_queues.size(); ++i) {
+                lua_pushinteger(L, m_queues[i]->dones.load(std::memory_order_relaxed));
+                lua_rawseti(L, -2, i + 1);
+            }
+            lua_setfield(L, -2, "dones");
+        }
+
+    protected:
+        mail* steal(size_t index) {
+            size_t victim = index, most = 0;
+            for (size_t i = 0; i < m_queues.size(); ++i) {
+                if (i == index) continue;
+                size_t size = m_queues[i]->size.load(std::memory_order_relaxed);
+                if (size > most) {
+                    most = size;
+                    victim = i;
+                }
+            }
+            if (victim == index) return nullptr;
+            auto& queue = m_queues[victim];
+            std::unique_lock<spin_mutex> lock(queue->mutex);
+            if (queue->jobs.empty()) return nullptr;
+            mail* job = queue->jobs.back();
+            queue->jobs.pop_back();
+            queue->size.store(queue->jobs.size(), std::memory_order_relaxed);
+            m_steals.fetch_add(1, std::memory_order_relaxed);
+            return job;
+        }
+
+    private:
+        struct job_queue {
+            spin_mutex mutex;
+            std::deque<mail*> jobs;
+            std::atomic<size_t> size = 0;      //无锁读取, 用于选择窃取目标
+            std::atomic<uint64_t> dones = 0;
+        };
+        std::string m_name;
+        std::vector<std::shared_ptr<worker>> m_workers;
+        std::vector<std::unique_ptr<job_queue>> m_queues;
+        std::atomic<size_t> m_next = 0;
+        std::atomic<size_t> m_pending = 0;
+        std::atomic<uint64_t> m_submits = 0;
+        std::atomic<uint64_t> m_steals = 0;
+    };
+}
+
+#endif
@@ -2,7 +2,7 @@
 #define __SCHEDULER_H__
 #include <condition_variable>
 
-#include "worker.h"
+#include "pool.h"
 
 using namespace std::chrono;
 using vstring = std::string_view;
@@ -39,8 +39,27 @@ namespace lworker {
             LOG_ERROR(fmt::format("thread [{}] work is repeat startup", name));
             return false;
         }
-        uint8_t* encode(lua_State* L, size_t& data_len) {
-            return m_codec->encode(L, 2, &data_len);
+
+        //启动任务池, 通过name投递的任务由count个成员分担
+        bool startup_pool(vstring name, vstring entry, vstring incl, size_t count) {
+            std::unique_lock<spin_mutex> lock(m_mutex);
+            if (count == 0 || m_worker_map.find(name) != m_worker_map.end() || m_pool_map.find(name) != m_pool_map.end()) {
+                LOG_ERROR(fmt::format("thread pool [{}] is repeat startup or count is zero", name));
+                return false;
+            }
+            auto pool = std::make_shared<worker_pool>(this, name, entry, incl, m_service, count);
+            m_pool_map.insert(std::make_pair(name, pool));
+            pool->startup();
+            return true;
+        }
+
+        std::shared_ptr<worker_pool> find_pool(vstring name) {
+            std::unique_lock<spin_mutex> lock(m_mutex);
+            auto it = m_pool_map.find(name);
+            if (it != m_pool_map.end()) {
+                return it->second;
+            }
+            return nullptr;
         }
         //call by self thread
         int broadcast(lua_State* L) {
@@ -56,18 +75,24 @@ namespace lworker {
             }
             return 0;
         }
-        //call by other thread or self
-        int call(lua_State* L, vstring name, uint8_t* data, size_t data_len) {
-            if (data) {
+        //call by other thread or self, 邮箱满时worker线程等待wait_ms, master线程传0直接返回失败
+        int call(lua_State* L, vstring name, mail* m, int wait_ms = 0) {
+            if (m) {
                 if (name == "master") {
-                    lua_pushboolean(L, call(L, data, data_len));
+                    lua_pushboolean(L, call(L, m, wait_ms));
                     return 1;
                 }
                 auto workor = find_worker(name);
                 if (workor) {
-                    lua_pushboolean(L, workor->call(L, data, data_len));
+                    lua_pushboolean(L, workor->call(L, m, wait_ms));
                     return 1;
                 }
+                auto pool = find_pool(name);
+                if (pool) {
+                    lua_pushboolean(L, pool->submit(m));
+                    return 1;
+                }
+                mail::release(m);
                 LOG_ERROR(fmt::format("thread call [{}] work is not exist", name));
             } else {
                 LOG_ERROR(fmt::format("thread call [{}] encode faild", name));
@@ -76,45 +101,61 @@ namespace lworker {
             return 1;
         }
         //call by other thread or self
-        bool call(lua_State* L, uint8_t* data, size_t data_len) {
-            std::unique_lock<spin_mutex> lock(m_mutex);
-            uint8_t* target = m_write_buf->peek_space(data_len + sizeof(uint32_t));
-            if (target) {
-                m_write_buf->write<uint32_t>(data_len);
-                m_write_buf->push_data(data, data_len);
+        bool call(lua_State* L, mail* m, int wait_ms = 0) {
+            if (m_mailbox.push(m, wait_ms)) {
                 return true;
             }
-            LOG_ERROR(fmt::format("master thread call buffer is full!,size:{}",m_write_buf->size()));
+            LOG_ERROR(fmt::format("master thread call buffer is full!,size:{},bytes:{}", m_mailbox.size(), m_mailbox.bytes()));
             return false;
         }
         //call by self thread
         void update(uint64_t clock_ms) {
-            if (m_read_buf->empty()) {
-                if (m_write_buf->empty()) {
-                    return;
-                }
-                std::unique_lock<spin_mutex> lock(m_mutex);
-                m_read_buf.swap(m_write_buf);
-            }
-            size_t plen = 0,pcount = 0;
+            size_t pcount = 0;
             const char* service = m_service.c_str();
-            slice* slice = read_slice(m_read_buf, &plen);
-            while (slice) {
-                m_codec->set_slice(slice);
+            m_stats.frames.fetch_add(1, std::memory_order_relaxed);
+            m_mailbox.reset_notify();
+            auto start = steady_us();
+            while (mail* m = m_mailbox.pop()) {
+                slice slice(m->data(), m->len);
+                m_codec->set_slice(&slice);
                 m_lua->table_call(service, "on_scheduler", nullptr, m_codec, std::tie());
+                m_mailbox.release(m);
                 if (m_codec->failed()) {
-                    m_read_buf->clean();
-                    break;
+                    LOG_ERROR(fmt::format("on_scheduler decode failed:{}", m_codec->err()));
+                    continue;
                 }
-                m_read_buf->pop_size(plen);
                 ++pcount;
                 auto cost_time = steady_ms() - clock_ms;
                 if (cost_time > 100) {
-                    LOG_ERROR(fmt::format("on_scheduler is busy,cost:{},pcount:{},remain:{}", cost_time, pcount, m_read_buf->size()));
+                    LOG_ERROR(fmt::format("on_scheduler is busy,cost:{},pcount:{},remain:{}", cost_time, pcount, m_mailbox.size()));
                     break;
                 }
-                slice = read_slice(m_read_buf, &plen);
             }
+            if (pcount > 0) {
+                m_stats.mails.fetch_add(pcount, std::memory_order_relaxed);
+                m_stats.mail_us.fetch_add(steady_us() - start, std::memory_order_relaxed);
+            }
+        }
+
+        int event_fd() {
+            return m_mailbox.event_fd();
+        }
+
+        //线程统计: { name = { frames, mails, mail_us, wakeups, pending, pending_bytes } }
+        int stats(lua_State* L) {
+            lua_newtable(L);
+            m_stats.push(L, m_mailbox);
+            lua_setfield(L, -2, "master");
+            std::unique_lock<spin_mutex> lock(m_mutex);
+            for (auto& [name, workor] : m_worker_map) {
+                workor->stats(L);
+                lua_setfield(L, -2, name.c_str());
+            }
+            for (auto& [name, pool] : m_pool_map) {
+                pool->stats(L);
+                lua_setfield(L, -2, name.c_str());
+            }
+            return 1;
         }
 
         void destory(vstring name) {
@@ -131,6 +172,10 @@ namespace lworker {
                 it.second->stop();
             }
             m_worker_map.clear();
+            for (auto it : m_pool_map) {
+                it.second->stop();
+            }
+            m_pool_map.clear();
         }
 
         std::vector<std::string> workers() {
@@ -146,9 +191,10 @@ namespace lworker {
         std::string m_service;
         codec_base* m_codec = nullptr;
         std::unique_ptr<kit_state> m_lua = nullptr;
-        std::shared_ptr<luabuf> m_read_buf = std::make_shared<luabuf>(32,32);
-        std::shared_ptr<luabuf> m_write_buf = std::make_shared<luabuf>(32,32);
+        mailbox m_mailbox = mailbox(MAILBOX_CAPACITY, MAILBOX_MASTER_BYTES);
+        mailbox_stats m_stats;
         std::map<std::string, std::shared_ptr<worker>, std::less<>> m_worker_map;
+        std::map<std::string, std::shared_ptr<worker_pool>, std::less<>> m_pool_map;
     };
 }
 
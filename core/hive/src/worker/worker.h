@@ -8,6 +8,8 @@
 #include "thread_name.hpp"
 #include "lua_kit.h"
 #include "../lualog/logger.h"
+#include "mailbox.h"
+#include "frozen.h"
 
 using namespace luakit;
 using vstring = std::string_view;
@@ -17,27 +19,26 @@ extern "C" void open_custom_libs(lua_State * L);
 
 namespace lworker {
 
-    static slice* read_slice(std::shared_ptr<luabuf> buff, size_t* pack_len) {
-        uint8_t* plen = buff->peek_data(sizeof(uint32_t));
-        if (plen) {
-            uint32_t len = *(uint32_t*)plen;
-            uint8_t* pdata = buff->peek_data(len);
-            if (pdata) {
-                *pack_len = sizeof(uint32_t) + len;
-                return buff->get_slice(len, sizeof(uint32_t));
-            }
-        }
-        return nullptr;
-    }
+    constexpr size_t MAILBOX_CAPACITY       = 128 * 1024;           //Ϣ
+    constexpr size_t MAILBOX_WORKER_BYTES   = 32 * 1024 * 1024;     //workerֽ
+    constexpr size_t MAILBOX_MASTER_BYTES   = 16 * 1024 * 1024;     //masterֽ
+    constexpr int    MAILBOX_WAIT_MS        = 100;                  //ʱworker߳ȴ(ms), master̲߳ȴ
 
     class worker;
     class ischeduler {
     public:
         virtual int broadcast(lua_State* L) = 0;
-        virtual int call(lua_State* L, vstring name, uint8_t* data, size_t data_len) = 0;
+        virtual int call(lua_State* L, vstring name, mail* m, int wait_ms) = 0;
         virtual void destory(vstring name) = 0;
     };
 
+    //ؽӿ, worker̵߳
+    class ijob_source {
+    public:
+        virtual mail* take(size_t index) = 0;
+        virtual void done(size_t index, mail* job) = 0;
+    };
+
     class worker
     {
     public:
@@ -58,45 +59,73 @@ namespace lworker {
             return getenv(key);
         }
         //call by other thread
-        bool call(lua_State* L, uint8_t* data, size_t data_len) {
-            std::unique_lock<spin_mutex> lock(m_mutex);
-            uint8_t* target = m_write_buf->peek_space(data_len + sizeof(uint32_t));
-            if (target) {
-                m_write_buf->write<uint32_t>(data_len);
-                m_write_buf->push_data(data, data_len);
+        bool call(lua_State* L, uint8_t* data, size_t data_len, int wait_ms = 0) {
+            return call(L, mail::create(data, data_len), wait_ms);
+        }
+        //call by other thread, ӹmȨ, ʱȴwait_ms
+        bool call(lua_State* L, mail* m, int wait_ms = 0) {
+            if (m_mailbox.push(m, wait_ms)) {
                 return true;
             }
-            LOG_ERROR(fmt::format("[{}] thread call buffer is full!,size:{}", m_name, m_write_buf->size()));
+            LOG_ERROR(fmt::format("[{}] thread call buffer is full!,size:{},bytes:{}", m_name, m_mailbox.size(), m_mailbox.bytes()));
             return false;
         }
         //call by self thread
         void update(uint64_t clock_ms) {
-            if (m_read_buf->empty()) {
-                if (m_write_buf->empty()) {
-                    return;
-                }
-                std::unique_lock<spin_mutex> lock(m_mutex);
-                m_read_buf.swap(m_write_buf);
+            size_t pcount = 0;
+            m_mailbox.reset_notify();
+            auto start = steady_us();
+            while (mail* m = m_mailbox.pop()) {
+                dispatch(m);
+                m_mailbox.release(m);
+                if (is_busy(clock_ms, ++pcount)) break;
             }
-            size_t plen = 0, pcount = 0;
-            const char* service = m_service.c_str();
-            slice* slice = read_slice(m_read_buf, &plen);
-            while (slice) {
-                m_codec->set_slice(slice);
-                m_lua->table_call(service, "on_worker", nullptr, m_codec, std::tie());
-                if (m_codec->failed()) {
-                    m_read_buf->clean();
-                    break;
-                }
-                m_read_buf->pop_size(plen);
+            //سԱ: ضΪʱԱȡ, ʱó֡()
+            while (m_jobs && steady_ms() - clock_ms <= 100) {
+                mail* m = m_jobs->take(m_index);
+                if (!m) break;
+                dispatch(m);
+                m_jobs->done(m_index, m);
                 ++pcount;
-                auto cost_time = steady_ms() - clock_ms;
-                if (steady_ms() - clock_ms > 100) {
-                    LOG_ERROR(fmt::format("on_worker [{}]  is busy,cost:{},pcount:{},remain:{}", m_name, cost_time, pcount, m_read_buf->size()));
-                    break;
-                }
-                slice = read_slice(m_read_buf, &plen);
             }
+            if (pcount > 0) {
+                m_stats.mails.fetch_add(pcount, std::memory_order_relaxed);
+                m_stats.mail_us.fetch_add(steady_us() - start, std::memory_order_relaxed);
+            }
+        }
+
+        void dispatch(mail* m) {
+            slice slice(m->data(), m->len);
+            m_codec->set_slice(&slice);
+            m_lua->table_call(m_service.c_str(), "on_worker", nullptr, m_codec, std::tie());
+            if (m_codec->failed()) {
+                LOG_ERROR(fmt::format("on_worker [{}] decode failed:{}", m_name, m_codec->err()));
+            }
+        }
+
+        bool is_busy(uint64_t clock_ms, size_t pcount) {
+            auto cost_time = steady_ms() - clock_ms;
+            if (cost_time > 100) {
+                LOG_ERROR(fmt::format("on_worker [{}]  is busy,cost:{},pcount:{},remain:{}", m_name, cost_time, pcount, m_mailbox.size()));
+                return true;
+            }
+            return false;
+        }
+
+        //
+        void set_jobs(ijob_source* jobs, size_t index) {
+            m_jobs = jobs;
+            m_index = index;
+        }
+
+        //call by other thread, luabus.wait߳
+        void wakeup() {
+            m_mailbox.notify();
+        }
+
+        //call by other thread
+        void stats(lua_State* L) {
+            m_stats.push(L, m_mailbox);
         }
 
         void startup(){            
@@ -113,10 +142,12 @@ namespace lworker {
             hive.set_function("stop", [&]() { m_running = false; });
             hive.set_function("update", [&](uint64_t clock_ms) { update(clock_ms); });
             hive.set_function("getenv", [&](const char* key) { return get_env(key); });
+            hive.set_function("event_fd", [&]() { return m_mailbox.event_fd(); });
+            hive.set_function("freeze", [](lua_State* L) { return frozen_mgr::instance()->freeze(L); });
+            hive.set_function("frozen", [](lua_State* L) { return frozen_mgr::instance()->frozen(L); });
+            hive.set_function("unfreeze", [](lua_State* L) { return frozen_mgr::instance()->unfreeze(L); });
             hive.set_function("call", [&](lua_State* L, vstring name) { 
-                size_t data_len;
-                uint8_t* data = m_codec->encode(L, 2, &data_len);
-                return m_schedulor->call(L, name, data, data_len);
+                return m_schedulor->call(L, name, encode_mail(L, 2), MAILBOX_WAIT_MS);
             });
             m_lua->run_script(g_sandbox, [&](vstring err) {
                 LOG_ERROR(fmt::format("worker load sandbox failed, because: {}", err.data()));
@@ -141,6 +172,7 @@ namespace lworker {
             while (m_running) {
                 if (m_stop) break;
                 m_lua->table_call(service, "run");
+                m_stats.frames.fetch_add(1, std::memory_order_relaxed);
             }
             if (!m_stop) {                
                 m_schedulor->destory(m_name);
@@ -153,7 +185,6 @@ namespace lworker {
         }
 
     private:
-        spin_mutex m_mutex;
         std::thread m_thread;
         bool m_stop = false;
         bool m_running = false;
@@ -161,8 +192,10 @@ namespace lworker {
         ischeduler* m_schedulor = nullptr;
         std::string m_name, m_entry, m_service, m_include;
         std::unique_ptr<kit_state> m_lua = std::make_unique<kit_state>();
-        std::shared_ptr<luabuf> m_read_buf = std::make_shared<luabuf>(64,32);
-        std::shared_ptr<luabuf> m_write_buf = std::make_shared<luabuf>(64,32);
+        mailbox m_mailbox = mailbox(MAILBOX_CAPACITY, MAILBOX_WORKER_BYTES);
+        mailbox_stats m_stats;
+        ijob_source* m_jobs = nullptr;
+        size_t m_index = 0;
     };
 }
 
@@ -41,6 +41,7 @@ STDCPP = -std=c++17
 MYCFLAGS += -I../../extend/lua/lua
 MYCFLAGS += -I../../extend/fmt/include
 MYCFLAGS += -I../../extend/luakit/include
+MYCFLAGS += -I../../extend/utility
 
 #需要定义的选项
 MYCFLAGS += -DFMT_HEADER_ONLY
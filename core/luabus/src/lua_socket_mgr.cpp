@@ -2,12 +2,18 @@
 #include "lua_socket_mgr.h"
 #include "lua_socket_node.h"
 
-bool lua_socket_mgr::setup(lua_State* L, uint32_t max_fd) {
+bool lua_socket_mgr::setup(lua_State* L, uint32_t max_fd, int io_threads) {
 	m_luakit = std::make_shared<kit_state>(L);
 	m_mgr = std::make_shared<socket_mgr>();
 	m_codec = luakit::get_codec();
 	m_router = std::make_shared<socket_router>(m_mgr);
-	return m_mgr->setup(max_fd);
+	if (!m_mgr->setup(max_fd)) {
+		return false;
+	}
+	if (io_threads > 0) {
+		m_mgr->setup_shards(io_threads);
+	}
+	return true;
 }
 
 int lua_socket_mgr::listen(lua_State* L, const char* ip, int port) {
@@ -95,6 +101,20 @@ int lua_socket_mgr::broad_group(lua_State* L, codec_base* codec) {
 	lua_pushboolean(L, false);
 	return 1;
 }
+//broad_channel(codec, channel, ...): һ, ж߹Ϳ
+int lua_socket_mgr::broad_channel(lua_State* L, codec_base* codec) {
+	size_t channel_len = 0;
+	const char* channel = luaL_checklstring(L, 2, &channel_len);
+	size_t data_len = 0;
+	char* data = (char*)codec->encode(L, 3, &data_len);
+	if (data_len > 1 && data_len < NET_PACKET_MAX_LEN) {
+		sendv_item items[] = { {data, data_len} };
+		lua_pushinteger(L, m_mgr->broad_channel(std::string(channel, channel_len), items, _countof(items)));
+		return 1;
+	}
+	lua_pushinteger(L, -1);
+	return 1;
+}
 int lua_socket_mgr::broad_rpc(lua_State* L) {
 	if (m_codec) {
 		bus_ids.clear();
@@ -9,7 +9,7 @@ struct lua_socket_mgr final
 {
 public:
 	~lua_socket_mgr() {};
-	bool setup(lua_State* L, uint32_t max_fd);
+	bool setup(lua_State* L, uint32_t max_fd, int io_threads);
 	int wait(int64_t now, int ms) { return m_mgr->wait(now,ms); }
 	int listen(lua_State* L, const char* ip, int port);
 	int connect(lua_State* L, const char* ip, const char* port, int timeout);
@@ -23,6 +23,17 @@ public:
 	const std::string get_rpc_key();
 	int broad_group(lua_State* L, codec_base* codec);
 	int broad_rpc(lua_State* L);
+	//㲥Ƶ
+	bool subscribe(std::string channel, uint32_t token) { return m_mgr->subscribe(channel, token); }
+	bool unsubscribe(std::string channel, uint32_t token) { return m_mgr->unsubscribe(channel, token); }
+	size_t channel_size(std::string channel) { return m_mgr->channel_size(channel); }
+	int broad_channel(lua_State* L, codec_base* codec);
+	int send_stats(lua_State* L) {
+		lua_pushinteger(L, m_mgr->send_calls());
+		lua_pushinteger(L, m_mgr->send_bytes());
+		return 2;
+	}
+	uint32_t watch_event(int fd) { return m_mgr->watch_event(fd); }
 
 	//·
 	void set_player_service(uint32_t player_id, uint32_t sid, uint8_t login);
@@ -40,6 +40,13 @@ lua_socket_node::lua_socket_node(uint32_t token, lua_State* L, stdsptr<socket_mg
 
 lua_socket_node::~lua_socket_node() {
 	close();
+	lua_State* L = m_luakit->L();
+	for (auto ref : m_send_refs) {
+		luaL_unref(L, LUA_REGISTRYINDEX, ref);
+	}
+	for (auto ref : m_recv_methods) {
+		luaL_unref(L, LUA_REGISTRYINDEX, ref);
+	}
 }
 
 int lua_socket_node::call_pb(lua_State* L) {
@@ -51,7 +58,7 @@ int lua_socket_node::call_pb(lua_State* L) {
 	if (m_codec) {
 		size_t data_len = 0;
 		char* data = (char*)m_codec->encode(L, 1, &data_len);
-		if (data_len > 1 && data_len < NET_PACKET_MAX_LEN) {
+		if (data_len > 1 && data_len <= SOCKET_PACKET_MAX) {
 			m_mgr->send(m_token, data, data_len);
 			lua_pushinteger(L, data_len);
 			return 1;
@@ -88,17 +95,27 @@ int lua_socket_node::call_data(lua_State* L) {
 
 int lua_socket_node::call(lua_State* L, uint32_t session_id, uint8_t flag, uint32_t source_id) {
 	if (m_codec) {
+		uint8_t method[RPC_METHOD_HEAD];
+		size_t method_len = 0;
+		uint32_t define = 0;
+		bool intern = m_intern && encode_method(L, method, &method_len, &define);
 		size_t data_len = 0;
-		void* data = m_codec->encode(L, 4, &data_len);
-		if (data_len <= SOCKET_PACKET_MAX) {
+		void* data = m_codec->encode(L, intern ? 5 : 4, &data_len);
+		if (data_len + method_len <= SOCKET_PACKET_MAX) {
 			router_header header;
 			header.session_id = session_id;
-			header.rpc_flag = flag;
+			header.rpc_flag = intern ? (flag | RPC_FLAG_METHOD) : flag;
 			header.source_id = source_id;
 			header.msg_id = (uint8_t)rpc_type::remote_call;
-			header.len = data_len + ROUTER_HEAD_SIZE;
-			sendv_item items[] = { {&header, ROUTER_HEAD_SIZE}, {data, data_len} };
+			header.len = data_len + method_len + ROUTER_HEAD_SIZE;
+			sendv_item items[] = { {&header, ROUTER_HEAD_SIZE}, {method, method_len}, {data, data_len} };
 			auto send_len = m_mgr->sendv(m_token, items, _countof(items));
+			//ͳɹŵǼ·, ֤˱һ
+			if (define > 0 && send_len > 0) {
+				lua_pushvalue(L, 4);
+				m_send_refs.push_back(luaL_ref(L, LUA_REGISTRYINDEX));
+				m_send_methods.emplace(lua_tostring(L, 4), define);
+			}
 			lua_pushinteger(L, send_len);
 			return 1;
 		}
@@ -107,6 +124,32 @@ int lua_socket_node::call(lua_State* L, uint32_t session_id, uint8_t flag, uint3
 	return 1;
 }
 
+//: ѱŵֻ, ·; ߳ʱַ
+bool lua_socket_node::encode_method(lua_State* L, uint8_t* buf, size_t* len, uint32_t* define) {
+	if (lua_type(L, 4) != LUA_TSTRING) {
+		return false;
+	}
+	size_t name_len = 0;
+	const char* name = lua_tolstring(L, 4, &name_len);
+	if (name_len > RPC_METHOD_NAME) {
+		return false;
+	}
+	auto it = m_send_methods.find(name);
+	if (it != m_send_methods.end()) {
+		*len = encode_u64(buf, RPC_METHOD_HEAD, (uint64_t)it->second << 1);
+		return true;
+	}
+	if (m_send_methods.size() >= RPC_METHOD_MAX) {
+		return false;
+	}
+	*define = (uint32_t)m_send_methods.size() + 1;
+	size_t head_len = encode_u64(buf, RPC_METHOD_HEAD, (uint64_t)*define << 1 | 1);
+	buf[head_len++] = (uint8_t)name_len;
+	memcpy(buf + head_len, name, name_len);
+	*len = head_len + name_len;
+	return true;
+}
+
 int lua_socket_node::forward_target(lua_State* L, uint32_t session_id, uint8_t flag, uint32_t source_id, uint32_t target) {
 	if (m_codec) {
 		size_t data_len = 0;
@@ -239,8 +282,7 @@ int lua_socket_node::on_recv(slice* slice) {
 	}
 	switch ((rpc_type)msg) {
 	case rpc_type::remote_call:
-		on_call(header, slice);
-		break;
+		return on_call(header, slice);
 	case rpc_type::forward_target:
 		if (!m_router->do_forward_target(header, data, data_len, m_error_msg,is_router))
 			on_forward_error(header);
@@ -288,9 +330,55 @@ void lua_socket_node::on_forward_broadcast(router_header* header, size_t broadca
 	}
 }
 
-void lua_socket_node::on_call(router_header* header, slice* slice) {
+int lua_socket_node::on_call(router_header* header, slice* slice) {
+	if (header->rpc_flag & RPC_FLAG_METHOD) {
+		return on_call_method(header, slice);
+	}
 	m_codec->set_slice(slice);
 	m_luakit->object_call(this, "on_call", nullptr, m_codec, std::tie(), slice->size(), header->session_id, header->rpc_flag, header->source_id);
+	return 0;
+}
+
+//ŵrpc: עֱѹջ, ٽפַ
+int lua_socket_node::on_call_method(router_header* header, slice* slice) {
+	size_t recv_len = slice->size();
+	uint64_t value = 0;
+	if (slice->read_var64(&value) == 0) {
+		return -1;
+	}
+	lua_State* L = m_luakit->L();
+	uint32_t id = (uint32_t)(value >> 1);
+	if (value & 1) {
+		uint8_t* name_len = slice->read();
+		uint8_t* name = name_len ? slice->erase(*name_len) : nullptr;
+		if (name == nullptr || id != m_recv_methods.size() + 1) {
+			return -2;
+		}
+		lua_pushlstring(L, (const char*)name, *name_len);
+		m_recv_methods.push_back(luaL_ref(L, LUA_REGISTRYINDEX));
+	} else if (id == 0 || id > m_recv_methods.size()) {
+		return -3;
+	}
+	//Զ˿ʼͱ, ˵ֽ֧, Ҳ
+	m_intern = true;
+	luakit::lua_guard g(L);
+	if (!luakit::get_object_function(L, this, "on_call")) {
+		return 0;
+	}
+	luakit::native_to_lua_mutil(L, recv_len, header->session_id, (uint8_t)(header->rpc_flag & ~RPC_FLAG_METHOD), header->source_id);
+	lua_rawgeti(L, LUA_REGISTRYINDEX, m_recv_methods[id - 1]);
+	int arg_num = 5;
+	m_codec->set_slice(slice);
+	try {
+		arg_num += (int)m_codec->decode(L);
+	} catch (const std::length_error&) {
+		return 0;
+	} catch (const std::exception& e) {
+		m_codec->error(e.what());
+		return 0;
+	}
+	luakit::lua_call_function(L, nullptr, arg_num, 0);
+	return 0;
 }
 
 int lua_socket_node::on_call_pb(slice* slice) {
@@ -3,6 +3,7 @@
 #include <array>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include "socket_mgr.h"
 #include "socket_router.h"
 
@@ -26,6 +27,7 @@ struct lua_socket_node final
 	}
 	void set_flow_ctrl(int ctrl_package, int ctrl_bytes) { m_mgr->set_flow_ctrl(m_token, ctrl_package, ctrl_bytes); }
 	bool can_send() { return m_mgr->can_send(m_token); }
+	void set_method_intern(bool intern) { m_intern = intern; }
 	bool is_command_cd(uint32_t cmd_id, uint32_t cd_time, uint64_t now_ms) {
 		uint64_t last_ms = m_command_cds[cmd_id];
 		m_command_cds[cmd_id] = now_ms;
@@ -65,7 +67,9 @@ private:
 	int on_recv(slice* slice);
 	int on_call_pb(slice* slice);
 	int on_call_data(slice* slice);
-	void on_call(router_header* header, slice* slice);
+	int on_call(router_header* header, slice* slice);
+	int on_call_method(router_header* header, slice* slice);
+	bool encode_method(lua_State* L, uint8_t* buf, size_t* len, uint32_t* define);
 	void on_forward_broadcast(router_header* header, size_t target_size);
 	void on_forward_error(router_header* header);
 	
@@ -76,5 +80,9 @@ private:
 	eproto_type m_proto_type;
 	std::string m_error_msg;
 	std::map<uint32_t, uint32_t> m_command_cds;
+	bool m_intern = false;
+	std::vector<int> m_send_refs;
+	std::vector<int> m_recv_methods;
+	std::unordered_map<const char*, uint32_t> m_send_methods;
 };
 
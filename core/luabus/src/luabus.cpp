@@ -8,8 +8,8 @@
 namespace luabus {
     thread_local lua_socket_mgr socket_mgr;
 
-	static bool init_socket_mgr(lua_State* L, uint32_t max_fd) {
-        return socket_mgr.setup(L, max_fd);
+	static bool init_socket_mgr(lua_State* L, uint32_t max_fd, int io_threads) {
+        return socket_mgr.setup(L, max_fd, io_threads);
 	}
 
 	static socket_udp* create_udp() {
@@ -62,6 +62,12 @@ namespace luabus {
         lluabus.set_function("get_rpc_key", []() { return socket_mgr.get_rpc_key(); });
         lluabus.set_function("broad_group", [](lua_State* L, codec_base* codec) { return socket_mgr.broad_group(L,codec); });
         lluabus.set_function("broad_rpc", [](lua_State* L) { return socket_mgr.broad_rpc(L); });
+        lluabus.set_function("subscribe", [](std::string channel, uint32_t token) { return socket_mgr.subscribe(channel, token); });
+        lluabus.set_function("unsubscribe", [](std::string channel, uint32_t token) { return socket_mgr.unsubscribe(channel, token); });
+        lluabus.set_function("channel_size", [](std::string channel) { return socket_mgr.channel_size(channel); });
+        lluabus.set_function("broad_channel", [](lua_State* L, codec_base* codec) { return socket_mgr.broad_channel(L, codec); });
+        lluabus.set_function("send_stats", [](lua_State* L) { return socket_mgr.send_stats(L); });
+        lluabus.set_function("watch_event", [](int fd) { return socket_mgr.watch_event(fd); });
         lluabus.set_function("set_service_name", [](uint32_t service_id, std::string service_name) { return socket_mgr.set_service_name(service_id,service_name); });
         lluabus.set_function("set_player_service", [](uint32_t player_id, uint32_t sid, uint8_t login) { return socket_mgr.set_player_service(player_id, sid,login); });
         lluabus.set_function("find_player_sid", [](uint32_t player_id, uint16_t service_id) { return socket_mgr.find_player_sid(player_id, service_id); });
@@ -112,6 +118,7 @@ namespace luabus {
             "set_codec", &lua_socket_node::set_codec,
             "set_flow_ctrl",&lua_socket_node::set_flow_ctrl,
             "can_send",&lua_socket_node::can_send,
+            "set_method_intern",&lua_socket_node::set_method_intern,
             "is_command_cd",&lua_socket_node::is_command_cd
             );
         return lluabus;
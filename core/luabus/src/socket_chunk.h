@@ -0,0 +1,51 @@
+﻿#pragma once
+#include <new>
+#include <atomic>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+// 引用计数的只读发送块
+// 广播时只拷贝一次,由多个连接的发送队列共享
+class shared_chunk
+{
+public:
+	template <typename T>
+	static shared_chunk* create(const T items[], int count) {
+		size_t len = 0;
+		for (int i = 0; i < count; i++) {
+			len += items[i].len;
+		}
+		auto chunk = (shared_chunk*)malloc(sizeof(shared_chunk) + len);
+		if (chunk == nullptr) {
+			return nullptr;
+		}
+		new (chunk) shared_chunk(len);
+		uint8_t* data = chunk->data();
+		for (int i = 0; i < count; i++) {
+			memcpy(data, items[i].data, items[i].len);
+			data += items[i].len;
+		}
+		return chunk;
+	}
+
+	void retain() {
+		m_ref.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	void release() {
+		if (m_ref.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			this->~shared_chunk();
+			free(this);
+		}
+	}
+
+	size_t size() { return m_len; }
+	uint8_t* data() { return (uint8_t*)(this + 1); }
+
+private:
+	shared_chunk(size_t len) : m_len(len) {}
+
+	std::atomic<uint32_t> m_ref = 1;
+	size_t m_len = 0;
+};
@@ -11,6 +11,7 @@ constexpr int SOCKET_RECV_LEN		= 16*1024;
 constexpr int IO_BUFFER_SEND		= 8*1024;
 constexpr int SOCKET_PACKET_MAX		= 1024 * 1024 * 16; //16m
 constexpr int GROUP_PLAYER_MAX		= 1000;
+constexpr int FLOW_CTRL_CHECK_TIME	= 2000; //限流检测间隔(ms)
 
 #if defined(__linux) || defined(__APPLE__)
 #include <errno.h>
@@ -52,6 +53,39 @@ bool wsa_send_empty(socket_t fd, WSAOVERLAPPED& ovl);
 bool wsa_recv_empty(socket_t fd, WSAOVERLAPPED& ovl);
 #endif
 
+//聚合发送
+constexpr int SEND_IOV_MAX			= 64;
+#if defined(__linux) || defined(__APPLE__)
+#include <sys/uio.h>
+using send_iov = iovec;
+inline void set_send_iov(send_iov& iov, const void* data, size_t len) {
+	iov.iov_base = (void*)data;
+	iov.iov_len = len;
+}
+inline int send_iovs(socket_t fd, send_iov iovs[], int count, int flags) {
+	msghdr msg;
+	memset(&msg, 0, sizeof(msg));
+	msg.msg_iov = iovs;
+	msg.msg_iovlen = count;
+	return (int)sendmsg(fd, &msg, flags);
+}
+#endif
+
+#ifdef _MSC_VER
+using send_iov = WSABUF;
+inline void set_send_iov(send_iov& iov, const void* data, size_t len) {
+	iov.buf = (char*)data;
+	iov.len = (ULONG)len;
+}
+inline int send_iovs(socket_t fd, send_iov iovs[], int count, int flags) {
+	DWORD bytes = 0;
+	if (WSASend(fd, iovs, count, &bytes, (DWORD)flags, nullptr, nullptr) == SOCKET_ERROR) {
+		return SOCKET_ERROR;
+	}
+	return (int)bytes;
+}
+#endif
+
 template <typename T>
 using stdsptr = std::shared_ptr<T>;
 
@@ -64,6 +64,8 @@ bool socket_listener::update(int64_t, bool check_timeout) {
 			}
 		}
 	}
+	//iocp需要持续投递accept
+	m_mgr->set_active(this);
 #endif
 
 	if (m_link_status == elink_status::link_closed) {
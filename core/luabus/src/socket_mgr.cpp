@@ -3,12 +3,36 @@
 #include "socket_mgr.h"
 #include "socket_stream.h"
 #include "socket_listener.h"
+#include "socket_shard.h"
 #include "fmt/core.h"
 
 #ifdef _MSC_VER
 #pragma comment(lib, "Ws2_32.lib")
 #endif
 
+#ifdef __linux
+#include <sys/eventfd.h>
+
+struct socket_event : public socket_object
+{
+	socket_event(socket_mgr* mgr, int fd) : m_mgr(mgr), m_fd(fd) {}
+	bool update(int64_t now, bool check_timeout) override { return m_link_status != elink_status::link_closed; }
+	bool get_remote_ip(std::string& ip) override { return false; }
+	void close() override {
+		if (m_link_status != elink_status::link_closed) {
+			m_mgr->unwatch(m_fd);
+			m_link_status = elink_status::link_closed;
+		}
+	}
+	void on_can_recv(size_t data_len, bool is_eof) override {
+		uint64_t value = 0;
+		[[maybe_unused]] auto ret = ::read(m_fd, &value, sizeof(value));
+	}
+	socket_mgr* m_mgr = nullptr;
+	int m_fd = -1;
+};
+#endif
+
 socket_mgr::socket_mgr() {
 #ifdef _MSC_VER
 	WORD    wVersion = MAKEWORD(2, 2);
@@ -18,6 +42,24 @@ socket_mgr::socket_mgr() {
 }
 
 socket_mgr::~socket_mgr() {
+#ifdef __linux
+	//先停止io线程
+	for (auto shard : m_shards) {
+		delete shard;
+	}
+	m_shards.clear();
+	if (m_shard_msgs) {
+		while (auto msg = m_shard_msgs->pop()) {
+			msg->release();
+		}
+		delete m_shard_msgs;
+		m_shard_msgs = nullptr;
+	}
+	if (m_shard_event != -1) {
+		::close(m_shard_event);
+		m_shard_event = -1;
+	}
+#endif
 	for (auto& node : m_objects) {
 		delete node.second;
 	}
@@ -68,9 +110,89 @@ bool socket_mgr::setup(uint32_t max_connection) {
 #endif
 	m_max_count = max_connection;
 	m_events.resize(max_connection);
+	m_wheel.setup(steady_ms());
 	return true;
 }
 
+bool socket_mgr::setup_shards(int count) {
+#ifdef __linux
+	if (count <= 0 || !m_shards.empty())
+		return false;
+	m_shard_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_shard_event == -1)
+		return false;
+	epoll_event ev;
+	ev.data.ptr = nullptr;
+	ev.events = EPOLLIN;
+	if (epoll_ctl(m_handle, EPOLL_CTL_ADD, m_shard_event, &ev) != 0)
+		return false;
+	m_shard_msgs = new mpsc_queue<shard_msg>();
+	for (int i = 0; i < count; i++) {
+		auto shard = new socket_shard(this, i);
+		m_shards.push_back(shard);
+		if (!shard->setup())
+			return false;
+	}
+	return true;
+#else
+	return false;
+#endif
+}
+
+uint32_t socket_mgr::watch_event(int fd) {
+#ifdef __linux
+	if (fd < 0)
+		return 0;
+	auto object = new socket_event(this, fd);
+	epoll_event ev;
+	ev.data.ptr = object;
+	ev.events = EPOLLIN;
+	if (epoll_ctl(m_handle, EPOLL_CTL_ADD, fd, &ev) != 0) {
+		delete object;
+		return 0;
+	}
+	return add_object(object);
+#else
+	return 0;
+#endif
+}
+
+void socket_mgr::post_shard_msg(shard_msg* msg) {
+#ifdef __linux
+	m_shard_msgs->push(msg);
+#endif
+}
+
+void socket_mgr::wake_shards() {
+#ifdef __linux
+	if (!m_shard_notified.exchange(true)) {
+		uint64_t value = 1;
+		[[maybe_unused]] auto ret = ::write(m_shard_event, &value, sizeof(value));
+	}
+#endif
+}
+
+//处理io线程上报的消息
+void socket_mgr::dispatch_shards(int64_t now) {
+#ifdef __linux
+	m_shard_pending = false;
+	m_shard_notified = false;
+	size_t count = 0;
+	while (auto msg = m_shard_msgs->pop()) {
+		auto object = (socket_shard_stream*)get_object(msg->token);
+		if (object) {
+			object->on_shard_msg(msg);
+		}
+		msg->release();
+		// 防止单帧处理太久,剩余消息下一帧继续
+		if ((++count & 0xff) == 0 && steady_ms() - now > 10) {
+			m_shard_pending = true;
+			break;
+		}
+	}
+#endif
+}
+
 #ifdef _MSC_VER
 bool socket_mgr::get_socket_funcs() {
 	bool result = false;
@@ -108,18 +230,33 @@ Exit0:
 #endif
 
 int socket_mgr::wait(int64_t now, int timeout) {
-	bool check_timeout = (now - m_last_check_time) > 2000;
-	m_last_check_time = check_timeout ? now : m_last_check_time;
-	auto it = m_objects.begin(), end = m_objects.end();
-	while (it != end) {
-		socket_object* object = it->second;
-		if (!object->update(now,check_timeout)) {
-			it = m_objects.erase(it);
-			delete object;
-			continue;
+	//时间轮到期检测
+	m_wheel.update(now, m_expires);
+	for (auto& node : m_expires) {
+		socket_object* object = get_object(node.token);
+		if (object && object->m_check_tick == node.expire) {
+			object->m_check_tick = 0;
+			update_object(object, now, true);
+		}
+	}
+	//活跃对象更新
+	m_updates.swap(m_actives);
+	for (auto token : m_updates) {
+		socket_object* object = get_object(token);
+		if (object && object->m_active) {
+			object->m_active = false;
+			update_object(object, now, false);
 		}
-		++it;
 	}
+	m_updates.clear();
+#ifdef __linux
+	for (auto shard : m_shards) {
+		shard->notify();
+	}
+	if (m_shard_pending) {
+		timeout = 0;
+	}
+#endif
 	int escape = steady_ms() - now;
 	timeout = escape >= timeout ? 0 : timeout - escape;
 #ifdef _MSC_VER
@@ -139,9 +276,21 @@ int socket_mgr::wait(int64_t now, int timeout) {
 	for (int i = 0; i < event_count; i++) {
 		epoll_event& ev = m_events[i];
 		auto object = (socket_object*)ev.data.ptr;
+		if (object == nullptr) {
+			uint64_t value = 0;
+			[[maybe_unused]] auto ret = ::read(m_shard_event, &value, sizeof(value));
+			continue;
+		}
 		if (ev.events & EPOLLIN) object->on_can_recv();
 		if (ev.events & EPOLLOUT) object->on_can_send();
 	}
+	if (!m_shards.empty()) {
+		dispatch_shards(now);
+		//本帧新accept的连接
+		for (auto shard : m_shards) {
+			shard->notify();
+		}
+	}
 #endif
 
 #ifdef __APPLE__
@@ -192,9 +341,7 @@ uint32_t socket_mgr::listen(std::string& err, const char ip[], int port, eproto_
 	if (ret == SOCKET_ERROR) goto Exit0;
 
 	if (watch_listen(fd, listener) && listener->setup(fd)) {
-		auto token = new_token();
-		m_objects[token] = listener;
-		return token;
+		return add_object(listener);
 	}
 
 Exit0:
@@ -222,10 +369,7 @@ uint32_t socket_mgr::connect(std::string& err, const char node_name[], const cha
 #endif
 
 	stm->connect(node_name, service_name, timeout);
-
-	auto token = new_token();
-	m_objects[token] = stm;
-	return token;
+	return add_object(stm);
 }
 
 void socket_mgr::set_timeout(uint32_t token, int duration) {
@@ -273,22 +417,108 @@ int socket_mgr::sendv(uint32_t token, const sendv_item items[], int count) {
 	return 0;
 }
 
-void socket_mgr::broadgroup(std::vector<uint32_t>& groups, const void* data, size_t data_len) {
-	for (auto token : groups) {
-		send(token, data, data_len);
+int socket_mgr::send_chunk(uint32_t token, shared_chunk* chunk) {
+	auto node = get_object(token);
+	if (node) {
+		return node->send_chunk(chunk);
 	}
+	return 0;
+}
+
+void socket_mgr::broadgroup(std::vector<uint32_t>& groups, const void* data, size_t data_len) {
+	sendv_item items[] = { {data, data_len} };
+	broadgroupv(groups, items, _countof(items));
 }
 
 void socket_mgr::broadgroupv(std::vector<uint32_t>& groups, const sendv_item items[], int count) {
+	if (groups.empty()) return;
+	//只拷贝一次,所有连接共享
+	auto chunk = shared_chunk::create(items, count);
+	if (chunk == nullptr) return;
 	for (auto token : groups) {
-		sendv(token, items, count);
+		send_chunk(token, chunk);
+	}
+	chunk->release();
+}
+
+bool socket_mgr::subscribe(const std::string& channel, uint32_t token) {
+	auto object = get_object(token);
+	if (object == nullptr || object->link_status() == elink_status::link_closed) {
+		return false;
+	}
+	auto& chan = m_channels[channel];
+	if (!chan.indexes.emplace(token, (uint32_t)chan.objects.size()).second) {
+		return false;
+	}
+	chan.objects.push_back(object);
+	object->m_channels.push_back(channel);
+	return true;
+}
+
+bool socket_mgr::unsubscribe(const std::string& channel, uint32_t token) {
+	auto object = get_object(token);
+	if (object == nullptr) {
+		return false;
+	}
+	auto& names = object->m_channels;
+	auto it = std::find(names.begin(), names.end(), channel);
+	if (it == names.end()) {
+		return false;
+	}
+	names.erase(it);
+	leave_channel(channel, object);
+	return true;
+}
+
+void socket_mgr::leave_channel(const std::string& channel, socket_object* object) {
+	auto it = m_channels.find(channel);
+	if (it == m_channels.end()) {
+		return;
+	}
+	auto& chan = it->second;
+	auto iter = chan.indexes.find(object->m_token);
+	if (iter != chan.indexes.end()) {
+		uint32_t index = iter->second;
+		auto last = chan.objects.back();
+		chan.objects[index] = last;
+		chan.indexes[last->m_token] = index;
+		chan.objects.pop_back();
+		chan.indexes.erase(object->m_token);
+	}
+	if (chan.objects.empty()) {
+		m_channels.erase(it);
+	}
+}
+
+int socket_mgr::broad_channel(const std::string& channel, const sendv_item items[], int count) {
+	auto it = m_channels.find(channel);
+	if (it == m_channels.end()) {
+		return 0;
+	}
+	//只拷贝一次,所有订阅者共享
+	auto chunk = shared_chunk::create(items, count);
+	if (chunk == nullptr) {
+		return 0;
+	}
+	//发送出错会回调lua, 期间可能退订, 先复制订阅者列表
+	std::vector<socket_object*> objects = it->second.objects;
+	for (auto object : objects) {
+		object->send_chunk(chunk);
 	}
+	chunk->release();
+	return (int)objects.size();
+}
+
+size_t socket_mgr::channel_size(const std::string& channel) {
+	auto it = m_channels.find(channel);
+	return it == m_channels.end() ? 0 : it->second.objects.size();
 }
 
 void socket_mgr::close(uint32_t token) {
 	auto node = get_object(token);
 	if (node) {
 		node->close();
+		set_active(node);
 	}
 }
 
@@ -453,19 +683,55 @@ void socket_mgr::unwatch(socket_t fd) {
 }
 
 int socket_mgr::accept_stream(socket_t fd, const char ip[], const std::function<void(int, eproto_type)>& cb, eproto_type proto_type) {
+#ifdef __linux
+	//rpc/pb连接交给io线程
+	if (!m_shards.empty() && (proto_type == eproto_type::proto_rpc || proto_type == eproto_type::proto_pb)) {
+		auto shard = m_shards[m_shard_index++ % m_shards.size()];
+		auto* stm = new socket_shard_stream(this, shard, proto_type, fd, ip);
+		auto token = add_object(stm);
+		auto verify = (proto_type == eproto_type::proto_rpc) ? m_handshake_verify : "";
+		auto msg = shard_msg::create(shard_msg_type::accept, token, verify.size());
+		memcpy(msg->data(), verify.c_str(), verify.size());
+		msg->param1 = fd;
+		msg->param2 = (int64_t)proto_type;
+		msg->pending = stm->pending();
+		shard->post(msg);
+		cb(token, proto_type);
+		return token;
+	}
+#endif
 	auto* stm = new socket_stream(this, proto_type, elink_type::elink_tcp_accept);
 	if (proto_type == eproto_type::proto_rpc) {
 		stm->set_handshake(false);
 	}
 	if (watch_accepted(fd, stm) && stm->accept_socket(fd, ip)) {
-		auto token = new_token();
-		m_objects[token] = stm;
+		auto token = add_object(stm);
 		cb(token, proto_type);
 		return token;
 	}
 	delete stm;
 	return 0;
 }
+uint64_t socket_mgr::send_calls() {
+	uint64_t calls = m_send_calls;
+#ifdef __linux
+	for (auto shard : m_shards) {
+		calls += shard->send_calls();
+	}
+#endif
+	return calls;
+}
+
+uint64_t socket_mgr::send_bytes() {
+	uint64_t bytes = m_send_bytes;
+#ifdef __linux
+	for (auto shard : m_shards) {
+		bytes += shard->send_bytes();
+	}
+#endif
+	return bytes;
+}
+
 socket_object* socket_mgr::get_object(int token) {
 	auto it = m_objects.find(token);
 	if (it != m_objects.end()) {
@@ -479,4 +745,35 @@ uint32_t socket_mgr::new_token() {
 		// nothing ...
 	}
 	return m_next_token;
-}
\ No newline at end of file
+}
+
+uint32_t socket_mgr::add_object(socket_object* object) {
+	auto token = new_token();
+	object->m_token = token;
+	m_objects[token] = object;
+	set_active(object);
+	return token;
+}
+
+void socket_mgr::update_object(socket_object* object, int64_t now, bool check_timeout) {
+	if (!object->update(now, check_timeout)) {
+		for (auto& channel : object->m_channels) {
+			leave_channel(channel, object);
+		}
+		m_objects.erase(object->m_token);
+		delete object;
+	}
+}
+
+void socket_mgr::set_active(socket_object* object) {
+	if (!object->m_active && object->m_token != 0) {
+		object->m_active = true;
+		m_actives.push_back(object->m_token);
+	}
+}
+
+void socket_mgr::set_check_time(socket_object* object, int64_t check_time) {
+	if (object->m_token != 0) {
+		object->m_check_tick = m_wheel.insert(object->m_token, check_time);
+	}
+}
@@ -5,9 +5,13 @@
 #include <thread>
 #include <mutex>
 #include <limits.h>
+#include <algorithm>
 #include <functional>
 #include <unordered_map>
 #include "socket_helper.h"
+#include "socket_wheel.h"
+#include "socket_chunk.h"
+#include "socket_queue.h"
 
 using namespace luakit;
 
@@ -53,6 +57,7 @@ struct socket_object
 	virtual void set_flow_ctrl(int ctrl_package, int ctrl_bytes){ }
 	virtual int  send(const void* data, size_t data_len) { return 0; }
 	virtual int  sendv(const sendv_item items[], int count) { return 0; };
+	virtual int  send_chunk(shared_chunk* chunk) { return send(chunk->data(), chunk->size()); }
 	virtual void set_codec(codec_base* codec) { m_codec = codec; }
 	virtual void set_accept_callback(const std::function<void(int, eproto_type)>& cb) { }
 	virtual void set_connect_callback(const std::function<void(bool, const char*)>& cb) { }
@@ -69,6 +74,12 @@ struct socket_object
 #endif
 	elink_status link_status() { return m_link_status; };
 	void set_handshake(bool status) { m_handshake = status; };
+
+	//socket_mgr调度状态
+	uint32_t m_token = 0;
+	bool     m_active = false;		//是否在活跃队列
+	uint64_t m_check_tick = 0;		//时间轮检测tick
+	std::vector<std::string> m_channels;	//订阅的广播频道
 protected:
 	codec_base* m_codec = nullptr;
 	eproto_type m_proto_type = eproto_type::proto_rpc;
@@ -76,6 +87,15 @@ protected:
 	bool         m_handshake = true; //握手状态
 };
 
+//广播频道: 订阅者数组+下标索引, 退订时和末尾交换
+struct socket_channel
+{
+	std::vector<socket_object*> objects;
+	std::unordered_map<uint32_t, uint32_t> indexes;
+};
+
+struct shard_msg;
+class socket_shard;
 class socket_mgr
 {
 public:
@@ -83,6 +103,10 @@ public:
 	~socket_mgr();
 
 	bool setup(uint32_t max_connection);
+	//开启io线程, accept的rpc/pb连接收发由io线程完成(仅linux)
+	bool setup_shards(int count);
+	//监听外部eventfd(如线程邮箱),可读时唤醒wait
+	uint32_t watch_event(int fd);
 
 #ifdef _MSC_VER
 	bool get_socket_funcs();
@@ -99,8 +123,14 @@ public:
 	bool can_send(uint32_t token);
 	int  send(uint32_t token, const void* data, size_t data_len);
 	int  sendv(uint32_t token, const sendv_item items[], int count);
+	int  send_chunk(uint32_t token, shared_chunk* chunk);
 	void broadgroup(std::vector<uint32_t>& groups, const void* data, size_t data_len);
 	void broadgroupv(std::vector<uint32_t>& groups, const sendv_item items[], int count);
+	//广播频道, 连接关闭时自动退订
+	bool subscribe(const std::string& channel, uint32_t token);
+	bool unsubscribe(const std::string& channel, uint32_t token);
+	int  broad_channel(const std::string& channel, const sendv_item items[], int count);
+	size_t channel_size(const std::string& channel);
 	void close(uint32_t token);
 	void set_codec(uint32_t token, codec_base* codec);
 	bool get_remote_ip(uint32_t token, std::string& ip);
@@ -124,10 +154,29 @@ public:
 	socket_object* get_object(int token);
 	uint32_t new_token();
 
+	//加入活跃队列,下一帧update
+	void set_active(socket_object* object);
+	//加入时间轮,到期后检测(超时/限流/连接)
+	void set_check_time(socket_object* object, int64_t check_time);
+
+	//发送统计: 系统调用次数和字节数
+	void count_send(size_t send_len) { m_send_calls++; m_send_bytes += send_len; }
+	uint64_t send_calls();
+	uint64_t send_bytes();
+
+	//io线程调用: 投递消息并唤醒lua线程
+	void post_shard_msg(shard_msg* msg);
+	void wake_shards();
+
 	const std::string& get_handshake_verify() { return m_handshake_verify; }
 	void set_handshake_verify(const std::string& verify) { m_handshake_verify = verify; }
 
 private:
+	uint32_t add_object(socket_object* object);
+	void update_object(socket_object* object, int64_t now, bool check_timeout);
+	void leave_channel(const std::string& channel, socket_object* object);
+	void dispatch_shards(int64_t now);
+
 #ifdef _MSC_VER
 	LPFN_ACCEPTEX m_accept_func = nullptr;
 	LPFN_CONNECTEX m_connect_func = nullptr;
@@ -139,6 +188,13 @@ private:
 #ifdef __linux
 	int m_handle = -1;
 	std::vector<epoll_event> m_events;
+	//io线程
+	int m_shard_event = -1;
+	uint32_t m_shard_index = 0;
+	bool m_shard_pending = false;
+	std::atomic<bool> m_shard_notified = false;
+	std::vector<socket_shard*> m_shards;
+	mpsc_queue<shard_msg>* m_shard_msgs = nullptr;
 #endif
 
 #ifdef __APPLE__
@@ -148,8 +204,14 @@ private:
 
 	int m_max_count = 0;
 	int m_count = 0;
+	uint64_t m_send_calls = 0;
+	uint64_t m_send_bytes = 0;
 	uint32_t m_next_token = 0;
-	int64_t  m_last_check_time = 0;
 	std::unordered_map<uint32_t, socket_object*> m_objects;
+	std::unordered_map<std::string, socket_channel> m_channels;
+	std::vector<uint32_t> m_actives;
+	std::vector<uint32_t> m_updates;
+	socket_wheel m_wheel;
+	wheel_list m_expires;
 	std::string m_handshake_verify = "CLBY20220816CLBY&*^%$#@!";
 };
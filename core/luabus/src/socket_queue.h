@@ -0,0 +1,54 @@
+﻿#pragma once
+#include <atomic>
+
+// 无锁多生产者单消费者队列(侵入式,Vyukov)
+// 节点类型T需要包含成员: std::atomic<T*> next
+template <typename T>
+class mpsc_queue
+{
+public:
+	mpsc_queue() : m_head(&m_stub), m_tail(&m_stub) {}
+
+	// 任意线程调用
+	void push(T* node) {
+		node->next.store(nullptr, std::memory_order_relaxed);
+		T* prev = m_head.exchange(node, std::memory_order_acq_rel);
+		prev->next.store(node, std::memory_order_release);
+	}
+
+	// 仅消费线程调用, 队列为空或生产者尚未完成链接时返回nullptr
+	T* pop() {
+		T* tail = m_tail;
+		T* next = tail->next.load(std::memory_order_acquire);
+		if (tail == &m_stub) {
+			if (next == nullptr) return nullptr;
+			m_tail = next;
+			tail = next;
+			next = next->next.load(std::memory_order_acquire);
+		}
+		if (next) {
+			m_tail = next;
+			return tail;
+		}
+		if (tail != m_head.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+		push(&m_stub);
+		next = tail->next.load(std::memory_order_acquire);
+		if (next) {
+			m_tail = next;
+			return tail;
+		}
+		return nullptr;
+	}
+
+	// 仅消费线程调用
+	bool empty() {
+		return m_tail == &m_stub && m_stub.next.load(std::memory_order_acquire) == nullptr;
+	}
+
+private:
+	std::atomic<T*> m_head;
+	T* m_tail;
+	T m_stub;
+};
@@ -179,14 +179,20 @@ bool socket_router::do_forward_group_player(router_header* header, char* data, s
 	header->msg_id = (uint8_t)rpc_type::remote_call;
 	header->len = data_len + ROUTER_HEAD_SIZE;
 	auto& services = m_services[service_id];
+	shared_chunk* chunk = nullptr;
 	for (auto target_id : m_target_ids) {
 		auto pTarget = services.get_target(target_id);
-		if (pTarget != nullptr) {			
-			sendv_item items[] = { {header, sizeof(router_header)}, {data, data_len} };
-			m_mgr->sendv(pTarget->token, items, _countof(items));
+		if (pTarget != nullptr) {
+			if (chunk == nullptr) {
+				sendv_item items[] = { {header, sizeof(router_header)}, {data, data_len} };
+				chunk = shared_chunk::create(items, _countof(items));
+				if (chunk == nullptr) return false;
+			}
+			m_mgr->send_chunk(pTarget->token, chunk);
 			services.flow_inc(sizeof(router_header) + data_len);
 		}
 	}
+	if (chunk) chunk->release();
 	return true;
 }
 
@@ -216,15 +222,21 @@ bool socket_router::do_forward_broadcast(router_header* header, int source, char
 
 	header->msg_id = (uint8_t)rpc_type::remote_call;
 	sendv_item items[] = { {header, sizeof(router_header)}, {data, data_len} };
-
+	//所有目标共享同一份数据
+	shared_chunk* chunk = nullptr;
 	auto& group = m_services[service_id];
 	for (auto& [id,target] : group.mp_nodes) {
 		if (target->token != 0 && target->token != source) {
-			m_mgr->sendv(target->token, items, _countof(items));
+			if (chunk == nullptr) {
+				chunk = shared_chunk::create(items, _countof(items));
+				if (chunk == nullptr) return false;
+			}
+			m_mgr->send_chunk(target->token, chunk);
 			broadcast_num++;
 			group.flow_inc(sizeof(router_header) + data_len);
 		}
 	}
+	if (chunk) chunk->release();
 	return true;
 }
 
@@ -58,6 +58,13 @@ struct router_header {
 #pragma pack()
 constexpr size_t ROUTER_HEAD_SIZE = sizeof(router_header);
 
+//rpc方法编号: 直连的rpc按方法名首次出现的顺序编号, 之后只发送编号
+//包体前缀为varint(id << 1 | define), define时紧跟uint8长度和方法名, 转发的rpc仍然发送方法名
+constexpr uint8_t  RPC_FLAG_METHOD	= 0x80;
+constexpr uint32_t RPC_METHOD_MAX	= 4096;
+constexpr size_t   RPC_METHOD_NAME	= 40;	//lua短字符串上限, 短字符串全局唯一, 可以按地址查找
+constexpr size_t   RPC_METHOD_HEAD	= 8 + RPC_METHOD_NAME;
+
 struct service_list {
 	uint16_t hash = 0;
 	stdsptr<service_node> master = nullptr;
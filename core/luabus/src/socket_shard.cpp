@@ -0,0 +1,564 @@
+﻿#include "stdafx.h"
+#ifdef __linux
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include "fmt/core.h"
+#include "socket_shard.h"
+#include "socket_router.h"
+
+constexpr int SHARD_WAIT_MS		= 100;
+constexpr int SHARD_MAX_EVENTS	= 1024;
+constexpr size_t PB_HEAD_SIZE	= 12;	//与luapb的pb_header保持一致
+constexpr size_t PB_HEAD_EXT	= 16;	//扩展包长: 包头len为0xffff时后跟uint32的实际包长
+constexpr size_t PB_PACKET_MAX	= 4 * 1024 * 1024;
+
+shard_msg* shard_msg::create(shard_msg_type type, uint32_t token, size_t len) {
+	auto msg = (shard_msg*)malloc(sizeof(shard_msg) + len);
+	new (msg) shard_msg();
+	msg->type = type;
+	msg->token = token;
+	msg->len = len;
+	return msg;
+}
+
+shard_msg* shard_msg::create(shard_msg_type type, uint32_t token, const sendv_item items[], int count) {
+	size_t len = 0;
+	for (int i = 0; i < count; i++) {
+		len += items[i].len;
+	}
+	auto msg = create(type, token, len);
+	uint8_t* data = msg->data();
+	for (int i = 0; i < count; i++) {
+		memcpy(data, items[i].data, items[i].len);
+		data += items[i].len;
+	}
+	return msg;
+}
+
+shard_msg* shard_msg::create(shard_msg_type type, uint32_t token, shared_chunk* chunk) {
+	auto msg = create(type, token);
+	chunk->retain();
+	msg->chunk = chunk;
+	msg->len = chunk->size();
+	return msg;
+}
+
+void shard_msg::release() {
+	if (chunk) {
+		chunk->release();
+		chunk = nullptr;
+	}
+	this->~shard_msg();
+	free(this);
+}
+
+socket_shard::~socket_shard() {
+	stop();
+	for (auto& [token, conn] : m_conns) {
+		closesocket(conn->fd);
+		for (auto msg : conn->send_queue) {
+			msg->release();
+		}
+		delete conn;
+	}
+	m_conns.clear();
+	while (auto msg = m_inbox.pop()) {
+		msg->release();
+	}
+	if (m_event != -1) {
+		::close(m_event);
+		m_event = -1;
+	}
+	if (m_handle != -1) {
+		::close(m_handle);
+		m_handle = -1;
+	}
+}
+
+bool socket_shard::setup() {
+	m_handle = epoll_create(SHARD_MAX_EVENTS);
+	if (m_handle == -1) {
+		return false;
+	}
+	m_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (m_event == -1) {
+		return false;
+	}
+	epoll_event ev;
+	ev.data.ptr = nullptr;
+	ev.events = EPOLLIN;
+	if (epoll_ctl(m_handle, EPOLL_CTL_ADD, m_event, &ev) != 0) {
+		return false;
+	}
+	m_events.resize(SHARD_MAX_EVENTS);
+	m_running = true;
+	m_thread = std::thread(&socket_shard::run, this);
+	return true;
+}
+
+void socket_shard::stop() {
+	if (m_running.exchange(false)) {
+		m_posted = true;
+		notify();
+		if (m_thread.joinable()) {
+			m_thread.join();
+		}
+	}
+}
+
+void socket_shard::post(shard_msg* msg) {
+	m_inbox.push(msg);
+	m_posted = true;
+}
+
+void socket_shard::notify() {
+	if (m_posted) {
+		m_posted = false;
+		uint64_t value = 1;
+		[[maybe_unused]] auto ret = ::write(m_event, &value, sizeof(value));
+	}
+}
+
+void socket_shard::run() {
+	std::vector<shard_conn*> dirtys;
+	while (m_running) {
+		int count = epoll_wait(m_handle, &m_events[0], (int)m_events.size(), SHARD_WAIT_MS);
+		for (int i = 0; i < count; i++) {
+			epoll_event& ev = m_events[i];
+			if (ev.data.ptr == nullptr) {
+				uint64_t value = 0;
+				[[maybe_unused]] auto ret = ::read(m_event, &value, sizeof(value));
+				continue;
+			}
+			auto conn = (shard_conn*)ev.data.ptr;
+			if ((ev.events & EPOLLIN) && conn->fd != INVALID_SOCKET) do_recv(conn);
+			if ((ev.events & EPOLLOUT) && conn->fd != INVALID_SOCKET) do_send(conn);
+		}
+		//处理lua线程投递的消息,同一连接的发送合并到一次writev
+		while (auto msg = m_inbox.pop()) {
+			auto it = m_conns.find(msg->token);
+			shard_conn* conn = (it != m_conns.end()) ? it->second : nullptr;
+			if (conn && conn->fd != INVALID_SOCKET && (msg->type == shard_msg_type::send || msg->type == shard_msg_type::chunk)) {
+				if (conn->send_queue.empty()) dirtys.push_back(conn);
+				conn->send_queue.push_back(msg);
+				continue;
+			}
+			on_message(msg);
+		}
+		for (auto conn : dirtys) {
+			if (conn->fd != INVALID_SOCKET) do_send(conn);
+		}
+		dirtys.clear();
+		auto now = steady_ms();
+		if (now - m_last_check_time >= 1000) {
+			m_last_check_time = now;
+			check_timeout(now);
+		}
+		//释放本轮关闭的连接
+		for (auto it = m_conns.begin(); it != m_conns.end();) {
+			if (it->second->fd == INVALID_SOCKET) {
+				delete it->second;
+				it = m_conns.erase(it);
+				continue;
+			}
+			++it;
+		}
+		if (m_reported) {
+			m_reported = false;
+			m_mgr->wake_shards();
+		}
+	}
+}
+
+void socket_shard::on_message(shard_msg* msg) {
+	auto it = m_conns.find(msg->token);
+	shard_conn* conn = (it != m_conns.end()) ? it->second : nullptr;
+	switch (msg->type) {
+	case shard_msg_type::accept:
+		on_accept(msg);
+		break;
+	case shard_msg_type::close:
+		if (conn == nullptr || conn->fd == INVALID_SOCKET) {
+			report(shard_msg::create(shard_msg_type::closed, msg->token));
+			break;
+		}
+		if (msg->param1) {
+			close_conn(conn);
+			report(shard_msg::create(shard_msg_type::closed, msg->token));
+			break;
+		}
+		//等待发送缓冲清空
+		conn->closing = true;
+		shutdown(conn->fd, SD_RECEIVE);
+		do_send(conn);
+		break;
+	case shard_msg_type::timeout:
+		if (conn) conn->timeout = (int)msg->param1;
+		break;
+	case shard_msg_type::flow_ctrl:
+		if (conn) {
+			conn->fc_ctrl_package = msg->param1;
+			conn->fc_ctrl_bytes = msg->param2;
+			conn->last_fc_time = steady_ms();
+		}
+		break;
+	case shard_msg_type::nodelay:
+		if (conn && conn->fd != INVALID_SOCKET) set_no_delay(conn->fd, (int)msg->param1);
+		break;
+	default:
+		break;
+	}
+	msg->release();
+}
+
+void socket_shard::on_accept(shard_msg* msg) {
+	auto conn = new shard_conn();
+	conn->fd = (socket_t)msg->param1;
+	conn->token = msg->token;
+	conn->proto_type = (eproto_type)msg->param2;
+	conn->pending = msg->pending;
+	conn->verify.assign((const char*)msg->data(), msg->len);
+	conn->handshake = conn->verify.empty();
+	conn->last_recv_time = steady_ms();
+	epoll_event ev;
+	ev.data.ptr = conn;
+	ev.events = EPOLLIN | EPOLLOUT | EPOLLET;
+	if (epoll_ctl(m_handle, EPOLL_CTL_ADD, conn->fd, &ev) != 0) {
+		closesocket(conn->fd);
+		delete conn;
+		report(shard_msg::create(shard_msg_type::closed, msg->token));
+		return;
+	}
+	m_conns[conn->token] = conn;
+	do_recv(conn);
+}
+
+void socket_shard::do_recv(shard_conn* conn) {
+	while (conn->fd != INVALID_SOCKET && !conn->closing) {
+		auto* space = conn->recv_buffer.peek_space(SOCKET_RECV_LEN);
+		if (space == nullptr) {
+			on_error(conn, fmt::format("do-recv-buffer-full:{}", conn->recv_buffer.size()));
+			return;
+		}
+		int recv_len = recv(conn->fd, (char*)space, SOCKET_RECV_LEN, 0);
+		if (recv_len < 0) {
+			int err = get_socket_error();
+			if (err == EINTR)
+				continue;
+			if (err == EAGAIN)
+				break;
+			on_error(conn, fmt::format("do-recv-failed:{}", err));
+			return;
+		}
+		if (recv_len == 0) {
+			on_error(conn, "connection-lost-recv-0");
+			return;
+		}
+		conn->recv_buffer.pop_space(recv_len);
+		if (!dispatch_package(conn)) {
+			return;
+		}
+	}
+}
+
+int socket_shard::load_packet(shard_conn* conn, uint8_t* data, size_t data_len) {
+	size_t package_size = 0;
+	if (conn->proto_type == eproto_type::proto_rpc) {
+		if (data_len < ROUTER_HEAD_SIZE) return 0;
+		package_size = ((router_header*)data)->len;
+		if (package_size < ROUTER_HEAD_SIZE) return -1;
+	} else {
+		if (data_len < PB_HEAD_SIZE) return 0;
+		package_size = *(uint16_t*)data;
+		if (package_size == 0xffff) {
+			if (data_len < PB_HEAD_EXT) return 0;
+			package_size = *(uint32_t*)(data + PB_HEAD_SIZE);
+			if (package_size < PB_HEAD_EXT || package_size > PB_PACKET_MAX) return -1;
+		}
+		if (package_size < PB_HEAD_SIZE) return -1;
+	}
+	return data_len < package_size ? 0 : (int)package_size;
+}
+
+bool socket_shard::dispatch_package(shard_conn* conn) {
+	while (true) {
+		size_t data_len = 0;
+		auto* data = conn->recv_buffer.data(&data_len);
+		if (data_len == 0) break;
+		// 检测握手
+		if (!conn->handshake) {
+			size_t verify_len = conn->verify.size();
+			if (data_len < verify_len) break;
+			if (memcmp(data, conn->verify.c_str(), verify_len) != 0) {
+				on_error(conn, "handshake_rpc fail:-1");
+				return false;
+			}
+			conn->recv_buffer.pop_size(verify_len);
+			conn->handshake = true;
+			conn->last_recv_time = steady_ms();
+			continue;
+		}
+		int package_size = load_packet(conn, data, data_len);
+		if (package_size < 0) {
+			on_error(conn, "package-length-err");
+			return false;
+		}
+		if (package_size == 0) break;
+		auto msg = shard_msg::create(shard_msg_type::package, conn->token, package_size);
+		memcpy(msg->data(), data, package_size);
+		report(msg);
+		conn->recv_buffer.pop_size(package_size);
+		if (conn->proto_type == eproto_type::proto_pb) {
+			conn->fc_package++;
+			conn->fc_bytes += package_size;
+		}
+		conn->last_recv_time = steady_ms();
+	}
+	return true;
+}
+
+void socket_shard::do_send(shard_conn* conn) {
+	while (!conn->send_queue.empty()) {
+		send_iov iovs[SEND_IOV_MAX];
+		int count = 0;
+		for (auto msg : conn->send_queue) {
+			if (count >= SEND_IOV_MAX) break;
+			set_send_iov(iovs[count++], msg->data() + msg->offset, msg->len - msg->offset);
+		}
+		int send_len = send_iovs(conn->fd, iovs, count, MSG_NOSIGNAL);
+		if (send_len == SOCKET_ERROR) {
+			int err = get_socket_error();
+			if (err == EINTR)
+				continue;
+			if (err == EAGAIN)
+				return;
+			on_error(conn, "do-send-failed");
+			return;
+		}
+		if (send_len == 0) {
+			on_error(conn, "connection-lost-send-0");
+			return;
+		}
+		m_send_calls.fetch_add(1, std::memory_order_relaxed);
+		m_send_bytes.fetch_add(send_len, std::memory_order_relaxed);
+		size_t left = (size_t)send_len;
+		while (left > 0) {
+			auto msg = conn->send_queue.front();
+			size_t len = std::min<size_t>(msg->len - msg->offset, left);
+			msg->offset += len;
+			left -= len;
+			if (msg->offset == msg->len) {
+				conn->send_queue.pop_front();
+				release_send(conn, msg);
+			}
+		}
+	}
+	if (conn->closing) {
+		close_conn(conn);
+		report(shard_msg::create(shard_msg_type::closed, conn->token));
+	}
+}
+
+bool socket_shard::check_flow_ctrl(shard_conn* conn, int64_t now) {
+	if (conn->fc_ctrl_package < 1 || conn->fc_ctrl_bytes < 1) return false;
+	auto escape_time = (now - conn->last_fc_time) / 1000;
+	if (escape_time > 5) {
+		if ((conn->fc_package / escape_time) > conn->fc_ctrl_package || conn->fc_bytes / escape_time > conn->fc_ctrl_bytes) {
+			return true;
+		}
+		conn->fc_package = 0;
+		conn->fc_bytes = 0;
+		conn->last_fc_time = now;
+	}
+	return false;
+}
+
+void socket_shard::check_timeout(int64_t now) {
+	for (auto& [token, conn] : m_conns) {
+		if (conn->fd == INVALID_SOCKET || conn->closing) continue;
+		if (conn->timeout > 0 && now - conn->last_recv_time > conn->timeout) {
+			on_error(conn, fmt::format("timeout:{}", conn->timeout));
+			continue;
+		}
+		if (conn->proto_type == eproto_type::proto_pb && check_flow_ctrl(conn, now)) {
+			on_error(conn, fmt::format("trigger package:{} or bytes:{},escape_time:{} flowctrl line,will be closed",
+				conn->fc_package, conn->fc_bytes, now - conn->last_fc_time));
+		}
+	}
+}
+
+void socket_shard::on_error(shard_conn* conn, const std::string& err) {
+	if (conn->fd == INVALID_SOCKET) return;
+	close_conn(conn);
+	auto msg = shard_msg::create(shard_msg_type::error, conn->token, err.size() + 1);
+	memcpy(msg->data(), err.c_str(), err.size() + 1);
+	report(msg);
+}
+
+//连接在本轮循环结束时释放
+void socket_shard::close_conn(shard_conn* conn) {
+	epoll_ctl(m_handle, EPOLL_CTL_DEL, conn->fd, nullptr);
+	closesocket(conn->fd);
+	conn->fd = INVALID_SOCKET;
+	for (auto msg : conn->send_queue) {
+		release_send(conn, msg);
+	}
+	conn->send_queue.clear();
+}
+
+void socket_shard::release_send(shard_conn* conn, shard_msg* msg) {
+	if (conn->pending) {
+		conn->pending->fetch_sub(msg->len, std::memory_order_relaxed);
+	}
+	msg->release();
+}
+
+void socket_shard::report(shard_msg* msg) {
+	m_mgr->post_shard_msg(msg);
+	m_reported = true;
+}
+
+socket_shard_stream::socket_shard_stream(socket_mgr* mgr, socket_shard* shard, eproto_type proto_type, socket_t fd, const char ip[])
+	: m_mgr(mgr), m_shard(shard), m_socket(fd), m_ip(ip) {
+	mgr->increase_count();
+	m_proto_type = proto_type;
+	m_link_status = elink_status::link_connected;
+}
+
+socket_shard_stream::~socket_shard_stream() {
+	m_mgr->decrease_count();
+}
+
+bool socket_shard_stream::update(int64_t now, bool check_timeout) {
+	//关闭中: 等待io线程释放连接
+	return m_link_status != elink_status::link_closed;
+}
+
+void socket_shard_stream::close() {
+	if (m_link_status == elink_status::link_connected) {
+		m_link_status = elink_status::link_colsing;
+		m_shard->post(shard_msg::create(shard_msg_type::close, m_token));
+	}
+}
+
+void socket_shard_stream::set_timeout(int duration) {
+	auto msg = shard_msg::create(shard_msg_type::timeout, m_token);
+	msg->param1 = duration;
+	m_shard->post(msg);
+}
+
+void socket_shard_stream::set_nodelay(int flag) {
+	//fd归io线程所有, 关闭后可能已被复用
+	if (m_link_status != elink_status::link_connected)
+		return;
+	auto msg = shard_msg::create(shard_msg_type::nodelay, m_token);
+	msg->param1 = flag;
+	m_shard->post(msg);
+}
+
+void socket_shard_stream::set_flow_ctrl(int ctrl_package, int ctrl_bytes) {
+	auto msg = shard_msg::create(shard_msg_type::flow_ctrl, m_token);
+	msg->param1 = ctrl_package;
+	msg->param2 = ctrl_bytes;
+	m_shard->post(msg);
+}
+
+int socket_shard_stream::send(const void* data, size_t data_len) {
+	sendv_item items[] = { {data, data_len} };
+	return sendv(items, _countof(items));
+}
+
+int socket_shard_stream::sendv(const sendv_item items[], int count) {
+	if (m_link_status != elink_status::link_connected)
+		return 0;
+	size_t total_len = 0;
+	for (int i = 0; i < count; i++) {
+		total_len += items[i].len;
+	}
+	if (total_len == 0 || !check_pending(total_len))
+		return 0;
+	m_shard->post(shard_msg::create(shard_msg_type::send, m_token, items, count));
+	return (int)total_len;
+}
+
+int socket_shard_stream::send_chunk(shared_chunk* chunk) {
+	size_t data_len = chunk->size();
+	if (m_link_status != elink_status::link_connected || data_len == 0)
+		return 0;
+	if (!check_pending(data_len))
+		return 0;
+	m_shard->post(shard_msg::create(shard_msg_type::chunk, m_token, chunk));
+	return (int)data_len;
+}
+
+//对端不收时io线程的发送队列会一直增长, 超过上限关闭连接
+bool socket_shard_stream::check_pending(size_t data_len) {
+	size_t pending = m_pending->load(std::memory_order_relaxed);
+	if (pending + data_len > SOCKET_PACKET_MAX) {
+		on_error(fmt::format("send-buffer-full:{},want:{}", pending, data_len).c_str());
+		return false;
+	}
+	m_pending->fetch_add(data_len, std::memory_order_relaxed);
+	return true;
+}
+
+void socket_shard_stream::on_shard_msg(shard_msg* msg) {
+	switch (msg->type) {
+	case shard_msg_type::package:
+		if (m_link_status == elink_status::link_connected) {
+			on_package(msg->data(), msg->len);
+		}
+		break;
+	case shard_msg_type::error:
+		on_error((const char*)msg->data());
+		break;
+	case shard_msg_type::closed:
+		m_socket = INVALID_SOCKET;
+		m_link_status = elink_status::link_closed;
+		m_mgr->set_active(this);
+		break;
+	default:
+		break;
+	}
+}
+
+void socket_shard_stream::on_package(uint8_t* data, size_t data_len) {
+	slice package(data, data_len);
+	if (m_proto_type == eproto_type::proto_pb && m_codec) {
+		m_codec->set_slice(&package);
+		m_codec->load_packet(data_len);
+		auto ret = m_package_cb(&package);
+		if (ret != 0) {
+			on_error(fmt::format("package process ret:{},ip:{}", ret, m_ip).c_str());
+			return;
+		}
+		if (m_codec->failed()) {
+			on_error(fmt::format("codec decode failed:{}", m_codec->err()).c_str());
+		}
+		return;
+	}
+	auto ret = m_package_cb(&package);
+	if (ret != 0) {
+		on_error(fmt::format("package process ret:{},ip:{}", ret, m_ip).c_str());
+	}
+}
+
+void socket_shard_stream::on_error(const char err[]) {
+	if (m_link_status == elink_status::link_closed)
+		return;
+	//关闭中出错: io线程已释放连接,不再回调
+	bool connected = (m_link_status == elink_status::link_connected);
+	if (connected) {
+		//通知io线程立即关闭连接, 对端不收包时不等待发送; io线程已先行关闭时只回报closed
+		auto msg = shard_msg::create(shard_msg_type::close, m_token);
+		msg->param1 = 1;
+		m_shard->post(msg);
+	}
+	m_link_status = elink_status::link_closed;
+	m_socket = INVALID_SOCKET;
+	m_mgr->set_active(this);
+	if (connected) {
+		m_error_cb(err);
+	}
+}
+#endif
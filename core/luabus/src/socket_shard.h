@@ -0,0 +1,148 @@
+﻿#pragma once
+#ifdef __linux
+#include <deque>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include "socket_mgr.h"
+#include "socket_queue.h"
+
+// io线程与lua线程之间的消息类型
+enum class shard_msg_type : uint8_t {
+	accept		= 0,	//lua->io: 新连接,data为握手串
+	send		= 1,	//lua->io: 发送数据
+	chunk		= 2,	//lua->io: 发送共享块
+	close		= 3,	//lua->io: 关闭连接,param1为1时丢弃未发送数据
+	timeout		= 4,	//lua->io: 设置超时
+	flow_ctrl	= 5,	//lua->io: 设置限流
+	package		= 6,	//io->lua: 完整数据包
+	error		= 7,	//io->lua: 连接错误,data为错误信息
+	closed		= 8,	//io->lua: 连接已释放
+	nodelay		= 9,	//lua->io: 设置nodelay
+};
+
+//待发送字节数, lua线程投递时增加, io线程发出或丢弃时减少
+using shard_pending = std::shared_ptr<std::atomic<size_t>>;
+
+struct shard_msg {
+	std::atomic<shard_msg*> next = nullptr;
+	shard_msg_type type = shard_msg_type::send;
+	uint32_t token = 0;
+	int64_t param1 = 0;
+	int64_t param2 = 0;
+	shared_chunk* chunk = nullptr;
+	size_t len = 0;
+	size_t offset = 0;		//已发送长度
+	shard_pending pending;	//accept: 连接的待发送字节数
+
+	uint8_t* data() { return chunk ? chunk->data() : (uint8_t*)(this + 1); }
+
+	static shard_msg* create(shard_msg_type type, uint32_t token, size_t len = 0);
+	static shard_msg* create(shard_msg_type type, uint32_t token, const sendv_item items[], int count);
+	static shard_msg* create(shard_msg_type type, uint32_t token, shared_chunk* chunk);
+	void release();
+};
+
+// io线程上的连接
+struct shard_conn {
+	socket_t fd = INVALID_SOCKET;
+	uint32_t token = 0;
+	eproto_type proto_type = eproto_type::proto_rpc;
+	bool handshake = true;
+	bool closing = false;
+	std::string verify;
+	luabuf recv_buffer;
+	std::deque<shard_msg*> send_queue;
+	shard_pending pending;
+	int timeout = -1;
+	int64_t last_recv_time = 0;
+	//流量控制
+	int64_t fc_ctrl_package = 0;
+	int64_t fc_ctrl_bytes = 0;
+	int64_t fc_package = 0;
+	int64_t fc_bytes = 0;
+	int64_t last_fc_time = 0;
+};
+
+class socket_shard
+{
+public:
+	socket_shard(socket_mgr* mgr, int index) : m_mgr(mgr), m_index(index) {}
+	~socket_shard();
+
+	bool setup();
+	void stop();
+	//lua线程投递,notify后io线程处理
+	void post(shard_msg* msg);
+	void notify();
+
+	uint64_t send_calls() { return m_send_calls.load(std::memory_order_relaxed); }
+	uint64_t send_bytes() { return m_send_bytes.load(std::memory_order_relaxed); }
+
+protected:
+	void run();
+	void on_message(shard_msg* msg);
+	void on_accept(shard_msg* msg);
+	void do_recv(shard_conn* conn);
+	void do_send(shard_conn* conn);
+	bool dispatch_package(shard_conn* conn);
+	int  load_packet(shard_conn* conn, uint8_t* data, size_t data_len);
+	bool check_flow_ctrl(shard_conn* conn, int64_t now);
+	void check_timeout(int64_t now);
+	void on_error(shard_conn* conn, const std::string& err);
+	void close_conn(shard_conn* conn);
+	void release_send(shard_conn* conn, shard_msg* msg);
+	void report(shard_msg* msg);
+
+private:
+	socket_mgr* m_mgr = nullptr;
+	int m_index = 0;
+	int m_handle = -1;		//epoll
+	int m_event = -1;		//eventfd
+	bool m_posted = false;	//lua线程: 有未通知的消息
+	bool m_reported = false;	//io线程: 本轮有上报的消息
+	std::atomic<bool> m_running = false;
+	std::thread m_thread;
+	mpsc_queue<shard_msg> m_inbox;
+	std::unordered_map<uint32_t, shard_conn*> m_conns;
+	std::vector<epoll_event> m_events;
+	int64_t m_last_check_time = 0;
+	std::atomic<uint64_t> m_send_calls = 0;
+	std::atomic<uint64_t> m_send_bytes = 0;
+};
+
+// lua线程上的连接代理,io由socket_shard完成
+struct socket_shard_stream : public socket_object
+{
+	socket_shard_stream(socket_mgr* mgr, socket_shard* shard, eproto_type proto_type, socket_t fd, const char ip[]);
+	~socket_shard_stream();
+
+	bool update(int64_t now, bool check_timeout) override;
+	bool get_remote_ip(std::string& ip) override { ip = m_ip; return true; }
+	void close() override;
+	void set_timeout(int duration) override;
+	void set_nodelay(int flag) override;
+	void set_flow_ctrl(int ctrl_package, int ctrl_bytes) override;
+	int  send(const void* data, size_t data_len) override;
+	int  sendv(const sendv_item items[], int count) override;
+	int  send_chunk(shared_chunk* chunk) override;
+	void set_package_callback(const std::function<int(slice*)>& cb) override { m_package_cb = cb; }
+	void set_error_callback(const std::function<void(const char*)>& cb) override { m_error_cb = cb; }
+
+	void on_shard_msg(shard_msg* msg);
+	shard_pending pending() { return m_pending; }
+
+private:
+	void on_package(uint8_t* data, size_t data_len);
+	void on_error(const char err[]);
+	bool check_pending(size_t data_len);
+
+	socket_mgr* m_mgr = nullptr;
+	socket_shard* m_shard = nullptr;
+	socket_t m_socket = INVALID_SOCKET;
+	std::string m_ip;
+	shard_pending m_pending = std::make_shared<std::atomic<size_t>>(0);
+	std::function<void(const char*)> m_error_cb = nullptr;
+	std::function<int(slice*)> m_package_cb = nullptr;
+};
+#endif
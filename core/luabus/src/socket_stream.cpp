@@ -48,6 +48,10 @@ socket_stream::~socket_stream() {
 		freeaddrinfo(m_addr);
 		m_addr = nullptr;
 	}
+	for (auto& seg : m_send_queue) {
+		if (seg.chunk) seg.chunk->release();
+	}
+	m_send_queue.clear();
 	m_mgr->decrease_count();
 }
 
@@ -77,20 +81,37 @@ void socket_stream::connect(const char node_name[], const char service_name[], i
 	m_connecting_time = steady_ms() + timeout;
 }
 
+void socket_stream::set_timeout(int duration) {
+	m_timeout = duration;
+	schedule_check(steady_ms());
+}
+
+void socket_stream::set_flow_ctrl(int ctrl_package, int ctrl_bytes) {
+	m_fc_ctrl_package = ctrl_package;
+	m_fc_ctrl_bytes = ctrl_bytes;
+	m_last_fc_time = steady_ms();
+	schedule_check(m_last_fc_time);
+}
+
 void socket_stream::close() {
 	if (m_socket == INVALID_SOCKET) {
 		m_link_status = elink_status::link_closed;
+		m_mgr->set_active(this);
 		return;
 	}
 	shutdown(m_socket, SD_RECEIVE);
 	m_link_status = elink_status::link_colsing;
+	m_mgr->set_active(this);
 }
 
-bool socket_stream::update(int64_t now,bool check_timeout) {
+bool socket_stream::update(int64_t now, bool check_timeout) {
 	switch (m_link_status) {
 	case elink_status::link_closed: {
 #ifdef _MSC_VER
-		if (m_ovl_ref > 0) return true;
+		if (m_ovl_ref > 0) {
+			m_mgr->set_active(this);
+			return true;
+		}
 #endif
 		if (m_socket != INVALID_SOCKET) {
 			m_mgr->unwatch(m_socket);
@@ -100,10 +121,12 @@ bool socket_stream::update(int64_t now,bool check_timeout) {
 		return false;
 	}
 	case elink_status::link_colsing: {
+		//等待发送缓冲清空
+		m_mgr->set_active(this);
 #ifdef _MSC_VER
 		if (m_ovl_ref > 1) return true;
 #endif
-		if (m_send_buffer.empty()) {
+		if (m_send_queue.empty()) {
 			m_link_status = elink_status::link_closed;
 		}
 		return true;
@@ -113,6 +136,9 @@ bool socket_stream::update(int64_t now,bool check_timeout) {
 			on_connect(false, "timeout");
 			return true;
 		}
+		if (m_check_tick == 0) {
+			m_mgr->set_check_time(this, m_connecting_time + 1);
+		}
 		try_connect();
 		return true;
 	}
@@ -130,12 +156,35 @@ bool socket_stream::update(int64_t now,bool check_timeout) {
 				}
 			}
 		}
+		if (m_check_tick == 0) {
+			schedule_check(now);
+		}
 		dispatch_package(true);
 	}
 	}
 	return true;
 }
 
+//计算下次检测时间:超时按最后接收时间惰性推迟,限流按固定间隔
+void socket_stream::schedule_check(int64_t now) {
+	if (m_link_status != elink_status::link_connected) {
+		return;
+	}
+	int64_t check_time = 0;
+	if (m_timeout > 0) {
+		check_time = m_last_recv_time + m_timeout + 1;
+	}
+	if (eproto_type::proto_pb == m_proto_type && m_fc_ctrl_package > 0 && m_fc_ctrl_bytes > 0) {
+		int64_t fc_time = now + FLOW_CTRL_CHECK_TIME;
+		if (check_time == 0 || fc_time < check_time) {
+			check_time = fc_time;
+		}
+	}
+	if (check_time > 0) {
+		m_mgr->set_check_time(this, check_time);
+	}
+}
+
 #ifdef _MSC_VER
 static bool bind_any(socket_t s) {
 	struct sockaddr_in6 v6addr;
@@ -277,68 +326,170 @@ int socket_stream::send(const void* data, size_t data_len)
 
 int socket_stream::sendv(const sendv_item items[], int count)
 {
-	int send_len = 0;
 	if (m_link_status != elink_status::link_connected)
-		return send_len;
+		return 0;
 
+	size_t total_len = 0;
 	for (int i = 0; i < count; i++) {
-		auto item = items[i];
-		send_len += stream_send((char*)item.data, item.len);
+		total_len += items[i].len;
 	}
-	return send_len;
-}
-
-int socket_stream::stream_send(const char* data, size_t data_len)
-{
-	int total_len = data_len;
-	if (m_link_status != elink_status::link_connected || data_len == 0)
+	if (total_len == 0)
 		return 0;
 
+	size_t send_len = 0;
 	if (need_delay_send()) {//延迟发送
-		if (0 == m_send_buffer.push_data((const uint8_t*)data, data_len)) {
-			on_error(fmt::format("send-buffer-full:{},data:{},want:{}", m_send_buffer.capacity(), m_send_buffer.size(), data_len).c_str());
-			return 0;
+		for (int i = 0; i < count; i++) {
+			if (items[i].len > 0 && !queue_buffer((const char*)items[i].data, items[i].len)) {
+				return 0;
+			}
 		}
-		if (m_send_buffer.size() > IO_BUFFER_SEND) {
+		if (m_send_size > IO_BUFFER_SEND) {
 			do_send(UINT_MAX, false);
 		}
 	} else {
-		if (m_send_buffer.empty()) {
-			while (data_len > 0) {
-				int send_len = ::send(m_socket, data, (int)data_len, 0);
-				if (send_len == 0) {
+		if (m_send_queue.empty()) {
+			//发送队列为空,直接聚合发送
+			while (send_len < total_len) {
+				send_iov iovs[SEND_IOV_MAX];
+				int iov_count = fill_item_iovs(iovs, items, count, send_len);
+				int len = send_iovs(m_socket, iovs, iov_count, s_send_flag);
+				if (len == 0) {
 					on_error("connection-send-lost");
 					return 0;
 				}
-				if (send_len == SOCKET_ERROR) {
+				if (len == SOCKET_ERROR) {
 					break;
 				}
-				data += send_len;
-				data_len -= send_len;
+				m_mgr->count_send(len);
+				send_len += len;
 			}
-			if (data_len == 0) {
-				return total_len;
+			if (send_len == total_len) {
+				return (int)total_len;
 			}
 		}
-		if (0 == m_send_buffer.push_data((const uint8_t*)data, data_len)) {
-			on_error(fmt::format("send-buffer-full:{},data:{},want:{}", m_send_buffer.capacity(), m_send_buffer.size(), data_len).c_str());
-			return 0;
+		//剩余数据进入发送队列
+		size_t offset = send_len;
+		for (int i = 0; i < count; i++) {
+			size_t len = items[i].len;
+			if (offset >= len) {
+				offset -= len;
+				continue;
+			}
+			if (!queue_buffer((const char*)items[i].data + offset, len - offset)) {
+				return 0;
+			}
+			offset = 0;
 		}
 	}
+	return watch_send() ? (int)total_len : 0;
+}
+
+int socket_stream::send_chunk(shared_chunk* chunk)
+{
+	size_t data_len = chunk->size();
+	if (m_link_status != elink_status::link_connected || data_len == 0)
+		return 0;
+
+	if (m_send_size + data_len > SOCKET_PACKET_MAX) {
+		on_error(fmt::format("send-buffer-full:{},want:{}", m_send_size, data_len).c_str());
+		return 0;
+	}
+	chunk->retain();
+	m_send_queue.push_back(send_segment{ chunk, data_len, 0 });
+	m_send_size += data_len;
+	if (!need_delay_send() || m_send_size > IO_BUFFER_SEND) {
+		do_send(UINT_MAX, false);
+	}
+	return watch_send() ? (int)data_len : 0;
+}
 
+int socket_stream::stream_send(const char* data, size_t data_len)
+{
+	sendv_item items[] = { {data, data_len} };
+	return sendv(items, _countof(items));
+}
+
+bool socket_stream::watch_send() {
 #if _MSC_VER
 	if (!wsa_send_empty(m_socket, m_send_ovl)) {
 		on_error("send-failed");
-		return 0;
+		return false;
 	}
 	m_ovl_ref++;
 #else
 	if (!m_mgr->watch_send(m_socket, this, true)) {
 		on_error("watch-error");
-		return 0;
+		return false;
 	}
 #endif
-	return total_len;
+	return true;
+}
+
+//写入发送缓冲,相邻的缓冲数据合并为一个节点
+bool socket_stream::queue_buffer(const char* data, size_t data_len) {
+	if (0 == m_send_buffer.push_data((const uint8_t*)data, data_len)) {
+		on_error(fmt::format("send-buffer-full:{},data:{},want:{}", m_send_buffer.capacity(), m_send_buffer.size(), data_len).c_str());
+		return false;
+	}
+	if (!m_send_queue.empty() && m_send_queue.back().chunk == nullptr) {
+		m_send_queue.back().len += data_len;
+	} else {
+		m_send_queue.push_back(send_segment{ nullptr, data_len, 0 });
+	}
+	m_send_size += data_len;
+	return true;
+}
+
+//跳过已发送的offset字节,填充剩余的items
+int socket_stream::fill_item_iovs(send_iov iovs[], const sendv_item items[], int count, size_t offset) {
+	int iov_count = 0;
+	for (int i = 0; i < count && iov_count < SEND_IOV_MAX; i++) {
+		size_t len = items[i].len;
+		if (offset >= len) {
+			offset -= len;
+			continue;
+		}
+		set_send_iov(iovs[iov_count++], (const char*)items[i].data + offset, len - offset);
+		offset = 0;
+	}
+	return iov_count;
+}
+
+int socket_stream::fill_send_iovs(send_iov iovs[], size_t max_len) {
+	int count = 0;
+	size_t buf_offset = 0;
+	uint8_t* buf_head = m_send_buffer.head();
+	for (auto& seg : m_send_queue) {
+		if (count >= SEND_IOV_MAX || max_len == 0) break;
+		size_t len = std::min<size_t>(seg.len, max_len);
+		if (seg.chunk) {
+			set_send_iov(iovs[count++], seg.chunk->data() + seg.offset, len);
+		} else {
+			set_send_iov(iovs[count++], buf_head + buf_offset, len);
+			buf_offset += seg.len;
+		}
+		max_len -= len;
+	}
+	return count;
+}
+
+void socket_stream::pop_send(size_t send_len) {
+	m_send_size -= send_len;
+	while (send_len > 0 && !m_send_queue.empty()) {
+		auto& seg = m_send_queue.front();
+		size_t len = std::min<size_t>(seg.len, send_len);
+		if (seg.chunk) {
+			seg.offset += len;
+		} else {
+			m_send_buffer.pop_size(len);
+		}
+		seg.len -= len;
+		send_len -= len;
+		if (seg.len == 0) {
+			if (seg.chunk) seg.chunk->release();
+			m_send_queue.pop_front();
+		}
+	}
 }
 
 #ifdef _MSC_VER
@@ -376,7 +527,9 @@ void socket_stream::on_complete(WSAOVERLAPPED* ovl)
 	m_socket = INVALID_SOCKET;
 	if (m_next == nullptr) {
 		on_connect(false, "connect-failed");
+		return;
 	}
+	m_mgr->set_active(this);
 }
 #endif
 
@@ -408,16 +561,16 @@ void socket_stream::on_can_send(size_t max_len, bool is_eof) {
 	m_socket = INVALID_SOCKET;
 	if (m_next == nullptr) {
 		on_connect(false, "connect-failed");
+		return;
 	}
+	m_mgr->set_active(this);
 }
 #endif
 
 void socket_stream::do_send(size_t max_len, bool is_eof) {
 	size_t total_send = 0;
 	while (total_send < max_len && (m_link_status != elink_status::link_closed)) {
-		size_t data_len = 0;
-		auto data = m_send_buffer.data(&data_len);
-		if (data_len == 0) {
+		if (m_send_queue.empty()) {
 			if (!m_mgr->watch_send(m_socket, this, false)) {
 				on_error("do-watch-error");
 				return;
@@ -425,8 +578,9 @@ void socket_stream::do_send(size_t max_len, bool is_eof) {
 			break;
 		}
 
-		size_t try_len = std::min<size_t>(data_len, max_len - total_send);
-		int send_len = ::send(m_socket, (char*)data, (int)try_len, s_send_flag);
+		send_iov iovs[SEND_IOV_MAX];
+		int iov_count = fill_send_iovs(iovs, max_len - total_send);
+		int send_len = send_iovs(m_socket, iovs, iov_count, s_send_flag);
 		if (send_len == SOCKET_ERROR) {
 			int err = get_socket_error();
 #ifdef _MSC_VER
@@ -454,8 +608,9 @@ void socket_stream::do_send(size_t max_len, bool is_eof) {
 			on_error("connection-lost-send-0");
 			return;
 		}
+		m_mgr->count_send(send_len);
 		total_send += send_len;
-		m_send_buffer.pop_size((size_t)send_len);
+		pop_send((size_t)send_len);
 	}
 	if (is_eof || max_len == 0) {
 		on_error("connection-lost");
@@ -541,16 +696,23 @@ void socket_stream::dispatch_package(bool reset) {
 			}
 			package_size = header->len;
 			if (data_len < package_size) return;
-			m_package_cb(m_recv_buffer.get_slice(package_size));
+			auto ret = m_package_cb(m_recv_buffer.get_slice(package_size));
 			m_recv_buffer.pop_size(package_size);
+			//方法编号不一致等协议错误, 关闭连接
+			if (ret != 0) {
+				on_error(fmt::format("rpc package process ret:{},ip:{}", ret, m_ip).c_str());
+				return;
+			}
 		}break;
 		case eproto_type::proto_pb:
 		case eproto_type::proto_text: {
 			if (m_codec) {
+				//回调中可能切换codec(如协商压缩), 本包始终使用解包时的codec
+				codec_base* codec = m_codec;
 				//解析数据包头长度
 				slice* slice = m_recv_buffer.get_slice();
-				m_codec->set_slice(slice);
-				package_size = m_codec->load_packet(data_len);
+				codec->set_slice(slice);
+				package_size = codec->load_packet(data_len);
 				//当前包头长度解析失败, 关闭连接
 				if (package_size < 0) {
 					on_error(fmt::format("text package-length-err,ip:{}", m_ip).c_str());
@@ -566,11 +728,11 @@ void socket_stream::dispatch_package(bool reset) {
 					return;
 				}
 				// 数据包解析失败
-				if (m_codec->failed()) {
-					on_error(fmt::format("codec decode failed:{}", m_codec->err()).c_str());
+				if (codec->failed()) {
+					on_error(fmt::format("codec decode failed:{}", codec->err()).c_str());
 					return;
 				}
-				size_t read_size = m_codec->get_packet_len();
+				size_t read_size = codec->get_packet_len();
 				// 数据包还没有收完整
 				if (read_size == 0) {
 					std::cout << "read_size:" << package_size << std::endl;
@@ -595,6 +757,7 @@ void socket_stream::dispatch_package(bool reset) {
 		// 防止单个连接处理太久
 		if ((m_last_recv_time - m_tick_dispatch_time) > max_process_time()) {
 			m_need_dispatch_pkg = true;
+			m_mgr->set_active(this);
 			m_stock_count++;
 			if (m_stock_count > 10) {// 连续积压10次处理不完,断开链接
 				on_error(fmt::format("busy cann't process count:{},data_len:{}",m_stock_count,m_recv_buffer.size()).c_str());
@@ -639,6 +802,7 @@ void socket_stream::on_error(const char err[]) {
 			m_socket = INVALID_SOCKET;
 		}
 		m_link_status = elink_status::link_closed;
+		m_mgr->set_active(this);
 		m_error_cb(err);
 	}
 }
@@ -657,10 +821,12 @@ void socket_stream::on_connect(bool ok, const char reason[]) {
 				m_socket = INVALID_SOCKET;
 			}
 			m_link_status = elink_status::link_closed;
+			m_mgr->set_active(this);
 		}
 		else {
 			m_link_status = elink_status::link_connected;
 			m_last_recv_time = steady_ms();
+			schedule_check(m_last_recv_time);
 			send_handshake_rpc();
 		}
 		m_connect_cb(ok, reason);
@@ -1,8 +1,16 @@
 ﻿#pragma once
 
+#include <deque>
 #include "socket_helper.h"
 #include "socket_mgr.h"
 
+//发送队列节点,chunk为空时表示m_send_buffer中的一段数据
+struct send_segment {
+	shared_chunk* chunk = nullptr;
+	size_t len = 0;
+	size_t offset = 0;
+};
+
 struct socket_stream : public socket_object
 {
 #ifdef _MSC_VER
@@ -22,12 +30,13 @@ struct socket_stream : public socket_object
 	void set_package_callback(const std::function<int(slice*)>& cb) override { m_package_cb = cb; }
 	void set_error_callback(const std::function<void(const char*)>& cb) override { m_error_cb = cb; }
 	void set_connect_callback(const std::function<void(bool, const char*)>& cb) override { m_connect_cb = cb; }
-	void set_timeout(int duration) override { m_timeout = duration; }
+	void set_timeout(int duration) override;
 	void set_nodelay(int flag) override { set_no_delay(m_socket, flag); }
-	void set_flow_ctrl(int ctrl_package, int ctrl_bytes) override { m_fc_ctrl_package = ctrl_package; m_fc_ctrl_bytes = ctrl_bytes; m_last_fc_time = steady_ms(); }
+	void set_flow_ctrl(int ctrl_package, int ctrl_bytes) override;
 
 	int send(const void* data, size_t data_len) override;
 	int sendv(const sendv_item items[], int count) override;
+	int send_chunk(shared_chunk* chunk) override;
 	int stream_send(const char* data, size_t data_len);
 
 #ifdef _MSC_VER
@@ -42,6 +51,12 @@ struct socket_stream : public socket_object
 	void do_send(size_t max_len, bool is_eof);
 	void do_recv(size_t max_len, bool is_eof);
 
+	bool watch_send();
+	bool queue_buffer(const char* data, size_t data_len);
+	int  fill_send_iovs(send_iov iovs[], size_t max_len);
+	int  fill_item_iovs(send_iov iovs[], const sendv_item items[], int count, size_t offset);
+	void pop_send(size_t send_len);
+
 	void dispatch_package(bool reset);
 	int  handshake_rpc(BYTE* data, size_t data_len);
 	void send_handshake_rpc();
@@ -49,6 +64,7 @@ struct socket_stream : public socket_object
 	void on_connect(bool ok, const char reason[]);
 	void reset_dispatch_pkg(bool init);
 	bool check_flow_ctrl(int64_t now);
+	void schedule_check(int64_t now);
 	bool need_delay_send();
 	int64_t max_process_time();
 
@@ -57,6 +73,8 @@ struct socket_stream : public socket_object
 	socket_t m_socket = INVALID_SOCKET;
 	luabuf m_recv_buffer;
 	luabuf m_send_buffer;
+	std::deque<send_segment> m_send_queue;
+	size_t m_send_size = 0;
 
 	std::string m_node_name;
 	std::string m_service_name;
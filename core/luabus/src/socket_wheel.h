@@ -0,0 +1,69 @@
+﻿#pragma once
+#include <vector>
+#include <stdint.h>
+#include "timer_wheel.hpp"
+
+constexpr int WHEEL_TICK_MS		= 10;	//时间轮精度
+
+struct wheel_node {
+	uint64_t expire;
+	uint32_t token;
+};
+
+struct wheel_list : std::vector<wheel_node> {
+	using node_type = wheel_node;
+
+	template<typename F>
+	void flush(F&& fn) {
+		std::vector<wheel_node> list;
+		list.swap(*this);
+		for (auto& node : list) {
+			fn(node);
+		}
+	}
+
+	void push(const wheel_node& node) { emplace_back(node); }
+
+	static uint64_t expire_of(const wheel_node& node) { return node.expire; }
+};
+
+// 分层时间轮,只处理到期的节点
+// 节点不支持删除,由调用方根据expire判断节点是否过期
+class socket_wheel
+{
+public:
+	using wheel_type = utility::timer_wheel<wheel_list>;
+
+	void setup(int64_t now) {
+		m_wheel.reset((uint64_t)now / WHEEL_TICK_MS);
+	}
+
+	uint64_t insert(uint32_t token, int64_t expire_ms) {
+		uint64_t time = m_wheel.time();
+		uint64_t expire = (uint64_t)expire_ms / WHEEL_TICK_MS;
+		if (expire <= time) {
+			expire = time + 1;
+		} else if (expire - time > wheel_type::MAX_TICK) {
+			expire = time + wheel_type::MAX_TICK;
+		}
+		m_wheel.add(wheel_node{ expire, token });
+		return expire;
+	}
+
+	// 推进时间轮,到期节点写入expires
+	void update(int64_t now, wheel_list& expires) {
+		expires.clear();
+		uint64_t target = (uint64_t)now / WHEEL_TICK_MS;
+		while (m_wheel.time() < target) {
+			m_wheel.shift();
+			wheel_list& list = m_wheel.current();
+			if (!list.empty()) {
+				expires.insert(expires.end(), list.begin(), list.end());
+				list.clear();
+			}
+		}
+	}
+
+private:
+	wheel_type m_wheel;
+};
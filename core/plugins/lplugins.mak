@@ -44,6 +44,7 @@ MYCFLAGS += -I../../extend/lua/lua
 MYCFLAGS += -I../../extend/fmt/include
 MYCFLAGS += -I../../extend/luakit/include
 MYCFLAGS += -I../../extend/utility
+MYCFLAGS += -I../../extend/luaxlsx/src
 
 #需要定义的选项
 MYCFLAGS += -DFMT_HEADER_ONLY
@@ -131,6 +132,16 @@ OBJS += $(patsubst $(SRC_DIR)/lcrypt/%.m, $(INT_DIR)/lcrypt/%.o, $(filter-out $(
 OBJS += $(patsubst $(SRC_DIR)/lcrypt/%.cc, $(INT_DIR)/lcrypt/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lcrypt/*.cc)))
 OBJS += $(patsubst $(SRC_DIR)/lcrypt/%.cpp, $(INT_DIR)/lcrypt/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lcrypt/*.cpp)))
 #子目录
+OBJS += $(patsubst $(SRC_DIR)/lmetrics/%.c, $(INT_DIR)/lmetrics/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lmetrics/*.c)))
+OBJS += $(patsubst $(SRC_DIR)/lmetrics/%.m, $(INT_DIR)/lmetrics/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lmetrics/*.m)))
+OBJS += $(patsubst $(SRC_DIR)/lmetrics/%.cc, $(INT_DIR)/lmetrics/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lmetrics/*.cc)))
+OBJS += $(patsubst $(SRC_DIR)/lmetrics/%.cpp, $(INT_DIR)/lmetrics/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lmetrics/*.cpp)))
+#子目录
+OBJS += $(patsubst $(SRC_DIR)/lprof/%.c, $(INT_DIR)/lprof/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lprof/*.c)))
+OBJS += $(patsubst $(SRC_DIR)/lprof/%.m, $(INT_DIR)/lprof/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lprof/*.m)))
+OBJS += $(patsubst $(SRC_DIR)/lprof/%.cc, $(INT_DIR)/lprof/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lprof/*.cc)))
+OBJS += $(patsubst $(SRC_DIR)/lprof/%.cpp, $(INT_DIR)/lprof/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lprof/*.cpp)))
+#子目录
 OBJS += $(patsubst $(SRC_DIR)/lrandom/%.c, $(INT_DIR)/lrandom/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lrandom/*.c)))
 OBJS += $(patsubst $(SRC_DIR)/lrandom/%.m, $(INT_DIR)/lrandom/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lrandom/*.m)))
 OBJS += $(patsubst $(SRC_DIR)/lrandom/%.cc, $(INT_DIR)/lrandom/%.o, $(filter-out $(EXCLUDE), $(wildcard $(SRC_DIR)/lrandom/*.cc)))
@@ -197,6 +208,8 @@ pre_build:
 	mkdir -p $(INT_DIR)/lcache
 	mkdir -p $(INT_DIR)/lcodec
 	mkdir -p $(INT_DIR)/lcrypt
+	mkdir -p $(INT_DIR)/lmetrics
+	mkdir -p $(INT_DIR)/lprof
 	mkdir -p $(INT_DIR)/lrandom
 	mkdir -p $(INT_DIR)/lstdfs
 	mkdir -p $(INT_DIR)/ltimer
@@ -1,6 +1,13 @@
 #pragma once
 
 #include "lua_kit.h"
+#include "snappy.h"
+
+#define MINIZ_NO_STDIO
+#define MINIZ_NO_TIME
+#define MINIZ_NO_ARCHIVE_APIS
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#include "miniz.h"
 
 using namespace std;
 using namespace luakit;
@@ -17,6 +24,67 @@ namespace lbson {
     const uint32_t OP_CHECKSUM      = 1 << 0;
     const uint32_t OP_MORE_COME     = 1 << 1;
 
+    //OP_COMPRESSED: 头部 + originalOpcode + uncompressedSize + compressorId
+    const uint32_t OP_COMPRESSED    = 2012;
+    const uint32_t OP_MSG_HEAD      = 4 * 4;
+    const uint32_t OP_ZIP_HLEN      = 4 * 2 + 1;
+
+    //压缩算法id, 与mongo的compressorId一致
+    const uint8_t OP_ZIP_NOOP       = 0;
+    const uint8_t OP_ZIP_SNAPPY     = 1;
+    const uint8_t OP_ZIP_ZLIB       = 2;
+    const uint8_t OP_ZIP_NONE       = 0xff;
+
+    inline uint8_t zip_compressor(const char* name) {
+        if (name == nullptr) return OP_ZIP_NONE;
+        if (strcmp(name, "snappy") == 0) return OP_ZIP_SNAPPY;
+        if (strcmp(name, "zlib") == 0) return OP_ZIP_ZLIB;
+        if (strcmp(name, "noop") == 0) return OP_ZIP_NOOP;
+        return OP_ZIP_NONE;
+    }
+
+    inline size_t zip_bound(uint8_t compressor, size_t len) {
+        if (compressor == OP_ZIP_SNAPPY) return snappy::max_compressed_length(len);
+        if (compressor == OP_ZIP_ZLIB) return mz_compressBound(len);
+        return len;
+    }
+
+    //dst至少zip_bound长度, dst_len返回压缩后长度
+    inline bool zip_compress(uint8_t compressor, int level, const uint8_t* src, size_t len, uint8_t* dst, size_t* dst_len) {
+        if (compressor == OP_ZIP_SNAPPY) {
+            *dst_len = snappy::compress(src, len, dst);
+            return true;
+        }
+        if (compressor == OP_ZIP_ZLIB) {
+            mz_ulong zlen = mz_compressBound(len);
+            if (mz_compress2(dst, &zlen, src, len, level) != MZ_OK) return false;
+            *dst_len = zlen;
+            return true;
+        }
+        if (compressor == OP_ZIP_NOOP) {
+            memcpy(dst, src, len);
+            *dst_len = len;
+            return true;
+        }
+        return false;
+    }
+
+    //dst_len为原始长度, 解压结果长度不一致视为失败
+    inline bool zip_uncompress(uint8_t compressor, const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len) {
+        if (compressor == OP_ZIP_SNAPPY) {
+            return snappy::uncompress(src, len, dst, dst_len);
+        }
+        if (compressor == OP_ZIP_ZLIB) {
+            mz_ulong zlen = dst_len;
+            return mz_uncompress(dst, &zlen, src, len) == MZ_OK && zlen == dst_len;
+        }
+        if (compressor == OP_ZIP_NOOP && len == dst_len) {
+            memcpy(dst, src, len);
+            return true;
+        }
+        return false;
+    }
+
     static char bson_numstrs[max_bson_index][4];
     static int bson_numstr_len[max_bson_index];
 
@@ -81,8 +149,8 @@ namespace lbson {
             return lua_gettop(L);
         }
 
-        uint8_t* encode_pairs(lua_State* L, size_t* data_len) {
-            int n = lua_gettop(L);
+        uint8_t* encode_pairs(lua_State* L, size_t* data_len, int n = -1) {
+            if (n < 0) n = lua_gettop(L);
             if (n < 2 || n % 2 != 0) {
                 luaL_error(L, "Invalid ordered dict");
             }
@@ -108,6 +176,52 @@ namespace lbson {
             return m_buffer.data(data_len);
         }
 
+        //OP_MSG kind-1文档序列: { ident = { doc, ... } }, 文档直接编码进发送缓冲
+        void encode_sequences(lua_State* L, int index) {
+            lua_pushnil(L);
+            while (lua_next(L, index) != 0) {
+                if (lua_type(L, -2) != LUA_TSTRING || lua_type(L, -1) != LUA_TTABLE) {
+                    luaL_error(L, "Invalid document sequence");
+                }
+                size_t sz;
+                const char* ident = lua_tolstring(L, -2, &sz);
+                m_buffer.write<uint8_t>(1);
+                size_t offset = m_buffer.size();
+                m_buffer.write<uint32_t>(0);
+                write_cstring(ident, sz);
+                size_t count = lua_rawlen(L, -1);
+                for (size_t i = 1; i <= count; ++i) {
+                    if (lua_rawgeti(L, -1, i) != LUA_TTABLE) {
+                        luaL_error(L, "Invalid document %d in sequence %s", (int)i, ident);
+                    }
+                    pack_dict(L, 0);
+                    lua_pop(L, 1);
+                }
+                uint32_t size = m_buffer.size() - offset;
+                m_buffer.copy(offset, (uint8_t*)&size, sizeof(uint32_t));
+                lua_pop(L, 1);
+            }
+        }
+
+        //解析kind-1文档序列, 以ident为key挂到栈顶的应答文档上
+        void unpack_sequence(lua_State* L, slice* slice) {
+            uint32_t sz = read_val<uint32_t>(L, slice);
+            if (sz < 4 || slice->size() < sz - 4) {
+                throw lua_exception("invalid document sequence, length = %d", sz);
+            }
+            size_t remain = slice->size() - (sz - 4);
+            size_t klen = 0;
+            const char* ident = read_cstring(slice, klen);
+            lua_pushlstring(L, ident, klen);
+            lua_createtable(L, 8, 0);
+            int index = 1;
+            while (slice->size() > remain) {
+                unpack_dict(L, slice, false);
+                lua_rawseti(L, -2, index++);
+            }
+            lua_rawset(L, -3);
+        }
+
         luabuf* get_buffer() {
             return &m_buffer;;
         }
@@ -593,6 +707,11 @@ namespace lbson {
 
     class mgocodec : public codec_base {
     public:
+        //compressor: 握手协商出的压缩算法, nullptr表示不压缩; level: zlib压缩等级, 0使用默认等级
+        mgocodec(const char* compressor, int level) : m_level(level > 0 ? level : MZ_DEFAULT_COMPRESSION) {
+            m_compressor = zip_compressor(compressor);
+        }
+
         virtual int load_packet(size_t data_len) {
             if (!m_slice) return 0;
             uint32_t* packet_len = (uint32_t*)m_slice->peek(sizeof(uint32_t));
@@ -614,8 +733,20 @@ namespace lbson {
             buf->write<uint32_t>(0);
             buf->write<uint8_t>(0);
             lua_remove(L, 1);
-            uint8_t* data = m_bson->encode_pairs(L, len);
+            //参数个数为奇数时, 最后一个参数为kind-1文档序列
+            int top = lua_gettop(L);
+            if (top % 2 == 1 && lua_type(L, top) == LUA_TTABLE) {
+                m_bson->encode_pairs(L, len, top - 1);
+                m_bson->encode_sequences(L, top);
+            } else {
+                m_bson->encode_pairs(L, len);
+            }
+            uint8_t* data = buf->data(len);
             buf->copy(0, (uint8_t*)len, sizeof(uint32_t));
+            //mongod按请求的压缩方式压缩应答, 协商后所有请求都压缩
+            if (m_compressor != OP_ZIP_NONE) {
+                return compress(data, len);
+            }
             return data;
         }
 
@@ -625,21 +756,32 @@ namespace lbson {
             m_slice->erase(8);
             uint32_t session_id = m_bson->read_val<uint32_t>(L, m_slice);
             uint32_t opcode = m_bson->read_val<uint32_t>(L, m_slice);
+            slice* body = m_slice;
+            if (opcode == OP_COMPRESSED) {
+                body = uncompress(L, &opcode);
+            }
             if (opcode != OP_MSG_CODE) {
                 throw lua_exception("unsupported opcode: %d", opcode);
             }
-            uint32_t flags = m_bson->read_val<uint32_t>(L, m_slice);
+            uint32_t flags = m_bson->read_val<uint32_t>(L, body);
             if (flags > 0 && ((flags & OP_CHECKSUM) != 0 || ((flags ^ OP_MORE_COME) != 0))) {
                 throw lua_exception("unsupported flags: %d", flags);
             }
-            uint32_t payload = m_bson->read_val<uint8_t>(L, m_slice);
+            uint32_t payload = m_bson->read_val<uint8_t>(L, body);
             if (payload != 0) {
-                throw lua_exception("unsupported flags: %d", payload);
+                throw lua_exception("unsupported payload: %d", payload);
             }
             int otop = lua_gettop(L);
             lua_pushinteger(L, session_id);
             try {
-                m_bson->unpack_dict(L, m_slice, false);
+                m_bson->unpack_dict(L, body, false);
+                while (!body->empty()) {
+                    payload = m_bson->read_val<uint8_t>(L, body);
+                    if (payload != 1) {
+                        throw lua_exception("unsupported payload: %d", payload);
+                    }
+                    m_bson->unpack_sequence(L, body);
+                }
             } catch (const exception& e){
                 lua_settop(L, otop);
                 throw lua_exception(e.what());
@@ -651,7 +793,52 @@ namespace lbson {
             m_bson = bson;
         }
 
+    protected:
+        //压缩OP_MSG头部之后的数据
+        uint8_t* compress(uint8_t* data, size_t* len) {
+            const uint8_t* src = data + OP_MSG_HEAD;
+            size_t src_len = *len - OP_MSG_HEAD;
+            m_zbuf.clean();
+            uint8_t* head = m_zbuf.peek_space(OP_MSG_HEAD + OP_ZIP_HLEN + zip_bound(m_compressor, src_len));
+            if (!head) return data;
+            size_t dst_len = 0;
+            if (!zip_compress(m_compressor, m_level, src, src_len, head + OP_MSG_HEAD + OP_ZIP_HLEN, &dst_len)) return data;
+            uint32_t total = OP_MSG_HEAD + OP_ZIP_HLEN + dst_len;
+            //messageLength, requestID, responseTo沿用原消息
+            memcpy(head, data, OP_MSG_HEAD);
+            memcpy(head, &total, sizeof(uint32_t));
+            memcpy(head + 12, &OP_COMPRESSED, sizeof(uint32_t));
+            memcpy(head + 16, &OP_MSG_CODE, sizeof(uint32_t));
+            uint32_t size = src_len;
+            memcpy(head + 20, &size, sizeof(uint32_t));
+            head[24] = m_compressor;
+            m_zbuf.pop_space(total);
+            return m_zbuf.data(len);
+        }
+
+        slice* uncompress(lua_State* L, uint32_t* opcode) {
+            *opcode = m_bson->read_val<uint32_t>(L, m_slice);
+            uint32_t size = m_bson->read_val<uint32_t>(L, m_slice);
+            uint8_t compressor = m_bson->read_val<uint8_t>(L, m_slice);
+            size_t src_len = 0;
+            const uint8_t* src = m_slice->data(&src_len);
+            m_zbuf.clean();
+            uint8_t* dst = m_zbuf.peek_space(size);
+            if (!dst) {
+                throw lua_exception("compressed message too large: %d", size);
+            }
+            if (!zip_uncompress(compressor, src, src_len, dst, size)) {
+                throw lua_exception("uncompress failed, compressor: %d", compressor);
+            }
+            m_slice->erase(src_len);
+            m_zbuf.pop_space(size);
+            return m_zbuf.get_slice();
+        }
+
     protected:
         bson* m_bson;
+        int m_level = -1;
+        uint8_t m_compressor = OP_ZIP_NONE;
+        luabuf m_zbuf;
     };
-}
\ No newline at end of file
+}
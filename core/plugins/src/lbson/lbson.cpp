@@ -30,6 +30,100 @@ namespace lbson {
         return thread_bson.date(L, value * 1000);
     }
 
+    //OP_COMPRESSED使用的压缩算法, 供工具和测试直接调用
+    static int compress(lua_State* L) {
+        size_t data_len = 0;
+        uint8_t compressor = zip_compressor(lua_tostring(L, 1));
+        const uint8_t* data = (const uint8_t*)luaL_checklstring(L, 2, &data_len);
+        std::string out(zip_bound(compressor, data_len), 0);
+        size_t out_len = 0;
+        if (!zip_compress(compressor, (int)luaL_optinteger(L, 3, MZ_DEFAULT_COMPRESSION), data, data_len, (uint8_t*)out.data(), &out_len)) {
+            return luaL_error(L, "compress failed: %s", lua_tostring(L, 1));
+        }
+        lua_pushlstring(L, out.data(), out_len);
+        return 1;
+    }
+
+    static int uncompress(lua_State* L) {
+        size_t data_len = 0;
+        uint8_t compressor = zip_compressor(lua_tostring(L, 1));
+        const uint8_t* data = (const uint8_t*)luaL_checklstring(L, 2, &data_len);
+        std::string out(luaL_checkinteger(L, 3), 0);
+        if (!zip_uncompress(compressor, data, data_len, (uint8_t*)out.data(), out.size())) {
+            return luaL_error(L, "uncompress failed: %s", lua_tostring(L, 1));
+        }
+        lua_pushlstring(L, out.data(), out.size());
+        return 1;
+    }
+
+    static bool deep_equal(lua_State* L, int a, int b, uint32_t depth) {
+        if (lua_rawequal(L, a, b)) return true;
+        if (lua_type(L, a) != LUA_TTABLE || lua_type(L, b) != LUA_TTABLE) return false;
+        if (depth > max_bson_depth) return false;
+        a = lua_absindex(L, a);
+        b = lua_absindex(L, b);
+        luaL_checkstack(L, 4, nullptr);
+        lua_pushnil(L);
+        while (lua_next(L, a) != 0) {
+            lua_pushvalue(L, -2);
+            lua_rawget(L, b);
+            if (!deep_equal(L, -2, -1, depth + 1)) {
+                lua_pop(L, 3);
+                return false;
+            }
+            lua_pop(L, 2);
+        }
+        lua_pushnil(L);
+        while (lua_next(L, b) != 0) {
+            lua_pop(L, 1);
+            lua_pushvalue(L, -1);
+            lua_rawget(L, a);
+            bool miss = lua_isnil(L, -1);
+            lua_pop(L, 1);
+            if (miss) {
+                lua_pop(L, 1);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    //顶层字段比较: 返回 sets{key=新值}, unsets{key...}, 子表做深比较
+    static int diff(lua_State* L) {
+        luaL_checktype(L, 1, LUA_TTABLE);
+        luaL_checktype(L, 2, LUA_TTABLE);
+        lua_settop(L, 2);
+        lua_newtable(L);
+        lua_newtable(L);
+        lua_pushnil(L);
+        while (lua_next(L, 2) != 0) {
+            lua_pushvalue(L, -2);
+            lua_rawget(L, 1);
+            bool same = deep_equal(L, -1, -2, 1);
+            lua_pop(L, 1);
+            if (!same) {
+                lua_pushvalue(L, -2);
+                lua_insert(L, -2);
+                lua_rawset(L, 3);
+            } else {
+                lua_pop(L, 1);
+            }
+        }
+        lua_Integer count = 0;
+        lua_pushnil(L);
+        while (lua_next(L, 1) != 0) {
+            lua_pop(L, 1);
+            lua_pushvalue(L, -1);
+            lua_rawget(L, 2);
+            if (lua_isnil(L, -1)) {
+                lua_pushvalue(L, -2);
+                lua_rawseti(L, 4, ++count);
+            }
+            lua_pop(L, 1);
+        }
+        return 2;
+    }
+
     static void init_static_bson() {
         for (uint32_t i = 0; i < max_bson_index; ++i) {
             char tmp[8];
@@ -38,8 +132,8 @@ namespace lbson {
         }
     }
 
-    static codec_base* mongo_codec() {
-        mgocodec* codec = new mgocodec();
+    static codec_base* mongo_codec(const char* compressor, int level) {
+        mgocodec* codec = new mgocodec(compressor, level);
         codec->set_bson(&thread_bson);
         return codec;
     }
@@ -56,6 +150,9 @@ namespace lbson {
         llbson.set_function("pairs", pairs);
         llbson.set_function("regex", regex);
         llbson.set_function("date", date);
+        llbson.set_function("compress", compress);
+        llbson.set_function("uncompress", uncompress);
+        llbson.set_function("diff", diff);
         llbson.new_enum("BSON_TYPE",
             "BSON_EOO", bson_type::BSON_EOO,
             "BSON_REAL", bson_type::BSON_REAL,
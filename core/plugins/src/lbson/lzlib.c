@@ -0,0 +1,6 @@
+//OP_COMPRESSED的zlib压缩, 复用luaxlsx中的miniz
+#define MINIZ_NO_STDIO
+#define MINIZ_NO_TIME
+#define MINIZ_NO_ARCHIVE_APIS
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#include "miniz.c"
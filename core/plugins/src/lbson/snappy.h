@@ -0,0 +1,206 @@
+#pragma once
+
+#include <string.h>
+#include <stdint.h>
+
+//https://github.com/google/snappy/blob/main/format_description.txt
+//mongo OP_COMPRESSED使用的snappy原始格式, 只实现单次压缩/解压
+namespace lbson {
+    namespace snappy {
+        const size_t SNAPPY_BLOCK       = 1 << 16;
+        const uint32_t SNAPPY_HASH_BITS = 14;
+
+        inline size_t max_compressed_length(size_t len) {
+            return 32 + len + len / 6;
+        }
+
+        inline uint32_t load32(const uint8_t* p) {
+            uint32_t v;
+            memcpy(&v, p, sizeof(v));
+            return v;
+        }
+
+        inline uint32_t hash(uint32_t v) {
+            return (v * 0x1e35a7bd) >> (32 - SNAPPY_HASH_BITS);
+        }
+
+        inline uint8_t* emit_literal(uint8_t* op, const uint8_t* literal, size_t len) {
+            size_t n = len - 1;
+            if (n < 60) {
+                *op++ = (uint8_t)(n << 2);
+            } else {
+                uint8_t* base = op++;
+                uint32_t count = 0;
+                while (n > 0) {
+                    *op++ = n & 0xff;
+                    n >>= 8;
+                    count++;
+                }
+                *base = (uint8_t)((59 + count) << 2);
+            }
+            memcpy(op, literal, len);
+            return op + len;
+        }
+
+        //len: 4~64
+        inline uint8_t* emit_copy_upto64(uint8_t* op, size_t offset, size_t len) {
+            if (len < 12 && offset < 2048) {
+                *op++ = (uint8_t)(1 | ((len - 4) << 2) | ((offset >> 8) << 5));
+                *op++ = offset & 0xff;
+            } else {
+                *op++ = (uint8_t)(2 | ((len - 1) << 2));
+                *op++ = offset & 0xff;
+                *op++ = (offset >> 8) & 0xff;
+            }
+            return op;
+        }
+
+        inline uint8_t* emit_copy(uint8_t* op, size_t offset, size_t len) {
+            while (len >= 68) {
+                op = emit_copy_upto64(op, offset, 64);
+                len -= 64;
+            }
+            if (len > 64) {
+                op = emit_copy_upto64(op, offset, 60);
+                len -= 60;
+            }
+            return emit_copy_upto64(op, offset, len);
+        }
+
+        //块内偏移不超过64K, 只需要1/2字节偏移的copy
+        inline uint8_t* compress_block(const uint8_t* input, size_t len, uint8_t* op, uint16_t* table) {
+            const uint8_t* ip = input;
+            const uint8_t* ip_end = input + len;
+            const uint8_t* next_emit = input;
+            if (len >= 16) {
+                memset(table, 0, sizeof(uint16_t) << SNAPPY_HASH_BITS);
+                const uint8_t* ip_limit = ip_end - 4;
+                uint32_t skip = 32;
+                ip++;
+                while (ip < ip_limit) {
+                    uint32_t v = load32(ip);
+                    uint32_t h = hash(v);
+                    const uint8_t* candidate = input + table[h];
+                    table[h] = (uint16_t)(ip - input);
+                    if (load32(candidate) != v) {
+                        //长时间无匹配时加大步长
+                        ip += skip++ >> 5;
+                        continue;
+                    }
+                    if (ip > next_emit) {
+                        op = emit_literal(op, next_emit, ip - next_emit);
+                    }
+                    size_t matched = 4;
+                    while (ip + matched < ip_end && candidate[matched] == ip[matched]) {
+                        matched++;
+                    }
+                    op = emit_copy(op, ip - candidate, matched);
+                    ip += matched;
+                    next_emit = ip;
+                    skip = 32;
+                    if (ip < ip_limit) {
+                        table[hash(load32(ip - 1))] = (uint16_t)(ip - 1 - input);
+                    }
+                }
+            }
+            if (next_emit < ip_end) {
+                op = emit_literal(op, next_emit, ip_end - next_emit);
+            }
+            return op;
+        }
+
+        //dst至少max_compressed_length(len)
+        inline size_t compress(const uint8_t* src, size_t len, uint8_t* dst) {
+            uint8_t* op = dst;
+            size_t v = len;
+            while (v >= 0x80) {
+                *op++ = (uint8_t)(v | 0x80);
+                v >>= 7;
+            }
+            *op++ = (uint8_t)v;
+            uint16_t table[1 << SNAPPY_HASH_BITS];
+            for (size_t pos = 0; pos < len; pos += SNAPPY_BLOCK) {
+                size_t block = (len - pos) < SNAPPY_BLOCK ? (len - pos) : SNAPPY_BLOCK;
+                op = compress_block(src + pos, block, op, table);
+            }
+            return op - dst;
+        }
+
+        inline const uint8_t* read_varint(const uint8_t* ip, const uint8_t* ip_end, size_t* value) {
+            size_t result = 0;
+            for (uint32_t shift = 0; shift < 35 && ip < ip_end; shift += 7) {
+                uint8_t c = *ip++;
+                result |= (size_t)(c & 0x7f) << shift;
+                if (c < 0x80) {
+                    *value = result;
+                    return ip;
+                }
+            }
+            return nullptr;
+        }
+
+        inline bool uncompressed_length(const uint8_t* src, size_t len, size_t* result) {
+            return read_varint(src, src + len, result) != nullptr;
+        }
+
+        //dst_len必须等于头部记录的原始长度
+        inline bool uncompress(const uint8_t* src, size_t len, uint8_t* dst, size_t dst_len) {
+            size_t expect = 0;
+            const uint8_t* ip_end = src + len;
+            const uint8_t* ip = read_varint(src, ip_end, &expect);
+            if (!ip || expect != dst_len) return false;
+            uint8_t* op = dst;
+            uint8_t* op_end = dst + dst_len;
+            while (ip < ip_end) {
+                uint8_t tag = *ip++;
+                size_t length, offset;
+                switch (tag & 3) {
+                case 0: {
+                        length = tag >> 2;
+                        if (length >= 60) {
+                            size_t bytes = length - 59;
+                            if ((size_t)(ip_end - ip) < bytes) return false;
+                            length = 0;
+                            for (size_t i = 0; i < bytes; ++i) {
+                                length |= (size_t)ip[i] << (8 * i);
+                            }
+                            ip += bytes;
+                        }
+                        length += 1;
+                        if ((size_t)(ip_end - ip) < length || (size_t)(op_end - op) < length) return false;
+                        memcpy(op, ip, length);
+                        ip += length;
+                        op += length;
+                    }
+                    continue;
+                case 1:
+                    if (ip_end - ip < 1) return false;
+                    length = 4 + ((tag >> 2) & 7);
+                    offset = ((size_t)(tag >> 5) << 8) | ip[0];
+                    ip += 1;
+                    break;
+                case 2:
+                    if (ip_end - ip < 2) return false;
+                    length = (tag >> 2) + 1;
+                    offset = ip[0] | ((size_t)ip[1] << 8);
+                    ip += 2;
+                    break;
+                default:
+                    if (ip_end - ip < 4) return false;
+                    length = (tag >> 2) + 1;
+                    offset = load32(ip);
+                    ip += 4;
+                    break;
+                }
+                if (offset == 0 || offset > (size_t)(op - dst) || (size_t)(op_end - op) < length) return false;
+                //允许重叠拷贝
+                const uint8_t* from = op - offset;
+                for (size_t i = 0; i < length; ++i) {
+                    op[i] = from[i];
+                }
+                op += length;
+            }
+            return op == op_end;
+        }
+    }
+}
@@ -0,0 +1,219 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <variant>
+#include <unordered_map>
+#include "timer_wheel.hpp"
+
+namespace cache {
+
+	//侵入式链表节点, 挂在时间轮的槽位或到期队列上, 摘除是O(1); 哨兵节点作为链表头
+	struct wheel_node {
+		using node_type = wheel_node*;
+
+		wheel_node* prev = this;
+		wheel_node* next = this;
+		void* owner = nullptr;
+		uint64_t expire = 0;
+
+		bool linked() const { return next != this; }
+
+		void unlink() {
+			prev->next = next;
+			next->prev = prev;
+			prev = next = this;
+		}
+
+		void push(wheel_node* node) {
+			node->prev = prev;
+			node->next = this;
+			prev->next = node;
+			prev = node;
+		}
+
+		//整条链表移到list尾部
+		void splice_to(wheel_node* list) {
+			if (!linked()) return;
+			wheel_node* first = next;
+			wheel_node* last = prev;
+			first->prev = list->prev;
+			last->next = list;
+			list->prev->next = first;
+			list->prev = last;
+			prev = next = this;
+		}
+
+		template<typename F>
+		void flush(F&& fn) {
+			wheel_node list;
+			splice_to(&list);
+			while (list.linked()) {
+				wheel_node* node = list.next;
+				node->unlink();
+				fn(node);
+			}
+		}
+
+		static uint64_t expire_of(wheel_node* node) { return node->expire; }
+	};
+
+	//分层时间轮(utility::timer_wheel); 到期节点按到期顺序进入FIFO队列, 由使用方分批取走
+	class timing_wheel {
+	public:
+		timing_wheel() = default;
+		timing_wheel(const timing_wheel&) = delete;
+		timing_wheel& operator=(const timing_wheel&) = delete;
+
+		void reset(uint64_t now) { wheel.reset(now); }
+
+		void schedule(wheel_node* node, uint64_t expire) {
+			uint64_t time = wheel.time();
+			if (expire <= time) {
+				//已在到期队列中的保持原有顺序
+				if (node->linked() && node->expire <= time) return;
+				node->unlink();
+				node->expire = expire;
+				due.push(node);
+				return;
+			}
+			node->unlink();
+			node->expire = expire;
+			wheel.add(node);
+		}
+
+		void update(uint64_t now) {
+			while (wheel.time() < now) {
+				wheel.shift();
+				wheel.current().splice_to(&due);
+			}
+		}
+
+		wheel_node* pop() {
+			if (!due.linked()) return nullptr;
+			wheel_node* node = due.next;
+			node->unlink();
+			return node;
+		}
+
+	protected:
+		wheel_node due;
+		utility::timer_wheel<wheel_node> wheel;
+	};
+
+	using store_key = std::variant<int64_t, std::string>;
+
+	struct store_entry {
+		store_key key;
+		wheel_node expire_node;
+		wheel_node dirty_node;
+	};
+
+	//缓存对象的过期和存盘调度: 过期时间轮 + 存盘时间轮(到期后按FIFO分批取出)
+	//时间以毫秒传入, 按tick_ms取整, 每次只处理到期的条目
+	class cache_store {
+	public:
+		cache_store(uint64_t clock_ms, uint32_t tick_ms) : tick_ms(tick_ms > 0 ? tick_ms : 1) {
+			expire_wheel.reset(clock_ms / this->tick_ms);
+			dirty_wheel.reset(clock_ms / this->tick_ms);
+		}
+
+		void expire(const store_key& key, uint64_t clock_ms) {
+			store_entry* entry = find_or_create(key);
+			expire_wheel.schedule(&entry->expire_node, to_tick(clock_ms));
+		}
+
+		void dirty(const store_key& key, uint64_t clock_ms) {
+			store_entry* entry = find_or_create(key);
+			if (!entry->dirty_node.linked()) {
+				dirty_count++;
+			}
+			dirty_wheel.schedule(&entry->dirty_node, to_tick(clock_ms));
+		}
+
+		void clean(const store_key& key) {
+			auto it = entries.find(key);
+			if (it != entries.end()) {
+				unlink_dirty(it->second.get());
+			}
+		}
+
+		bool remove(const store_key& key) {
+			auto it = entries.find(key);
+			if (it == entries.end()) {
+				return false;
+			}
+			unlink_dirty(it->second.get());
+			it->second->expire_node.unlink();
+			entries.erase(it);
+			return true;
+		}
+
+		//取出到期的过期检查, limit为0时不限数量
+		template<typename F>
+		size_t pop_expired(uint64_t clock_ms, size_t limit, F&& fn) {
+			expire_wheel.update(clock_ms / tick_ms);
+			return pop(expire_wheel, limit, false, fn);
+		}
+
+		template<typename F>
+		size_t pop_dirty(uint64_t clock_ms, size_t limit, F&& fn) {
+			dirty_wheel.update(clock_ms / tick_ms);
+			return pop(dirty_wheel, limit, true, fn);
+		}
+
+		template<typename F>
+		void foreach_dirty(F&& fn) {
+			for (auto& [key, entry] : entries) {
+				if (entry->dirty_node.linked()) fn(key);
+			}
+		}
+
+		size_t size() const { return entries.size(); }
+		size_t get_dirty_count() const { return dirty_count; }
+
+	protected:
+		uint64_t to_tick(uint64_t clock_ms) const {
+			return (clock_ms + tick_ms - 1) / tick_ms;
+		}
+
+		store_entry* find_or_create(const store_key& key) {
+			auto& entry = entries[key];
+			if (!entry) {
+				entry = std::make_unique<store_entry>();
+				entry->key = key;
+				entry->expire_node.owner = entry.get();
+				entry->dirty_node.owner = entry.get();
+			}
+			return entry.get();
+		}
+
+		void unlink_dirty(store_entry* entry) {
+			if (entry->dirty_node.linked()) {
+				entry->dirty_node.unlink();
+				dirty_count--;
+			}
+		}
+
+		template<typename F>
+		size_t pop(timing_wheel& wheel, size_t limit, bool is_dirty, F& fn) {
+			size_t count = 0;
+			while (limit == 0 || count < limit) {
+				wheel_node* node = wheel.pop();
+				if (!node) break;
+				if (is_dirty) dirty_count--;
+				fn(((store_entry*)node->owner)->key);
+				count++;
+			}
+			return count;
+		}
+
+	protected:
+		uint32_t tick_ms = 100;
+		size_t dirty_count = 0;
+		timing_wheel expire_wheel;
+		timing_wheel dirty_wheel;
+		std::unordered_map<store_key, std::unique_ptr<store_entry>> entries;
+	};
+}
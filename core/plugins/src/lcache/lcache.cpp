@@ -1,4 +1,5 @@
 #include "lrucache.hpp"
+#include "cache_store.hpp"
 #include "lua_kit.h"
 #include <vector>
 #include <memory>
@@ -113,6 +114,142 @@ namespace cache {
 		lua_setmetatable(L, -2);// set userdata metatable
 		return 1;
     }
+
+	static store_key read_key(lua_State* L, int idx) {
+		int type = lua_type(L, idx);
+		if (type == LUA_TNUMBER) {
+			int isnum = 0;
+			lua_Integer key = lua_tointegerx(L, idx, &isnum);
+			if (isnum) return key;
+		} else if (type == LUA_TSTRING) {
+			size_t len;
+			const char* key = lua_tolstring(L, idx, &len);
+			return std::string(key, len);
+		}
+		luaL_argerror(L, idx, "key must be integer or string");
+		return 0;
+	}
+
+	static void push_key(lua_State* L, const store_key& key) {
+		if (auto value = std::get_if<int64_t>(&key)) {
+			lua_pushinteger(L, *value);
+		} else {
+			auto& str = std::get<std::string>(key);
+			lua_pushlstring(L, str.data(), str.size());
+		}
+	}
+
+	static cache_store* check_store(lua_State* L) {
+		return (cache_store*)luaL_checkudata(L, 1, "lcachestore");
+	}
+
+	static int lstore_expire(lua_State* L) {
+		cache_store* store = check_store(L);
+		store->expire(read_key(L, 2), (uint64_t)luaL_checkinteger(L, 3));
+		return 0;
+	}
+
+	static int lstore_dirty(lua_State* L) {
+		cache_store* store = check_store(L);
+		store->dirty(read_key(L, 2), (uint64_t)luaL_checkinteger(L, 3));
+		return 0;
+	}
+
+	static int lstore_clean(lua_State* L) {
+		cache_store* store = check_store(L);
+		store->clean(read_key(L, 2));
+		return 0;
+	}
+
+	static int lstore_remove(lua_State* L) {
+		cache_store* store = check_store(L);
+		lua_pushboolean(L, store->remove(read_key(L, 2)) ? 1 : 0);
+		return 1;
+	}
+
+	//pop_expired(clock_ms, limit) => { key... }
+	static int lstore_pop_expired(lua_State* L) {
+		cache_store* store = check_store(L);
+		uint64_t clock_ms = (uint64_t)luaL_checkinteger(L, 2);
+		size_t limit = (size_t)luaL_optinteger(L, 3, 0);
+		lua_newtable(L);
+		lua_Integer index = 0;
+		store->pop_expired(clock_ms, limit, [&](const store_key& key) {
+			push_key(L, key);
+			lua_rawseti(L, -2, ++index);
+		});
+		return 1;
+	}
+
+	static int lstore_pop_dirty(lua_State* L) {
+		cache_store* store = check_store(L);
+		uint64_t clock_ms = (uint64_t)luaL_checkinteger(L, 2);
+		size_t limit = (size_t)luaL_optinteger(L, 3, 0);
+		lua_newtable(L);
+		lua_Integer index = 0;
+		store->pop_dirty(clock_ms, limit, [&](const store_key& key) {
+			push_key(L, key);
+			lua_rawseti(L, -2, ++index);
+		});
+		return 1;
+	}
+
+	//全部脏数据的key, 停服存盘时使用
+	static int lstore_dirty_keys(lua_State* L) {
+		cache_store* store = check_store(L);
+		lua_createtable(L, (int)store->get_dirty_count(), 0);
+		lua_Integer index = 0;
+		store->foreach_dirty([&](const store_key& key) {
+			push_key(L, key);
+			lua_rawseti(L, -2, ++index);
+		});
+		return 1;
+	}
+
+	static int lstore_size(lua_State* L) {
+		cache_store* store = check_store(L);
+		lua_pushinteger(L, store->size());
+		return 1;
+	}
+
+	static int lstore_dirty_count(lua_State* L) {
+		cache_store* store = check_store(L);
+		lua_pushinteger(L, store->get_dirty_count());
+		return 1;
+	}
+
+	static int lstore_release(lua_State* L) {
+		std::destroy_at(check_store(L));
+		return 0;
+	}
+
+	static int lstore_create(lua_State* L) {
+		uint64_t clock_ms = (uint64_t)luaL_checkinteger(L, 1);
+		uint32_t tick_ms = (uint32_t)luaL_optinteger(L, 2, 100);
+		void* p = lua_newuserdatauv(L, sizeof(cache_store), 0);
+		new (p) cache_store(clock_ms, tick_ms);
+		if (luaL_newmetatable(L, "lcachestore"))//mt
+		{
+			luaL_Reg l[] = {
+				{ "expire", lstore_expire},
+				{ "dirty", lstore_dirty},
+				{ "clean", lstore_clean},
+				{ "remove", lstore_remove},
+				{ "pop_expired", lstore_pop_expired},
+				{ "pop_dirty", lstore_pop_dirty},
+				{ "dirty_keys", lstore_dirty_keys},
+				{ "size", lstore_size},
+				{ "dirty_count", lstore_dirty_count},
+				{ NULL,NULL }
+			};
+			luaL_newlib(L, l); //{}
+			lua_setfield(L, -2, "__index");//mt[__index] = {}
+			lua_pushcfunction(L, lstore_release);
+			lua_setfield(L, -2, "__gc");//mt[__gc] = lstore_release
+		}
+		lua_setmetatable(L, -2);// set userdata metatable
+		return 1;
+	}
 }
 
 extern "C" {
@@ -120,6 +257,7 @@ extern "C" {
 	{
 		luaL_Reg l[] = {
 			{"new",cache::lcreate},
+			{"store",cache::lstore_create},
 			{"release",cache::lrelease},
 			{NULL,NULL}
 		};
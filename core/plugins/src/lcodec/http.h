@@ -144,7 +144,7 @@ namespace lcodec {
             }
         }
 
-        void http_parse_body(lua_State* L, string_view header, string_view buf) {
+        void http_parse_body(lua_State* L, string_view header, string_view& buf) {
             m_buf->clean();
             bool jsonable = false;
             bool contentlenable = false;
@@ -209,7 +209,7 @@ namespace lcodec {
             lua_pushboolean(L, jsonable);
         }
 
-        void parse_http_packet(lua_State* L, string_view buf) {
+        void parse_http_packet(lua_State* L, string_view& buf) {
             size_t pos = buf.find(CRLF2);
             if (pos == string_view::npos) {
                 throw length_error("http text not full");
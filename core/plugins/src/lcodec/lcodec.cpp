@@ -10,8 +10,8 @@ namespace lcodec {
         return rcodec;
     }
 
-    static codec_base* wss_codec(codec_base* codec) {
-        wsscodec* wcodec = new wsscodec();
+    static codec_base* wss_codec(codec_base* codec, size_t max_size, bool deflate) {
+        wsscodec* wcodec = new wsscodec(max_size, deflate);
         wcodec->set_codec(codec);
         wcodec->set_buff(luakit::get_buff());
         return wcodec;
@@ -1,6 +1,8 @@
 #pragma once
 #include <deque>
+#include <vector>
 #include <string>
+#include <string.h>
 
 #ifdef _MSC_VER
 #define strncasecmp _strnicmp
@@ -15,148 +17,311 @@ using namespace luakit;
 namespace lcodec {
     inline size_t       CRLF_LEN    = 2;
     inline const char*  RDS_CRLF    = "\r\n";
+    inline int64_t      RDS_BULK_MAX = 512 * 1024 * 1024;   //redis的proto-max-bulk-len
 
     class rdscodec : public codec_base {
     public:
+        //按长度分帧: 逐个值扫描, 记录已扫描位置和各层聚合类型剩余的元素数
+        //数据不完整时返回0并保留进度, 下次收到数据从断点继续, 完整后才交给decode
         virtual int load_packet(size_t data_len) {
             if (!m_slice) return 0;
-            return data_len;
+            const char* data = (const char*)m_slice->head();
+            while (true) {
+                const char* head = data + m_scan;
+                size_t remain = data_len - m_scan;
+                const char* crlf = find_crlf(head, remain);
+                if (!crlf) return 0;
+                //记录顶层值是否为RESP3的push消息
+                if (m_frames.empty()) m_push = (head[0] == '>');
+                int64_t count = 0;
+                size_t next = crlf - data + CRLF_LEN;
+                switch (head[0]) {
+                case '+': case '-': case ':': case '_': case '#': case ',': case '(':
+                    break;
+                case '$': case '!': case '=':
+                    if (!parse_length(head + 1, crlf, count) || count > RDS_BULK_MAX) return -1;
+                    if (count >= 0) {
+                        next += count + CRLF_LEN;
+                        if (next > data_len) return 0;
+                        if (memcmp(data + next - CRLF_LEN, RDS_CRLF, CRLF_LEN)) return -1;
+                    }
+                    count = 0;
+                    break;
+                case '*': case '~': case '>': case '%': case '|':
+                    if (!parse_length(head + 1, crlf, count)) return -1;
+                    //map的元素为键值对, 属性表之后还跟随一个实际的值
+                    if (head[0] == '%') count *= 2;
+                    if (head[0] == '|') count = count * 2 + 1;
+                    break;
+                default:
+                    return -1;
+                }
+                m_scan = next;
+                if (count > 0) {
+                    m_frames.push_back(count);
+                    continue;
+                }
+                //当前值完整, 逐层扣减父级剩余元素数
+                while (!m_frames.empty()) {
+                    if (--m_frames.back() > 0) break;
+                    m_frames.pop_back();
+                }
+                if (m_frames.empty()) {
+                    //push消息不计入应答数: 批量应答之前的单独返回, 夹在批量应答中的由decode另外返回
+                    if (m_push && m_replies > 0) continue;
+                    //批量命令的应答收齐后一起交给decode
+                    if (!m_push && ++m_replies < front_count()) continue;
+                    size_t packet_len = m_scan;
+                    m_scan = 0;
+                    m_replies = 0;
+                    return (int)packet_len;
+                }
+            }
         }
 
+        //encode(session_id, cmd, args...): 单条命令
+        //encode(session_id, { {cmd, args...}, ... }): 批量命令写入同一个缓冲区, 应答合并为一个包返回
         virtual uint8_t* encode(lua_State* L, int index, size_t* len) {
             m_buf->clean();
             int n = lua_gettop(L);
             uint32_t session_id = lua_tointeger(L, index++);
-            m_buf->write(fmt::format("*{}\r\n", n - index + 1));
-            for (int i = index; i <= n; ++i) {
-                encode_bulk_string(L, i);
+            if (lua_type(L, index) != LUA_TTABLE) {
+                m_buf->write(fmt::format("*{}\r\n", n - index + 1));
+                for (int i = index; i <= n; ++i) {
+                    encode_bulk_string(L, i);
+                }
+                sessions.push_back({ session_id, 1, false });
+                return m_buf->data(len);
             }
-            sessions.push_back(session_id);
+            uint32_t count = (uint32_t)lua_rawlen(L, index);
+            if (count == 0) luaL_error(L, "redis pipeline is empty");
+            for (uint32_t c = 1; c <= count; ++c) {
+                if (lua_rawgeti(L, index, c) != LUA_TTABLE) {
+                    luaL_error(L, "redis pipeline cmd %d must be table", c);
+                }
+                int cmd = lua_gettop(L);
+                lua_Integer argc = lua_rawlen(L, cmd);
+                m_buf->write(fmt::format("*{}\r\n", argc));
+                for (lua_Integer i = 1; i <= argc; ++i) {
+                    lua_rawgeti(L, cmd, i);
+                    encode_bulk_string(L, -1);
+                    lua_pop(L, 1);
+                }
+                lua_pop(L, 1);
+            }
+            sessions.push_back({ session_id, count, true });
             return m_buf->data(len);
         }
 
+        //load_packet保证了数据完整, 这里只做转换
+        //批量命令返回: session_id, true, results, errors(没有失败时为nil, 否则为 序号->错误信息), pushes(应答中夹带的push消息)
         virtual size_t decode(lua_State* L) {
             int top = lua_gettop(L);
             size_t osize = m_slice->size();
             string_view buf = m_slice->contents();
-            lua_pushinteger(L, sessions.empty() ? 0 : sessions.front());
-            parse_redis_packet(L, buf);
-            if (!sessions.empty()) sessions.pop_front();
+            //RESP3的push消息不对应请求
+            bool push = !buf.empty() && buf[0] == '>';
+            rds_session session = (push || sessions.empty()) ? rds_session{ 0, 1, false } : sessions.front();
+            lua_pushinteger(L, session.id);
+            //按encode时的形式区分, 只有一条命令的批量也返回结果数组
+            if (session.batch) {
+                parse_redis_batch(L, buf, session.count);
+            } else {
+                parse_redis_packet(L, buf);
+            }
+            if (!push && !sessions.empty()) sessions.pop_front();
             m_packet_len = osize - buf.size();
             m_slice->erase(m_packet_len);
             return lua_gettop(L) - top;
         }
 
+        virtual void error(const std::string& err) {
+            codec_base::error(err);
+            m_scan = 0;
+            m_replies = 0;
+            m_push = false;
+            m_frames.clear();
+        }
+
         void set_codec(codec_base* codec) {
             m_jcodec = codec;
         }
 
     protected:
-        void parse_redis_success(lua_State* L, string_view line) {
-            lua_pushboolean(L, true);
-            lua_pushlstring(L, line.data(), line.size());
+        uint32_t front_count() {
+            return sessions.empty() ? 1 : sessions.front().count;
         }
 
-        void parse_redis_error(lua_State* L, string_view line) {
-            lua_pushboolean(L, false);
-            lua_pushlstring(L, line.data(), line.size());
+        const char* find_crlf(const char* data, size_t len) {
+            const char* end = data + len;
+            while (data < end) {
+                const char* cr = (const char*)memchr(data, '\r', end - data);
+                if (!cr || cr + 1 >= end) return nullptr;
+                if (cr[1] == '\n') return cr;
+                data = cr + 1;
+            }
+            return nullptr;
         }
 
-        void parse_redis_integer(lua_State* L, string_view line, bool rootable = false) {
-            if (rootable) lua_pushboolean(L, true);
-            lua_pushinteger(L, atoll(line.data()));
+        bool parse_length(const char* data, const char* end, int64_t& value) {
+            bool negative = (data < end && *data == '-');
+            if (negative) data++;
+            if (data >= end) return false;
+            value = 0;
+            for (; data < end; ++data) {
+                if (*data < '0' || *data > '9' || value > RDS_BULK_MAX) return false;
+                value = value * 10 + (*data - '0');
+            }
+            if (negative) value = -value;
+            return true;
         }
 
-        void parse_redis_string(lua_State* L, string_view line, string_view& buf, bool rootable = false) {
-            int64_t length = atoll(line.data());
-            if (length >= 0) {
-                string_view nline;
-                if (!read_line(buf, nline))
-                    throw length_error("redis text not full");
-                if (!strncasecmp(nline.data(), "[js]", 4)) {
-                    nline.remove_prefix(4);
-                    m_jcodec->decode(L, (uint8_t*)nline.data(), nline.size());
-                } else {
-                    lua_pushlstring(L, nline.data(), nline.size());
-                }
-            }
-            else {
-                lua_pushnil(L);
-            }
-            if (rootable) {
-                lua_pushboolean(L, true);
-                lua_insert(L, -2);
-            }
+        string_view read_line(string_view& buf) {
+            size_t pos = buf.find(RDS_CRLF);
+            if (pos == string_view::npos) throw lua_exception("invalid redis format, line not end");
+            string_view line = buf.substr(0, pos);
+            buf.remove_prefix(pos + CRLF_LEN);
+            return line;
         }
 
-        void parse_redis_array(lua_State* L, string_view line, string_view& buf, bool rootable = false) {
-            int64_t length = atoll(line.data());
-            if (length >= 0) {
-                lua_createtable(L, 0, 4);
-                for (int i = 1; i <= length; ++i) {
-                    string_view line;
-                    if (!read_line(buf, line)) throw length_error("redis text not full");
-                    if (line.size() < 1) throw lua_exception("invalid redis array format,len is zero");
-                    switch (line[0]) {
-                    case ':':
-                        parse_redis_integer(L, line.substr(1));
-                        break;
-                    case '$':
-                        parse_redis_string(L, line.substr(1), buf);
-                        break;
-                    case '*':
-                        parse_redis_array(L, line.substr(1), buf);
-                        break;
-                    default:
-                        throw lua_exception(fmt::format("invalid redis array format:{}", line).c_str());
-                        break;
-                    }
-                    lua_seti(L, -2, i);
-                }
-            }
-            else {
-                lua_pushnil(L);
-            }
-            if (rootable) {
-                lua_pushboolean(L, true);
-                lua_insert(L, -2);
+        string_view read_bulk(string_view& buf, int64_t length) {
+            string_view data = buf.substr(0, length);
+            buf.remove_prefix(length + CRLF_LEN);
+            return data;
+        }
+
+        void parse_redis_string(lua_State* L, string_view data) {
+            if (data.size() >= 4 && !strncasecmp(data.data(), "[js]", 4)) {
+                data.remove_prefix(4);
+                m_jcodec->decode(L, (uint8_t*)data.data(), data.size());
+            } else {
+                lua_pushlstring(L, data.data(), data.size());
             }
         }
 
-        void parse_redis_packet(lua_State* L, string_view& buf) {
-            string_view line;
-            if (!read_line(buf, line)) throw length_error("redis text not full");
+        //解析一个值压栈, 返回false表示该值是错误应答
+        bool parse_redis_value(lua_State* L, string_view& buf, int depth) {
+            if (depth > luakit::max_encode_depth) throw lua_exception("redis reply too depth");
+            luaL_checkstack(L, 4, "redis reply too depth");
+            string_view line = read_line(buf);
             if (line.size() < 1) throw lua_exception("invalid redis format,len is zero");
-            switch (line[0]) {
+            char type = line[0];
+            line.remove_prefix(1);
+            int64_t length = 0;
+            switch (type) {
             case '+':
-                parse_redis_success(L, line.substr(1));
-                break;
+            case '(':
+                lua_pushlstring(L, line.data(), line.size());
+                return true;
             case '-':
-                parse_redis_error(L, line.substr(1));
-                break;
+                lua_pushlstring(L, line.data(), line.size());
+                return false;
             case ':':
-                parse_redis_integer(L, line.substr(1), true);
-                break;
+                lua_pushinteger(L, atoll(line.data()));
+                return true;
+            case ',':
+                lua_pushnumber(L, atof(line.data()));
+                return true;
+            case '#':
+                lua_pushboolean(L, !line.empty() && line[0] == 't');
+                return true;
+            case '_':
+                lua_pushnil(L);
+                return true;
             case '$':
-                parse_redis_string(L, line.substr(1), buf, true);
-                break;
+            case '!':
+            case '=': {
+                parse_length(line.data(), line.data() + line.size(), length);
+                if (length < 0) {
+                    lua_pushnil(L);
+                    return true;
+                }
+                string_view data = read_bulk(buf, length);
+                if (type == '!') {
+                    lua_pushlstring(L, data.data(), data.size());
+                    return false;
+                }
+                //verbatim字符串带3字节格式前缀, 如txt:
+                if (type == '=' && data.size() >= 4) data.remove_prefix(4);
+                parse_redis_string(L, data);
+                return true;
+            }
             case '*':
-                parse_redis_array(L, line.substr(1), buf, true);
-                break;
+            case '~':
+            case '>':
+                parse_length(line.data(), line.data() + line.size(), length);
+                if (length < 0) {
+                    lua_pushnil(L);
+                    return true;
+                }
+                lua_createtable(L, (int)length, 0);
+                for (int64_t i = 1; i <= length; ++i) {
+                    parse_redis_value(L, buf, depth + 1);
+                    lua_seti(L, -2, i);
+                }
+                return true;
+            case '%':
+                parse_length(line.data(), line.data() + line.size(), length);
+                lua_createtable(L, 0, (int)length);
+                for (int64_t i = 1; i <= length; ++i) {
+                    parse_redis_value(L, buf, depth + 1);
+                    parse_redis_value(L, buf, depth + 1);
+                    if (lua_isnil(L, -2)) {
+                        lua_pop(L, 2);
+                        continue;
+                    }
+                    lua_rawset(L, -3);
+                }
+                return true;
+            case '|':
+                //属性表暂不透出, 跳过后解析实际的值
+                parse_length(line.data(), line.data() + line.size(), length);
+                for (int64_t i = 0; i < length * 2; ++i) {
+                    parse_redis_value(L, buf, depth + 1);
+                    lua_pop(L, 1);
+                }
+                return parse_redis_value(L, buf, depth);
             default:
-                throw lua_exception(fmt::format("invalid redis format:{}",line).c_str());
-                break;
+                throw lua_exception(fmt::format("invalid redis format:{}", type).c_str());
             }
         }
 
-        bool read_line(string_view& buf, string_view& line) {
-            size_t pos = buf.find(RDS_CRLF);
-            if (pos != string_view::npos) {
-                line = buf.substr(0, pos);
-                buf.remove_prefix(pos + CRLF_LEN);
-                return true;
+        void parse_redis_batch(lua_State* L, string_view& buf, uint32_t count) {
+            lua_pushboolean(L, true);
+            lua_createtable(L, count, 0);
+            int results = lua_gettop(L);
+            //errors和pushes有内容时才创建
+            lua_pushnil(L);
+            lua_pushnil(L);
+            int errors = results + 1, pushes = results + 2;
+            for (uint32_t i = 1; i <= count; ++i) {
+                while (!buf.empty() && buf[0] == '>') {
+                    if (lua_isnil(L, pushes)) {
+                        lua_createtable(L, 4, 0);
+                        lua_replace(L, pushes);
+                    }
+                    parse_redis_value(L, buf, 0);
+                    lua_rawseti(L, pushes, lua_rawlen(L, pushes) + 1);
+                }
+                if (!parse_redis_value(L, buf, 0)) {
+                    if (lua_isnil(L, errors)) {
+                        lua_createtable(L, 0, 4);
+                        lua_replace(L, errors);
+                    }
+                    lua_pushvalue(L, -1);
+                    lua_rawseti(L, errors, i);
+                }
+                lua_rawseti(L, results, i);
+            }
+            if (lua_isnil(L, pushes)) lua_pop(L, 1);
+        }
+
+        void parse_redis_packet(lua_State* L, string_view& buf) {
+            lua_pushboolean(L, true);
+            if (!parse_redis_value(L, buf, 0)) {
+                lua_pushboolean(L, false);
+                lua_replace(L, -3);
             }
-            return false;
         }
 
         void number_encode(double value) {
@@ -202,7 +367,17 @@ namespace lcodec {
         }
 
     protected:
-        deque<uint32_t> sessions;
+        //批量命令的session对应count个应答
+        struct rds_session {
+            uint32_t id;
+            uint32_t count;
+            bool batch;
+        };
+        deque<rds_session> sessions;
         codec_base* m_jcodec = nullptr;
+        size_t m_scan = 0;              //当前应答已分帧的长度
+        vector<int64_t> m_frames;       //未完成的聚合类型剩余元素数
+        uint32_t m_replies = 0;         //当前批量命令已完整的应答数
+        bool m_push = false;            //当前顶层值是push消息
     };
 }
@@ -2,6 +2,20 @@
 
 #include "lua_kit.h"
 
+#define MINIZ_NO_STDIO
+#define MINIZ_NO_TIME
+#define MINIZ_NO_ARCHIVE_APIS
+#define MINIZ_NO_ZLIB_COMPATIBLE_NAMES
+#include "miniz.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define WS_UNMASK_SSE2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define WS_UNMASK_SSE2
+#endif
+
 using namespace std;
 using namespace luakit;
 
@@ -25,8 +39,52 @@ namespace lcodec {
             | ((uint16_t)data[0] << 8);
     }
 
+    //掩码按4字节循环, 向量化时每次处理的长度都是4的倍数, 掩码不需要错位
+    inline void ws_unmask(uint8_t* data, size_t len, const uint8_t* mask) {
+        uint32_t mask32;
+        memcpy(&mask32, mask, sizeof(uint32_t));
+        size_t i = 0;
+#if defined(__AVX2__)
+        __m256i mask256 = _mm256_set1_epi32((int)mask32);
+        for (; i + 32 <= len; i += 32) {
+            __m256i v = _mm256_loadu_si256((__m256i*)(data + i));
+            _mm256_storeu_si256((__m256i*)(data + i), _mm256_xor_si256(v, mask256));
+        }
+#endif
+#if defined(WS_UNMASK_SSE2)
+        __m128i mask128 = _mm_set1_epi32((int)mask32);
+        for (; i + 16 <= len; i += 16) {
+            __m128i v = _mm_loadu_si128((__m128i*)(data + i));
+            _mm_storeu_si128((__m128i*)(data + i), _mm_xor_si128(v, mask128));
+        }
+#endif
+        uint64_t mask64 = ((uint64_t)mask32 << 32) | mask32;
+        for (; i + 8 <= len; i += 8) {
+            uint64_t v;
+            memcpy(&v, data + i, sizeof(uint64_t));
+            v ^= mask64;
+            memcpy(data + i, &v, sizeof(uint64_t));
+        }
+        for (; i < len; i++) {
+            data[i] ^= mask[i & 3];
+        }
+    }
+
+    constexpr size_t WS_MAX_SIZE        = 4 * 1024 * 1024;  //默认单条消息上限
+    constexpr size_t WS_DEFLATE_MIN     = 256;              //小于该长度的消息不压缩
+    constexpr uint8_t WS_RSV1           = 0x40;             //permessage-deflate压缩标记
+
     class wsscodec : public codec_base {
     public:
+        wsscodec(size_t max_size, bool deflate) : m_deflate(deflate) {
+            m_max_size = max_size > 0 ? max_size : WS_MAX_SIZE;
+        }
+
+        ~wsscodec() {
+            if (m_inflate_init) mz_inflateEnd(&m_inflate);
+            if (m_deflate_init) mz_deflateEnd(&m_deflater);
+        }
+
         virtual int load_packet(size_t data_len) {
             if (!m_slice) return 0;
             uint8_t* payload = (uint8_t*)m_slice->peek(sizeof(uint8_t), 1);
@@ -35,12 +93,14 @@ namespace lcodec {
             uint8_t payloadlen = (*payload) & 0x7f;
             if (payloadlen < 0x7e) {
                 m_packet_len = masklen + payloadlen + sizeof(uint16_t);
+                if (m_packet_len > m_slice->size()) return 0;
                 return m_packet_len;
             }
             size_t ext_len = (payloadlen == 0x7f) ? 8 : 2;
             uint8_t* data = m_slice->peek(ext_len, sizeof(uint16_t));
             if (!data) return 0;
             size_t length = (payloadlen == 0x7f) ? byteswap8(*(uint64_t*)data) : byteswap2(*(uint16_t*)data);
+            if (length > m_max_size) return -1;
             m_packet_len = masklen + ext_len + length + sizeof(uint16_t);
             if (m_packet_len > m_slice->size()) return 0;
             return m_packet_len;
@@ -55,7 +115,13 @@ namespace lcodec {
             } else {
                 body = (uint8_t*)lua_tolstring(L, index + 1, len);
             }
-            m_buf->write<uint8_t>((0x80 | opcode));
+            //数据帧超过阈值时压缩, 控制帧不压缩
+            uint8_t head = (uint8_t)(0x80 | opcode);
+            if (m_deflate && opcode <= 0x02 && *len >= WS_DEFLATE_MIN) {
+                body = deflate_body(body, len);
+                head |= WS_RSV1;
+            }
+            m_buf->write<uint8_t>(head);
             if (*len < 0x7e) {
                 m_buf->write<uint8_t>(*len);
             } else if (*len <= 0xffff) {
@@ -69,49 +135,153 @@ namespace lcodec {
             return m_buf->data(len);
         }
 
+        //分片的消息收完整之前不返回数据
         virtual size_t decode(lua_State* L) {
             uint8_t head = *(uint8_t*)m_slice->read<uint8_t>();
-            if ((head & 0x80) != 0x80) throw lua_exception("sharded packet not suppert!");
             uint8_t payload  = *(uint8_t*)m_slice->read<uint8_t>();
+            bool fin = ((head & 0x80) == 0x80);
+            bool zip = ((head & WS_RSV1) == WS_RSV1);
             uint8_t opcode = head & 0xf;
             bool mask = ((payload & 0x80) == 0x80);
             payload = payload & 0x7f;
             if (payload >= 0x7e) {
                 m_slice->erase((payload == 0x7f) ? 8 : 2);
             }
-            int top = lua_gettop(L);
-            lua_pushstring(L, "WSS");
-            lua_pushinteger(L, opcode);
             if (mask) {
                 size_t data_len;
-                char* maskkey = (char*)m_slice->erase(4);
-                char* data = (char*)m_slice->data(&data_len);
-                xor_byte(data, maskkey, data_len, 4);
+                uint8_t* maskkey = m_slice->erase(4);
+                uint8_t* data = m_slice->data(&data_len);
+                ws_unmask(data, data_len, maskkey);
             }
             size_t osize = m_slice->size();
+            uint8_t* data = m_slice->head();
+            m_slice->erase(osize);
+            //控制帧不分片, 可以插在分片中间
+            if (opcode >= 0x08) {
+                if (!fin) throw lua_exception("fragmented control frame!");
+                return push_message(L, opcode, data, osize);
+            }
+            if (zip && !m_deflate) throw lua_exception("deflate not negotiated!");
+            if (opcode != 0x00) {
+                if (m_frag_opcode != 0) throw lua_exception("new message before fragments finished!");
+                if (fin) {
+                    if (zip) data = inflate_body(data, &osize);
+                    return push_message(L, opcode, data, osize);
+                }
+                m_frag_opcode = opcode;
+                m_frag_zip = zip;
+                m_frags.assign((char*)data, osize);
+                return 0;
+            }
+            //continuation
+            if (m_frag_opcode == 0) throw lua_exception("continuation frame without start!");
+            if (m_frags.size() + osize > m_max_size) throw lua_exception("fragmented message too large!");
+            m_frags.append((char*)data, osize);
+            if (!fin) return 0;
+            opcode = m_frag_opcode;
+            m_frag_opcode = 0;
+            data = (uint8_t*)m_frags.data();
+            osize = m_frags.size();
+            if (m_frag_zip) data = inflate_body(data, &osize);
+            return push_message(L, opcode, data, osize);
+        }
+
+        void set_codec(codec_base* codec) {
+            m_jcodec = codec;
+        }
+
+    protected:
+        size_t push_message(lua_State* L, uint8_t opcode, uint8_t* data, size_t len) {
+            int top = lua_gettop(L);
+            lua_pushstring(L, "WSS");
+            lua_pushinteger(L, opcode);
             if (opcode == 0x02) {
-                m_jcodec->set_slice(m_slice);
+                slice mslice(data, len);
+                m_jcodec->set_slice(&mslice);
                 m_jcodec->decode(L);
             } else {
-                lua_pushlstring(L, (char*)m_slice->head(), osize);
+                lua_pushlstring(L, (char*)data, len);
             }
-            m_slice->erase(osize);
             return lua_gettop(L) - top;
         }
 
-        void set_codec(codec_base* codec) {
-            m_jcodec = codec;
+        //双方都不保留上下文(no_context_takeover), 每条消息重置压缩流
+        uint8_t* inflate_body(uint8_t* data, size_t* len) {
+            static const uint8_t tail[4] = { 0x00, 0x00, 0xff, 0xff };
+            if (!m_inflate_init) {
+                memset(&m_inflate, 0, sizeof(m_inflate));
+                if (mz_inflateInit2(&m_inflate, -MZ_DEFAULT_WINDOW_BITS) != MZ_OK) throw lua_exception("inflate init failed!");
+                m_inflate_init = true;
+            } else {
+                mz_inflateReset(&m_inflate);
+            }
+            if (m_unzip.size() < *len * 4) m_unzip.resize(std::min(*len * 4, m_max_size));
+            if (m_unzip.size() < 1024) m_unzip.resize(1024);
+            m_unzip_len = 0;
+            int ret = inflate_chunk(data, *len);
+            if (ret != MZ_STREAM_END) inflate_chunk((uint8_t*)tail, sizeof(tail));
+            *len = m_unzip_len;
+            return m_unzip.data();
         }
 
-    protected:
-        char* xor_byte(char* buffer, char* mask, size_t blen, size_t mlen) {
-            for (size_t i = 0; i < blen; i++) {
-                buffer[i] = buffer[i] ^ mask[i % mlen];
+        int inflate_chunk(uint8_t* data, size_t len) {
+            m_inflate.next_in = data;
+            m_inflate.avail_in = (unsigned int)len;
+            while (true) {
+                if (m_unzip_len == m_unzip.size()) {
+                    if (m_unzip.size() >= m_max_size) throw lua_exception("inflate message too large!");
+                    m_unzip.resize(std::min(m_unzip.size() * 2, m_max_size));
+                }
+                m_inflate.next_out = m_unzip.data() + m_unzip_len;
+                m_inflate.avail_out = (unsigned int)(m_unzip.size() - m_unzip_len);
+                int ret = mz_inflate(&m_inflate, MZ_SYNC_FLUSH);
+                m_unzip_len = m_unzip.size() - m_inflate.avail_out;
+                if (ret == MZ_STREAM_END) return ret;
+                if (ret != MZ_OK && ret != MZ_BUF_ERROR) throw lua_exception("inflate failed: %d!", ret);
+                //输入已消耗完且输出还有空间
+                if (m_inflate.avail_in == 0 && m_inflate.avail_out > 0) return ret;
+            }
+        }
+
+        //SYNC_FLUSH结尾的00 00 ff ff按协议去掉
+        uint8_t* deflate_body(uint8_t* body, size_t* len) {
+            if (!m_deflate_init) {
+                memset(&m_deflater, 0, sizeof(m_deflater));
+                if (mz_deflateInit2(&m_deflater, MZ_BEST_SPEED, MZ_DEFLATED, -MZ_DEFAULT_WINDOW_BITS, 9, MZ_DEFAULT_STRATEGY) != MZ_OK) {
+                    throw lua_exception("deflate init failed!");
+                }
+                m_deflate_init = true;
+            } else {
+                mz_deflateReset(&m_deflater);
             }
-            return buffer;
+            size_t bound = mz_deflateBound(&m_deflater, (mz_ulong)*len) + 16;
+            if (m_zip.size() < bound) m_zip.resize(bound);
+            m_deflater.next_in = body;
+            m_deflater.avail_in = (unsigned int)*len;
+            m_deflater.next_out = m_zip.data();
+            m_deflater.avail_out = (unsigned int)m_zip.size();
+            int ret = mz_deflate(&m_deflater, MZ_SYNC_FLUSH);
+            if (ret != MZ_OK || m_deflater.avail_in != 0) throw lua_exception("deflate failed: %d!", ret);
+            size_t zip_len = m_zip.size() - m_deflater.avail_out;
+            *len = zip_len >= 4 ? zip_len - 4 : zip_len;
+            return m_zip.data();
         }
 
     protected:
         codec_base* m_jcodec = nullptr;
+        size_t m_max_size = WS_MAX_SIZE;
+        bool m_deflate = false;
+        //分片
+        uint8_t m_frag_opcode = 0;
+        bool m_frag_zip = false;
+        std::string m_frags;
+        //permessage-deflate
+        bool m_inflate_init = false;
+        bool m_deflate_init = false;
+        mz_stream m_inflate;
+        mz_stream m_deflater;
+        size_t m_unzip_len = 0;
+        std::vector<uint8_t> m_zip;
+        std::vector<uint8_t> m_unzip;
     };
 }
@@ -0,0 +1,128 @@
+#include "metrics.hpp"
+#include "lua_kit.h"
+
+namespace lmetrics {
+	static metric_registry& registry() {
+		return metric_registry::instance();
+	}
+
+	static int lintern(lua_State* L, metric_type type) {
+		size_t len;
+		const char* name = luaL_checklstring(L, 1, &len);
+		uint32_t id = registry().intern(std::string(name, len), type);
+		if (id == 0) {
+			return luaL_argerror(L, 1, "metric type conflict or too many metrics");
+		}
+		lua_pushinteger(L, id);
+		return 1;
+	}
+
+	static int lcounter(lua_State* L) {
+		return lintern(L, metric_type::counter);
+	}
+
+	static int lgauge(lua_State* L) {
+		return lintern(L, metric_type::gauge);
+	}
+
+	static int lhistogram(lua_State* L) {
+		return lintern(L, metric_type::histogram);
+	}
+
+	//counter/gauge累加
+	static int ladd(lua_State* L) {
+		lua_Integer id = luaL_checkinteger(L, 1);
+		auto type = registry().type(id);
+		if (type != metric_type::counter && type != metric_type::gauge) {
+			return luaL_argerror(L, 1, "invalid counter or gauge id");
+		}
+		registry().add((uint32_t)id, luaL_optinteger(L, 2, 1));
+		return 0;
+	}
+
+	static int lset(lua_State* L) {
+		lua_Integer id = luaL_checkinteger(L, 1);
+		if (registry().type(id) != metric_type::gauge) {
+			return luaL_argerror(L, 1, "invalid gauge id");
+		}
+		registry().set((uint32_t)id, luaL_checkinteger(L, 2));
+		return 0;
+	}
+
+	static int lobserve(lua_State* L) {
+		lua_Integer id = luaL_checkinteger(L, 1);
+		if (registry().type(id) != metric_type::histogram) {
+			return luaL_argerror(L, 1, "invalid histogram id");
+		}
+		lua_Integer v = luaL_checkinteger(L, 2);
+		registry().observe((uint32_t)id, v > 0 ? (uint64_t)v : 0);
+		return 0;
+	}
+
+	static int lvalue(lua_State* L) {
+		lua_Integer id = luaL_checkinteger(L, 1);
+		auto type = registry().type(id);
+		if (type != metric_type::counter && type != metric_type::gauge) {
+			return luaL_argerror(L, 1, "invalid counter or gauge id");
+		}
+		lua_pushinteger(L, registry().value((uint32_t)id));
+		return 1;
+	}
+
+	static void set_field(lua_State* L, const char* key, uint64_t v) {
+		lua_pushinteger(L, (lua_Integer)v);
+		lua_setfield(L, -2, key);
+	}
+
+	//snapshot(prefix, detail): {name = value}, 直方图为{count, sum, max[, p50, p90, p99, p999]}
+	static int lsnapshot(lua_State* L) {
+		size_t len = 0;
+		const char* prefix = luaL_optlstring(L, 1, "", &len);
+		bool detail = lua_toboolean(L, 2);
+		lua_newtable(L);
+		registry().snapshot(std::string(prefix, len), detail, [&](const metric_info& info, int64_t value, hist_summary* summary) {
+			if (summary == nullptr) {
+				lua_pushinteger(L, value);
+			} else {
+				lua_createtable(L, 0, detail ? 7 : 3);
+				set_field(L, "count", summary->count);
+				set_field(L, "sum", summary->sum);
+				set_field(L, "max", summary->max);
+				if (detail) {
+					set_field(L, "p50", summary->quantile(0.5));
+					set_field(L, "p90", summary->quantile(0.9));
+					set_field(L, "p99", summary->quantile(0.99));
+					set_field(L, "p999", summary->quantile(0.999));
+				}
+			}
+			lua_setfield(L, -2, info.name.c_str());
+		});
+		return 1;
+	}
+
+	static int lsize(lua_State* L) {
+		lua_pushinteger(L, registry().size());
+		lua_pushinteger(L, registry().shards());
+		return 2;
+	}
+}
+
+extern "C" {
+	LUALIB_API int luaopen_lmetrics(lua_State* L)
+	{
+		luaL_Reg l[] = {
+			{"counter", lmetrics::lcounter},
+			{"gauge", lmetrics::lgauge},
+			{"histogram", lmetrics::lhistogram},
+			{"add", lmetrics::ladd},
+			{"set", lmetrics::lset},
+			{"observe", lmetrics::lobserve},
+			{"value", lmetrics::lvalue},
+			{"snapshot", lmetrics::lsnapshot},
+			{"size", lmetrics::lsize},
+			{NULL,NULL}
+		};
+		luaL_newlib(L, l);
+		return 1;
+	}
+}
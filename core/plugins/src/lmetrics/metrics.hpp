@@ -0,0 +1,334 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace lmetrics {
+
+	enum class metric_type : uint8_t {
+		none = 0,
+		counter = 1,
+		gauge = 2,
+		histogram = 3,
+	};
+
+	constexpr uint32_t METRIC_BLOCK = 256;
+	constexpr uint32_t METRIC_BLOCKS = 256;
+	constexpr uint32_t METRIC_MAX = METRIC_BLOCK * METRIC_BLOCKS;
+
+	//直方图分桶: 小于16精确计数, 之后每个2的幂区间再分16档, 相对误差不超过1/16
+	constexpr uint32_t HIST_SUB_BITS = 4;
+	constexpr uint32_t HIST_SUB = 1 << HIST_SUB_BITS;
+	constexpr uint32_t HIST_BUCKETS = (64 - HIST_SUB_BITS + 1) * HIST_SUB;
+
+	inline uint32_t highest_bit(uint64_t v) {
+#ifdef _MSC_VER
+		unsigned long r = 0;
+		_BitScanReverse64(&r, v);
+		return (uint32_t)r;
+#else
+		return 63 - (uint32_t)__builtin_clzll(v);
+#endif
+	}
+
+	inline uint32_t hist_index(uint64_t v) {
+		if (v < HIST_SUB) {
+			return (uint32_t)v;
+		}
+		uint32_t e = highest_bit(v);
+		return (e - HIST_SUB_BITS + 1) * HIST_SUB + (uint32_t)((v >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+	}
+
+	//桶内的最大值
+	inline uint64_t hist_upper(uint32_t index) {
+		if (index < HIST_SUB) {
+			return index;
+		}
+		uint32_t shift = index / HIST_SUB - 1;
+		uint64_t lower = (uint64_t)(HIST_SUB + index % HIST_SUB) << shift;
+		return lower + ((1ull << shift) - 1);
+	}
+
+	//单写者累加, 不需要lock前缀, 读线程读到的是某个时刻的完整值
+	template <typename T>
+	inline void relaxed_add(std::atomic<T>& a, T n) {
+		a.store(a.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+	}
+
+	struct hist_data {
+		std::atomic<uint64_t> count{ 0 };
+		std::atomic<uint64_t> sum{ 0 };
+		std::atomic<uint64_t> max{ 0 };
+		std::atomic<uint64_t> buckets[HIST_BUCKETS] = {};
+
+		void observe(uint64_t v) {
+			relaxed_add<uint64_t>(buckets[hist_index(v)], 1);
+			relaxed_add<uint64_t>(count, 1);
+			relaxed_add<uint64_t>(sum, v);
+			if (v > max.load(std::memory_order_relaxed)) {
+				max.store(v, std::memory_order_relaxed);
+			}
+		}
+	};
+
+	struct metric_cell {
+		std::atomic<int64_t> value{ 0 };
+		std::atomic<hist_data*> hist{ nullptr };
+	};
+
+	struct metric_block {
+		metric_cell cells[METRIC_BLOCK];
+
+		~metric_block() {
+			for (auto& cell : cells) {
+				delete cell.hist.load(std::memory_order_relaxed);
+			}
+		}
+	};
+
+	//按id分块存放的指标值, 块和直方图由写线程按需分配, 读线程acquire后访问
+	struct metric_shard {
+		std::atomic<metric_block*> blocks[METRIC_BLOCKS] = {};
+
+		~metric_shard() {
+			for (auto& block : blocks) {
+				delete block.load(std::memory_order_relaxed);
+			}
+		}
+
+		metric_cell* find(uint32_t id) {
+			auto block = blocks[id / METRIC_BLOCK].load(std::memory_order_acquire);
+			return block ? &block->cells[id % METRIC_BLOCK] : nullptr;
+		}
+
+		metric_cell* cell(uint32_t id) {
+			auto& slot = blocks[id / METRIC_BLOCK];
+			auto block = slot.load(std::memory_order_acquire);
+			if (block == nullptr) {
+				block = new metric_block();
+				slot.store(block, std::memory_order_release);
+			}
+			return &block->cells[id % METRIC_BLOCK];
+		}
+
+		hist_data* hist(uint32_t id) {
+			auto c = cell(id);
+			auto h = c->hist.load(std::memory_order_acquire);
+			if (h == nullptr) {
+				h = new hist_data();
+				c->hist.store(h, std::memory_order_release);
+			}
+			return h;
+		}
+	};
+
+	struct hist_summary {
+		uint64_t count = 0;
+		uint64_t sum = 0;
+		uint64_t max = 0;
+		std::vector<uint64_t> buckets;
+
+		void merge(hist_data* h, bool detail) {
+			count += h->count.load(std::memory_order_relaxed);
+			sum += h->sum.load(std::memory_order_relaxed);
+			max = std::max(max, h->max.load(std::memory_order_relaxed));
+			if (detail) {
+				buckets.resize(HIST_BUCKETS);
+				for (uint32_t i = 0; i < HIST_BUCKETS; ++i) {
+					buckets[i] += h->buckets[i].load(std::memory_order_relaxed);
+				}
+			}
+		}
+
+		uint64_t quantile(double q) const {
+			uint64_t total = 0;
+			for (auto n : buckets) total += n;
+			if (total == 0) {
+				return 0;
+			}
+			uint64_t rank = std::max<uint64_t>(1, (uint64_t)(q * total + 0.5)), seen = 0;
+			for (uint32_t i = 0; i < HIST_BUCKETS; ++i) {
+				seen += buckets[i];
+				if (seen >= rank) {
+					return std::min(hist_upper(i), max);
+				}
+			}
+			return max;
+		}
+	};
+
+	struct metric_info {
+		std::string name;
+		metric_type type;
+	};
+
+	//全局指标注册表
+	//写入: 每个线程写自己的分片, 无锁无共享缓存行; gauge是全局值, 直接原子操作
+	//读取: 加锁遍历所有分片聚合, 线程退出时分片累加到全局分片后释放
+	class metric_registry {
+	public:
+		static metric_registry& instance() {
+			static metric_registry registry;
+			return registry;
+		}
+
+		//名字驻留为id, 0表示类型冲突或者超出上限
+		uint32_t intern(const std::string& name, metric_type type) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			auto it = m_ids.find(name);
+			if (it != m_ids.end()) {
+				return (m_metrics[it->second].type == type) ? it->second : 0;
+			}
+			uint32_t id = (uint32_t)m_metrics.size();
+			if (id >= METRIC_MAX) {
+				return 0;
+			}
+			m_global.cell(id);
+			m_metrics.push_back({ name, type });
+			m_ids.emplace(name, id);
+			m_types[id].store((uint8_t)type, std::memory_order_release);
+			return id;
+		}
+
+		metric_type type(uint64_t id) {
+			if (id >= METRIC_MAX) {
+				return metric_type::none;
+			}
+			return (metric_type)m_types[id].load(std::memory_order_acquire);
+		}
+
+		void add(uint32_t id, int64_t n) {
+			if (type(id) == metric_type::gauge) {
+				m_global.find(id)->value.fetch_add(n, std::memory_order_relaxed);
+				return;
+			}
+			relaxed_add<int64_t>(local_shard()->cell(id)->value, n);
+		}
+
+		void set(uint32_t id, int64_t v) {
+			m_global.find(id)->value.store(v, std::memory_order_relaxed);
+		}
+
+		void observe(uint32_t id, uint64_t v) {
+			local_shard()->hist(id)->observe(v);
+		}
+
+		int64_t value(uint32_t id) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			int64_t v = m_global.find(id)->value.load(std::memory_order_relaxed);
+			if (m_metrics[id].type == metric_type::counter) {
+				for (auto shard : m_shards) {
+					if (auto c = shard->find(id)) v += c->value.load(std::memory_order_relaxed);
+				}
+			}
+			return v;
+		}
+
+		//遍历名字以prefix开头的指标, 聚合所有分片
+		template <typename F>
+		void snapshot(const std::string& prefix, bool detail, F&& visit) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			for (uint32_t id = 1; id < m_metrics.size(); ++id) {
+				auto& info = m_metrics[id];
+				if (info.name.compare(0, prefix.size(), prefix) != 0) {
+					continue;
+				}
+				auto global = m_global.find(id);
+				if (info.type == metric_type::histogram) {
+					hist_summary summary;
+					if (auto h = global->hist.load(std::memory_order_acquire)) summary.merge(h, detail);
+					for (auto shard : m_shards) {
+						auto c = shard->find(id);
+						auto h = c ? c->hist.load(std::memory_order_acquire) : nullptr;
+						if (h) summary.merge(h, detail);
+					}
+					visit(info, 0, &summary);
+					continue;
+				}
+				int64_t v = global->value.load(std::memory_order_relaxed);
+				if (info.type == metric_type::counter) {
+					for (auto shard : m_shards) {
+						if (auto c = shard->find(id)) v += c->value.load(std::memory_order_relaxed);
+					}
+				}
+				visit(info, v, nullptr);
+			}
+		}
+
+		size_t size() {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			return m_metrics.size() - 1;
+		}
+
+		size_t shards() {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			return m_shards.size();
+		}
+
+	protected:
+		metric_registry() {
+			m_metrics.push_back({ "", metric_type::none });
+		}
+
+		struct shard_holder {
+			metric_shard* shard = nullptr;
+			~shard_holder() {
+				if (shard) metric_registry::instance().retire(shard);
+			}
+		};
+
+		metric_shard* local_shard() {
+			thread_local shard_holder holder;
+			if (holder.shard == nullptr) {
+				auto shard = new metric_shard();
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_shards.push_back(shard);
+				holder.shard = shard;
+			}
+			return holder.shard;
+		}
+
+		//线程退出, 计数累加到全局分片
+		void retire(metric_shard* shard) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_shards.erase(std::remove(m_shards.begin(), m_shards.end(), shard), m_shards.end());
+			for (uint32_t id = 1; id < m_metrics.size(); ++id) {
+				auto c = shard->find(id);
+				if (c == nullptr) {
+					id += METRIC_BLOCK - id % METRIC_BLOCK - 1;
+					continue;
+				}
+				auto global = m_global.find(id);
+				global->value.fetch_add(c->value.load(std::memory_order_relaxed), std::memory_order_relaxed);
+				auto h = c->hist.load(std::memory_order_relaxed);
+				if (h == nullptr) {
+					continue;
+				}
+				auto g = m_global.hist(id);
+				relaxed_add<uint64_t>(g->count, h->count.load(std::memory_order_relaxed));
+				relaxed_add<uint64_t>(g->sum, h->sum.load(std::memory_order_relaxed));
+				g->max.store(std::max(g->max.load(std::memory_order_relaxed), h->max.load(std::memory_order_relaxed)), std::memory_order_relaxed);
+				for (uint32_t i = 0; i < HIST_BUCKETS; ++i) {
+					relaxed_add<uint64_t>(g->buckets[i], h->buckets[i].load(std::memory_order_relaxed));
+				}
+			}
+			delete shard;
+		}
+
+	private:
+		std::mutex m_mutex;
+		metric_shard m_global;
+		std::vector<metric_info> m_metrics;
+		std::vector<metric_shard*> m_shards;
+		std::unordered_map<std::string, uint32_t> m_ids;
+		std::atomic<uint8_t> m_types[METRIC_MAX] = {};
+	};
+}
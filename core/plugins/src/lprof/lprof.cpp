@@ -0,0 +1,178 @@
+#include "profiler.hpp"
+
+namespace lprof {
+	//一次性钩子: 进入后立即恢复原有钩子, 再取栈
+	static void prof_hook(lua_State* L, lua_Debug* ar) {
+		auto prof = profiler::current();
+		if (prof == nullptr) {
+			lua_sethook(L, nullptr, 0, 0);
+			return;
+		}
+		prof->restore_hook(L);
+		if (prof->running()) {
+			prof->sample(L);
+		}
+	}
+
+#ifdef __linux
+	//信号处理里只挂钩子, lua_sethook可以在信号中安全调用
+	//阻塞在C函数里时, 钩子在返回lua后触发, 耗时计入调用它的lua函数
+	static void on_signal(int sig) {
+		auto prof = profiler::current();
+		if (prof == nullptr || !prof->running()) {
+			return;
+		}
+		lua_State* L = profiler::running_state();
+		L = L ? L : prof->main();
+		//上次的钩子还未触发
+		if (lua_gethook(L) == prof_hook) {
+			return;
+		}
+		prof->save_hook(L);
+		lua_sethook(L, prof_hook, LUA_MASKCOUNT, 1);
+	}
+
+	static void install_signal() {
+		static std::once_flag flag;
+		std::call_once(flag, []() {
+			struct sigaction sa = {};
+			sa.sa_handler = on_signal;
+			sa.sa_flags = SA_RESTART;
+			sigemptyset(&sa.sa_mask);
+			sigaction(SIGPROF, &sa, nullptr);
+		});
+	}
+#endif
+
+	static lua_State* main_thread(lua_State* L) {
+		lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_MAINTHREAD);
+		lua_State* main = lua_tothread(L, -1);
+		lua_pop(L, 1);
+		return main;
+	}
+
+	//start(name, interval_us): 本线程开始采样, 间隔按线程cpu时间计算
+	static int lstart(lua_State* L) {
+		size_t len;
+		const char* name = luaL_checklstring(L, 1, &len);
+		lua_Integer interval = luaL_optinteger(L, 2, 1000);
+		luaL_argcheck(L, interval > 0, 2, "interval must be positive");
+#ifdef __linux
+		install_signal();
+#endif
+		auto prof = profiler::instance().local();
+		lua_pushboolean(L, prof->start(std::string(name, len), interval, main_thread(L)));
+		return 1;
+	}
+
+	static int lstop(lua_State* L) {
+		auto prof = profiler::current();
+		if (prof == nullptr) {
+			return 0;
+		}
+		prof->stop();
+		//已挂上但未触发的钩子, 恢复为原有钩子
+		lua_State* running = profiler::running_state();
+		for (lua_State* co : { main_thread(L), running }) {
+			if (co && lua_gethook(co) == prof_hook) {
+				prof->restore_hook(co);
+			}
+		}
+		return 0;
+	}
+
+	static int lrunning(lua_State* L) {
+		auto prof = profiler::current();
+		lua_pushboolean(L, prof && prof->running());
+		return 1;
+	}
+
+	static int lreset(lua_State* L) {
+		profiler::instance().reset();
+		return 0;
+	}
+
+	//同lcorolib的auxresume, 额外记录正在运行的协程
+	static int auxresume(lua_State* L, lua_State* co, int narg) {
+		int status, nres;
+		if (!lua_checkstack(co, narg)) {
+			lua_pushliteral(L, "too many arguments to resume");
+			return -1;
+		}
+		lua_xmove(L, co, narg);
+		auto& running = profiler::running_state();
+		running = co;
+		status = lua_resume(co, L, narg, &nres);
+		running = L;
+		if (status == LUA_OK || status == LUA_YIELD) {
+			if (!lua_checkstack(L, nres + 1)) {
+				lua_pop(co, nres);
+				lua_pushliteral(L, "too many results to resume");
+				return -1;
+			}
+			lua_xmove(co, L, nres);
+			return nres;
+		}
+		lua_xmove(co, L, 1);
+		return -1;
+	}
+
+	//resume(co, ...): 替换coroutine.resume, 信号到来时才能找到正在运行的协程
+	static int lresume(lua_State* L) {
+		lua_State* co = lua_tothread(L, 1);
+		luaL_argexpected(L, co, 1, "coroutine");
+		int r = auxresume(L, co, lua_gettop(L) - 1);
+		if (r < 0) {
+			lua_pushboolean(L, 0);
+			lua_insert(L, -2);
+			return 2;
+		}
+		lua_pushboolean(L, 1);
+		lua_insert(L, -(r + 1));
+		return r + 1;
+	}
+
+	//dump(top): 所有虚拟机合并后的折叠栈文本, 总采样数, 按self排序的前top个函数{name, self, total}
+	static int ldump(lua_State* L) {
+		size_t top = (size_t)luaL_optinteger(L, 1, 50);
+		std::vector<func_stat> funcs;
+		std::unordered_map<std::string, uint64_t> stacks;
+		uint64_t samples = profiler::instance().collect(stacks, funcs);
+		std::string folded;
+		for (auto& [stack, count] : stacks) {
+			folded.append(stack).append(" ").append(std::to_string(count)).append("\n");
+		}
+		lua_pushlstring(L, folded.c_str(), folded.size());
+		lua_pushinteger(L, (lua_Integer)samples);
+		size_t size = std::min(top, funcs.size());
+		lua_createtable(L, (int)size, 0);
+		for (size_t i = 0; i < size; ++i) {
+			lua_createtable(L, 0, 3);
+			lua_pushlstring(L, funcs[i].name.c_str(), funcs[i].name.size());
+			lua_setfield(L, -2, "name");
+			lua_pushinteger(L, (lua_Integer)funcs[i].self);
+			lua_setfield(L, -2, "self");
+			lua_pushinteger(L, (lua_Integer)funcs[i].total);
+			lua_setfield(L, -2, "total");
+			lua_rawseti(L, -2, (lua_Integer)i + 1);
+		}
+		return 3;
+	}
+}
+
+extern "C" {
+	LUALIB_API int luaopen_lprof(lua_State* L)
+	{
+		luaL_Reg l[] = {
+			{"start", lprof::lstart},
+			{"stop", lprof::lstop},
+			{"running", lprof::lrunning},
+			{"reset", lprof::lreset},
+			{"resume", lprof::lresume},
+			{"dump", lprof::ldump},
+			{NULL,NULL}
+		};
+		luaL_newlib(L, l);
+		return 1;
+	}
+}
@@ -0,0 +1,318 @@
+#pragma once
+
+#include <mutex>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "lua_kit.h"
+
+#ifdef __linux
+#include <time.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#endif
+
+namespace lprof {
+
+	constexpr int PROF_MAX_DEPTH = 64;
+	constexpr size_t PROF_MAX_STACKS = 65536;
+	constexpr size_t PROF_FRAME_LEN = 256;
+
+	struct func_stat {
+		std::string name;
+		uint64_t self = 0;
+		uint64_t total = 0;
+	};
+
+	//单个lua虚拟机的采样数据, 只有所在线程写入, dump时加锁读取
+	//linux下按线程cpu时间定时发信号, 信号处理里给正在运行的lua_State挂一次性钩子, 下一条指令进入钩子取栈
+	//空闲(阻塞在epoll等)不消耗cpu时间, 不会被采样; 两次采样之间没有钩子, 不影响执行速度
+	//cpu时间定时器精度受内核时钟节拍限制, 间隔小于节拍时按节拍采样
+	class profile {
+	public:
+		~profile() {
+			stop();
+#ifdef __linux
+			if (m_timer_created) {
+				timer_delete(m_timer);
+			}
+#endif
+		}
+
+		bool start(const std::string& name, int64_t interval, lua_State* main) {
+#ifdef __linux
+			if (!m_timer_created) {
+				sigevent sev = {};
+				sev.sigev_notify = SIGEV_THREAD_ID;
+				sev.sigev_signo = SIGPROF;
+				sev._sigev_un._tid = (pid_t)syscall(SYS_gettid);
+				if (timer_create(CLOCK_THREAD_CPUTIME_ID, &sev, &m_timer) != 0) {
+					return false;
+				}
+				m_timer_created = true;
+			}
+			{
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_name = name;
+				m_stacks.clear();
+				m_samples = 0;
+			}
+			m_main = main;
+			m_running = true;
+			itimerspec spec = {};
+			spec.it_interval.tv_sec = interval / 1000000;
+			spec.it_interval.tv_nsec = (interval % 1000000) * 1000;
+			spec.it_value = spec.it_interval;
+			return timer_settime(m_timer, 0, &spec, nullptr) == 0;
+#else
+			return false;
+#endif
+		}
+
+		void stop() {
+			m_running = false;
+#ifdef __linux
+			if (m_timer_created) {
+				itimerspec spec = {};
+				timer_settime(m_timer, 0, &spec, nullptr);
+			}
+#endif
+		}
+
+		bool running() { return m_running; }
+		lua_State* main() { return m_main; }
+
+		//挂采样钩子前保存原有钩子(debug.sethook), 触发或停止采样时恢复
+		void save_hook(lua_State* L) {
+			m_hook = lua_gethook(L);
+			m_hook_mask = lua_gethookmask(L);
+			m_hook_count = lua_gethookcount(L);
+		}
+
+		void restore_hook(lua_State* L) {
+			lua_sethook(L, m_hook, m_hook_mask, m_hook_count);
+		}
+
+		//栈按根在前折叠: name;[coroutine];f1;f2 ...
+		//帧按函数标识记录(lua函数为short_src:linedefined, C函数为函数指针), 调用处的名字只用于显示
+		void sample(lua_State* L) {
+			lua_Debug ar;
+			int depth = 0;
+			while (depth < PROF_MAX_DEPTH && lua_getstack(L, depth, &ar)) {
+				depth++;
+			}
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_key = m_name;
+			bool ismain = lua_pushthread(L) == 1;
+			lua_pop(L, 1);
+			if (!ismain) {
+				m_key.append(";[coroutine]");
+			}
+			if (depth == PROF_MAX_DEPTH && lua_getstack(L, depth, &ar)) {
+				m_key.append(";...");
+			}
+			for (int level = depth - 1; level >= 0; --level) {
+				if (!lua_getstack(L, level, &ar)) {
+					continue;
+				}
+				//'f'总会压入函数
+				lua_getinfo(L, "Snf", &ar);
+				const void* cfunc = (*ar.what == 'C') ? (const void*)lua_tocfunction(L, -1) : nullptr;
+				lua_pop(L, 1);
+				m_key.push_back(';');
+				append_frame(ar, cfunc);
+			}
+			m_samples++;
+			auto it = m_stacks.find(m_key);
+			if (it != m_stacks.end()) {
+				it->second++;
+				return;
+			}
+			if (m_stacks.size() >= PROF_MAX_STACKS) {
+				m_stacks[m_name + ";[overflow]"]++;
+				return;
+			}
+			m_stacks.emplace(m_key, 1);
+		}
+
+		template <typename F>
+		uint64_t visit(F&& f) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			for (auto& [stack, count] : m_stacks) {
+				f(stack, count);
+			}
+			return m_samples;
+		}
+
+		//合并函数标识到显示名的映射, 已有名字的不覆盖
+		void merge_names(std::unordered_map<std::string, std::string>& names) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			for (auto& [id, name] : m_names) {
+				names.emplace(id, name);
+			}
+		}
+
+		void reset() {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_stacks.clear();
+			m_samples = 0;
+		}
+
+	protected:
+		void append_frame(lua_Debug& ar, const void* cfunc) {
+			char frame[PROF_FRAME_LEN];
+			if (cfunc) {
+				snprintf(frame, sizeof(frame), "[C]%p", cfunc);
+			} else {
+				snprintf(frame, sizeof(frame), "%s:%d", ar.short_src, ar.linedefined);
+			}
+			//折叠栈用';'分隔帧
+			for (char* p = frame; *p; ++p) {
+				if (*p == ';') *p = ',';
+			}
+			m_key.append(frame);
+			//同一函数以第一次取到的名字显示
+			const char* name = ar.name ? ar.name : (*ar.what == 'm' ? "main" : nullptr);
+			if (name && m_names.find(frame) == m_names.end()) {
+				m_names.emplace(frame, name);
+			}
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::string m_name;
+		std::string m_key;
+		std::unordered_map<std::string, uint64_t> m_stacks;
+		std::unordered_map<std::string, std::string> m_names;
+		uint64_t m_samples = 0;
+		lua_State* m_main = nullptr;
+		lua_Hook m_hook = nullptr;
+		int m_hook_mask = 0;
+		int m_hook_count = 0;
+		std::atomic<bool> m_running = false;
+#ifdef __linux
+		timer_t m_timer;
+		bool m_timer_created = false;
+#endif
+	};
+
+	//进程内所有虚拟机的采样数据
+	//每个线程一个profile, 线程退出时注销
+	class profiler {
+	public:
+		static profiler& instance() {
+			static profiler prof;
+			return prof;
+		}
+
+		profile* local() {
+			thread_local profile_holder holder;
+			if (holder.prof == nullptr) {
+				holder.prof = new profile();
+				std::unique_lock<std::mutex> lock(m_mutex);
+				m_profiles.push_back(holder.prof);
+			}
+			current() = holder.prof;
+			return holder.prof;
+		}
+
+		static profile*& current() {
+			thread_local profile* prof = nullptr;
+			return prof;
+		}
+
+		//本线程正在运行的lua_State, 由resume维护, nullptr表示主线程
+		static lua_State*& running_state() {
+			thread_local lua_State* L = nullptr;
+			return L;
+		}
+
+		void reset() {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			for (auto prof : m_profiles) {
+				prof->reset();
+			}
+		}
+
+		//合并所有线程的折叠栈, 同时按函数标识统计self/total采样数
+		uint64_t collect(std::unordered_map<std::string, uint64_t>& stacks, std::vector<func_stat>& funcs) {
+			uint64_t samples = 0;
+			std::unordered_map<std::string, func_stat> stats;
+			std::unordered_map<std::string, std::string> names;
+			std::unordered_set<std::string> seen;
+			std::string display;
+			std::unique_lock<std::mutex> lock(m_mutex);
+			for (auto prof : m_profiles) {
+				prof->merge_names(names);
+			}
+			for (auto prof : m_profiles) {
+				samples += prof->visit([&](const std::string& stack, uint64_t count) {
+					seen.clear();
+					size_t begin = stack.find(';');
+					display = stack.substr(0, begin);
+					while (begin != std::string::npos) {
+						size_t end = stack.find(';', begin + 1);
+						std::string frame = stack.substr(begin + 1, end == std::string::npos ? end : end - begin - 1);
+						begin = end;
+						display.push_back(';');
+						if (frame == "[coroutine]" || frame == "..." || frame == "[overflow]") {
+							display.append(frame);
+							continue;
+						}
+						//递归只计一次total
+						auto& stat = stats[frame];
+						if (stat.name.empty()) stat.name = frame_name(names, frame);
+						display.append(stat.name);
+						if (seen.insert(frame).second) stat.total += count;
+						if (end == std::string::npos) stat.self += count;
+					}
+					stacks[display] += count;
+				});
+			}
+			for (auto& [id, stat] : stats) {
+				funcs.push_back(std::move(stat));
+			}
+			std::sort(funcs.begin(), funcs.end(), [](const func_stat& a, const func_stat& b) {
+				return a.self != b.self ? a.self > b.self : a.total > b.total;
+			});
+			return samples;
+		}
+
+	protected:
+		//显示名: lua函数为"name (src:line)", C函数为"name [C]", 取不到名字时保留标识
+		static std::string frame_name(const std::unordered_map<std::string, std::string>& names, const std::string& frame) {
+			auto it = names.find(frame);
+			bool cfunc = frame.compare(0, 3, "[C]") == 0;
+			if (it == names.end()) {
+				return cfunc ? frame : "? (" + frame + ")";
+			}
+			return cfunc ? it->second + " [C]" : it->second + " (" + frame + ")";
+		}
+
+		struct profile_holder {
+			profile* prof = nullptr;
+			~profile_holder() {
+				if (prof) {
+					//先摘掉, 避免已到达的信号访问到释放的profile
+					current() = nullptr;
+					profiler::instance().retire(prof);
+				}
+			}
+		};
+
+		void retire(profile* prof) {
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_profiles.erase(std::remove(m_profiles.begin(), m_profiles.end(), prof), m_profiles.end());
+			delete prof;
+		}
+
+	private:
+		std::mutex m_mutex;
+		std::vector<profile*> m_profiles;
+	};
+}
@@ -1,109 +1,230 @@
-#include <list>
+#include <memory>
+#include <vector>
 #include "ltimer.h"
 #include "croncpp.h"
 #include "lua_kit.h"
+#include "timer_wheel.hpp"
 
-constexpr int TIME_NEAR_SHIFT = 8;
-constexpr int TIME_LEVEL_SHIFT = 6;
-constexpr int TIME_NEAR = (1 << TIME_NEAR_SHIFT);
-constexpr int TIME_LEVEL = (1 << TIME_LEVEL_SHIFT);
-constexpr int TIME_NEAR_MASK = (TIME_NEAR - 1);
-constexpr int TIME_LEVEL_MASK = (TIME_LEVEL - 1);
+constexpr int TIME_BLOCK_SHIFT = 12;
+constexpr int TIME_BLOCK = (1 << TIME_BLOCK_SHIFT);
+constexpr int TIME_BLOCK_MASK = (TIME_BLOCK - 1);
 
 namespace ltimer {
 
+	//timer_id = gen << 32 | index, index定位节点, gen防止节点复用后误删
 	struct timer_node {
-		size_t expire;
-		uint64_t timer_id;
+		timer_node* prev = nullptr;
+		timer_node* next = nullptr;
+		size_t expire = 0;
+		size_t period = 0;
+		uint64_t timer_id = 0;
+		uint32_t index = 0;
+		uint32_t gen = 0;
 	};
 
-	using timer_list = std::list<timer_node>;
-	using integer_vector = std::vector<uint64_t>;
+	//侵入式双向循环链表, 节点记录前后指针, 取消时O(1)摘除
+	struct timer_list {
+		using node_type = timer_node*;
+
+		timer_node head;
+		timer_list() { head.prev = head.next = &head; }
+		timer_list(const timer_list&) = delete;
+		timer_list& operator=(const timer_list&) = delete;
+
+		void push(timer_node* node) {
+			node->prev = head.prev;
+			node->next = &head;
+			head.prev->next = node;
+			head.prev = node;
+		}
+
+		timer_node* pop() {
+			if (head.next == &head) {
+				return nullptr;
+			}
+			timer_node* node = head.next;
+			unlink(node);
+			return node;
+		}
+
+		//把other的节点全部移到本链表(本链表为空)
+		void take(timer_list& other) {
+			if (other.head.next == &other.head) {
+				return;
+			}
+			head.next = other.head.next;
+			head.prev = other.head.prev;
+			head.next->prev = &head;
+			head.prev->next = &head;
+			other.head.prev = other.head.next = &other.head;
+		}
+
+		//摘下所有节点后逐个回调, 供时间轮逐层下移
+		template<typename F>
+		void flush(F&& fn) {
+			timer_list list;
+			list.take(*this);
+			while (timer_node* node = list.pop()) {
+				fn(node);
+			}
+		}
+
+		static size_t expire_of(timer_node* node) { return node->expire; }
+
+		static void unlink(timer_node* node) {
+			node->prev->next = node->next;
+			node->next->prev = node->prev;
+			node->prev = node->next = nullptr;
+		}
+	};
 
 	class lua_timer {
 	public:
-		integer_vector update(size_t elapse);
-		void insert(uint64_t timer_id, size_t escape);
+		uint64_t insert(size_t escape, size_t period);
+		bool cancel(uint64_t timer_id);
+		bool reset(uint64_t timer_id, size_t escape, size_t period);
+		bool set_period(uint64_t timer_id, size_t period);
+		int update(lua_State* L);
+		size_t size() { return m_size; }
 
 	protected:
-		void shift();
-		void add_node(timer_node&& node);
-		void execute(integer_vector& timers);
-		void move_list(uint32_t level, uint32_t idx);
+		size_t execute(lua_State* L, int& errors);
+		timer_node* find(uint64_t timer_id);
+		timer_node* alloc_node();
+		void free_node(timer_node* node);
 
 	protected:
-		size_t time = 0;
-		timer_list near[TIME_NEAR];
-		timer_list t[4][TIME_LEVEL];
+		size_t m_size = 0;
+		utility::timer_wheel<timer_list> m_wheel;
+		timer_list m_rearms;
+		//节点按块分配, 释放后挂在空闲链表复用
+		timer_node* m_free = nullptr;
+		std::vector<std::unique_ptr<timer_node[]>> m_blocks;
 	};
 
-	void lua_timer::add_node(timer_node&& node) {
-		size_t expire = node.expire;
-		if ((expire | TIME_NEAR_MASK) == (time | TIME_NEAR_MASK)) {
-			near[expire & TIME_NEAR_MASK].emplace_back(node);
-			return;
-		}
-		uint32_t i;
-		uint32_t mask = TIME_NEAR << TIME_LEVEL_SHIFT;
-		for (i = 0; i < 3; i++) {
-			if ((expire | (mask - 1)) == (time | (mask - 1))) {
-				break;
+	timer_node* lua_timer::alloc_node() {
+		if (m_free == nullptr) {
+			uint32_t base = (uint32_t)(m_blocks.size() << TIME_BLOCK_SHIFT);
+			auto& block = m_blocks.emplace_back(new timer_node[TIME_BLOCK]);
+			for (int i = TIME_BLOCK - 1; i >= 0; --i) {
+				block[i].index = base + i;
+				block[i].next = m_free;
+				m_free = &block[i];
 			}
-			mask <<= TIME_LEVEL_SHIFT;
 		}
-		t[i][((expire >> (TIME_NEAR_SHIFT + i * TIME_LEVEL_SHIFT)) & TIME_LEVEL_MASK)].emplace_back(node);
+		timer_node* node = m_free;
+		m_free = node->next;
+		//gen从1开始, 保持timer_id为正数
+		node->gen = (node->gen >= INT32_MAX) ? 1 : node->gen + 1;
+		node->timer_id = ((uint64_t)node->gen << 32) | node->index;
+		node->next = nullptr;
+		m_size++;
+		return node;
 	}
 
-	void lua_timer::insert(uint64_t timer_id, size_t escape) {
-		timer_node node{ time + escape, timer_id };
-		add_node(std::move(node));
+	void lua_timer::free_node(timer_node* node) {
+		node->timer_id = 0;
+		node->next = m_free;
+		m_free = node;
+		m_size--;
 	}
 
-	void lua_timer::move_list(uint32_t level, uint32_t idx) {
-		timer_list& list = t[level][idx];
-		for (auto node : list) {
-			add_node(std::move(node));
+	timer_node* lua_timer::find(uint64_t timer_id) {
+		size_t index = timer_id & 0xffffffff;
+		if (index >= (m_blocks.size() << TIME_BLOCK_SHIFT)) {
+			return nullptr;
 		}
-		list.clear();
+		timer_node* node = &m_blocks[index >> TIME_BLOCK_SHIFT][index & TIME_BLOCK_MASK];
+		return (timer_id != 0 && node->timer_id == timer_id) ? node : nullptr;
 	}
 
-	void lua_timer::shift() {
-		size_t ct = ++time;
-		if (ct == 0) {
-			move_list(3, 0);
-			return;
-		}
-		uint32_t i = 0;
-		int mask = TIME_NEAR;
-		size_t time = ct >> TIME_NEAR_SHIFT;
-		while ((ct & (mask - 1)) == 0) {
-			uint32_t idx = time & TIME_LEVEL_MASK;
-			if (idx != 0) {
-				move_list(i, idx);
-				break;
-			}
-			mask <<= TIME_LEVEL_SHIFT;
-			time >>= TIME_LEVEL_SHIFT;
-			++i;
+	//period为0是单次定时器, 触发后回收
+	uint64_t lua_timer::insert(size_t escape, size_t period) {
+		timer_node* node = alloc_node();
+		node->expire = m_wheel.time() + escape;
+		node->period = period;
+		m_wheel.add(node);
+		return node->timer_id;
+	}
+
+	bool lua_timer::cancel(uint64_t timer_id) {
+		timer_node* node = find(timer_id);
+		if (node == nullptr) {
+			return false;
+		}
+		timer_list::unlink(node);
+		free_node(node);
+		return true;
+	}
+
+	bool lua_timer::reset(uint64_t timer_id, size_t escape, size_t period) {
+		timer_node* node = find(timer_id);
+		if (node == nullptr) {
+			return false;
+		}
+		timer_list::unlink(node);
+		node->expire = m_wheel.time() + escape;
+		node->period = period;
+		m_wheel.add(node);
+		return true;
+	}
+
+	bool lua_timer::set_period(uint64_t timer_id, size_t period) {
+		timer_node* node = find(timer_id);
+		if (node == nullptr) {
+			return false;
 		}
+		node->period = period;
+		return true;
 	}
 
-	void lua_timer::execute(integer_vector& timers) {
-		uint32_t idx = time & TIME_NEAR_MASK;
-		for (auto node : near[idx]) {
-			timers.emplace_back(node.timer_id);
+	//到期节点先摘到临时链表, 回调里可以安全的增删定时器
+	//周期定时器先挂到待续期链表, 本次update结束后再续期, 卡顿多个周期时只触发一次
+	size_t lua_timer::execute(lua_State* L, int& errors) {
+		timer_list fires;
+		fires.take(m_wheel.current());
+		size_t count = 0;
+		while (timer_node* node = fires.pop()) {
+			uint64_t timer_id = node->timer_id;
+			if (node->period > 0) {
+				m_rearms.push(node);
+			} else {
+				free_node(node);
+			}
+			lua_pushvalue(L, 2);
+			lua_pushinteger(L, (lua_Integer)timer_id);
+			//不能跳出, 保留第一个错误
+			if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+				if (errors++ > 0) {
+					lua_pop(L, 1);
+				}
+			}
+			count++;
 		}
-		near[idx].clear();
+		return count;
 	}
 
-	integer_vector lua_timer::update(size_t elapse) {
-		integer_vector timers;
-		execute(timers);
+	//update(elapse, dispatch): 推进elapse个刻度, 每个到期的定时器调用dispatch(timer_id), 返回触发数量
+	int lua_timer::update(lua_State* L) {
+		size_t elapse = (size_t)luaL_checkinteger(L, 1);
+		luaL_checktype(L, 2, LUA_TFUNCTION);
+		lua_settop(L, 2);
+		int errors = 0;
+		size_t count = execute(L, errors);
 		for (size_t i = 0; i < elapse; i++) {
-			shift();
-			execute(timers);
+			m_wheel.shift();
+			count += execute(L, errors);
+		}
+		//按当前时间续期
+		while (timer_node* node = m_rearms.pop()) {
+			node->expire = m_wheel.time() + node->period;
+			m_wheel.add(node);
+		}
+		if (errors > 0) {
+			return lua_error(L);
 		}
-		return timers;
+		lua_pushinteger(L, (lua_Integer)count);
+		return 1;
 	}
 
 	static int cron_next(lua_State* L, std::string cex) {
@@ -118,15 +239,6 @@ namespace ltimer {
 		}
 	}
 
-	thread_local lua_timer thread_timer;
-	static void timer_insert(uint64_t timer_id, size_t escape) {
-		thread_timer.insert(timer_id, escape);
-	}
-
-	static integer_vector timer_update(size_t elapse) {
-		return thread_timer.update(elapse);
-	}
-
 	static int timer_time(lua_State* L) {
 		return luakit::variadic_return(L, now_ms(), steady_ms());
 	}
@@ -135,12 +247,12 @@ namespace ltimer {
 		luakit::kit_state kit_state(L);
 		auto luatimer = kit_state.new_table();
 		luatimer.set_function("time", timer_time);
-		luatimer.set_function("insert", timer_insert);
-		luatimer.set_function("update", timer_update);
+		luatimer.set_function("wheel", []() { return new lua_timer(); });
 		luatimer.set_function("now", []() { return now(); });
 		luatimer.set_function("now_ms", []() { return now_ms(); });
 		luatimer.set_function("clock", []() { return steady(); });
 		luatimer.set_function("clock_ms", []() { return steady_ms(); });
+		luatimer.set_function("clock_us", []() { return steady_us(); });
 		luatimer.set_function("sleep", [](uint64_t ms) { return sleep(ms); });
 		luatimer.set_function("offset", [](int64_t v) { offset(v); });
 		luatimer.set_function("offset_value", []() { return offset_; });
@@ -155,6 +267,14 @@ namespace ltimer {
 		luatimer.set_function("is_birthday", [](uint64_t _early, uint64_t _late) { return is_birthday(_early, _late); });
 		luatimer.set_function("day_begin_time", [](uint64_t ts) { return day_begin_time(ts); });
 
+		kit_state.new_class<lua_timer>(
+			"insert", &lua_timer::insert,
+			"cancel", &lua_timer::cancel,
+			"reset", &lua_timer::reset,
+			"set_period", &lua_timer::set_period,
+			"update", &lua_timer::update,
+			"size", &lua_timer::size
+		);
 		return luatimer;
 	}
 }
@@ -30,6 +30,10 @@ namespace ltimer {
 		return duration_cast<milliseconds>(steady_clock::now().time_since_epoch()).count();
 	}
 
+	inline uint64_t steady_us() {
+		return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+	}
+
 	inline void sleep(uint64_t ms) {
 		std::this_thread::sleep_for(std::chrono::milliseconds(ms));
 	}
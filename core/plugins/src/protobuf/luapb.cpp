@@ -2,22 +2,51 @@
 #include "pb.c"
 #include "lua_kit.h"
 #include "xor.h"
+#include "../lcrypt/lz4.h"
 
 using namespace std;
 using namespace luakit;
 
 namespace luapb {
 
-    thread_local std::unordered_map<uint32_t,std::string> pb_cmd_ids;
+    //cmd_id对应的协议, 类型指针按需解析并缓存, schema变化(load/clear/切换state)后重新解析
+    struct pb_cmd {
+        std::string name;
+        const pb_Type* type = nullptr;
+        const pb_State* state = nullptr;
+        uint32_t version = 0;
+    };
+
+    thread_local uint32_t pb_schema_version = 1;
+    thread_local std::unordered_map<uint32_t, pb_cmd> pb_cmd_ids;
 
     constexpr int FlagMask_REQ      = 0x01;
     constexpr int FlagMask_RES      = 0x02;
     constexpr int FlagMask_Encrypt  = 0x04;
     constexpr int FlagMask_Zip      = 0x08;
 
+    constexpr uint16_t PB_LEN_EXT   = 0xffff;               // 包长超出uint16时, 包头后跟uint32的实际包长
+    constexpr size_t PB_PACKET_MAX  = 4 * 1024 * 1024;      // 单包上限4M
+
+    //按cmd_id统计压缩效果和耗时, 用于调整需要压缩的协议
+    struct pb_zip_stat {
+        uint64_t zip_count = 0;     // 压缩发送的包数
+        uint64_t zip_skip = 0;      // 压缩后没有变小, 原样发送的包数
+        uint64_t zip_raw = 0;       // 压缩前字节数
+        uint64_t zip_bytes = 0;     // 压缩后字节数
+        uint64_t zip_ns = 0;        // 压缩耗时
+        uint64_t unzip_count = 0;   // 解压的包数
+        uint64_t unzip_raw = 0;     // 解压后字节数
+        uint64_t unzip_bytes = 0;   // 解压前字节数
+        uint64_t unzip_ns = 0;      // 解压耗时
+    };
+
+    thread_local size_t pb_zip_min = 512;
+    thread_local std::unordered_map<uint32_t, pb_zip_stat> pb_zip_stats;
+
     #pragma pack(1)
     struct pb_header {
-        uint16_t    len;            // 整个包的长度
+        uint16_t    len;            // 整个包的长度, PB_LEN_EXT表示使用扩展包长
         uint8_t     flag;           // 标志位
         uint8_t     seq_id;         // 序号
         uint32_t    cmd_id;         // 协议ID
@@ -35,8 +64,13 @@ namespace luapb {
             pb_header* header =(pb_header*)m_slice->peek(sizeof(pb_header));
             if (!header) return 0;
             m_packet_len = header->len;
+            if (m_packet_len == PB_LEN_EXT) {
+                uint32_t* ext_len = (uint32_t*)m_slice->peek(sizeof(uint32_t), sizeof(pb_header));
+                if (!ext_len) return 0;
+                m_packet_len = *ext_len;
+                if (m_packet_len < PB_HEAD_EXT || m_packet_len > PB_PACKET_MAX) return -1;
+            }
             if (m_packet_len < sizeof(pb_header)) return -1;
-            if (m_packet_len >= 0xffff) return -1;
             if (!m_slice->peek(m_packet_len)) return 0;
             if (m_packet_len > data_len) return 0;
             return m_packet_len;
@@ -66,30 +100,37 @@ namespace luapb {
                 pb_addslice(e.b, sh);
                 pb_addslice(e.b, pb_lslice(buf,data_len));                
             } else {
-                const pb_Type* t = pb_type_from_stack(L, LS, &header);
+                const pb_Type* t = pb_type_from_cmd(L, LS, header.cmd_id);
                 if (t == nullptr) luaL_error(L, "pb message not define cmd: %d", header.cmd_id);
                 //encode            
                 lua_pushvalue(L, index);
                 pb_addslice(e.b, sh);
                 lpbE_encode(&e, t, -1);
             }
-            *len = pb_bufflen(e.b);
-            auto data = (uint8_t*)pb_buffer(e.b);
-            ((pb_header*)data)->len = *len;
-            //encrypt
-            if (encrypt(header.flag)) {
-                xor_code(data+sizeof(header), *len - sizeof(header));
+            uint8_t* body = (uint8_t*)pb_buffer(e.b) + sizeof(header);
+            size_t body_len = pb_bufflen(e.b) - sizeof(header);
+            //zip: 小于阈值或压缩后没有变小的包清除压缩标记
+            if (is_zip(header.flag)) {
+                if (body_len < pb_zip_min || !zip_body(header.cmd_id, body, body_len)) {
+                    header.flag &= ~FlagMask_Zip;
+                } else {
+                    body = m_zip.data() + PB_HEAD_EXT;
+                    body_len = m_zip_len;
+                }
             }
-            return data;
+            return pack_body(header, body, body_len, len);
         }
 
         virtual size_t decode(lua_State* L) {
             pb_header* header =(pb_header*)m_slice->erase(sizeof(pb_header));
+            if (header->len == PB_LEN_EXT) {
+                m_slice->erase(sizeof(uint32_t));
+            }
             //cmd_id
             lpb_State* LS = lpb_lstate(L);
-            const pb_Type* t = pb_type_from_enum(L, LS, header->cmd_id);
+            const pb_Type* t = pb_type_from_cmd(L, LS, header->cmd_id);
             if (t == nullptr) {
-                throw lua_exception("pb message not define cmd: %d", header->cmd_id);
+                throw lua_exception("pb decode invalid cmdid: %d!", header->cmd_id);
             }
             //data
             size_t data_len;
@@ -98,40 +139,135 @@ namespace luapb {
             if (encrypt(header->flag)) {
                 xor_code((uint8_t*)data, data_len);
             }
+            //recv_len为实际收到的长度
+            size_t recv_len = data_len;
+            if (is_zip(header->flag)) {
+                data = unzip_body(header->cmd_id, data, &data_len);
+            }
 
             //return
             int top = lua_gettop(L);
-            lua_pushinteger(L, data_len);
+            lua_pushinteger(L, recv_len);
             lua_pushinteger(L, header->cmd_id);
             lua_pushinteger(L, header->flag);
             lua_pushinteger(L, header->session_id);
             lua_pushinteger(L, header->seq_id);
-            //decode
-            lua_push_function(L, [&](lua_State* L) {
-                lpb_Env e;
-                pb_Slice s = pb_lslice(data, data_len);
-                lpb_pushtypetable(L, LS, t);
-                e.L = L, e.LS = LS, e.s = &s;
-                lpbD_message(&e, t);
-                return 1;
-            });
-            if (lua_pcall(L, 0, 1, 0)) {
+            //decode, 使用静态函数, 不为每个包创建闭包
+            pb_decoder decoder{ LS, t, pb_lslice(data, data_len) };
+            lua_pushcfunction(L, decode_message);
+            lua_pushlightuserdata(L, &decoder);
+            if (lua_pcall(L, 1, 1, 0)) {
                 throw lua_exception("decode pb cmdid: %d failed: %s", header->cmd_id, lua_tostring(L, -1));
             }
             return lua_gettop(L) - top;
         }
 
     protected:
-        const pb_Type* pb_type_from_enum(lua_State* L, lpb_State* LS, size_t cmd_id) {
-            auto it = pb_cmd_ids.find(cmd_id);
-            if (it == pb_cmd_ids.end()) throw lua_exception("pb decode invalid cmdid: %d!", cmd_id);
-            return lpb_type(L, LS, pb_lslice(it->second.c_str(), it->second.size()));
+        static constexpr size_t PB_HEAD_EXT = sizeof(pb_header) + sizeof(uint32_t);
+
+        //压缩到m_zip, 前面预留扩展包头; 格式: uint32原始长度 + lz4数据
+        bool zip_body(uint32_t cmd_id, const uint8_t* body, size_t body_len) {
+            uint64_t start = luakit::steady_ns();
+            int bound = LZ4_compressBound((int)body_len);
+            if (bound <= 0) return false;
+            size_t need = PB_HEAD_EXT + sizeof(uint32_t) + bound;
+            if (m_zip.size() < need) m_zip.resize(need);
+            uint8_t* out = m_zip.data() + PB_HEAD_EXT;
+            *(uint32_t*)out = (uint32_t)body_len;
+            int zip_len = LZ4_compress_default((const char*)body, (char*)out + sizeof(uint32_t), (int)body_len, bound);
+            pb_zip_stat& stat = pb_zip_stats[cmd_id];
+            stat.zip_ns += luakit::steady_ns() - start;
+            if (zip_len <= 0 || zip_len + sizeof(uint32_t) >= body_len) {
+                stat.zip_skip++;
+                return false;
+            }
+            m_zip_len = zip_len + sizeof(uint32_t);
+            stat.zip_count++;
+            stat.zip_raw += body_len;
+            stat.zip_bytes += m_zip_len;
+            return true;
         }
 
-        const pb_Type* pb_type_from_stack(lua_State* L, lpb_State* LS, pb_header* header) {
-            auto it = pb_cmd_ids.find(header->cmd_id);
-            if (it == pb_cmd_ids.end()) luaL_error(L, "invalid pb cmd: %d", header->cmd_id);
-            return lpb_type(L, LS, pb_lslice(it->second.c_str(), it->second.size()));
+        char* unzip_body(uint32_t cmd_id, char* data, size_t* data_len) {
+            uint64_t start = luakit::steady_ns();
+            if (*data_len < sizeof(uint32_t)) {
+                throw lua_exception("pb unzip cmdid: %d invalid length!", cmd_id);
+            }
+            uint32_t raw_len = *(uint32_t*)data;
+            if (raw_len > PB_PACKET_MAX) {
+                throw lua_exception("pb unzip cmdid: %d too large: %d!", cmd_id, raw_len);
+            }
+            if (m_unzip.size() < raw_len) m_unzip.resize(raw_len);
+            int zip_len = (int)(*data_len - sizeof(uint32_t));
+            int out_len = LZ4_decompress_safe(data + sizeof(uint32_t), (char*)m_unzip.data(), zip_len, (int)raw_len);
+            if (out_len != (int)raw_len) {
+                throw lua_exception("pb unzip cmdid: %d failed!", cmd_id);
+            }
+            pb_zip_stat& stat = pb_zip_stats[cmd_id];
+            stat.unzip_count++;
+            stat.unzip_raw += raw_len;
+            stat.unzip_bytes += *data_len;
+            stat.unzip_ns += luakit::steady_ns() - start;
+            *data_len = raw_len;
+            return (char*)m_unzip.data();
+        }
+
+        //body前面需要留出包头的空间, 超出uint16的包使用扩展包长
+        uint8_t* pack_body(pb_header& header, uint8_t* body, size_t body_len, size_t* len) {
+            size_t total = sizeof(pb_header) + body_len;
+            if (total >= PB_LEN_EXT) {
+                total += sizeof(uint32_t);
+                if (total > PB_PACKET_MAX) {
+                    *len = 0;
+                    return nullptr;
+                }
+                //未压缩的包没有预留扩展包长的空间
+                if (body != m_zip.data() + PB_HEAD_EXT) {
+                    if (m_zip.size() < total) m_zip.resize(total);
+                    memcpy(m_zip.data() + PB_HEAD_EXT, body, body_len);
+                    body = m_zip.data() + PB_HEAD_EXT;
+                }
+                *(uint32_t*)(body - sizeof(uint32_t)) = (uint32_t)total;
+                header.len = PB_LEN_EXT;
+            } else {
+                header.len = (uint16_t)total;
+            }
+            uint8_t* data = body - (total - body_len);
+            memcpy(data, &header, sizeof(pb_header));
+            //encrypt
+            if (encrypt(header.flag)) {
+                xor_code(body, body_len);
+            }
+            *len = total;
+            return data;
+        }
+
+        struct pb_decoder {
+            lpb_State* LS;
+            const pb_Type* t;
+            pb_Slice s;
+        };
+
+        static int decode_message(lua_State* L) {
+            pb_decoder* decoder = (pb_decoder*)lua_touserdata(L, 1);
+            lpb_Env e;
+            lpb_pushtypetable(L, decoder->LS, decoder->t);
+            e.L = L, e.LS = decoder->LS, e.s = &decoder->s;
+            lpbD_message(&e, decoder->t);
+            return 1;
+        }
+
+        //未绑定的cmd_id返回nullptr
+        const pb_Type* pb_type_from_cmd(lua_State* L, lpb_State* LS, uint32_t cmd_id) {
+            auto it = pb_cmd_ids.find(cmd_id);
+            if (it == pb_cmd_ids.end()) return nullptr;
+            pb_cmd& cmd = it->second;
+            if (cmd.version != pb_schema_version || cmd.state != LS->state) {
+                cmd.type = lpb_type(L, LS, pb_lslice(cmd.name.c_str(), cmd.name.size()));
+                cmd.state = LS->state;
+                cmd.version = pb_schema_version;
+            }
+            return cmd.type;
         }
 
         bool encrypt(uint8_t flag) {
@@ -143,8 +279,59 @@ namespace luapb {
         }
 
     protected:
+        size_t m_zip_len = 0;
+        std::vector<uint8_t> m_zip;
+        std::vector<uint8_t> m_unzip;
     };
     
+    static void bind_cmd(uint32_t cmd_id, std::string fullname) {
+        pb_cmd& cmd = pb_cmd_ids[cmd_id];
+        cmd.name = fullname;
+        cmd.version = 0;
+    }
+
+    //schema变化时使缓存的类型失效
+    static int load_pb(lua_State* L) {
+        pb_schema_version++;
+        return Lpb_load(L);
+    }
+
+    static int loadfile_pb(lua_State* L) {
+        pb_schema_version++;
+        return Lpb_loadfile(L);
+    }
+
+    static int clear_pb(lua_State* L) {
+        pb_schema_version++;
+        return Lpb_clear(L);
+    }
+
+    static int state_pb(lua_State* L) {
+        pb_schema_version++;
+        return Lpb_state(L);
+    }
+
+    //zip_stats(clear) => { [cmd_id] = { zip_count, zip_skip, ... } }
+    static int zip_stats(lua_State* L) {
+        bool clear = lua_isnone(L, 1) || lua_toboolean(L, 1);
+        lua_createtable(L, 0, (int)pb_zip_stats.size());
+        for (auto& [cmd_id, stat] : pb_zip_stats) {
+            lua_createtable(L, 0, 9);
+            lua_pushinteger(L, stat.zip_count); lua_setfield(L, -2, "zip_count");
+            lua_pushinteger(L, stat.zip_skip); lua_setfield(L, -2, "zip_skip");
+            lua_pushinteger(L, stat.zip_raw); lua_setfield(L, -2, "zip_raw");
+            lua_pushinteger(L, stat.zip_bytes); lua_setfield(L, -2, "zip_bytes");
+            lua_pushinteger(L, stat.zip_ns); lua_setfield(L, -2, "zip_ns");
+            lua_pushinteger(L, stat.unzip_count); lua_setfield(L, -2, "unzip_count");
+            lua_pushinteger(L, stat.unzip_raw); lua_setfield(L, -2, "unzip_raw");
+            lua_pushinteger(L, stat.unzip_bytes); lua_setfield(L, -2, "unzip_bytes");
+            lua_pushinteger(L, stat.unzip_ns); lua_setfield(L, -2, "unzip_ns");
+            lua_rawseti(L, -2, cmd_id);
+        }
+        if (clear) pb_zip_stats.clear();
+        return 1;
+    }
+
     static codec_base* pb_codec() {
         pbcodec* codec = new pbcodec();
         codec->set_buff(luakit::get_buff());
@@ -155,8 +342,14 @@ namespace luapb {
         luaopen_pb(L);
         lua_table luapb(L);
         luapb.set_function("pbcodec", pb_codec);
-        luapb.set_function("bind_cmd", [](uint32_t cmd_id, std::string fullname) { pb_cmd_ids[cmd_id] = fullname; });
+        luapb.set_function("load", load_pb);
+        luapb.set_function("loadfile", loadfile_pb);
+        luapb.set_function("clear", clear_pb);
+        luapb.set_function("state", state_pb);
+        luapb.set_function("bind_cmd", bind_cmd);
         luapb.set_function("xor_init", [](uint64_t key) { xor_init(key); });
+        luapb.set_function("zip_init", [](size_t zip_min) { pb_zip_min = zip_min; });
+        luapb.set_function("zip_stats", zip_stats);
         return luapb;
     }
 }
@@ -30,6 +30,7 @@ namespace llmdb {
             "batch_put", &mdb_driver::batch_put,
             "batch_get", &mdb_driver::batch_get,
             "batch_del", &mdb_driver::batch_del,
+            "batch_write", &mdb_driver::batch_write,
             "set_flags", &mdb_driver::set_flags,
             "begin_txn", &mdb_driver::begin_txn,
             "abort_txn", &mdb_driver::abort_txn,
@@ -218,6 +218,48 @@ namespace llmdb {
             lua_pushinteger(L, rc);
             return 1;
         }
+        int batch_write(lua_State* L) {
+            MDB_val mkey, mval;
+            lua_Integer count = 0;
+            luaL_checktype(L, 1, LUA_TTABLE);
+            int rc = mdb_txn_begin(_env, nullptr, 0, &_txn);
+            if (rc != MDB_SUCCESS) {
+                lua_pushinteger(L, rc);
+                return 1;
+            }
+            AutoCommit ac(this);
+            count = luaL_len(L, 1);
+            for (lua_Integer i = 1; i <= count; ++i) {
+                lua_settop(L, 1);
+                lua_geti(L, 1, i);
+                lua_geti(L, 2, 1);
+                rc = mdb_dbi_open(_txn, luaL_optstring(L, 3, nullptr), MDB_CREATE, &_dbi);
+                if (rc != MDB_SUCCESS) goto exit;
+                if (lua_getfield(L, 2, "puts") == LUA_TTABLE) {
+                    lua_pushnil(L);
+                    while (lua_next(L, 4) != 0) {
+                        read_key(L, -2, mkey);
+                        read_value(L, -1, mval);
+                        lua_pop(L, 1);
+                        rc = mdb_put(_txn, _dbi, &mkey, &mval, 0);
+                        if (rc != MDB_SUCCESS) goto exit;
+                    }
+                }
+                if (lua_getfield(L, 2, "dels") == LUA_TTABLE) {
+                    lua_pushnil(L);
+                    while (lua_next(L, 5) != 0) {
+                        read_key(L, -1, mkey);
+                        lua_pop(L, 1);
+                        rc = mdb_del(_txn, _dbi, &mkey, nullptr);
+                        if (rc != MDB_SUCCESS && rc != MDB_NOTFOUND) goto exit;
+                    }
+                }
+            }
+            rc = ac.commit(MDB_SUCCESS);
+        exit:
+            lua_pushinteger(L, rc);
+            return 1;
+        }
         int32_t cursor_open(const char* name) {
             int rc = begin_txn(name);
             if (rc != MDB_SUCCESS) return rc;
@@ -135,6 +135,22 @@ namespace luakit {
             return m_head;
         }
 
+        //移交内存所有权(调用者free), 自身改用spare(malloc分配, 大小spare_size), 没有时重新分配默认大小
+        uint8_t* detach(size_t* len, uint8_t* spare = nullptr, size_t spare_size = 0) {
+            _regularize();
+            uint8_t* data = m_data;
+            *len = (size_t)(m_tail - m_head);
+            if (!spare) {
+                spare = (uint8_t*)malloc(BUFFER_DEF);
+                spare_size = BUFFER_DEF;
+            }
+            m_data = spare;
+            m_size = spare_size;
+            m_head = m_tail = m_data;
+            m_end = m_data + spare_size;
+            return data;
+        }
+
         std::string_view string() {
             size_t len = (size_t)(m_tail - m_head);
             return std::string_view((const char*)m_head, len);
@@ -31,6 +31,11 @@ namespace luakit {
 		return duration_cast<milliseconds>(dur).count();
 	}
 
+	inline uint64_t steady_ns() {
+		steady_clock::duration dur = steady_clock::now().time_since_epoch();
+		return duration_cast<nanoseconds>(dur).count();
+	}
+
 	inline void sleep(uint64_t ms) {
 		std::this_thread::sleep_for(std::chrono::milliseconds(ms));
 	}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <stdint.h>
+
+namespace utility
+{
+//分层时间轮(同skynet): near层256个刻度, 其上4层各64格, 覆盖32位刻度
+//刻度计数为64位, 跨越32位边界时最高层回绕的槽位下移
+//槽位链表由使用方提供, 需要实现:
+//  list_t::node_type       挂在槽位上的节点
+//  list_t::expire_of(node) 节点的到期刻度
+//  list.push(node)         挂到链表尾部
+//  list.flush(fn)          摘下所有节点, 依次调用fn(node)
+template<typename list_t>
+class timer_wheel
+{
+public:
+	using node_type = typename list_t::node_type;
+
+	static constexpr int NEAR_SHIFT = 8;
+	static constexpr int LEVEL_SHIFT = 6;
+	static constexpr int NEAR = (1 << NEAR_SHIFT);
+	static constexpr int LEVEL = (1 << LEVEL_SHIFT);
+	static constexpr int NEAR_MASK = (NEAR - 1);
+	static constexpr int LEVEL_MASK = (LEVEL - 1);
+	//距当前刻度的最大跨度, 超出会和回绕后的槽位重叠
+	static constexpr uint64_t MAX_TICK = (1ull << (NEAR_SHIFT + 4 * LEVEL_SHIFT)) - 1;
+
+	uint64_t time() const { return m_time; }
+
+	//仅在没有节点时调整当前刻度
+	void reset(uint64_t time) { m_time = time; }
+
+	//按到期刻度挂到对应的层, 到期刻度不能小于当前刻度
+	void add(node_type node) {
+		uint64_t expire = list_t::expire_of(node);
+		if ((expire | NEAR_MASK) == (m_time | NEAR_MASK)) {
+			m_near[expire & NEAR_MASK].push(node);
+			return;
+		}
+		uint32_t i;
+		uint64_t mask = NEAR << LEVEL_SHIFT;
+		for (i = 0; i < 3; i++) {
+			if ((expire | (mask - 1)) == (m_time | (mask - 1))) {
+				break;
+			}
+			mask <<= LEVEL_SHIFT;
+		}
+		m_levels[i][((expire >> (NEAR_SHIFT + i * LEVEL_SHIFT)) & LEVEL_MASK)].push(node);
+	}
+
+	//推进一个刻度, 高层到期的槽位下移
+	void shift() {
+		uint64_t ct = ++m_time;
+		uint32_t i = 0;
+		uint64_t mask = NEAR;
+		uint64_t time = ct >> NEAR_SHIFT;
+		while ((ct & (mask - 1)) == 0) {
+			uint32_t idx = time & LEVEL_MASK;
+			if (idx != 0) {
+				move_list(i, idx);
+				return;
+			}
+			mask <<= LEVEL_SHIFT;
+			time >>= LEVEL_SHIFT;
+			//跨越32位边界, 最高层回绕
+			if (++i == 4) {
+				move_list(3, 0);
+				return;
+			}
+		}
+	}
+
+	//当前刻度的到期链表
+	list_t& current() { return m_near[m_time & NEAR_MASK]; }
+
+protected:
+	void move_list(uint32_t level, uint32_t idx) {
+		m_levels[level][idx].flush([this](node_type node) { add(node); });
+	}
+
+protected:
+	uint64_t m_time = 0;
+	list_t m_near[NEAR];
+	list_t m_levels[4][LEVEL];
+};
+}
@@ -77,6 +77,11 @@ function MongoAgent:unsafe_insert(db_query, hash_key, db_name)
     return self:execute("rpc_mongo_unsafe_insert", db_query, hash_key, db_name)
 end
 
+--db_query: {coll_name, ops, ordered}
+function MongoAgent:bulk_write(db_query, hash_key, db_name)
+    return self:execute("rpc_mongo_bulk_write", db_query, hash_key, db_name)
+end
+
 --db_query: {coll_name, selector}
 function MongoAgent:count(db_query, hash_key, db_name)
     return self:execute("rpc_mongo_count", db_query, hash_key, db_name)
@@ -15,6 +15,7 @@ local gc_mgr        = hive.get("gc_mgr")
 local thread_mgr    = hive.get("thread_mgr")
 local update_mgr    = hive.get("update_mgr")
 local config_mgr    = hive.get("config_mgr")
+local prof_mgr      = hive.get("prof_mgr")
 
 local RPC_FAILED    = hive.enum("KernCode", "RPC_FAILED")
 local ServiceStatus = enum("ServiceStatus")
@@ -46,6 +47,9 @@ function MonitorAgent:__init()
     event_mgr:add_listener(self, "rpc_set_gc_step")
     event_mgr:add_listener(self, "rpc_check_endless_loop")
     event_mgr:add_listener(self, "rpc_table_find_one")
+    event_mgr:add_listener(self, "rpc_prof_start")
+    event_mgr:add_listener(self, "rpc_prof_stop")
+    event_mgr:add_listener(self, "rpc_prof_dump")
 
     event_mgr:add_trigger(self, "on_router_connected")
 
@@ -278,6 +282,23 @@ function MonitorAgent:rpc_table_find_one(tname, index)
     return 1, "table not find"
 end
 
+--采样分析, worker一起开启, dump时合并所有线程
+function MonitorAgent:rpc_prof_start(interval)
+    prof_mgr:start(interval)
+    hive.scheduler:broadcast("rpc_prof_start", interval)
+    return { code = 0, interval = prof_mgr:get_interval() }
+end
+
+function MonitorAgent:rpc_prof_stop()
+    prof_mgr:stop()
+    hive.scheduler:broadcast("rpc_prof_stop")
+    return { code = 0 }
+end
+
+function MonitorAgent:rpc_prof_dump(top)
+    return prof_mgr:dump(top)
+end
+
 hive.monitor = MonitorAgent()
 
 return MonitorAgent
@@ -1,14 +1,19 @@
 local sformat    = string.format
 local log_warn   = logger.warn
 local log_err    = logger.err
+local mhistogram = metrics.histogram
+local mobserve   = metrics.observe
 local scheduler  = hive.load("scheduler")
 
+local MaxMessageLen<const> = 32 * 1024
+
 local thread     = import("feature/worker_agent.lua")
 local ProxyAgent = singleton(thread)
 local prop       = property(ProxyAgent)
 prop:reader("ignore_statistics", {})
 prop:reader("statis_status", false)
 prop:reader("warns", {})
+prop:reader("metric_ids", {})
 
 function ProxyAgent:__init()
     self.service  = "proxy"
@@ -16,11 +21,11 @@ function ProxyAgent:__init()
     --开启调度器
     if scheduler then
         self:startup("worker.proxy")
-        --开启统计
-        if environ.status("HIVE_STATIS") then
-            self.statis_status = true
-            log_warn("[ProxyAgent:__init] open statis !!!,it will degrade performance")
-        end
+    end
+    --开启统计, 各线程写本地指标, proxy线程汇总上报
+    if environ.status("HIVE_STATIS") then
+        self.statis_status = true
+        log_warn("[ProxyAgent:__init] open statis !!!")
     end
     --添加忽略的rpc统计事件
     self:ignore_statis("rpc_heartbeat")
@@ -74,8 +79,21 @@ function ProxyAgent:statistics(event, name, len)
     if wlen and len > wlen then
         log_err("[ProxyAgent][statistics] [%s:%s],send len:%s,please check the logic is right?", event, name, len)
     end
+    if event == "on_proto_send" and len > MaxMessageLen then
+        log_err("[ProxyAgent][statistics] the msg is very long,cmd_id:{},len:{}", name, len)
+    end
     if self.statis_status and not self.ignore_statistics[name] then
-        self:send(event, name, len)
+        local ids = self.metric_ids[event]
+        if not ids then
+            ids                    = {}
+            self.metric_ids[event] = ids
+        end
+        local id = ids[name]
+        if not id then
+            id        = mhistogram(sformat("%s:%s", event, name))
+            ids[name] = id
+        end
+        mobserve(id, len)
     end
 end
 
@@ -3,6 +3,7 @@ local tpack      = table.pack
 local tunpack    = table.unpack
 local raw_yield  = coroutine.yield
 local raw_resume = coroutine.resume
+local co_resume  = raw_resume
 local co_running = coroutine.running
 
 local co_hookor  = hive.load("co_hookor")
@@ -20,7 +21,7 @@ function hive.init_coroutine()
             co_hookor:yield(co_running())
             co_hookor:resume(co)
         end
-        local args = tpack(raw_resume(co, ...))
+        local args = tpack(co_resume(co, ...))
         if co_hookor then
             co_hookor:resume(co_running())
         end
@@ -33,6 +34,11 @@ function hive.init_coroutine()
     end
 end
 
+--采样期间由采样分析库resume, 记录正在运行的协程
+function hive.profile_coroutine(enable)
+    co_resume = enable and profiler.resume or raw_resume
+end
+
 function hive.hook_coroutine(hooker)
     co_hookor      = hooker
     hive.co_hookor = hooker
@@ -23,6 +23,10 @@ crypt         = require("lcrypt")
 luabus        = require("luabus")
 --cache库
 lcache        = require("lcache")
+--指标库
+metrics       = require("lmetrics")
+--采样分析库
+profiler      = require("lprof")
 
 --特定模块
 if hgetenv("HIVE_SERVICE") then
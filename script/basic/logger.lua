@@ -37,6 +37,8 @@ function logger.init()
 
     log.set_max_logsize(log_size)
     log.set_clean_time(maxdays * 24 * 3600)
+    log.set_binary(environ.number("HIVE_LOG_BINARY", 0))
+    log.set_overflow(environ.number("HIVE_LOG_OVERFLOW", log.OVERFLOW.BLOCK), environ.number("HIVE_LOG_SAMPLE", 10))
     log.option(path, service_name, index, rolltype, wlvl);
     --设置日志过滤
     logger.filter(log_lvl)
@@ -35,7 +35,8 @@ function service.make_node(port, domain)
         host         = domain or hive.host,
         pid          = hive.pid,
         is_ready     = false,
-        status       = hive.service_status
+        status       = hive.service_status,
+        rpc_method   = true     --支持rpc方法编号
     }
     if not hive.node_info.host or hive.node_info.host == "" then
         hive.node_info.host = "127.0.0.1"
@@ -0,0 +1,83 @@
+-- cache_store.lua
+-- 缓存对象容器: 对象存放在lua表, 过期检查和存盘时间由lcache.store的时间轮调度
+-- 每次只取出到期的key, 不再按轮遍历全部对象
+local lstore     = lcache.store
+
+local CacheStore = class()
+local prop       = property(CacheStore)
+prop:reader("objs", {})         -- key => obj
+prop:reader("count", 0)         -- 数量
+prop:reader("store", nil)       -- native时间轮
+
+function CacheStore:__init(tick_ms)
+    self.store = lstore(hive.clock_ms, tick_ms or 100)
+end
+
+-- 设置指定key的值, 删除时同时取消调度
+function CacheStore:set(key, value)
+    local objs = self.objs
+    if not objs[key] and value then
+        self.count = self.count + 1
+    elseif objs[key] and not value then
+        self.count = self.count - 1
+        self.store:remove(key)
+    end
+    objs[key] = value
+end
+
+function CacheStore:get(key)
+    if not key then
+        return nil
+    end
+    return self.objs[key]
+end
+
+function CacheStore:iterator()
+    return next, self.objs
+end
+
+-- 设置过期检查时间
+function CacheStore:expire(key, clock_ms)
+    self.store:expire(key, clock_ms)
+end
+
+-- 设置存盘时间, clock_ms为nil时清除脏标记
+function CacheStore:set_dirty(key, clock_ms)
+    if clock_ms then
+        self.store:dirty(key, clock_ms)
+        return
+    end
+    self.store:clean(key)
+end
+
+function CacheStore:get_dirty_count()
+    return self.store:dirty_count()
+end
+
+-- 取出到期的过期检查, 取出后需要重新设置或删除
+function CacheStore:pop_expired(clock_ms, limit)
+    return self.store:pop_expired(clock_ms, limit)
+end
+
+-- 按到期顺序取出需要存盘的key, 超出limit的留到下次
+function CacheStore:pop_dirty(clock_ms, limit)
+    return self.store:pop_dirty(clock_ms, limit)
+end
+
+-- 遍历全部脏对象
+function CacheStore:dirty_iterator()
+    local objs  = self.objs
+    local keys  = self.store:dirty_keys()
+    local index = 0
+    local function iter()
+        index     = index + 1
+        local key = keys[index]
+        if key ~= nil then
+            return key, objs[key]
+        end
+    end
+    return iter
+end
+
+-- export
+return CacheStore
@@ -195,7 +195,7 @@ end
 function Influx:batch(batch_datas)
     local protocols = {}
     for measurement, datas in pairs(batch_datas) do
-        local prefix = self:quote_tags(measurement, datas.tags)
+        local prefix = self:quote_tags(datas.measurement or measurement, datas.tags)
         for _, fields in pairs(datas.field_list) do
             local suffix              = self:quote_fields(fields)
             protocols[#protocols + 1] = sformat("%s %s", prefix, suffix)
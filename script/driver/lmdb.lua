@@ -114,6 +114,17 @@ function Lmdb:dels(keys, dbname)
     return false
 end
 
+--多个库的写入和删除在一个事务内提交, 任一失败全部回滚
+--ops: { { dbname, puts = { key = value }, dels = { key } } }
+function Lmdb:writes(ops)
+    local ok, rc = xpcall_ret(self.driver.batch_write, "Lmdb:writes:%s", ops)
+    if ok and rc == MDB_SUCCESS then
+        return true
+    end
+    log_err("[Lmdb][writes] {} fail code:{}", ops, rc)
+    return false
+end
+
 function Lmdb:drop(dbname)
     local ok, rc = xpcall_ret(self.driver.quick_drop, "Lmdb:drop:%s", dbname or self.dbname)
     if ok and (rc == MDB_NOTFOUND or rc == MDB_SUCCESS) then
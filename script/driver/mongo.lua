@@ -1,5 +1,6 @@
 --mongo.lua
 local Socket       = import("driver/socket.lua")
+local MongoCursor  = import("driver/mongo_cursor.lua")
 local log_warn     = logger.warn
 local log_err      = logger.err
 local log_info     = logger.info
@@ -7,6 +8,7 @@ local qhash        = hive.hash
 local hdefer       = hive.defer
 local makechan     = hive.make_channel
 local type         = type
+local ipairs       = ipairs
 local tinsert      = table.insert
 local tunpack      = table.unpack
 local tdelete      = table_ext.delete
@@ -16,11 +18,12 @@ local ssub         = string.sub
 local sgsub        = string.gsub
 local sformat      = string.format
 local sgmatch      = string.gmatch
+local ssplit       = string_ext.split
 local mtointeger   = math.tointeger
 local lmd5         = crypt.md5
 local lsha1        = crypt.sha1
 local bsonpairs    = bson.pairs
-local bint64       = bson.int64
+local mongocodec   = bson.mongocodec
 local lrandomkey   = crypt.randomkey
 local lb64encode   = crypt.b64_encode
 local lb64decode   = crypt.b64_decode
@@ -38,6 +41,42 @@ local SECOND_MS    = hive.enum("PeriodTime", "SECOND_MS")
 local SECOND_10_MS = hive.enum("PeriodTime", "SECOND_10_MS")
 local DB_TIMEOUT   = hive.enum("NetwkTime", "DB_CALL_TIMEOUT")
 local POOL_COUNT   = environ.number("HIVE_DB_POOL_COUNT", 3)
+local BULK_SIZE    = environ.number("HIVE_MONGO_BULK_SIZE", 1000)
+local BATCH_SIZE   = environ.number("HIVE_MONGO_BATCH_SIZE", 1000)
+
+--批量写: 命令名对应的文档序列标识及单条操作构造
+local BULK_WRITES  = {
+    insert = {
+        ident = "documents",
+        build = function(doc)
+            return doc
+        end,
+        merge = function(result, reply)
+            result.nInserted = result.nInserted + (reply.n or 0)
+        end,
+    },
+    update = {
+        ident = "updates",
+        build = function(update, selector, upsert, multi)
+            return { q = selector, u = update, upsert = upsert, multi = multi }
+        end,
+        merge = function(result, reply)
+            local upserted   = reply.upserted and #reply.upserted or 0
+            result.nMatched  = result.nMatched + (reply.n or 0) - upserted
+            result.nModified = result.nModified + (reply.nModified or 0)
+            result.nUpserted = result.nUpserted + upserted
+        end,
+    },
+    delete = {
+        ident = "deletes",
+        build = function(selector, onlyone)
+            return { q = selector, limit = onlyone and 1 or 0 }
+        end,
+        merge = function(result, reply)
+            result.nRemoved = result.nRemoved + (reply.n or 0)
+        end,
+    },
+}
 
 local MongoDB      = class()
 local prop         = property(MongoDB)
@@ -51,15 +90,19 @@ prop:reader("connections", {})  --connections
 prop:reader("sessions", {})     --sessions
 prop:reader("readpref", { mode = "primary" })    --readPreference
 prop:reader("auth_source", "admin") --authSource
+prop:reader("compressors", nil)     --compressors
+prop:reader("zlib_level", 0)        --zlibCompressionLevel
+prop:reader("zip_codecs", {})       --压缩codec
 prop:reader("alives", {})           --alives
 prop:reader("req_counter", nil)
 prop:reader("res_counter", nil)
+prop:reader("send_bytes", 0)        --累计发送字节
 
 function MongoDB:__init(conf)
     self.user   = conf.user
     self.passwd = conf.passwd
     self.name   = conf.db
-    self.codec  = bson.mongocodec()
+    self.codec  = mongocodec()
     self:set_options(conf.opts)
     self:setup_pool(conf.hosts)
     --attach_hour
@@ -74,10 +117,10 @@ function MongoDB:__release()
 end
 
 function MongoDB:close()
-    for sock in pairs(self.alives) do
+    for _, sock in pairs(self.alives) do
         sock:close()
     end
-    for sock in pairs(self.connections) do
+    for _, sock in pairs(self.connections) do
         sock:close()
     end
     self.timer:unregister()
@@ -122,6 +165,10 @@ function MongoDB:set_options(opts)
             self.readpref = { mode = value }
         elseif key == "authSource" then
             self.auth_source = value
+        elseif key == "compressors" then
+            self.compressors = ssplit(value, ",")
+        elseif key == "zlibCompressionLevel" then
+            self.zlib_level = tonumber(value)
         end
     end
 end
@@ -162,6 +209,7 @@ function MongoDB:login(socket)
         return false
     end
     socket:set_codec(self.codec)
+    local compressor = self:handshake(socket)
     if #self.user > 1 and #self.passwd > 1 then
         local aok, aerr = self:auth(socket, self.user, self.passwd)
         if not aok then
@@ -171,12 +219,40 @@ function MongoDB:login(socket)
             return false
         end
     end
+    --握手和认证不能压缩, 完成后再切换codec
+    if compressor then
+        socket:set_codec(self:zip_codec(compressor))
+    end
     self.connections[id] = nil
     tinsert(self.alives, socket)
-    log_info("[MongoDB][login] connect db({}:{}:{}:{}) success!", ip, port, self.name, id)
+    log_info("[MongoDB][login] connect db({}:{}:{}:{}) success! compressor: {}", ip, port, self.name, id, compressor)
     return true, SUCCESS
 end
 
+--握手协商OP_COMPRESSED压缩算法, 服务端按优先级返回双方都支持的算法
+function MongoDB:handshake(sock)
+    if not self.compressors then
+        return
+    end
+    local ok, doc = self:adminCommand(sock, "isMaster", 1, "compression", self.compressors)
+    if not ok then
+        log_warn("[MongoDB][handshake] db({}:{}) negotiate compression failed: {}", sock.ip, sock.port, doc)
+        return
+    end
+    if doc.compression then
+        return doc.compression[1]
+    end
+end
+
+function MongoDB:zip_codec(compressor)
+    local codec = self.zip_codecs[compressor]
+    if not codec then
+        codec                       = mongocodec(compressor, self.zlib_level)
+        self.zip_codecs[compressor] = codec
+    end
+    return codec
+end
+
 function MongoDB:salt_password(password, salt, iter)
     if self.salted_pass then
         return self.salted_pass
@@ -273,7 +349,7 @@ end
 
 function MongoDB:decode_reply(result)
     if result.writeErrors then
-        return false, result.writeErrors[1].errmsg
+        return false, result.writeErrors[1].errmsg, result
     end
     if result.writeConcernError then
         return false, result.writeConcernError.errmsg
@@ -287,8 +363,8 @@ end
 function MongoDB:on_socket_recv(sock, session_id, result)
     if session_id > 0 then
         self.res_counter:count_increase()
-        local succ, doc = self:decode_reply(result)
-        thread_mgr:response(session_id, succ, doc)
+        local succ, doc, reply = self:decode_reply(result)
+        thread_mgr:response(session_id, succ, doc, reply)
     end
 end
 
@@ -297,9 +373,11 @@ function MongoDB:op_msg(sock, session_id, cmd, ...)
         return false, "db not connected"
     end
     local tick = lclock_ms()
-    if not sock:send_data(session_id, cmd, ...) then
+    local ok, send_len = sock:send_data(session_id, cmd, ...)
+    if not ok then
         return false, "send failed"
     end
+    self.send_bytes = self.send_bytes + send_len
     sock.sessions[session_id] = cmd
     self.req_counter:count_increase()
     local _<close> = hdefer(function()
@@ -322,8 +400,16 @@ function MongoDB:runCommand(cmd, cmd_v, ...)
     return self:op_msg(self.executer, session_id, cmd, cmd_v or 1, "$db", self.name, ...)
 end
 
+function MongoDB:sockCommand(sock, cmd, cmd_v, ...)
+    local session_id = thread_mgr:build_session_id()
+    return self:op_msg(sock, session_id, cmd, cmd_v or 1, "$db", self.name, ...)
+end
+
 function MongoDB:sendCommand(cmd, cmd_v, ...)
-    self.executer:send_data(0, cmd, cmd_v or 1, "$db", self.name, "writeConcern", { w = 0 }, ...)
+    local ok, send_len = self.executer:send_data(0, cmd, cmd_v or 1, "$db", self.name, "writeConcern", { w = 0 }, ...)
+    if ok then
+        self.send_bytes = self.send_bytes + send_len
+    end
 end
 
 function MongoDB:drop_collection(co_name)
@@ -392,6 +478,49 @@ function MongoDB:unsafe_delete(co_name, selector, onlyone)
     return self:sendCommand("delete", co_name, "deletes", { cmd_data })
 end
 
+-- 批量写, 相邻的同类操作合并为一条命令, 文档以OP_MSG文档序列发送
+-- ops: { {"insert", doc}, {"update", update, selector, upsert, multi}, {"delete", selector, onlyone}, ... }
+-- ordered: 默认true, 遇到写错误即停止; false时忽略单条错误继续执行
+-- @return: true, result / false, errmsg, result
+-- result: { nInserted, nMatched, nModified, nUpserted, nRemoved, writeErrors = { {index, errmsg}, ... } }
+-- 命令执行失败(网络/超时等)时只返回false, errmsg, 此时无法确定哪些操作已生效
+function MongoDB:bulk_write(co_name, ops, ordered)
+    ordered      = ordered ~= false
+    local result = { nInserted = 0, nMatched = 0, nModified = 0, nUpserted = 0, nRemoved = 0 }
+    local index, count = 1, #ops
+    while index <= count do
+        local kind = ops[index][1]
+        local bulk = BULK_WRITES[kind]
+        if not bulk then
+            return false, sformat("unsupported bulk op: %s", kind)
+        end
+        local base, docs = index - 1, {}
+        repeat
+            docs[#docs + 1] = bulk.build(tunpack(ops[index], 2))
+            index           = index + 1
+        until index > count or #docs >= BULK_SIZE or ops[index][1] ~= kind
+        local ok, res, reply = self:runCommand(kind, co_name, "ordered", ordered, { [bulk.ident] = docs })
+        if not ok and not reply then
+            return false, res
+        end
+        bulk.merge(result, reply or res)
+        if reply then
+            local errors = result.writeErrors or {}
+            for _, err in ipairs(reply.writeErrors) do
+                errors[#errors + 1] = { index = base + err.index + 1, errmsg = err.errmsg }
+            end
+            result.writeErrors = errors
+            if ordered then
+                break
+            end
+        end
+    end
+    if result.writeErrors then
+        return false, result.writeErrors[1].errmsg, result
+    end
+    return true, result
+end
+
 function MongoDB:count(co_name, query, limit, skip)
     local succ, doc = self:runCommand("count", co_name, "query", query, "limit", limit or 0, "skip", skip or 0)
     if not succ then
@@ -426,32 +555,42 @@ end
 -- 参数说明
 --sort: {k1=1} / {k1,1,k2,-1,k3,-1}
 function MongoDB:find(co_name, query, projection, sortor, limit, skip)
-    local fsortor     = self:format_pairs(sortor)
-    local succ, reply = self:runCommand("find", co_name, "filter", query,
-            "projection", projection or {}, "sort", fsortor or {}, "limit", limit or 100, "skip", skip or 0)
+    local succ, cursor = self:cursor(co_name, query, projection, sortor, limit or 100, skip)
     if not succ then
-        return succ, reply
+        return succ, cursor
     end
     local results = {}
-    local cursor  = reply.cursor
-    while cursor do
-        local documents = cursor.firstBatch or cursor.nextBatch
-        tjoin(documents, results)
-        if not cursor.id or cursor.id == 0 then
-            break
+    while true do
+        local ok, documents = cursor:next_batch()
+        if not ok then
+            return ok, documents
         end
-        if limit and #results >= limit then
+        if not documents then
             break
         end
-        local msucc, moreply = self:runCommand("getMore", bint64(cursor.id), "collection", co_name)
-        if not msucc then
-            return msucc, moreply
-        end
-        cursor = moreply.cursor
+        tjoin(documents, results)
     end
     return true, results
 end
 
+-- 游标查询, 按batch_size分批拉取, 遍历时只持有当前批次, 适合导出/扫描大集合
+-- limit: 默认0不限制; batch_size: 默认HIVE_MONGO_BATCH_SIZE
+-- local ok, cursor = mongodb:cursor(co_name, query)
+-- for doc in cursor:iterator() do ... end
+-- 提前结束遍历时调用cursor:close()释放服务端游标
+function MongoDB:cursor(co_name, query, projection, sortor, limit, skip, batch_size)
+    local sock        = self.executer
+    local fsortor     = self:format_pairs(sortor)
+    local cursor      = MongoCursor(self, sock, co_name, batch_size or BATCH_SIZE)
+    local succ, reply = self:sockCommand(sock, "find", co_name, "filter", query or {}, "projection", projection or {},
+            "sort", fsortor or {}, "limit", limit or 0, "skip", skip or 0, "batchSize", cursor:get_batch_size())
+    if not succ then
+        return succ, reply
+    end
+    cursor:attach(reply.cursor)
+    return true, cursor
+end
+
 function MongoDB:find_and_modify(co_name, update, selector, upsert, fields, new)
     return self:runCommand("findAndModify", co_name, "query", selector, "update", update, "fields", fields, "upsert", upsert, "new", new)
 end
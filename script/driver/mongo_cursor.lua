@@ -0,0 +1,95 @@
+--mongo_cursor.lua
+--mongo游标: 按批次拉取, 只持有当前批次, 遍历过的文档随即释放
+local log_warn    = logger.warn
+local bint64      = bson.int64
+
+local MongoCursor = class()
+local prop        = property(MongoCursor)
+prop:reader("db", nil)          --mongodb
+prop:reader("sock", nil)        --游标所在连接, getMore必须发往同一服务
+prop:reader("co_name", nil)     --集合名
+prop:reader("id", 0)            --服务端游标id, 0表示已取完
+prop:reader("batch", nil)       --未取走的批次
+prop:reader("batch_size", nil)  --每批文档数
+prop:reader("err", nil)         --遍历中的错误
+
+function MongoCursor:__init(db, sock, co_name, batch_size)
+    self.db         = db
+    self.sock       = sock
+    self.co_name    = co_name
+    self.batch_size = batch_size
+end
+
+--作为<close>变量时, 离开作用域释放服务端游标
+function MongoCursor:__defer()
+    self:close()
+end
+
+function MongoCursor:attach(cursor)
+    self.id    = cursor.id or 0
+    self.batch = cursor.firstBatch or cursor.nextBatch
+end
+
+function MongoCursor:alive()
+    return self.id ~= 0
+end
+
+--取下一批文档: true, docs / true(已取完) / false, err
+function MongoCursor:next_batch()
+    local batch = self.batch
+    if batch then
+        self.batch = nil
+        return true, batch
+    end
+    if self.id == 0 then
+        return true
+    end
+    local ok, reply = self.db:sockCommand(self.sock, "getMore", bint64(self.id), "collection", self.co_name, "batchSize", self.batch_size)
+    if not ok then
+        self.id = 0
+        return false, reply
+    end
+    self:attach(reply.cursor)
+    return self:next_batch()
+end
+
+--逐条遍历: for doc in cursor:iterator() do ... end
+--出错时结束遍历, 错误通过get_err获取
+function MongoCursor:iterator()
+    local docs, index = nil, 0
+    return function()
+        while true do
+            if docs then
+                index     = index + 1
+                local doc = docs[index]
+                if doc ~= nil then
+                    docs[index] = nil
+                    return doc
+                end
+            end
+            local ok, batch = self:next_batch()
+            if not ok then
+                log_warn("[MongoCursor][iterator] {} getMore failed: {}", self.co_name, batch)
+                self.err = batch
+                return
+            end
+            if not batch then
+                return
+            end
+            docs, index = batch, 0
+        end
+    end
+end
+
+function MongoCursor:close()
+    self.batch = nil
+    if self.id ~= 0 then
+        local id = self.id
+        self.id  = 0
+        if self.sock and self.sock.alive then
+            self.sock:send_data(0, "killCursors", self.co_name, "cursors", { bint64(id) }, "$db", self.db:get_name())
+        end
+    end
+end
+
+return MongoCursor
@@ -1,6 +1,7 @@
 --redis.lua
 local Socket       = import("driver/socket.lua")
 
+local ipairs       = ipairs
 local tonumber     = tonumber
 local log_err      = logger.err
 local log_info     = logger.info
@@ -286,13 +287,17 @@ function RedisDB:on_socket_error(sock, token, err)
     end)
 end
 
-function RedisDB:on_socket_recv(sock, session_id, succ, res)
+function RedisDB:on_socket_recv(sock, session_id, succ, res, errs, pushes)
     if self.subscrible then
+        --批量应答中夹带的push消息
+        for _, push in ipairs(pushes or {}) do
+            self:do_socket_recv(push)
+        end
         self:do_socket_recv(res)
     end
     if session_id > 0 then
         self.res_counter:count_increase()
-        thread_mgr:response(session_id, succ, res)
+        thread_mgr:response(session_id, succ, res, errs)
     end
 end
 
@@ -314,6 +319,68 @@ function RedisDB:commit(socket, cmd, ...)
     return ok, res
 end
 
+--批量提交: 所有命令一次写出, 应答收齐后一次唤醒
+--返回 ok, results, errs; errs为nil或 序号->错误信息, 出错的命令在results中也是错误信息
+function RedisDB:commit_batch(socket, cmds)
+    local session_id = thread_mgr:build_session_id()
+    if not socket:send_data(session_id, cmds) then
+        return false, "send request failed"
+    end
+    self.req_counter:count_increase()
+    local ok, res, errs = thread_mgr:yield(session_id, sformat("redis_batch:%s", #cmds), DB_TIMEOUT)
+    if not ok then
+        log_err("[RedisDB][commit_batch] exec {} cmds failed: {}", #cmds, res)
+        return ok, res
+    end
+    for i, cmd in ipairs(cmds) do
+        local convertor = rconvertors[slower(cmd[1])]
+        if convertor and not (errs and errs[i]) then
+            res[i] = convertor(res[i])
+        end
+    end
+    return ok, res, errs
+end
+
+--管道: cmds = { {cmd, key, ...}, ... }, key用于选择节点(集群模式下命令需落在同一节点)
+function RedisDB:pipeline(cmds, key)
+    if #cmds == 0 then
+        return true, {}
+    end
+    local sock = self:choose_node(key or cmds[1][2])
+    if not sock then
+        return false, "db not connected"
+    end
+    return self:commit_batch(sock, cmds)
+end
+
+--事务: MULTI ... EXEC 作为一次管道提交, 返回EXEC的结果
+function RedisDB:multi(cmds, key)
+    local count = #cmds
+    local batch = { { "MULTI" } }
+    for i = 1, count do
+        batch[i + 1] = cmds[i]
+    end
+    batch[count + 2] = { "EXEC" }
+    local ok, res, errs = self:pipeline(batch, key or (cmds[1] and cmds[1][2]))
+    if not ok then
+        return ok, res
+    end
+    if errs then
+        return false, errs[count + 2] or res[count + 2]
+    end
+    local results = res[count + 2]
+    if not results then
+        return false, "transaction aborted"
+    end
+    for i, cmd in ipairs(cmds) do
+        local convertor = rconvertors[slower(cmd[1])]
+        if convertor then
+            results[i] = convertor(results[i])
+        end
+    end
+    return ok, results
+end
+
 function RedisDB:send(cmd, key, ...)
     local sock = self:choose_node(key)
     if sock then
@@ -188,7 +188,7 @@ end
 function Socket:send_data(...)
     if self.alive then
         local send_len = self.session.call_data(...)
-        return send_len > 0
+        return send_len > 0, send_len
     end
     log_err("[Socket][send_data] the socket not alive, can't send")
     return false, "socket not alive"
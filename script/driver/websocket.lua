@@ -9,6 +9,9 @@ local jsoncodec       = json.jsoncodec
 local wsscodec        = codec.wsscodec
 local httpcodec       = codec.httpcodec
 local xpcall          = hive.xpcall
+local sfind           = string.find
+local smatch          = string.match
+local tonumber        = tonumber
 
 local eproto_type     = luabus.eproto_type
 local event_mgr       = hive.get("event_mgr")
@@ -16,6 +19,9 @@ local thread_mgr      = hive.get("thread_mgr")
 
 local NETWORK_TIMEOUT = hive.enum("NetwkTime", "NETWORK_TIMEOUT")
 
+local WS_MAX_SIZE     = environ.number("HIVE_WS_MAX_SIZE", 4 * 1024 * 1024)   --单条消息上限(含分片合并和解压后)
+local WS_DEFLATE      = environ.status("HIVE_WS_DEFLATE")                      --是否支持permessage-deflate
+
 local WebSocket       = class()
 local prop            = property(WebSocket)
 prop:reader("ip", nil)
@@ -28,11 +34,13 @@ prop:reader("alive", false)
 prop:reader("session", nil)         --连接成功对象
 prop:reader("listener", nil)
 prop:reader("port", 0)
+prop:accessor("deflate", WS_DEFLATE) --是否支持permessage-deflate
+prop:reader("pendings", {})          --握手中的连接
 
 function WebSocket:__init(host)
     self.host   = host
     self.jcodec = jsoncodec()
-    self.wcodec = wsscodec(self.jcodec)
+    self.wcodec = wsscodec(self.jcodec, WS_MAX_SIZE, false)
     self.hcodec = httpcodec(self.jcodec)
 end
 
@@ -68,7 +76,8 @@ end
 
 function WebSocket:on_socket_accept(session)
     local socket = WebSocket(self.host)
-    socket:accept(session, session.ip, self.port)
+    socket:set_deflate(self.deflate)
+    socket:accept(session, session.ip, self.port, self.pendings)
 end
 
 function WebSocket:on_socket_error(token, err)
@@ -102,19 +111,23 @@ function WebSocket:on_socket_recv(session, token, opcode, message)
     end)
 end
 
---accept
-function WebSocket:accept(session, ip, port)
+--accept, 握手完成前由监听者持有, 避免会话被回收
+function WebSocket:accept(session, ip, port, pendings)
     log_debug("[WebSocket][accept] ip, port: {}, {}", ip, port)
     local token = session.token
+    pendings[token] = session
+    self.pendings = pendings
     session.set_timeout(NETWORK_TIMEOUT)
     session.on_call_data = function(recv_len, method, ...)
+        --分片消息未收完整时没有返回值
         if method == "WSS" then
             self:on_socket_recv(session, token, ...)
-        else
+        elseif method then
             self:on_handshake(session, token, ...)
         end
     end
     session.on_error     = function(stoken, err)
+        pendings[token] = nil
         self:on_socket_error(stoken, err)
     end
     self.ip, self.port   = ip, port
@@ -147,8 +160,13 @@ function WebSocket:on_handshake(session, token, url, params, headers, body)
     if headers["Sec-WebSocket-Protocol"] then
         cbheaders["Sec-WebSocket-Protocol"] = "mqtt"
     end
+    if self:negotiate_deflate(headers["Sec-WebSocket-Extensions"]) then
+        cbheaders["Sec-WebSocket-Extensions"] = "permessage-deflate; server_no_context_takeover; client_no_context_takeover"
+        self.wcodec = wsscodec(self.jcodec, WS_MAX_SIZE, true)
+    end
     self.alive   = true
     --handshake 完成
+    self.pendings[token] = nil
     self.token   = token
     self.session = session
     self:send_data(101, cbheaders, "")
@@ -159,6 +177,18 @@ function WebSocket:on_handshake(session, token, url, params, headers, body)
     return true
 end
 
+--协商permessage-deflate, 双方都不保留压缩上下文; 只支持默认的窗口大小
+function WebSocket:negotiate_deflate(extensions)
+    if not self.deflate or not extensions or not sfind(extensions, "permessage-deflate", 1, true) then
+        return false
+    end
+    local bits = smatch(extensions, "server_max_window_bits=(%d+)")
+    if bits and tonumber(bits) < 15 then
+        return false
+    end
+    return true
+end
+
 function WebSocket:send_data(...)
     if self.alive then
         local send_len = self.session.call_data(...)
@@ -81,6 +81,13 @@ function Counter:count_increase()
     end
 end
 
+function Counter:count_add(n)
+    self.count = self.count + n
+    if self.count > self.max then
+        self.max = self.count
+    end
+end
+
 function Counter:count_reduce()
     if self.count > 0 then
         self.count = self.count - 1
@@ -0,0 +1,57 @@
+--prof_mgr.lua
+--采样分析: 按线程cpu时间间隔采样lua调用栈(包括协程), 输出折叠栈(flamegraph)和函数self/total耗时占比
+local log_info   = logger.info
+local log_err    = logger.err
+local sformat    = string.format
+local pstart     = profiler.start
+local pstop      = profiler.stop
+local pdump      = profiler.dump
+
+local ProfMgr    = singleton()
+local prop       = property(ProfMgr)
+prop:reader("interval", 0)  --采样间隔(us)
+
+--采样期间coroutine.resume改由采样分析库执行; debug.sethook设置的钩子在每次取栈后恢复
+function ProfMgr:start(interval)
+    self.interval = interval or 1000
+    if not pstart(hive.title, self.interval) then
+        log_err("[ProfMgr][start] {} start failed", hive.title)
+        self.interval = 0
+        return false
+    end
+    hive.profile_coroutine(true)
+    log_info("[ProfMgr][start] {} interval:{}us", hive.title, self.interval)
+    return true
+end
+
+function ProfMgr:stop()
+    pstop()
+    hive.profile_coroutine(false)
+    self.interval = 0
+    log_info("[ProfMgr][stop] {}", hive.title)
+end
+
+--dump所有线程的采样数据, 折叠栈写入日志目录, 可用flamegraph.pl生成火焰图
+function ProfMgr:dump(top)
+    local folded, samples, funcs = pdump(top or 50)
+    local path                   = environ.get("HIVE_LOG_PATH", "./logs")
+    local filename               = sformat("%s/%s-%s.folded", path, hive.title, os.date("%Y%m%d-%H%M%S"))
+    local file                   = io.open(filename, "w")
+    if not file then
+        log_err("[ProfMgr][dump] open {} failed", filename)
+        filename = nil
+    else
+        file:write(folded)
+        file:close()
+    end
+    for _, func in ipairs(funcs) do
+        func.self_pct  = sformat("%.2f%%", samples > 0 and func.self * 100 / samples or 0)
+        func.total_pct = sformat("%.2f%%", samples > 0 and func.total * 100 / samples or 0)
+    end
+    log_info("[ProfMgr][dump] samples:{} file:{}", samples, filename)
+    return { samples = samples, file = filename, funcs = funcs }
+end
+
+hive.prof_mgr = ProfMgr()
+
+return ProfMgr
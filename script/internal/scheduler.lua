@@ -41,6 +41,17 @@ function Scheduler:startup(name, entry)
     return ok
 end
 
+--启动无状态任务池, count个成员共享任务队列
+function Scheduler:startup_pool(name, entry, count)
+    local ok, err = pcall(hive.worker_pool, name, entry, "internal/worker.lua", count)
+    if not ok or not err then
+        log_err("[Scheduler][startup_pool] startup failed: {}", err)
+        return false
+    end
+    log_info("[Scheduler][startup_pool] startup {}: {} x {}", name, entry, count)
+    return true
+end
+
 --访问其他线程任务
 function Scheduler:broadcast(rpc, ...)
     worker_broadcast("", 0, FLAG_REQ, "master", rpc, ...)
@@ -74,9 +85,14 @@ function Scheduler:call(name, rpc, ...)
     return false, KernCode.RPC_FAILED
 end
 
---访问其他线程任务
+--投递任务池任务, 由空闲成员执行并返回结果
+function Scheduler:submit(name, rpc, ...)
+    return self:call(name, rpc, ...)
+end
+
+--访问其他线程任务, 目标邮箱满时返回false, 由调用方决定重试或丢弃
 function Scheduler:send(name, rpc, ...)
-    worker_call(name, 0, FLAG_REQ, "master", rpc, ...)
+    return worker_call(name, 0, FLAG_REQ, "master", rpc, ...)
 end
 
 function Scheduler:names()
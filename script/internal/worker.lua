@@ -18,6 +18,8 @@ local FLAG_REQ           = hive.enum("FlagMask", "REQ")
 local FLAG_RES           = hive.enum("FlagMask", "RES")
 local THREAD_RPC_TIMEOUT = hive.enum("NetwkTime", "THREAD_RPC_TIMEOUT")
 local HALF_MS            = hive.enum("PeriodTime", "HALF_MS")
+--帧内io等待上限, 定时器精度高于10ms时随之缩短
+local FRAME_WAIT         = math.min(10, environ.number("HIVE_TIMER_ACCURACY", 20))
 local KernCode           = enum("KernCode")
 
 --初始化核心
@@ -32,13 +34,16 @@ end
 --初始化网络
 local function init_network()
     local max_conn = environ.number("HIVE_MAX_CONN", 4096)
-    luabus.init_socket_mgr(max_conn)
+    luabus.init_socket_mgr(max_conn, 0)
+    --邮箱有消息时唤醒luabus.wait
+    luabus.watch_event(hive.event_fd())
 end
 
 --初始化统计
 local function init_statis()
     import("agent/proxy_agent.lua")
     import("internal/perfeval_mgr.lua")
+    import("internal/prof_mgr.lua")
 end
 
 local function init_listener()
@@ -89,7 +94,7 @@ hive.run = function()
         local sclock_ms = lclock_ms()
         hive.update(sclock_ms)
         local scheduler_ms = lclock_ms() - sclock_ms
-        luabus.wait(sclock_ms, 10)
+        luabus.wait(sclock_ms, FRAME_WAIT)
         local now_ms, clock_ms = ltime()
         update_mgr:update(nil, now_ms, clock_ms)
         --时间告警
@@ -3,6 +3,7 @@ local log_info   = logger.info
 local event_mgr  = hive.get("event_mgr")
 local update_mgr = hive.get("update_mgr")
 local gc_mgr     = hive.get("gc_mgr")
+local prof_mgr   = hive.get("prof_mgr")
 
 local KernCode   = enum("KernCode")
 
@@ -14,6 +15,8 @@ function WorkerEvt:__init()
     event_mgr:add_listener(self, "rpc_count_lua_obj")
     event_mgr:add_listener(self, "rpc_full_gc")
     event_mgr:add_listener(self, "rpc_set_gc_step")
+    event_mgr:add_listener(self, "rpc_prof_start")
+    event_mgr:add_listener(self, "rpc_prof_stop")
 end
 
 --热更新
@@ -44,6 +47,14 @@ function WorkerEvt:rpc_set_gc_step(open_gc, slow_step, fast_step)
     gc_mgr:set_gc_step(open_gc, slow_step, fast_step)
 end
 
+function WorkerEvt:rpc_prof_start(interval)
+    prof_mgr:start(interval)
+end
+
+function WorkerEvt:rpc_prof_stop()
+    prof_mgr:stop()
+end
+
 hive.worker_evt = WorkerEvt()
 
 return WorkerEvt
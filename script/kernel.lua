@@ -14,6 +14,8 @@ local update_mgr    = hive.load("update_mgr")
 local event_mgr     = hive.load("event_mgr")
 
 local HALF_MS       = hive.enum("PeriodTime", "HALF_MS")
+--帧内io等待上限, 定时器精度高于10ms时随之缩短
+local FRAME_WAIT    = math.min(10, environ.number("HIVE_TIMER_ACCURACY", 20))
 
 --初始化核心
 local function init_core()
@@ -28,7 +30,11 @@ end
 local function init_network()
     local max_conn = environ.number("HIVE_MAX_CONN", 4096)
     local rpc_key  = environ.get("HIVE_RPC_KEY", "hive2022")
-    luabus.init_socket_mgr(max_conn)
+    --io线程数,0表示在主线程收发
+    local io_threads = environ.number("HIVE_IO_THREADS", 0)
+    luabus.init_socket_mgr(max_conn, io_threads)
+    --worker消息唤醒luabus.wait
+    luabus.watch_event(hive.worker_event_fd())
     luabus.set_rpc_key(crypt.md5(rpc_key, 1))
 end
 
@@ -36,6 +42,7 @@ end
 local function init_statis()
     import("agent/proxy_agent.lua")
     import("internal/perfeval_mgr.lua")
+    import("internal/prof_mgr.lua")
 end
 
 --初始化路由
@@ -150,7 +157,7 @@ hive.run  = function()
     local sclock_ms = lclock_ms()
     scheduler:update(sclock_ms)
     local scheduler_ms = lclock_ms() - sclock_ms
-    luabus.wait(sclock_ms, 10)
+    luabus.wait(sclock_ms, FRAME_WAIT)
     --系统更新
     local now_ms, clock_ms = ltime()
     update_mgr:update(scheduler, now_ms, clock_ms)
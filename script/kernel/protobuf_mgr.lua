@@ -13,6 +13,8 @@ local sends_with   = string_ext.ends_with
 local tunpack      = table.unpack
 local log_err      = logger.err
 local log_warn     = logger.warn
+local log_info     = logger.info
+local sformat      = string.format
 local env_get      = environ.get
 local setmetatable = setmetatable
 local pb_decode    = protobuf.decode
@@ -33,6 +35,9 @@ function ProtobufMgr:__init()
     --设置加密串
     local xor_key = environ.number("HIVE_PROTO_XOR", 123456789)
     protobuf.xor_init(xor_key)
+    --设置压缩阈值, 小于阈值的包不压缩
+    local zip_min = environ.number("HIVE_PROTO_ZIP_MIN", 512)
+    protobuf.zip_init(zip_min)
     --监听热更新
     event_mgr:add_trigger(self, "on_reload")
 end
@@ -211,6 +216,22 @@ function ProtobufMgr:msg_name(cmd_id)
     return self.pb_indexs[cmd_id]
 end
 
+--输出并清空压缩统计: 压缩率和平均耗时(us)
+function ProtobufMgr:dump_zip_stats()
+    for cmd_id, stat in pairs(protobuf.zip_stats()) do
+        local zip_total = stat.zip_count + stat.zip_skip
+        if zip_total > 0 then
+            local ratio = stat.zip_raw > 0 and stat.zip_bytes / stat.zip_raw or 1
+            log_info("[ProtobufMgr][dump_zip_stats] zip cmd:{}({}) count:{} skip:{} raw:{} zip:{} ratio:{} cost:{}us", cmd_id, self.pb_indexs[cmd_id],
+                stat.zip_count, stat.zip_skip, stat.zip_raw, stat.zip_bytes, sformat("%.3f", ratio), sformat("%.2f", stat.zip_ns / zip_total / 1000))
+        end
+        if stat.unzip_count > 0 then
+            log_info("[ProtobufMgr][dump_zip_stats] unzip cmd:{}({}) count:{} raw:{} zip:{} cost:{}us", cmd_id, self.pb_indexs[cmd_id],
+                stat.unzip_count, stat.unzip_raw, stat.unzip_bytes, sformat("%.2f", stat.unzip_ns / stat.unzip_count / 1000))
+        end
+    end
+end
+
 hive.protobuf_mgr = ProtobufMgr()
 
 return ProtobufMgr
@@ -1,18 +1,15 @@
 --timer_mgr.lua
 local log_err         = logger.err
 local log_info        = logger.info
-local ipairs          = ipairs
+local mmax            = math.max
 local tpack           = table.pack
 local tunpack         = table.unpack
-local next_id         = codec.next_id
 local lclock_ms       = timer.clock_ms
 local lnow_ms         = timer.now_ms
 local lcron_next      = timer.cron_next
-local ltinsert        = timer.insert
-local ltupdate        = timer.update
 
---定时器精度，20ms
-local TIMER_ACCURYACY = 20
+--定时器精度，默认20ms, 可通过HIVE_TIMER_ACCURACY调小
+local TIMER_ACCURYACY = environ.number("HIVE_TIMER_ACCURACY", 20)
 
 local thread_mgr      = hive.get("thread_mgr")
 
@@ -23,23 +20,34 @@ prop:reader("last_ms", 0)
 prop:reader("escape_ms", 0)
 function TimerMgr:__init()
     self.last_ms = lclock_ms()
+    --时间轮方法缓存下来, 避免每次访问生成闭包
+    local wheel     = timer.wheel()
+    self.wheel      = wheel
+    self.winsert    = wheel.insert
+    self.wcancel    = wheel.cancel
+    self.wupdate    = wheel.update
+    self.wperiod    = wheel.set_period
+    self.dispatch   = function(timer_id)
+        local handle = self.timers[timer_id]
+        if handle then
+            self:trigger(handle, self.last_ms)
+        end
+    end
 end
 
+--周期定时器由时间轮在每次推进后按当前时间续期(卡顿错过多个周期只触发一次), 次数用完时取消
 function TimerMgr:trigger(handle, clock_ms)
     if handle.times > 0 then
         handle.times = handle.times - 1
     end
     --防止在定时器中阻塞
     handle.params[#handle.params] = clock_ms - handle.last
-    thread_mgr:fork(handle.cb, tunpack(handle.params))
-    --更新定时器数据
+    handle.last = clock_ms
     if handle.times == 0 then
         self.timers[handle.timer_id] = nil
-        return
+        self.wcancel(handle.timer_id)
     end
-    --继续注册
-    handle.last = clock_ms
-    ltinsert(handle.timer_id, handle.period)
+    thread_mgr:fork(handle.cb, tunpack(handle.params))
 end
 
 function TimerMgr:on_frame(clock_ms)
@@ -47,13 +55,7 @@ function TimerMgr:on_frame(clock_ms)
     self.escape_ms  = escape_ms % TIMER_ACCURYACY
     self.last_ms    = clock_ms
     if escape_ms >= TIMER_ACCURYACY then
-        local timers = ltupdate(escape_ms // TIMER_ACCURYACY)
-        for _, timer_id in ipairs(timers or {}) do
-            local handle = self.timers[timer_id]
-            if handle then
-                self:trigger(handle, clock_ms)
-            end
-        end
+        self.wupdate(escape_ms // TIMER_ACCURYACY, self.dispatch)
     end
 end
 
@@ -80,12 +82,12 @@ function TimerMgr:cron(cex, cb, ...)
 end
 
 function TimerMgr:register(interval, period, times, cb, ...)
-    --生成id并注册
     local reg_ms   = lclock_ms()
-    local timer_id = next_id()
     --矫正时间误差
     interval       = interval + (reg_ms - self.last_ms)
-    ltinsert(timer_id, interval // TIMER_ACCURYACY)
+    --单次定时器周期为0, 触发后时间轮直接回收
+    local tick     = times == 1 and 0 or mmax(period // TIMER_ACCURYACY, 1)
+    local timer_id = self.winsert(interval // TIMER_ACCURYACY, tick)
     --包装回调参数
     local params          = tpack(...)
     params[#params + 1]   = 0
@@ -95,22 +97,21 @@ function TimerMgr:register(interval, period, times, cb, ...)
         last     = reg_ms,
         times    = times,
         params   = params,
-        timer_id = timer_id,
-        period   = period // TIMER_ACCURYACY
+        timer_id = timer_id
     }
     return timer_id
 end
 
 function TimerMgr:unregister(timer_id)
-    if timer_id then
+    if timer_id and self.timers[timer_id] then
         self.timers[timer_id] = nil
+        self.wcancel(timer_id)
     end
 end
 
 function TimerMgr:set_period(timer_id, period)
-    local info = self.timers[timer_id]
-    if info then
-        info.period = period // TIMER_ACCURYACY
+    if self.timers[timer_id] then
+        self.wperiod(timer_id, mmax(period // TIMER_ACCURYACY, 1))
     end
 end
 
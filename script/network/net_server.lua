@@ -3,6 +3,7 @@ local log_err          = logger.err
 local log_info         = logger.info
 local log_warn         = logger.warn
 local hxpcall          = hive.xpcall
+local sformat          = string.format
 local env_number       = environ.number
 local signal_quit      = signal.quit
 local eproto_type      = luabus.eproto_type
@@ -40,6 +41,7 @@ prop:reader("sessions", {})             --会话列表
 prop:reader("session_type", "default")  --会话类型
 prop:reader("session_count", 0)         --会话数量
 prop:reader("listener", nil)            --监听器
+prop:reader("channel", nil)             --全服广播频道
 prop:reader("command_cds", {})          --CMD定制CD
 prop:reader("codec", nil)               --编解码器
 prop:accessor("log_client_msg", nil)    --消息日志函数
@@ -50,6 +52,12 @@ function NetServer:__init(session_type)
     self.codec        = protobuf.pbcodec()
     --注册退出
     update_mgr:attach_quit(self)
+    update_mgr:attach_minute(self)
+end
+
+--输出压缩统计
+function NetServer:on_minute()
+    protobuf_mgr:dump_zip_stats()
 end
 
 function NetServer:on_quit()
@@ -75,6 +83,7 @@ function NetServer:setup(ip, port, induce)
         return
     end
     self.ip, self.port = ip, real_port
+    self.channel       = sformat("net_server:%s", real_port)
     log_info("[NetServer][setup] start listen at: {}:{} type={}", ip, real_port, self.proto_type)
     -- 安装回调
     self.listener.set_codec(self.codec)
@@ -137,15 +146,38 @@ function NetServer:write(session, cmd_id, data, session_id, flag)
     return false
 end
 
--- 广播数据
+-- 广播数据, 无过滤时走全服频道
 function NetServer:broadcast(cmd_id, data, filter)
+    if not filter then
+        return self:broadcast_channel(self.channel, cmd_id, data)
+    end
     local tokens = {}
     for _, session in pairs(self.sessions) do
-        if not filter or filter(session) then
+        if filter(session) then
             tokens[#tokens + 1] = session.token
         end
     end
-    luabus.broad_group(self.codec, tokens, cmd_id, FLAG_REQ, 0, data)
+    luabus.broad_group(self.codec, tokens, cmd_id, FLAG_REQ, 0, 0, data)
+    self:log_msg({}, cmd_id, data, 0, 0, false)
+    return true
+end
+
+-- 订阅频道(公会/世界/房间), 会话断开时自动退订
+function NetServer:subscribe(session, channel)
+    return luabus.subscribe(channel, session.token)
+end
+
+function NetServer:unsubscribe(session, channel)
+    return luabus.unsubscribe(channel, session.token)
+end
+
+-- 频道广播, 编码一次由底层分发给所有订阅者
+function NetServer:broadcast_channel(channel, cmd_id, data)
+    local count = luabus.broad_channel(self.codec, channel, cmd_id, FLAG_REQ, 0, 0, data)
+    if count < 0 then
+        log_err("[NetServer][broadcast_channel] encode failed! channel:{},cmd_id:{}", channel, cmd_id)
+        return false
+    end
     self:log_msg({}, cmd_id, data, 0, 0, false)
     return true
 end
@@ -237,6 +269,7 @@ function NetServer:add_session(session)
     if not self.sessions[token] then
         self.sessions[token] = session
         self.session_count   = self.session_count + 1
+        luabus.subscribe(self.channel, token)
         log_info("[NetServer][add_session] session count:{}", self.session_count)
     end
 end
@@ -247,6 +280,7 @@ function NetServer:remove_session(token)
     if session then
         self.sessions[token] = nil
         self.session_count   = self.session_count - 1
+        luabus.unsubscribe(self.channel, token)
         log_info("[NetServer][remove_session] session count:{}", self.session_count)
         return session
     end
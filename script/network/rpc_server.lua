@@ -247,6 +247,10 @@ function RpcServer:rpc_register(client, node, ...)
         client.service_name = node.service_name
         client.name         = node.name
         client.pid          = node.pid
+        --对端支持方法编号, 之后直连的rpc只发送编号, 对端收到后也开启
+        if node.rpc_method then
+            client.set_method_intern(true)
+        end
         self.holder:on_client_register(client, node, ...)
         self.indexes[client.id] = client
     else
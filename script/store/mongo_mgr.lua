@@ -39,6 +39,7 @@ function MongoMgr:__init()
     event_mgr:add_listener(self, "rpc_mongo_create_indexes", "create_indexes")
     event_mgr:add_listener(self, "rpc_mongo_get_indexes", "get_indexes")
     event_mgr:add_listener(self, "rpc_mongo_aggregate", "aggregate")
+    event_mgr:add_listener(self, "rpc_mongo_bulk_write", "bulk_write")
 end
 
 --初始化
@@ -63,6 +64,12 @@ function MongoMgr:setup()
     end
 end
 
+--db累计发送字节数, 用于统计写入流量
+function MongoMgr:get_send_bytes(db_name)
+    local mongodb = (not db_name or db_name == "default") and self.default_db or self.mongo_dbs[db_name]
+    return mongodb and mongodb:get_send_bytes() or 0
+end
+
 --查找mongo db
 function MongoMgr:get_db(db_name, hash_key, coll_name)
     local mongodb
@@ -104,6 +111,22 @@ function MongoMgr:find(db_name, hash_key, coll_name, selector, fields, sortor, l
     return MONGO_FAILED, "mongo db not exist"
 end
 
+--游标查询, 仅供本进程内导出/扫描大集合使用, 不走rpc
+function MongoMgr:cursor(db_name, hash_key, coll_name, selector, fields, sortor, limit, skip, batch_size)
+    local mongodb = self:get_db(db_name, hash_key, coll_name)
+    if mongodb then
+        local _<close>   = hdefer(function()
+            self:change_table_queue(coll_name, -1)
+        end)
+        local ok, res_oe = mongodb:cursor(coll_name, selector, fields, sortor, limit, skip, batch_size)
+        if not ok then
+            log_err("[MongoMgr][cursor] execute {} failed, because: {}", tpack(coll_name, selector, fields, sortor, limit, skip), res_oe)
+        end
+        return ok and SUCCESS or MONGO_FAILED, res_oe
+    end
+    return MONGO_FAILED, "mongo db not exist"
+end
+
 function MongoMgr:find_one(db_name, hash_key, coll_name, selector, fields)
     local mongodb = self:get_db(db_name, hash_key, coll_name)
     if mongodb then
@@ -299,6 +322,23 @@ function MongoMgr:aggregate(db_name, hash_key, coll_name, pipeline, options)
     return MONGO_FAILED, sformat("mongo db:%s not exist", db_name)
 end
 
+--批量写: ops = { {"insert", doc}, {"update", obj, selector, upsert, multi}, {"delete", selector, onlyone} }
+--返回 code, res_oe, result(含各类计数和writeErrors)
+function MongoMgr:bulk_write(db_name, hash_key, coll_name, ops, ordered)
+    local mongodb = self:get_db(db_name, hash_key, coll_name)
+    if mongodb then
+        local _<close>           = hdefer(function()
+            self:change_table_queue(coll_name, -1)
+        end)
+        local ok, res_oe, result = mongodb:bulk_write(coll_name, ops, ordered)
+        if not ok then
+            log_err("[MongoMgr][bulk_write] execute {} {} ops failed, because: {}", coll_name, #ops, res_oe)
+        end
+        return ok and SUCCESS or MONGO_FAILED, res_oe, result
+    end
+    return MONGO_FAILED, sformat("mongo db:%s not exist", db_name)
+end
+
 function MongoMgr:execute(db_name, hash_key, cmd, ...)
     local mongodb = self:get_db(db_name, hash_key)
     if mongodb then
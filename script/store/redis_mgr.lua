@@ -63,6 +63,34 @@ function RedisMgr:execute(db_name, cmd, ...)
     return REDIS_FAILED, sformat("redis db [%s] not exist", db_name)
 end
 
+--管道: cmds = { {cmd, key, ...}, ... }, 一次写出, 返回 code, results, errs
+function RedisMgr:pipeline(db_name, cmds, key)
+    local redisdb = self:get_db(db_name)
+    if redisdb then
+        local ok, res_oe, errs = redisdb:pipeline(cmds, key)
+        if not ok then
+            log_err("[RedisMgr][pipeline] execute {} cmds failed, because: {}", #cmds, res_oe)
+        end
+        self.db_counters[db_name or "default"]:count_increase()
+        return ok and SUCCESS or REDIS_FAILED, res_oe, errs
+    end
+    return REDIS_FAILED, sformat("redis db [%s] not exist", db_name)
+end
+
+--事务: MULTI/EXEC包裹cmds, 返回 code, EXEC结果
+function RedisMgr:multi(db_name, cmds, key)
+    local redisdb = self:get_db(db_name)
+    if redisdb then
+        local ok, res_oe = redisdb:multi(cmds, key)
+        if not ok then
+            log_err("[RedisMgr][multi] execute {} cmds failed, because: {}", #cmds, res_oe)
+        end
+        self.db_counters[db_name or "default"]:count_increase()
+        return ok and SUCCESS or REDIS_FAILED, res_oe
+    end
+    return REDIS_FAILED, sformat("redis db [%s] not exist", db_name)
+end
+
 hive.redis_mgr = RedisMgr()
 
 return RedisMgr
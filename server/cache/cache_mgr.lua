@@ -2,6 +2,7 @@
 import("store/mongo_mgr.lua")
 import("cache/lmdb_mgr.lua")
 local CacheObj     = import("cache/cache_obj.lua")
+local CacheStore   = import("container/cache_store.lua")
 local log_err      = logger.err
 local log_info     = logger.info
 local log_warn     = logger.warn
@@ -15,8 +16,10 @@ local KernCode     = enum("KernCode")
 local CacheCode    = enum("CacheCode")
 local CacheType    = enum("CacheType")
 local PeriodTime   = enum("PeriodTime")
+local SECOND_MS    = PeriodTime.SECOND_MS
 
 local SUCCESS      = KernCode.SUCCESS
+local MONGO_FAILED = KernCode.MONGO_FAILED
 local CAREAD       = CacheType.READ
 local CAWRITE      = CacheType.WRITE
 local CABOTH       = CacheType.BOTH
@@ -28,19 +31,21 @@ local update_mgr   = hive.get("update_mgr")
 local monitor      = hive.get("monitor")
 local timer_mgr    = hive.get("timer_mgr")
 local lmdb_mgr     = hive.get("lmdb_mgr")
+local mongo_mgr    = hive.get("mongo_mgr")
 
 local obj_table    = config_mgr:init_table("dbcache", "cache_name")
 
 local CacheMgr     = singleton()
 local prop         = property(CacheMgr)
 prop:reader("cache_confs", {})        -- cache_confs
-prop:reader("cache_lists", {})        -- cache_lists
-prop:reader("dirty_maps", {})         -- dirty objects
+prop:reader("cache_lists", {})        -- cache_lists, 过期和存盘由时间轮调度
 prop:reader("flush", false)           -- 立即存盘
 prop:reader("rwlock", false)          -- 开启读写锁
 prop:reader("req_counter", nil)
 prop:reader("save_limit", 100)
 prop:reader("save_count", 0)
+prop:reader("save_stat", { flush = 0, full = 0, delta = 0 })  -- 每分钟存储统计
+prop:reader("send_bytes", {})                               -- db_name => 上次统计时的发送字节
 
 function CacheMgr:__init()
     --初始化cache
@@ -66,13 +71,11 @@ function CacheMgr:__init()
 end
 
 function CacheMgr:setup()
-    local WheelMap = import("container/wheel_map.lua")
     --加载配置
     for _, obj_conf in obj_table:iterator() do
         local cache_name             = obj_conf.cache_name
         self.cache_confs[cache_name] = obj_conf
-        self.cache_lists[cache_name] = WheelMap(100, mrandom(1, 100))
-        self.dirty_maps[cache_name]  = WheelMap(100, mrandom(1, 100))
+        self.cache_lists[cache_name] = CacheStore()
     end
     self.save_limit = env_number("HIVE_SAVE_LIMIT", 100)
     self.rwlock     = environ.status("HIVE_OPEN_RWLOCK")
@@ -98,11 +101,13 @@ function CacheMgr:recover_cacheobj(cache_name, primary_key, data)
     cache_obj.holding = false
     self:set_dirty(cache_obj, true)
     cache_obj:set_expire_time(mrandom(1000, 60000))
+    self:set_expire(cache_obj)
+    return cache_obj
 end
 
 function CacheMgr:vote_stop_service()
-    for _, dirty_map in pairs(self.dirty_maps) do
-        if dirty_map:get_count() > 0 then
+    for _, cache_list in pairs(self.cache_lists) do
+        if cache_list:get_dirty_count() > 0 then
             return false
         end
     end
@@ -113,10 +118,12 @@ function CacheMgr:evt_change_service_status(status)
     if not hive.is_runing() then
         log_info("[CacheMgr][evt_change_service_status] enter flush mode,wait stop service:{}", hive.index)
         self.flush = true
-        for _, dirty_map in pairs(self.dirty_maps) do
-            for _, obj in dirty_map:iterator() do
-                self:save_cache(obj)
+        for cache_name, cache_list in pairs(self.cache_lists) do
+            local objs = {}
+            for _, obj in cache_list:dirty_iterator() do
+                objs[#objs + 1] = obj
             end
+            self:save_caches(cache_name, objs)
         end
         return
     end
@@ -150,51 +157,124 @@ function CacheMgr:on_service_ready(id, service_name)
 end
 
 function CacheMgr:on_fast(clock_ms)
-    self.save_count     = 0
-    for _, dirty_map in pairs(self.dirty_maps) do
-        for _, obj in dirty_map:wheel_iterator() do
-            if self.flush or obj:need_save(clock_ms) then
-                self:save_cache(obj)
+    self.save_count = 0
+    for cache_name, cache_list in pairs(self.cache_lists) do
+        local objs = {}
+        if self.flush then
+            for _, obj in cache_list:dirty_iterator() do
+                objs[#objs + 1] = obj
             end
-            --限流
-            if not self.flush and self.save_count > self.save_limit then
+        else
+            --限流, 未取出的留在队列中下次处理
+            local limit = self.save_limit - self.save_count
+            if limit <= 0 then
                 log_warn("[CacheMgr][on_fast] is very busy:{}/{}", self.save_count, self.save_limit)
                 return
             end
+            for _, primary_key in ipairs(cache_list:pop_dirty(clock_ms, limit)) do
+                local obj = cache_list:get(primary_key)
+                if obj:need_save(clock_ms) then
+                    objs[#objs + 1] = obj
+                else
+                    self:set_dirty(obj, true, clock_ms)
+                end
+            end
         end
+        self:save_caches(cache_name, objs)
     end
 end
 
---清理超时的记录
+--清理超时的记录, 只检查到期的对象
 function CacheMgr:on_second(clock_ms)
-    for cache_name, obj_list in pairs(self.cache_lists) do
-        for primary_key, obj in obj_list:wheel_iterator() do
-            if obj:expired(clock_ms, self.flush) then
-                obj_list:set(primary_key, nil)
-                obj:remove_lmdb()
+    for cache_name, cache_list in pairs(self.cache_lists) do
+        if self.flush then
+            for primary_key, obj in cache_list:iterator() do
+                if obj:expired(clock_ms, true) then
+                    cache_list:set(primary_key, nil)
+                    obj:remove_lmdb()
+                end
+            end
+        else
+            for _, primary_key in ipairs(cache_list:pop_expired(clock_ms)) do
+                local obj = cache_list:get(primary_key)
+                if obj:expired(clock_ms) then
+                    cache_list:set(primary_key, nil)
+                    obj:remove_lmdb()
+                else
+                    self:set_expire(obj, clock_ms)
+                end
             end
         end
     end
 end
 
 function CacheMgr:on_minute()
-    for cache_name, dirty_map in pairs(self.dirty_maps) do
-        if dirty_map:get_count() > 0 then
-            local cache_list = self.cache_lists[cache_name]
-            log_info("[CacheMgr][on_minute] dirty_size:{},{}/{}", cache_name, dirty_map:get_count(), cache_list:get_count())
+    for cache_name, cache_list in pairs(self.cache_lists) do
+        if cache_list:get_dirty_count() > 0 then
+            log_info("[CacheMgr][on_minute] dirty_size:{},{}/{}", cache_name, cache_list:get_dirty_count(), cache_list:get_count())
         end
     end
+    self:report_save()
 end
 
---设置标记
-function CacheMgr:set_dirty(cache_obj, is_dirty)
-    local dirty_map = self.dirty_maps[cache_obj.cache_name]
-    dirty_map:set(cache_obj:get_primary_value(), is_dirty and cache_obj or nil)
+--统计每次存盘写入mongo的字节数
+function CacheMgr:report_save()
+    local stat = self.save_stat
+    local dbs  = {}
+    for _, conf in pairs(self.cache_confs) do
+        dbs[conf.cache_db] = true
+    end
+    for db_name in pairs(dbs) do
+        local bytes = mongo_mgr:get_send_bytes(db_name)
+        local last  = self.send_bytes[db_name]
+        self.send_bytes[db_name] = bytes
+        if last and stat.flush > 0 then
+            local sent = bytes - last
+            log_info("[CacheMgr][report_save] db:{} flush:{} ops:{}(delta:{} full:{}) sent:{}KB avg:{}B/flush", db_name, stat.flush,
+                stat.delta + stat.full, stat.delta, stat.full, sent // 1024, sent // stat.flush)
+        end
+    end
+    self.save_stat = { flush = 0, full = 0, delta = 0 }
+end
+
+function CacheMgr:count_save(is_delta, flush)
+    local stat = self.save_stat
+    stat.flush = stat.flush + (flush or 0)
+    if is_delta then
+        stat.delta = stat.delta + 1
+    elseif is_delta == false then
+        stat.full = stat.full + 1
+    end
+end
+
+--设置标记, 按对象的存盘时间加入调度; 重新调度时(clock_ms)未到期的至少推迟1秒
+function CacheMgr:set_dirty(cache_obj, is_dirty, clock_ms)
+    local cache_list = self.cache_lists[cache_obj.cache_name]
+    if not is_dirty then
+        cache_list:set_dirty(cache_obj:get_primary_value(), nil)
+        return
+    end
+    local tick = cache_obj:save_tick()
+    if clock_ms and tick <= clock_ms then
+        tick = clock_ms + SECOND_MS
+    end
+    cache_list:set_dirty(cache_obj:get_primary_value(), tick)
+end
+
+--设置过期检查, 脏数据等存盘后再检查
+function CacheMgr:set_expire(cache_obj, clock_ms)
+    local cache_list = self.cache_lists[cache_obj.cache_name]
+    local tick       = cache_obj:expire_tick()
+    if clock_ms and tick <= clock_ms then
+        tick = clock_ms + SECOND_MS
+    end
+    cache_list:expire(cache_obj:get_primary_value(), tick)
 end
 
 function CacheMgr:delete(cache_obj, delay_time)
     cache_obj:set_lock_node_id(0)
     cache_obj:set_expire_time(delay_time or mrandom(1000, 60000))
+    self:set_expire(cache_obj)
 end
 
 function CacheMgr:clear_obj(cache_obj)
@@ -207,9 +287,13 @@ end
 function CacheMgr:save_cache(cache_obj, remove)
     thread_mgr:fork(function()
         self:set_dirty(cache_obj, false)
-        if not cache_obj:save() then
+        local ok, is_delta = cache_obj:save()
+        if not ok or cache_obj:is_dirty() then
             self:set_dirty(cache_obj, true)
         end
+        if is_delta ~= nil then
+            self:count_save(is_delta, 1)
+        end
         if remove then
             self:delete(cache_obj)
         end
@@ -218,6 +302,62 @@ function CacheMgr:save_cache(cache_obj, remove)
     return true
 end
 
+--批量存储: 同一cache的脏对象合并为一次bulk_write
+function CacheMgr:save_caches(cache_name, objs)
+    local count = #objs
+    if count == 0 then
+        return
+    end
+    if count == 1 then
+        self:save_cache(objs[1])
+        return
+    end
+    thread_mgr:fork(function()
+        local ops, saves = {}, {}
+        for _, obj in ipairs(objs) do
+            self:set_dirty(obj, false)
+            if obj:is_doing() then
+                self:set_dirty(obj, true)
+            elseif obj:is_dirty() then
+                local op, is_delta = obj:save_op()
+                if op then
+                    obj:set_is_doing(true)
+                    ops[#ops + 1]     = op
+                    saves[#saves + 1] = obj
+                    self:count_save(is_delta)
+                else
+                    --重试期内, 到重试时间再调度
+                    self:set_dirty(obj, true)
+                end
+            end
+        end
+        if #ops == 0 then
+            return
+        end
+        self:count_save(nil, 1)
+        local conf              = self.cache_confs[cache_name]
+        local code, res, detail = mongo_mgr:bulk_write(conf.cache_db, cache_name, conf.cache_table, ops, false)
+        --部分失败时只重试出错的对象, 命令失败时全部重试
+        local result            = (code == SUCCESS) and res or detail
+        local errors            = {}
+        if result and result.writeErrors then
+            for _, err in ipairs(result.writeErrors) do
+                errors[err.index] = err.errmsg
+            end
+        end
+        for i, obj in ipairs(saves) do
+            obj:set_is_doing(false)
+            if result and not errors[i] then
+                obj:save_done(SUCCESS)
+            else
+                obj:save_done(MONGO_FAILED, errors[i] or res)
+                self:set_dirty(obj, true)
+            end
+        end
+    end)
+    self.save_count = self.save_count + count
+end
+
 --缓存加载
 function CacheMgr:load_cache_impl(cache_list, conf, primary_key)
     local cache_obj = CacheObj(conf, primary_key)
@@ -227,6 +367,7 @@ function CacheMgr:load_cache_impl(cache_list, conf, primary_key)
         cache_list:set(primary_key, nil)
         return code
     end
+    self:set_expire(cache_obj)
     return SUCCESS, cache_obj
 end
 
@@ -4,7 +4,9 @@ local VarLock       = import("feature/var_lock.lua")
 
 local log_err       = logger.err
 local check_failed  = hive.failed
-local check_success = hive.success
+local pairs         = pairs
+local next          = next
+local bdiff         = bson.diff
 
 local KernCode      = enum("KernCode")
 local CacheCode     = enum("CacheCode")
@@ -12,6 +14,9 @@ local SUCCESS       = KernCode.SUCCESS
 local mongo_mgr     = hive.get("mongo_mgr")
 local lmdb_mgr      = hive.get("lmdb_mgr")
 
+--字段级增量存储, 关闭后每次整体写入
+local CACHE_DELTA   = environ.number("HIVE_CACHE_DELTA", 1) > 0
+
 local CacheObj      = class()
 local prop          = property(CacheObj)
 prop:accessor("holding", true)          -- holding status
@@ -31,6 +36,9 @@ prop:accessor("dirty", false)           -- dirty
 prop:accessor("fail_cnt", 0)            -- 存储失败次数
 prop:accessor("retry_time", 0)          -- 重试时间
 prop:accessor("data", {})               -- data
+prop:accessor("full_dirty", false)      -- 需要整体写入
+prop:reader("dirty_keys", {})           -- 变更字段: key => true($set)/false($unset)
+prop:reader("saving_keys", nil)         -- 存储中的变更字段, 失败时合并回dirty_keys
 prop:accessor("is_doing", false)        -- in doing
 prop:accessor("flush", false)
 prop:reader("save_cnt", 0)
@@ -59,6 +67,8 @@ function CacheObj:load()
     end
     self.data    = res
     self.holding = false
+    --库中不存在时首次存储需要整体写入
+    self.full_dirty = (res == nil)
     return SUCCESS
 end
 
@@ -80,12 +90,17 @@ function CacheObj:expired(clock_ms, flush)
         return false
     end
     local escape_time = clock_ms - self.active_tick
-    if escape_time > self.expire_time then
+    if escape_time >= self.expire_time then
         return true
     end
     return flush
 end
 
+--过期检查时间, 之后活跃会推迟过期, 检查时再重新计算
+function CacheObj:expire_tick()
+    return self.active_tick + self.expire_time
+end
+
 function CacheObj:need_save(clock_ms)
     if self.is_doing then
         return false
@@ -93,48 +108,110 @@ function CacheObj:need_save(clock_ms)
     if self.flush then
         return true
     end
-    if self.store_count <= self.update_count or self.update_time + self.store_time < clock_ms then
+    if self.store_count <= self.update_count or self.update_time + self.store_time <= clock_ms then
         return true
     end
     return false
 end
 
+--下次存盘时间, 存储失败时不早于重试时间
+function CacheObj:save_tick()
+    local clock_ms = hive.clock_ms
+    local tick     = self.update_time + self.store_time
+    if self.flush or self.store_count <= self.update_count then
+        tick = clock_ms
+    end
+    if self.fail_cnt > 0 and hive.now < self.retry_time then
+        local retry_tick = clock_ms + (self.retry_time - hive.now) * 1000
+        if retry_tick > tick then
+            tick = retry_tick
+        end
+    end
+    return tick
+end
+
 function CacheObj:save()
     if self.is_doing then
         return false
     end
     local _lock<close> = VarLock(self, "is_doing")
-    if self.dirty then
-        if check_success(self:save_impl()) then
-            self.flush = false
-        end
-    end
-    return true
+    local _, is_delta  = self:save_impl()
+    return true, is_delta
 end
 
+--返回存储结果, 以及是否增量写入(未写入时为nil)
 function CacheObj:save_impl()
     if self.dirty then
-        if self.fail_cnt > 0 and hive.now < self.retry_time then
+        local op, is_delta = self:save_op()
+        if not op then
             return KernCode.MONGO_FAILED
         end
-        local selector  = { [self.cache_key] = self.primary_value }
-        self.dirty      = false
-        local code, res = mongo_mgr:update(self.db_name, self.primary_value, self.cache_table, self.data, selector, true)
-        if check_failed(code) then
-            self.fail_cnt   = self.fail_cnt + 1
-            self.retry_time = hive.now + self.fail_cnt * 60
-            log_err("[CacheObj][save_impl] failed: cnt:{}, {}=> db: {}, table: {},data:{}", self.fail_cnt, res, self.db_name, self.cache_table, self.data)
-            self.dirty = true
-            return code
+        local code, res = mongo_mgr:update(self.db_name, self.primary_value, self.cache_table, op[2], op[3], op[4])
+        return self:save_done(code, res), is_delta
+    end
+    return SUCCESS
+end
+
+--生成存储操作并清除脏标记, 失败重试期内返回nil, 可单条提交或合并到bulk_write
+--有字段级变更记录时生成$set/$unset增量, 第二个返回值表示是否增量
+function CacheObj:save_op()
+    if self.fail_cnt > 0 and hive.now < self.retry_time then
+        return
+    end
+    self.dirty      = false
+    local selector  = { [self.cache_key] = self.primary_value }
+    local keys      = self.dirty_keys
+    self.dirty_keys = {}
+    if self.full_dirty or not CACHE_DELTA or not next(keys) then
+        self.full_dirty  = false
+        self.saving_keys = true
+        return { "update", self.data, selector, true }, false
+    end
+    local sets, unsets = {}, {}
+    for key, is_set in pairs(keys) do
+        if is_set then
+            sets[key] = self.data[key]
+        else
+            unsets[key] = ""
         end
-        self.fail_cnt     = 0
-        self.save_cnt     = self.save_cnt + 1
-        self.update_count = 0
-        self.update_time  = hive.clock_ms
-        self.active_tick  = hive.clock_ms
+    end
+    self.saving_keys = keys
+    return { "update", { ["$set"] = next(sets) and sets or nil, ["$unset"] = next(unsets) and unsets or nil }, selector, true }, true
+end
+
+--存储结果处理
+function CacheObj:save_done(code, res)
+    if check_failed(code) then
+        self.fail_cnt   = self.fail_cnt + 1
+        self.retry_time = hive.now + self.fail_cnt * 60
+        log_err("[CacheObj][save_done] failed: cnt:{}, {}=> db: {}, table: {},data:{}", self.fail_cnt, res, self.db_name, self.cache_table, self.data)
+        self:restore_keys()
+        self.dirty = true
         return code
     end
-    return SUCCESS
+    self.saving_keys  = nil
+    self.flush        = false
+    self.fail_cnt     = 0
+    self.save_cnt     = self.save_cnt + 1
+    self.update_count = 0
+    self.update_time  = hive.clock_ms
+    self.active_tick  = hive.clock_ms
+    return code
+end
+
+--存储失败, 未写入的变更合并回脏字段, 之后的变更优先
+function CacheObj:restore_keys()
+    local keys       = self.saving_keys
+    self.saving_keys = nil
+    if keys == true then
+        self.full_dirty = true
+        return
+    end
+    for key, is_set in pairs(keys or {}) do
+        if self.dirty_keys[key] == nil then
+            self.dirty_keys[key] = is_set
+        end
+    end
 end
 
 --删除数据
@@ -145,9 +222,10 @@ function CacheObj:destory()
         log_err("[CacheObj][destory] failed: {}=> db: {}, table: {}", res, self.db_name, self.cache_table)
         return code
     end
-    self.data    = {}
-    self.holding = true
-    self.dirty   = false
+    self.data       = {}
+    self.holding    = true
+    self.dirty      = false
+    self.dirty_keys = {}
     return SUCCESS
 end
 
@@ -158,17 +236,32 @@ function CacheObj:update(tab_data, flush, ignore_lmdb)
     end
     self:active()
     self.update_count = self.update_count + 1
-    if flush or self.data == nil or not next(self.data) then
-        self.flush = true
-    end
-    self.data  = tab_data
-    self.dirty = true
+    local old_data    = self.data
+    self.data         = tab_data
     if flush then
         self.flush = true
     end
-    if not ignore_lmdb then
-        self:save_lmdb()
+    if old_data == nil or not next(old_data) then
+        self.flush      = true
+        self.full_dirty = true
+        self.dirty      = true
+        if not ignore_lmdb then
+            self:save_lmdb()
+        end
+        return SUCCESS
+    end
+    --原表上修改后传回, 无法比较差异, 整体写入
+    if old_data == tab_data then
+        self.full_dirty = true
+        self.dirty      = true
+        if not ignore_lmdb then
+            self:save_lmdb()
+        end
+        return SUCCESS
     end
+    --只记录顶层字段的变更
+    local sets, unsets = bdiff(old_data, tab_data)
+    self:mark_dirty(sets, unsets, ignore_lmdb)
     return SUCCESS
 end
 
@@ -180,16 +273,46 @@ function CacheObj:update_key(table_kvs, flush, ignore_lmdb)
     self:active()
     self.update_count = self.update_count + 1
     if flush or not next(self.data) then
-        self.flush = true
+        self.flush      = true
+        self.full_dirty = self.full_dirty or not next(self.data)
     end
     for key, value in pairs(table_kvs) do
         self.data[key] = value
     end
+    self:mark_dirty(table_kvs, {}, ignore_lmdb)
+    return SUCCESS
+end
+
+--记录字段变更, lmdb追加增量日志
+function CacheObj:mark_dirty(sets, unsets, ignore_lmdb)
+    if not next(sets) and not next(unsets) then
+        return
+    end
+    local dirty_keys = self.dirty_keys
+    for key in pairs(sets) do
+        dirty_keys[key] = true
+    end
+    for _, key in pairs(unsets) do
+        dirty_keys[key] = false
+    end
     self.dirty = true
     if not ignore_lmdb then
-        self:save_lmdb()
+        if self.full_dirty then
+            self:save_lmdb()
+        else
+            lmdb_mgr:append_cache(self.cache_name, self.primary_value, { set = sets, unset = unsets }, self.data)
+        end
+    end
+end
+
+--回放lmdb增量日志
+function CacheObj:apply_delta(delta)
+    for key, value in pairs(delta.set or {}) do
+        self.data[key] = value
+    end
+    for _, key in pairs(delta.unset or {}) do
+        self.data[key] = nil
     end
-    return SUCCESS
 end
 
 function CacheObj:save_lmdb()
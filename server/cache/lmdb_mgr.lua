@@ -1,11 +1,28 @@
-local LMDB      = import("driver/lmdb.lua")
-local log_debug = logger.debug
-local sformat   = string.format
+local LMDB        = import("driver/lmdb.lua")
+local log_debug   = logger.debug
+local log_warn    = logger.warn
+local sformat     = string.format
+local smatch      = string.match
+local tostring    = tostring
+local tonumber    = tonumber
 
-local LmdbMgr   = singleton()
-local prop      = property(LmdbMgr)
+--增量日志条数超过阈值时合并为全量快照
+local LOG_COMPACT = environ.number("HIVE_LMDB_COMPACT", 64)
+
+--增量日志单独存放, 键为 @主键#序号, 同一主键的日志按序号有序
+local function log_dbname(cache_name)
+    return sformat("%s_log", cache_name)
+end
+
+local function log_key(primary_key, seq)
+    return sformat("@%s#%08d", primary_key, seq)
+end
+
+local LmdbMgr = singleton()
+local prop    = property(LmdbMgr)
 prop:reader("open_status", false)
 prop:reader("db", nil)
+prop:reader("log_seqs", {})     -- cache_name => { primary_key => 日志序号 }
 
 function LmdbMgr:__init()
     self:setup()
@@ -20,12 +37,53 @@ function LmdbMgr:setup()
     end
 end
 
+function LmdbMgr:get_seqs(cache_name)
+    local seqs = self.log_seqs[cache_name]
+    if not seqs then
+        seqs                       = {}
+        self.log_seqs[cache_name] = seqs
+    end
+    return seqs
+end
+
+--已写入的增量日志键
+function LmdbMgr:log_keys(cache_name, primary_key)
+    local keys = {}
+    local seq  = self:get_seqs(cache_name)[primary_key]
+    for i = 1, seq or 0 do
+        keys[i] = log_key(primary_key, i)
+    end
+    return keys
+end
+
+--写入全量快照并清理增量日志, 同一事务提交, 避免恢复时旧日志回放到新快照上
 function LmdbMgr:save_cache(cache_name, primary_key, data)
     if not self.open_status then
         return
     end
     log_debug("[LmdbMgr][save_cache] {},{}", cache_name, primary_key)
-    self.db:put(primary_key, data, cache_name)
+    local ok = self.db:writes({
+        { cache_name, puts = { [primary_key] = data } },
+        { log_dbname(cache_name), dels = self:log_keys(cache_name, primary_key) },
+    })
+    if ok then
+        self:get_seqs(cache_name)[primary_key] = 0
+    end
+end
+
+--追加增量日志, 没有快照或日志过多时写全量快照
+function LmdbMgr:append_cache(cache_name, primary_key, delta, data)
+    if not self.open_status then
+        return
+    end
+    local seqs = self:get_seqs(cache_name)
+    local seq  = seqs[primary_key]
+    if not seq or seq >= LOG_COMPACT then
+        return self:save_cache(cache_name, primary_key, data)
+    end
+    log_debug("[LmdbMgr][append_cache] {},{},{}", cache_name, primary_key, seq + 1)
+    seqs[primary_key] = seq + 1
+    self.db:put(log_key(primary_key, seq + 1), delta, log_dbname(cache_name))
 end
 
 function LmdbMgr:load_cache(cache_name, primary_key)
@@ -41,16 +99,43 @@ function LmdbMgr:delete_cache(cache_name, primary_key)
         return
     end
     log_debug("[LmdbMgr][delete_cache] {},{}", cache_name, primary_key)
-    self.db:del(primary_key, cache_name)
+    self.db:writes({
+        { cache_name, dels = { primary_key } },
+        { log_dbname(cache_name), dels = self:log_keys(cache_name, primary_key) },
+    })
+    self:get_seqs(cache_name)[primary_key] = nil
 end
 
+--恢复快照后回放增量日志, 再合并为新快照; 快照和日志的清理在同一事务内提交
 function LmdbMgr:recover(cache_name, cache_mgr)
     if not self.open_status then
         return
     end
     log_debug("[LmdbMgr][recover] {}", cache_name)
+    local objs, logs = {}, {}
     for key, value in self.db:iter(cache_name) do
-        cache_mgr:recover_cacheobj(cache_name, key, value)
+        objs[tostring(key)] = cache_mgr:recover_cacheobj(cache_name, key, value)
+    end
+    for key, delta in self.db:iter(log_dbname(cache_name)) do
+        logs[#logs + 1] = { key, delta }
+    end
+    local seqs, orphans = self:get_seqs(cache_name), {}
+    for _, log in ipairs(logs) do
+        local primary_key, seq = smatch(log[1], "^@(.+)#(%d+)$")
+        local cache_obj        = objs[primary_key]
+        if cache_obj then
+            cache_obj:apply_delta(log[2])
+            seqs[cache_obj:get_primary_value()] = tonumber(seq)
+        else
+            log_warn("[LmdbMgr][recover] {} delta log {} without snapshot", cache_name, log[1])
+            orphans[#orphans + 1] = log[1]
+        end
+    end
+    if #orphans > 0 then
+        self.db:dels(orphans, log_dbname(cache_name))
+    end
+    for _, cache_obj in pairs(objs) do
+        cache_obj:save_lmdb()
     end
 end
 
@@ -40,5 +40,29 @@ hive.startup(function()
     --import("qtest/xml_test.lua")
     --import("qtest/algo_test.lua")
     --import("qtest/profiler_test.lua")
+    --import("qtest/socket_wait_test.lua")
+    --import("qtest/broadcast_test.lua")
+    --import("qtest/sendv_test.lua")
+    --import("qtest/shard_test.lua")
+    --import("qtest/mailbox_test.lua")
+    --import("qtest/pool_test.lua")
+    --import("qtest/frozen_test.lua")
+    --import("qtest/logbench_test.lua")
+    --import("qtest/logbin_test.lua")
+    --import("qtest/rdsparse_test.lua")
+    --import("qtest/rdspipe_test.lua")
+    --import("qtest/mgobulk_test.lua")
+    --import("qtest/mgozip_test.lua")
+    --import("qtest/mgocursor_test.lua")
+    --import("qtest/cachedelta_test.lua")
+    --import("qtest/cachestore_test.lua")
+    --import("qtest/pbcodec_test.lua")
+    --import("qtest/pbzip_test.lua")
+    --import("qtest/wsframe_test.lua")
+    --import("qtest/metrics_test.lua")
+    --import("qtest/rpcmethod_test.lua")
+    --import("qtest/channel_test.lua")
+    --import("qtest/timerwheel_test.lua")
+    --import("qtest/shardclose_test.lua")
     import("qtest/lcache_test.lua")
 end)
@@ -49,6 +49,12 @@ function DevopsGmMgr:register_gm()
           args  = "start|integer service_name|string index|integer" },
         { group = "开发工具", gm_type = GMType.GLOBAL, name = "gm_table_find_one", desc = "查询表格配置", comment = "表名/索引,服务/index",
           args  = "tname|string tindex|string service_name|string index|integer" },
+        { group = "开发工具", gm_type = GMType.GLOBAL, name = "gm_prof_start", desc = "开启采样分析", comment = "采样间隔(us),服务/index",
+          args  = "interval|integer service_name|string index|integer" },
+        { group = "开发工具", gm_type = GMType.GLOBAL, name = "gm_prof_stop", desc = "关闭采样分析", comment = "服务/index",
+          args  = "service_name|string index|integer" },
+        { group = "开发工具", gm_type = GMType.GLOBAL, name = "gm_prof_dump", desc = "输出采样分析", comment = "前N个函数,服务/index,折叠栈写入日志目录",
+          args  = "top|integer service_name|string index|integer" },
         --工具
         { group = "开发工具", gm_type = GMType.GLOBAL, name = "gm_guid_view", desc = "guid信息", comment = "(拆解guid)", args = "guid|integer" },
         { group = "开发工具", gm_type = GMType.GLOBAL, name = "gm_log_format", desc = "日志格式", comment = "0压缩,1格式化", args = "data|string swline|integer json|integer" },
@@ -160,6 +166,18 @@ function DevopsGmMgr:gm_table_find_one(tname, tindex, service_name, index)
     return self:call_target_rpc(service_name, index, "rpc_table_find_one", tname, tindex)
 end
 
+function DevopsGmMgr:gm_prof_start(interval, service_name, index)
+    return self:call_target_rpc(service_name, index, "rpc_prof_start", interval > 0 and interval or 1000)
+end
+
+function DevopsGmMgr:gm_prof_stop(service_name, index)
+    return self:call_target_rpc(service_name, index, "rpc_prof_stop")
+end
+
+function DevopsGmMgr:gm_prof_dump(top, service_name, index)
+    return self:call_target_rpc(service_name, index, "rpc_prof_dump", top > 0 and top or 50)
+end
+
 function DevopsGmMgr:gm_guid_view(guid)
     local group, index, gtype, time, serial = codec.guid_source(guid)
     return { group = group, gtype = gtype, index = index, time = time_str(time), serial = serial }
@@ -0,0 +1,102 @@
+-- broadcast_test.lua
+-- 广播扇出开销: broad_rpc 和 router forward_broadcast
+local ltimer    = require("ltimer")
+local log_info  = logger.info
+local log_err   = logger.err
+local sformat   = string.format
+local srep      = string.rep
+
+local oclock    = os.clock
+local lclock_ms = ltimer.clock_ms
+
+local PORT      = 8702
+local SERVICE   = 5
+local MSG_COUNT = 200
+local PAYLOAD   = srep("x", 1024)
+local counts    = { 16, 128, 1024 }
+
+local listener  = luabus.listen("127.0.0.1", PORT)
+if not listener then
+    log_err("[broadcast_test] listen failed")
+    return
+end
+
+local sessions  = {}
+listener.on_accept = function(session)
+    sessions[#sessions + 1] = session
+end
+
+local function pump(check, timeout)
+    local deadline = lclock_ms() + timeout
+    while not check() and lclock_ms() < deadline do
+        luabus.wait(lclock_ms(), 1)
+    end
+end
+
+local function bench(count)
+    local clients   = {}
+    local received  = 0
+    local connected = 0
+    local function new_client()
+        local socket = luabus.connect("127.0.0.1", PORT, 5000)
+        socket.on_connect = function(res)
+            if res == "ok" then
+                connected = connected + 1
+            end
+        end
+        socket.on_call = function()
+            received = received + 1
+        end
+        clients[#clients + 1] = socket
+    end
+    --第一个连接作为发送者,其余作为广播目标
+    new_client()
+    pump(function() return #sessions == 1 end, 5000)
+    for _ = 1, count do
+        new_client()
+    end
+    pump(function() return connected == #clients and #sessions == #clients end, 10000)
+    local tokens = {}
+    for i = 2, #sessions do
+        tokens[#tokens + 1] = sessions[i].token
+        luabus.map_token((SERVICE << 16) | (i - 1), sessions[i].token, 0)
+    end
+    --broad_rpc
+    local cost = 0
+    for _ = 1, MSG_COUNT do
+        local start = oclock()
+        luabus.broad_rpc(tokens, 0, 0, "on_broadcast", PAYLOAD)
+        cost = cost + oclock() - start
+        luabus.wait(lclock_ms(), 0)
+    end
+    pump(function() return received >= MSG_COUNT * count end, 10000)
+    local bytes = MSG_COUNT * (#PAYLOAD + 32)
+    log_info("[broadcast_test] broad_rpc targets:{} recv:{}/{} send cost:{}us/msg copy bytes:{}(was {})",
+        count, received, MSG_COUNT * count, sformat("%.2f", cost * 1000000 / MSG_COUNT), bytes, bytes * count)
+    --router forward_broadcast
+    received = 0
+    local sender = clients[1]
+    local start = oclock()
+    for _ = 1, MSG_COUNT do
+        sender.forward_broadcast(0, 0, 0, SERVICE, "on_broadcast", PAYLOAD)
+    end
+    pump(function() return received >= MSG_COUNT * count end, 10000)
+    cost = oclock() - start
+    log_info("[broadcast_test] router targets:{} recv:{}/{} total cost:{}ms",
+        count, received, MSG_COUNT * count, sformat("%.2f", cost * 1000))
+    for i = 2, #sessions do
+        luabus.map_token((SERVICE << 16) | (i - 1), 0, 0)
+    end
+    for _, socket in pairs(clients) do
+        socket.close()
+    end
+    for _, session in pairs(sessions) do
+        session.close()
+    end
+    sessions = {}
+    pump(function() return false end, 20)
+end
+
+for _, count in ipairs(counts) do
+    bench(count)
+end
@@ -0,0 +1,196 @@
+-- cachedelta_test.lua
+-- cache字段级增量存储: 模拟mongo执行整体/增量写入, 对比每次存盘的写入字节和编码耗时, 校验lmdb增量日志恢复
+local TestUtil   = import("qtest/test_util.lua")
+
+local log_info   = logger.info
+local check      = TestUtil.checker("cachedelta_test")
+local sformat    = string.format
+local srep       = string.rep
+local oclock     = os.clock
+local bencode    = bson.encode
+
+local KernCode   = enum("KernCode")
+local SUCCESS    = KernCode.SUCCESS
+
+local ROUNDS     = 200
+local CACHE_NAME = "player_delta"
+
+local function same_value(a, b)
+    if type(a) ~= "table" or type(b) ~= "table" then
+        return a == b
+    end
+    for key, value in pairs(a) do
+        if not same_value(value, b[key]) then
+            return false
+        end
+    end
+    for key in pairs(b) do
+        if a[key] == nil then
+            return false
+        end
+    end
+    return true
+end
+
+--模拟mongo_mgr: 按mongo语义执行替换或$set/$unset, 统计写入字节
+local MongoStub = { store = {}, stat = { bytes = 0, full_bytes = 0, encode = 0, full_encode = 0, count = 0 } }
+
+function MongoStub:find_one(db_name, hash_key, coll_name, selector)
+    return SUCCESS, self.store[hash_key]
+end
+
+function MongoStub:update(db_name, hash_key, coll_name, obj, selector, upsert)
+    local stat  = self.stat
+    local clock = oclock()
+    local bytes = #bencode(obj)
+    stat.encode = stat.encode + oclock() - clock
+    stat.bytes  = stat.bytes + bytes
+    stat.count  = stat.count + 1
+    local doc   = self.store[hash_key]
+    if obj["$set"] or obj["$unset"] then
+        doc = doc or { [next(selector)] = hash_key }
+        for key, value in pairs(obj["$set"] or {}) do
+            doc[key] = value
+        end
+        for key in pairs(obj["$unset"] or {}) do
+            doc[key] = nil
+        end
+    else
+        doc = obj
+    end
+    --存储的是副本, 后续修改缓存数据不影响
+    self.store[hash_key] = bson.decode(bencode(doc))
+    return SUCCESS
+end
+
+function MongoStub:delete(db_name, hash_key)
+    self.store[hash_key] = nil
+    return SUCCESS
+end
+
+--整体写入的基准: 同一数据每次都编码完整文档
+function MongoStub:full_write(data)
+    local clock      = oclock()
+    local bytes      = #bencode(data)
+    local stat       = self.stat
+    stat.full_encode = stat.full_encode + oclock() - clock
+    stat.full_bytes  = stat.full_bytes + bytes
+end
+
+hive.mongo_mgr = MongoStub
+environ.set("HIVE_LMDB_OPEN", "1")
+import("cache/lmdb_mgr.lua")
+local lmdb_mgr = hive.lmdb_mgr
+local CacheObj = import("cache/cache_obj.lua")
+
+local CONF     = { cache_db = "default", cache_name = CACHE_NAME, cache_table = CACHE_NAME, cache_key = "id", expire_time = 600, store_time = 300, store_count = 200 }
+
+local function build_player(uid)
+    local bag, tasks, mails = {}, {}, {}
+    for i = 1, 1000 do
+        bag[i] = { id = 10000 + i, count = i % 99 + 1, bind = i % 3 == 0, attrs = { atk = i % 50, def = i % 30 } }
+    end
+    for i = 1, 200 do
+        tasks[i] = { id = 2000 + i, state = i % 4, progress = { i % 10, i % 5 } }
+    end
+    for i = 1, 50 do
+        mails[i] = { id = i, title = "系统邮件", content = srep("恭喜获得活动奖励", 4), read = false }
+    end
+    return { id = uid, name = sformat("player_%d", uid), level = 1, exp = 0, gold = 0, bag = bag, tasks = tasks, mails = mails, update_time = 0 }
+end
+
+--模拟Store:save, 每次rpc上传完整数据(反序列化后是新表), 变化的只有少量字段
+local function mutate(data, round)
+    local new       = bson.decode(bencode(data))
+    new.gold        = data.gold + round
+    new.update_time = round
+    if round % 10 == 0 then
+        new.level = data.level + 1
+        new.tasks[round // 10].state = 9
+    end
+    if round % 50 == 0 then
+        new.exp = nil
+    elseif data.exp == nil then
+        new.exp = round
+    end
+    return new
+end
+
+local function test_delta()
+    local uid = 1001
+    local obj = CacheObj(CONF, uid)
+    obj:load()
+    local data = build_player(uid)
+    obj:update(data, true)
+    check(obj:save(), "first save")
+    check(same_value(MongoStub.store[uid], data), "first save full")
+    MongoStub.stat = { bytes = 0, full_bytes = 0, encode = 0, full_encode = 0, count = 0 }
+    local deltas, diff = 0, 0
+    for round = 1, ROUNDS do
+        data        = mutate(data, round)
+        local clock = oclock()
+        obj:update(data)
+        diff        = diff + oclock() - clock
+        if round % 3 == 0 then
+            obj:update_key({ gold = data.gold + 1 })
+            data.gold = data.gold + 1
+        end
+        local _, is_delta = obj:save()
+        deltas            = deltas + (is_delta and 1 or 0)
+        MongoStub:full_write(data)
+        if not same_value(MongoStub.store[uid], data) then
+            check(false, "round {} store mismatch", round)
+            break
+        end
+    end
+    local stat = MongoStub.stat
+    check(deltas == ROUNDS, "delta saves: {}", deltas)
+    log_info("[cachedelta_test] {} flushes full: {}KB {}B/flush encode:{}ms", ROUNDS, stat.full_bytes // 1024, stat.full_bytes // ROUNDS, sformat("%.1f", stat.full_encode * 1000))
+    log_info("[cachedelta_test] {} flushes delta: {}KB {}B/flush encode:{}ms update(diff+lmdb):{}ms", ROUNDS, stat.bytes // 1024, stat.bytes // stat.count,
+        sformat("%.1f", stat.encode * 1000), sformat("%.1f", diff * 1000))
+    --存储失败时变更保留, 下次存储一并写入
+    data = mutate(data, ROUNDS + 1)
+    obj:update(data)
+    local op = obj:save_op()
+    obj:save_done(KernCode.MONGO_FAILED, "mock failed")
+    obj:set_retry_time(0)
+    check(op[2]["$set"] and obj:is_dirty(), "failed keep dirty")
+    obj:save()
+    check(same_value(MongoStub.store[uid], data), "retry store mismatch")
+    --原表上修改后传回, 整体写入
+    data.gold = data.gold + 7
+    obj:update(data)
+    check(obj:is_dirty(), "in-place update dirty")
+    local _, is_delta = obj:save()
+    check(not is_delta and same_value(MongoStub.store[uid], data), "in-place update store mismatch")
+    return obj, data
+end
+
+--lmdb: 增量日志回放后与内存数据一致, 超过阈值合并为快照
+local function test_lmdb(obj, data)
+    local seqs = lmdb_mgr:get_seqs(CACHE_NAME)
+    check(seqs[obj:get_primary_value()] < 64, "lmdb compact: {}", seqs[obj:get_primary_value()])
+    local fake_mgr = {}
+    local recovers = {}
+    function fake_mgr:recover_cacheobj(cache_name, primary_key, value)
+        local cobj = CacheObj(CONF, primary_key)
+        cobj:update(value, true, true)
+        recovers[primary_key] = cobj
+        return cobj
+    end
+    lmdb_mgr:recover(CACHE_NAME, fake_mgr)
+    local robj = recovers[obj:get_primary_value()]
+    check(robj and same_value(robj:get_data(), data), "lmdb recover mismatch")
+    check(seqs[obj:get_primary_value()] == 0, "lmdb recover compact")
+    --快照和日志清理同一事务提交, 恢复合并后不残留增量日志
+    local logs = 0
+    for _ in lmdb_mgr:get_db():iter(CACHE_NAME .. "_log") do
+        logs = logs + 1
+    end
+    check(logs == 0, "lmdb logs left: {}", logs)
+    lmdb_mgr:delete_cache(CACHE_NAME, obj:get_primary_value())
+end
+
+local obj, data = test_delta()
+test_lmdb(obj, data)
+log_info("[cachedelta_test] done")
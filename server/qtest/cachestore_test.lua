@@ -0,0 +1,160 @@
+-- cachestore_test.lua
+-- cache对象容器: 校验时间轮的过期/存盘调度, 对比WheelMap按轮遍历和时间轮每次的检查开销
+local WheelMap   = import("container/wheel_map.lua")
+local CacheStore = import("container/cache_store.lua")
+local TestUtil   = import("qtest/test_util.lua")
+
+local log_info   = logger.info
+local check      = TestUtil.checker("cachestore_test")
+local sformat    = string.format
+local oclock     = os.clock
+local mrandom    = math.random
+
+local TOTAL      = 300000
+local EXPIRE_MS  = 600000
+local SECONDS    = 300
+local ACTIVE     = 1000          --每秒活跃的对象数
+
+local function same_keys(keys, expects)
+    if #keys ~= #expects then
+        return false
+    end
+    for i, key in ipairs(expects) do
+        if keys[i] ~= key then
+            return false
+        end
+    end
+    return true
+end
+
+local function test_store()
+    local base  = 100000
+    local store = lcache.store(base, 100)
+    --按到期时间取出, 同一tick内按加入顺序
+    store:expire(1, base + 3000)
+    store:expire("a", base + 1000)
+    store:expire(2, base + 1000)
+    store:expire(3, base + 3600 * 1000)
+    check(#store:pop_expired(base + 900) == 0, "expire early")
+    check(same_keys(store:pop_expired(base + 1000), { "a", 2 }), "expire 1s")
+    --重新设置的时间覆盖之前的, 删除后不再取出
+    store:expire(1, base + 5000)
+    store:expire(4, base + 2000)
+    store:remove(4)
+    check(#store:pop_expired(base + 4000) == 0, "expire reset")
+    check(same_keys(store:pop_expired(base + 5000), { 1 }), "expire 5s")
+    check(same_keys(store:pop_expired(base + 3600 * 1000), { 3 }), "expire 1h")
+    check(store:size() == 4, "size: {}", store:size())
+    --存盘: 已到期的按先后顺序分批取出, 重复设置不改变队列位置
+    for i = 1, 10 do
+        store:dirty(i, base)
+    end
+    store:dirty(1, base)
+    store:dirty(11, base + 3600 * 1000 + 200)
+    store:clean(5)
+    check(store:dirty_count() == 10, "dirty count: {}", store:dirty_count())
+    check(same_keys(store:pop_dirty(base + 3600 * 1000, 4), { 1, 2, 3, 4 }), "dirty batch 1")
+    check(same_keys(store:pop_dirty(base + 3600 * 1000, 4), { 6, 7, 8, 9 }), "dirty batch 2")
+    check(same_keys(store:pop_dirty(base + 3600 * 1000, 4), { 10 }), "dirty batch 3")
+    check(#store:dirty_keys() == 1 and store:dirty_count() == 1, "dirty keys")
+    check(same_keys(store:pop_dirty(base + 3600 * 1000 + 200), { 11 }), "dirty 11")
+    check(store:dirty_count() == 0, "dirty clear")
+    --容器: 删除对象同时取消调度
+    local cs = CacheStore()
+    cs:set("p1", { id = "p1" })
+    cs:expire("p1", hive.clock_ms)
+    cs:set_dirty("p1", hive.clock_ms)
+    cs:set("p1", nil)
+    check(cs:get_count() == 0 and cs:get_dirty_count() == 0 and #cs:pop_expired(hive.clock_ms + 1000) == 0, "remove cancel")
+end
+
+local function make_objs(clock_ms)
+    local objs = {}
+    for i = 1, TOTAL do
+        --活跃时间分散在过期时间内
+        objs[i] = { id = i, active_tick = clock_ms - mrandom(0, EXPIRE_MS - 1000), expire_time = EXPIRE_MS }
+    end
+    return objs
+end
+
+local function expired(obj, clock_ms)
+    return clock_ms - obj.active_tick >= obj.expire_time
+end
+
+--当前实现: 每秒遍历一个轮子, 每个对象约100秒检查一次
+local function bench_wheel(objs, clock_ms)
+    local map = WheelMap(100, 1)
+    for _, obj in ipairs(objs) do
+        map:set(obj.id, obj)
+    end
+    local total, worst, checks, removes = 0, 0, 0, 0
+    for sec = 1, SECONDS do
+        clock_ms = clock_ms + 1000
+        for i = 1, ACTIVE do
+            local obj = map:get(mrandom(1, TOTAL))
+            if obj then
+                obj.active_tick = clock_ms
+            end
+        end
+        local clock = oclock()
+        for id, obj in map:wheel_iterator() do
+            checks = checks + 1
+            if expired(obj, clock_ms) then
+                map:set(id, nil)
+                removes = removes + 1
+            end
+        end
+        local cost = oclock() - clock
+        total      = total + cost
+        worst      = cost > worst and cost or worst
+    end
+    return total, worst, checks, removes
+end
+
+local function bench_store(objs, clock_ms)
+    local store = CacheStore()
+    for _, obj in ipairs(objs) do
+        store:set(obj.id, obj)
+        store:expire(obj.id, obj.active_tick + obj.expire_time)
+    end
+    local total, worst, checks, removes = 0, 0, 0, 0
+    for sec = 1, SECONDS do
+        clock_ms = clock_ms + 1000
+        for i = 1, ACTIVE do
+            local obj = store:get(mrandom(1, TOTAL))
+            if obj then
+                obj.active_tick = clock_ms
+            end
+        end
+        local clock = oclock()
+        for _, id in ipairs(store:pop_expired(clock_ms)) do
+            local obj = store:get(id)
+            checks    = checks + 1
+            if expired(obj, clock_ms) then
+                store:set(id, nil)
+                removes = removes + 1
+            else
+                store:expire(id, obj.active_tick + obj.expire_time)
+            end
+        end
+        local cost = oclock() - clock
+        total      = total + cost
+        worst      = cost > worst and cost or worst
+    end
+    return total, worst, checks, removes
+end
+
+local function ms(value)
+    return sformat("%.2f", value * 1000)
+end
+
+test_store()
+local clock_ms = hive.clock_ms
+local seed     = os.time()
+math.randomseed(seed)
+local wtotal, wworst, wchecks, wremoves = bench_wheel(make_objs(clock_ms), clock_ms)
+math.randomseed(seed)
+local stotal, sworst, schecks, sremoves = bench_store(make_objs(clock_ms), clock_ms)
+log_info("[cachestore_test] {} objs {}s wheel_map: total:{}ms worst:{}ms checks:{} removes:{}", TOTAL, SECONDS, ms(wtotal), ms(wworst), wchecks, wremoves)
+log_info("[cachestore_test] {} objs {}s cache_store: total:{}ms worst:{}ms checks:{} removes:{}", TOTAL, SECONDS, ms(stotal), ms(sworst), schecks, sremoves)
+log_info("[cachestore_test] done")
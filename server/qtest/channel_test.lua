@@ -0,0 +1,197 @@
+-- channel_test.lua
+-- 广播频道: 校验订阅/退订/断线自动退订, 对比千人频道逐条组装token广播和原生频道广播的耗时
+local TestUtil    = import("qtest/test_util.lua")
+
+local log_info    = logger.info
+local check       = TestUtil.checker("channel_test")
+local sformat     = string.format
+local schar       = string.char
+local tconcat     = table.concat
+local oclock      = os.clock
+local eproto_type = luabus.eproto_type
+
+local thread_mgr  = hive.get("thread_mgr")
+
+local PORT        = 16388
+local CLIENTS     = 1000
+local MESSAGES    = 1000
+local BATCH       = 50
+local CMD_ID      = 9102
+local FLAG_REQ    = hive.enum("FlagMask", "REQ")
+
+--手工生成FileDescriptorSet, 不依赖protoc
+local function varint(value)
+    local out = {}
+    repeat
+        local byte = value & 0x7f
+        value      = value >> 7
+        out[#out + 1] = schar(value ~= 0 and byte | 0x80 or byte)
+    until value == 0
+    return tconcat(out)
+end
+
+local function field_str(number, value)
+    return varint(number << 3 | 2) .. varint(#value) .. value
+end
+
+local function field_int(number, value)
+    return varint(number << 3) .. varint(value)
+end
+
+local function pb_schema()
+    local serial  = field_str(1, "serial") .. field_int(3, 1) .. field_int(4, 1) .. field_int(5, 13)
+    local text    = field_str(1, "text") .. field_int(3, 2) .. field_int(4, 1) .. field_int(5, 9)
+    local message = field_str(1, "chat_ntf") .. field_str(2, serial) .. field_str(2, text)
+    local body    = field_str(1, "qtest_chat.proto") .. field_str(2, "qtest_chat") .. field_str(4, message) .. field_str(12, "proto3")
+    return field_str(1, body)
+end
+
+--codec由lua持有, socket只保存指针
+local ChannelTest = { sessions = {}, clients = {}, recvs = 0, bad = 0, codecs = { protobuf.pbcodec(), protobuf.pbcodec() } }
+
+function ChannelTest:listen()
+    self.listener = luabus.listen("127.0.0.1", PORT, eproto_type.pb)
+    self.listener.set_codec(self.codecs[1])
+    self.listener.on_accept = function(session)
+        self.sessions[#self.sessions + 1] = session
+        session.on_call_pb = function()
+            return 0
+        end
+        session.on_error   = function(token, err)
+            session.closed = true
+        end
+    end
+end
+
+function ChannelTest:connect()
+    for i = 1, CLIENTS do
+        local socket = luabus.connect("127.0.0.1", PORT, 2000, eproto_type.pb)
+        socket.set_codec(self.codecs[2])
+        socket.on_connect = function(res)
+            socket.connected = (res == "ok")
+        end
+        socket.on_call_pb = function(recv_len, cmd_id, flag, session_id, seq_id, data)
+            self.recvs = self.recvs + 1
+            if cmd_id ~= CMD_ID or data.text ~= "hello world" then
+                self.bad = self.bad + 1
+            end
+            return 0
+        end
+        socket.on_error   = function(token, err)
+        end
+        self.clients[i] = socket
+        --分批连接, 避免超出listen队列
+        if i % 100 == 0 then
+            thread_mgr:sleep(50)
+        end
+    end
+    local start = hive.clock_ms
+    while #self.sessions < CLIENTS and hive.clock_ms - start < 10000 do
+        thread_mgr:sleep(10)
+    end
+    check(#self.sessions == CLIENTS, "accept: {}", #self.sessions)
+end
+
+function ChannelTest:wait(count)
+    local start = hive.clock_ms
+    while self.recvs < count and hive.clock_ms - start < 10000 do
+        thread_mgr:sleep(1)
+    end
+end
+
+function ChannelTest:verify()
+    for i, session in ipairs(self.sessions) do
+        luabus.subscribe("qtest_world", session.token)
+        if i % 2 == 0 then
+            luabus.subscribe("qtest_guild", session.token)
+        end
+    end
+    check(luabus.channel_size("qtest_world") == CLIENTS and luabus.channel_size("qtest_guild") == CLIENTS // 2, "size")
+    --重复订阅和退订未订阅的频道返回false
+    check(not luabus.subscribe("qtest_guild", self.sessions[2].token), "subscribe twice")
+    check(not luabus.unsubscribe("qtest_guild", self.sessions[1].token), "unsubscribe none")
+    self.recvs = 0
+    local count = luabus.broad_channel(self.codecs[1], "qtest_guild", CMD_ID, FLAG_REQ, 0, 0, { serial = 1, text = "hello world" })
+    self:wait(CLIENTS // 2)
+    check(count == CLIENTS // 2 and self.recvs == count and self.bad == 0, "guild broadcast: {} recv: {}", count, self.recvs)
+    --退订后收不到, 最后一个退订时频道删除
+    check(luabus.unsubscribe("qtest_guild", self.sessions[2].token), "unsubscribe")
+    check(luabus.channel_size("qtest_guild") == CLIENTS // 2 - 1, "unsubscribe size")
+    local solo = luabus.subscribe("qtest_solo", self.sessions[3].token) and luabus.unsubscribe("qtest_solo", self.sessions[3].token)
+    check(solo and luabus.channel_size("qtest_solo") == 0, "solo channel")
+    check(luabus.broad_channel(self.codecs[1], "qtest_none", CMD_ID, FLAG_REQ, 0, 0, { serial = 1, text = "x" }) == 0, "empty channel")
+    --客户端断开, 服务端会话关闭后自动退订
+    local clients = self.clients
+    for i = CLIENTS - 9, CLIENTS do
+        clients[i].close()
+        clients[i] = nil
+    end
+    local start = hive.clock_ms
+    while luabus.channel_size("qtest_world") > CLIENTS - 10 and hive.clock_ms - start < 5000 do
+        thread_mgr:sleep(10)
+    end
+    check(luabus.channel_size("qtest_world") == CLIENTS - 10, "auto unsubscribe: {}", luabus.channel_size("qtest_world"))
+    self.recvs = 0
+    count = luabus.broad_channel(self.codecs[1], "qtest_world", CMD_ID, FLAG_REQ, 0, 0, { serial = 2, text = "hello world" })
+    self:wait(count)
+    check(count == CLIENTS - 10 and self.recvs == count, "world broadcast: {} recv: {}", count, self.recvs)
+end
+
+--旧方式: 每条消息遍历会话组装token数组
+function ChannelTest:broad_group(data)
+    local tokens = {}
+    for _, session in pairs(self.session_map) do
+        tokens[#tokens + 1] = session.token
+    end
+    luabus.broad_group(self.codecs[1], tokens, CMD_ID, FLAG_REQ, 0, 0, data)
+    return #tokens
+end
+
+function ChannelTest:broad_channel(data)
+    return luabus.broad_channel(self.codecs[1], "qtest_world", CMD_ID, FLAG_REQ, 0, 0, data)
+end
+
+function ChannelTest:bench(name, broad)
+    self.recvs, self.bad = 0, 0
+    local data = { serial = 0, text = "hello world" }
+    local start, send_cpu, members = hive.clock_ms, 0, 0
+    for i = 1, MESSAGES, BATCH do
+        local clock = oclock()
+        for j = i, i + BATCH - 1 do
+            data.serial = j
+            members = broad(self, data)
+        end
+        send_cpu = send_cpu + oclock() - clock
+        self:wait((i + BATCH - 1) * members)
+    end
+    check(self.recvs == MESSAGES * members and self.bad == 0, "{} recv: {} bad: {}", name, self.recvs, self.bad)
+    log_info("[channel_test] {} {} msgs to {} members broadcast:{}ms ({}us/msg) wall:{}ms", name, MESSAGES, members,
+        sformat("%.1f", send_cpu * 1000), sformat("%.1f", send_cpu * 1000000 / MESSAGES), hive.clock_ms - start)
+    return send_cpu
+end
+
+thread_mgr:fork(function()
+    if not check(protobuf.load(pb_schema()), "load schema") then
+        return
+    end
+    protobuf.bind_cmd(CMD_ID, "qtest_chat.chat_ntf")
+    ChannelTest:listen()
+    ChannelTest:connect()
+    ChannelTest:verify()
+    --NetServer按token保存会话
+    ChannelTest.session_map = {}
+    for _, session in ipairs(ChannelTest.sessions) do
+        if not session.closed then
+            ChannelTest.session_map[session.token] = session
+        end
+    end
+    local group_cpu   = ChannelTest:bench("broad_group", ChannelTest.broad_group)
+    local channel_cpu = ChannelTest:bench("broad_channel", ChannelTest.broad_channel)
+    log_info("[channel_test] broadcast cpu group:{}ms channel:{}ms speedup:{}x", sformat("%.1f", group_cpu * 1000),
+        sformat("%.1f", channel_cpu * 1000), sformat("%.2f", group_cpu / channel_cpu))
+    for _, socket in pairs(ChannelTest.clients) do
+        socket.close()
+    end
+    ChannelTest.listener.close()
+    log_info("[channel_test] done")
+end)
@@ -0,0 +1,87 @@
+-- frozen_test.lua
+-- 冻结表的读取语义, 以及大参数整表传递和冻结表只传名字的对比
+local TestUtil   = import("qtest/test_util.lua")
+
+local ltimer     = require("ltimer")
+local log_info   = logger.info
+local check      = TestUtil.checker("frozen_test")
+local sformat    = string.format
+
+local lclock_ms  = ltimer.clock_ms
+local lclock_us  = ltimer.clock_us
+
+local scheduler  = hive.get("scheduler")
+local thread_mgr = hive.get("thread_mgr")
+
+local ITEM_COUNT = 2000
+local CALL_COUNT = 500
+
+local items = {}
+for i = 1, ITEM_COUNT do
+    items[i] = { id = i, name = "item" .. i, attrs = { i * 2, i * 3 }, flag = (i % 2 == 0) }
+end
+local config = { items = items, version = "1.0.0", [-1] = "neg", [100000] = 3.5 }
+
+--读取语义
+hive.freeze("config", config)
+local frozen = hive.frozen("config")
+check(frozen.version == "1.0.0", "string value")
+check(frozen[-1] == "neg" and frozen[100000] == 3.5, "hash int key")
+check(#frozen.items == ITEM_COUNT, "array len")
+check(frozen.items[10].attrs[2] == 30 and frozen.items[10].flag == true, "nested value")
+check(frozen.items[ITEM_COUNT + 1] == nil and frozen.unknown == nil, "missing key")
+check(not pcall(function() frozen.version = "2.0" end), "readonly")
+local keys = 0
+for _ in pairs(frozen) do
+    keys = keys + 1
+end
+check(keys == 4, "pairs count")
+local ids = 0
+for i, item in ipairs(frozen.items) do
+    ids = ids + item.id - i
+end
+check(ids == 0, "ipairs")
+hive.freeze("config", { version = "2.0.0" })
+check(frozen.version == "1.0.0" and hive.frozen("config").version == "2.0.0", "replace keep old proxy")
+hive.unfreeze("config")
+check(hive.frozen("config") == nil, "unfreeze")
+
+--worker读取
+local worker = "frozen_1"
+hive.freeze("items", items)
+scheduler:startup(worker, "qtest.frozen_worker")
+local deadline = lclock_ms() + 3000
+while lclock_ms() < deadline do
+    scheduler:update(lclock_ms())
+end
+
+local function bench(mode, rpc, arg)
+    local done, failed = 0, 0
+    local start = lclock_us()
+    thread_mgr:fork(function()
+        for i = 1, CALL_COUNT do
+            local id = i % ITEM_COUNT + 1
+            local ok, sum = scheduler:call(worker, rpc, arg, id)
+            if not ok or sum ~= id * 3 + #items[id].name then
+                failed = failed + 1
+            end
+            done = done + 1
+        end
+    end)
+    deadline = lclock_ms() + 60000
+    while done < CALL_COUNT and lclock_ms() < deadline do
+        scheduler:update(lclock_ms())
+        luabus.wait(lclock_ms(), 10)
+    end
+    local cost = lclock_us() - start
+    log_info("[frozen_test] {} calls:{} failed:{} {} calls/s", mode, done, failed, sformat("%.0f", done * 1000000 / cost))
+end
+
+thread_mgr:fork(function()
+    local ok, sum = scheduler:call(worker, "rpc_frozen_read", "items", 0)
+    check(ok and sum == ITEM_COUNT * (ITEM_COUNT + 1) // 2, "worker ipairs")
+end)
+bench("copy", "rpc_frozen_copy", items)
+bench("frozen", "rpc_frozen_read", "items")
+hive.worker_shutdown()
+log_info("[frozen_test] finish")
@@ -0,0 +1,39 @@
+--frozen_worker.lua
+--frozen_test的worker线程
+local FrozenWorker = singleton()
+
+function FrozenWorker:__init()
+    local event_mgr = hive.get("event_mgr")
+    event_mgr:add_listener(self, "rpc_frozen_copy")
+    event_mgr:add_listener(self, "rpc_frozen_read")
+end
+
+local function sum_items(items, id)
+    local item = items[id]
+    return item.id + item.attrs[1] + #item.name
+end
+
+--整表作为参数传入(序列化)
+function FrozenWorker:rpc_frozen_copy(items, id)
+    return sum_items(items, id)
+end
+
+--只传名字, 读取冻结表
+function FrozenWorker:rpc_frozen_read(name, id)
+    local items = hive.frozen(name)
+    if not items then
+        return 0
+    end
+    if id == 0 then
+        local sum = 0
+        for _, item in ipairs(items) do
+            sum = sum + item.id
+        end
+        return sum
+    end
+    return sum_items(items, id)
+end
+
+hive.startup(function()
+    hive.frozen_worker = FrozenWorker()
+end)
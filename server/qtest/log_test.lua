@@ -52,6 +52,12 @@ local function test2()
     log_debug("%s", str)
     str = logger.format("1:{1} 2:{2} 1:{1} 2:{2} 0:{0}", 0, 1, 2)
     log_debug("%s", str)
+    --format不限制字符串参数长度
+    local long = string.rep("x", 10000)
+    str = logger.format("name:{} long:{}", "player", long)
+    if str ~= "name:player long:" .. long then
+        logger.err("[log_test] format check failed: len:{}", #str)
+    end
 end
 
 test1()
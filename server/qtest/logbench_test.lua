@@ -0,0 +1,43 @@
+-- logbench_test.lua
+-- 日志吞吐和调用方耗时: drop/block/sample三种溢出策略
+local ltimer    = require("ltimer")
+local log_info  = logger.info
+local log_debug = logger.debug
+local sformat   = string.format
+
+local lclock_us = ltimer.clock_us
+local lclock_ms = ltimer.clock_ms
+
+local OVERFLOW  = log.OVERFLOW
+local LINES     = 100000
+
+local function bench(name, policy)
+    log.set_overflow(policy, 10)
+    local before = log.stats()
+    local cost, worst = 0, 0
+    local start = lclock_us()
+    for i = 1, LINES do
+        local t = lclock_us()
+        log_debug("[logbench_test] line:{} name:{} value:{}", i, "player", i * 3)
+        local used = lclock_us() - t
+        cost = cost + used
+        if used > worst then
+            worst = used
+        end
+    end
+    local total = lclock_us() - start
+    --等待写线程写完
+    local deadline = lclock_ms() + 10000
+    while log.stats().pending > 0 and lclock_ms() < deadline do
+        luabus.wait(lclock_ms(), 10)
+    end
+    local after = log.stats()
+    log_info("[logbench_test] {} lines:{} {} lines/s caller avg:{}us max:{}us drops:{} blocks:{} batches:{}",
+        name, LINES, sformat("%.0f", LINES * 1000000 / total), sformat("%.2f", cost / LINES), worst,
+        after.drops - before.drops, after.blocks - before.blocks, after.batches - before.batches)
+end
+
+bench("block", OVERFLOW.BLOCK)
+bench("drop", OVERFLOW.DROP)
+bench("sample", OVERFLOW.SAMPLE)
+log.set_overflow(OVERFLOW.BLOCK, 10)
@@ -0,0 +1,94 @@
+-- logbin_test.lua
+-- 二进制日志: 调用方耗时对比, .blog段解码校验
+local ltimer    = require("ltimer")
+local lstdfs    = require("lstdfs")
+local log_info  = logger.info
+local log_err   = logger.err
+local sformat   = string.format
+
+local lclock_us = ltimer.clock_us
+local lclock_ms = ltimer.clock_ms
+
+local BINARY    = log.BINARY
+local LINES     = 50000
+local MAX_LEN   = 4096  --debug级别参数截断长度
+
+local function wait_flush()
+    local deadline = lclock_ms() + 10000
+    while log.stats().pending > 0 and lclock_ms() < deadline do
+        luabus.wait(lclock_ms(), 10)
+    end
+    luabus.wait(lclock_ms(), 20)
+end
+
+local function bench(name, mode, log_func)
+    log.set_binary(mode)
+    local start = lclock_us()
+    for i = 1, LINES do
+        log_func("[logbin_test] line:{} name:{} rate:{} flag:{} id:{}", i, "player", i / 4, i % 2 == 0, 1000000 + i)
+    end
+    local cost = lclock_us() - start
+    wait_flush()
+    log_info("[logbin_test] {} lines:{} caller avg:{}us", name, LINES, sformat("%.2f", cost / LINES))
+end
+
+--FILE模式下新建的输出为二进制段
+log.set_binary(BINARY.FILE)
+local log_bin = logfeature.debug("logbin", nil, nil, true)
+log.set_binary(BINARY.OFF)
+local log_text = logfeature.debug("logtext", nil, nil, true)
+
+bench("text", BINARY.OFF, log_text)
+bench("defer", BINARY.DEFER, log_text)
+bench("binary", BINARY.FILE, log_bin)
+--超长字符串参数同文本模式截断
+log_bin("[logbin_test] long:{}", string.rep("x", MAX_LEN * 2))
+wait_flush()
+log.set_binary(BINARY.OFF)
+
+--解码校验
+local blog
+for _, file in pairs(lstdfs.dir("./logs")) do
+    if file.type ~= "directory" and lstdfs.extension(file.name) == ".blog" and string.find(file.name, "logbin") then
+        blog = file.name
+    end
+end
+local function find_blog(dir)
+    for _, file in pairs(lstdfs.dir(dir)) do
+        if file.type == "directory" then
+            find_blog(file.name)
+        elseif lstdfs.extension(file.name) == ".blog" and string.find(file.name, "logbin") then
+            --文件名带时间, 取最新的
+            if not blog or file.name > blog then
+                blog = file.name
+            end
+        end
+    end
+end
+find_blog("./logs")
+if not blog then
+    log_err("[logbin_test] blog file not found")
+    return
+end
+local output = "./logs/logbin_decode.log"
+local start = lclock_us()
+local count = log.decode(blog, output)
+log_info("[logbin_test] decode {} lines:{} cost:{}ms", blog, count, (lclock_us() - start) // 1000)
+local file = io.open(output, "r")
+local first = file and file:read("l")
+local long
+if file then
+    for line in file:lines() do
+        long = string.match(line, "long:(x*)") or long
+    end
+    file:close()
+end
+local expect = "line:1 name:player rate:0.25 flag:false id:1000001"
+if not long or #long ~= MAX_LEN then
+    log_err("[logbin_test] decode check failed: long arg len:{}", long and #long)
+end
+if count ~= LINES + 1 or not first or not string.find(first, expect, 1, true) then
+    log_err("[logbin_test] decode check failed: count:{} first:{}", count, first)
+else
+    log_info("[logbin_test] decode check ok: {}", first)
+end
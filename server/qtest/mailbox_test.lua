@@ -0,0 +1,185 @@
+-- mailbox_test.lua
+-- worker->master线程消息的吞吐和延迟: 1/4/16个生产者线程
+local ltimer     = require("ltimer")
+local log_info   = logger.info
+local log_err    = logger.err
+local sformat    = string.format
+local srep       = string.rep
+local tsort      = table.sort
+
+local lclock_ms  = ltimer.clock_ms
+local lclock_us  = ltimer.clock_us
+
+local event_mgr  = hive.get("event_mgr")
+local scheduler  = hive.get("scheduler")
+
+local PING_COUNT = 1000    --往返: 空闲worker的唤醒延迟
+local MSG_COUNT  = 100000  --压满: 吞吐
+local PACE_COUNT = 2000    --限速: 每个生产者的消息数
+local PACE_BATCH = 100     --限速: 每帧消息数
+local PRODUCERS  = { 1, 4, 16 }
+local LARGE_SIZES = { 64000, 256000, 1024000 }  --大消息: 字节数
+local LARGE_COUNT = 2000   --大消息: 投递数
+local LARGE_BATCH = 4      --大消息: 每批投递数
+
+local MailboxTest = singleton()
+
+function MailboxTest:__init()
+    self.latencys = {}
+    self.done = 0
+    self.failed = 0
+    event_mgr:add_listener(self, "rpc_mailbox_echo")
+    event_mgr:add_listener(self, "rpc_mailbox_done")
+end
+
+function MailboxTest:rpc_mailbox_echo(clock_us)
+    local latencys = self.latencys
+    latencys[#latencys + 1] = lclock_us() - clock_us
+end
+
+function MailboxTest:rpc_mailbox_done(failed)
+    self.done = self.done + 1
+    self.failed = self.failed + failed
+end
+
+function MailboxTest:startup(producers)
+    local names = {}
+    for i = 1, producers do
+        local name = sformat("mailbox_%d_%d", producers, i)
+        scheduler:startup(name, "qtest.mailbox_worker")
+        names[#names + 1] = name
+    end
+    --等待worker加载完成
+    local deadline = lclock_ms() + 3000
+    while lclock_ms() < deadline do
+        scheduler:update(lclock_ms())
+    end
+    return names
+end
+
+function MailboxTest:bench(names, mode, count, batch)
+    self.latencys, self.done, self.failed = {}, 0, 0
+    local producers = #names
+    local start = lclock_us()
+    for _, name in ipairs(names) do
+        scheduler:send(name, "rpc_mailbox_bench", count, batch)
+    end
+    local deadline = lclock_ms() + 60000
+    while self.done < producers and lclock_ms() < deadline do
+        scheduler:update(lclock_ms())
+    end
+    local cost = lclock_us() - start
+    local latencys = self.latencys
+    tsort(latencys)
+    local total = #latencys
+    log_info("[mailbox_test] {} producers:{} recv:{}/{} failed:{} {} calls/s p50:{}us p99:{}us max:{}us",
+        mode, producers, total, count * producers, self.failed, sformat("%.0f", total * 1000000 / cost),
+        latencys[total * 50 // 100 + 1], latencys[total * 99 // 100 + 1], latencys[total])
+end
+
+--主线程和worker都阻塞在luabus.wait, 测试邮箱唤醒
+function MailboxTest:ping(name)
+    local latencys = {}
+    local finish = false
+    local thread_mgr = hive.get("thread_mgr")
+    thread_mgr:fork(function()
+        for _ = 1, PING_COUNT do
+            local ok, clock_us = scheduler:call(name, "rpc_mailbox_ping", lclock_us())
+            if ok then
+                latencys[#latencys + 1] = lclock_us() - clock_us
+            end
+        end
+        finish = true
+    end)
+    local deadline = lclock_ms() + 30000
+    while not finish and lclock_ms() < deadline do
+        scheduler:update(lclock_ms())
+        luabus.wait(lclock_ms(), 10)
+    end
+    tsort(latencys)
+    local total = #latencys
+    log_info("[mailbox_test] ping rtt count:{} p50:{}us p99:{}us max:{}us", total,
+        latencys[total * 50 // 100 + 1], latencys[total * 99 // 100 + 1], latencys[total])
+    for wname, stat in pairs(hive.worker_stats()) do
+        log_info("[mailbox_test] stats {}: frames:{} mails:{} mail_us:{} wakeups:{} pending:{}",
+            wname, stat.frames, stat.mails, stat.mail_us, stat.wakeups, stat.pending)
+    end
+end
+
+--master投递不等待: worker邮箱满时立即返回失败, 由lua处理
+function MailboxTest:full(name)
+    --不超过半秒, worker不触发帧超时告警
+    scheduler:send(name, "rpc_mailbox_stall", 400)
+    --单个字符串不能超过64K, 拼成1M的消息
+    local data = {}
+    for i = 1, 16 do
+        data[i] = srep("x", 64000)
+    end
+    local failed = 0
+    local start = lclock_us()
+    for _ = 1, 64 do
+        if not scheduler:send(name, "rpc_mailbox_drop", data) then
+            failed = failed + 1
+        end
+    end
+    local cost = lclock_us() - start
+    log_info("[mailbox_test] master send to full mailbox failed:{}/64 cost:{}us", failed, cost)
+    --等待时每次失败至少100ms
+    if failed == 0 or cost > failed * 10000 then
+        log_err("[mailbox_test] check failed: master blocked, failed:{} cost:{}us", failed, cost)
+    end
+    --等待worker处理完积压的消息
+    local finish = false
+    hive.get("thread_mgr"):fork(function()
+        scheduler:call(name, "rpc_mailbox_ping", 0)
+        finish = true
+    end)
+    local deadline = lclock_ms() + 10000
+    while not finish and lclock_ms() < deadline do
+        scheduler:update(lclock_ms())
+        luabus.wait(lclock_ms(), 10)
+    end
+end
+
+--大消息(超过16K移交编码缓冲区)的投递耗时, 每批之后等待worker处理完
+function MailboxTest:large(name, size)
+    local data = {}
+    for i = 1, size // 64000 do
+        data[i] = srep("x", 64000)
+    end
+    local finish = false
+    local cost, count = 0, 0
+    hive.get("thread_mgr"):fork(function()
+        for _ = 1, LARGE_COUNT // LARGE_BATCH do
+            for _ = 1, LARGE_BATCH do
+                local start = lclock_us()
+                scheduler:send(name, "rpc_mailbox_drop", data)
+                cost = cost + lclock_us() - start
+                count = count + 1
+            end
+            scheduler:call(name, "rpc_mailbox_ping", 0)
+        end
+        finish = true
+    end)
+    local deadline = lclock_ms() + 30000
+    while not finish and lclock_ms() < deadline do
+        scheduler:update(lclock_ms())
+        luabus.wait(lclock_ms(), 10)
+    end
+    log_info("[mailbox_test] large send size:{}KB count:{} avg:{}us", size // 1024, count, sformat("%.1f", cost / count))
+end
+
+local test = MailboxTest()
+local ping_name = test:startup(1)[1]
+test:ping(ping_name)
+test:full(ping_name)
+for _, size in ipairs(LARGE_SIZES) do
+    test:large(ping_name, size)
+end
+hive.worker_shutdown()
+for _, producers in ipairs(PRODUCERS) do
+    local names = test:startup(producers)
+    test:bench(names, "flood", MSG_COUNT // producers, 0)
+    test:bench(names, "paced", PACE_COUNT, PACE_BATCH)
+    hive.worker_shutdown()
+end
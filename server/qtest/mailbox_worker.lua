@@ -0,0 +1,50 @@
+--mailbox_worker.lua
+--mailbox_test的生产者线程
+local ltimer    = require("ltimer")
+local lclock_us = ltimer.clock_us
+local wcall     = hive.call
+
+local FLAG_REQ  = hive.enum("FlagMask", "REQ")
+
+local MailboxWorker = singleton()
+
+function MailboxWorker:__init()
+    local event_mgr = hive.get("event_mgr")
+    event_mgr:add_listener(self, "rpc_mailbox_bench")
+    event_mgr:add_listener(self, "rpc_mailbox_ping")
+    event_mgr:add_listener(self, "rpc_mailbox_stall")
+    event_mgr:add_listener(self, "rpc_mailbox_drop")
+end
+
+--向主线程投递count条消息, batch>0时每batch条让出一帧
+function MailboxWorker:rpc_mailbox_bench(count, batch)
+    local failed = 0
+    local thread_mgr = hive.get("thread_mgr")
+    for i = 1, count do
+        if not wcall("master", 0, FLAG_REQ, hive.title, "rpc_mailbox_echo", lclock_us()) then
+            failed = failed + 1
+        end
+        if batch > 0 and i % batch == 0 then
+            thread_mgr:sleep(1)
+        end
+    end
+    hive.send_master("rpc_mailbox_done", failed)
+end
+
+function MailboxWorker:rpc_mailbox_ping(clock_us)
+    return clock_us
+end
+
+--占住线程ms毫秒, 期间邮箱不消费
+function MailboxWorker:rpc_mailbox_stall(ms)
+    local deadline = lclock_us() + ms * 1000
+    while lclock_us() < deadline do
+    end
+end
+
+function MailboxWorker:rpc_mailbox_drop(data)
+end
+
+hive.startup(function()
+    hive.mailbox_worker = MailboxWorker()
+end)
@@ -0,0 +1,165 @@
+-- metrics_test.lua
+-- 原生指标: 校验计数/直方图分位数/多线程聚合和线程退出后的累计值, 对比每条统计的耗时和旧的跨线程消息方式
+local TestUtil     = import("qtest/test_util.lua")
+
+local ltimer       = require("ltimer")
+local log_info     = logger.info
+local check        = TestUtil.checker("metrics_test")
+local sformat      = string.format
+local lclock_ms    = ltimer.clock_ms
+local lclock_us    = ltimer.clock_us
+local madd         = metrics.add
+local mobserve     = metrics.observe
+local msnapshot    = metrics.snapshot
+
+local event_mgr    = hive.get("event_mgr")
+local scheduler    = hive.get("scheduler")
+local proxy_agent  = hive.get("proxy_agent")
+
+local BENCH_COUNT  = 1000000
+local MSG_COUNT    = 100000
+local THREADS      = 4
+local THREAD_COUNT = 1000000
+
+local MetricsTest = singleton()
+
+function MetricsTest:__init()
+    self.done, self.costs, self.drained = 0, {}, nil
+    event_mgr:add_listener(self, "rpc_metrics_done")
+    event_mgr:add_listener(self, "rpc_metrics_drained")
+end
+
+function MetricsTest:rpc_metrics_done(cost_us)
+    self.done = self.done + 1
+    self.costs[#self.costs + 1] = cost_us
+end
+
+function MetricsTest:rpc_metrics_drained(count)
+    self.drained = count
+end
+
+function MetricsTest:wait(cond, timeout)
+    local deadline = lclock_ms() + (timeout or 30000)
+    while not cond() and lclock_ms() < deadline do
+        scheduler:update(lclock_ms())
+    end
+end
+
+function MetricsTest:verify()
+    local cid = metrics.counter("qtest:counter")
+    madd(cid)
+    madd(cid, 9)
+    check(metrics.value(cid) == 10, "counter: {}", metrics.value(cid))
+    local gid = metrics.gauge("qtest:gauge")
+    metrics.set(gid, 100)
+    madd(gid, -30)
+    check(metrics.value(gid) == 70, "gauge: {}", metrics.value(gid))
+    --同名同类型返回同一个id, 类型冲突报错
+    check(metrics.counter("qtest:counter") == cid, "intern")
+    check(not pcall(metrics.histogram, "qtest:counter"), "type conflict")
+    check(not pcall(mobserve, cid, 1), "observe counter")
+    --分位数误差不超过1/16
+    local hid = metrics.histogram("qtest:hist")
+    for i = 1, 100000 do
+        mobserve(hid, i)
+    end
+    local hist = msnapshot("qtest:hist", true)["qtest:hist"]
+    check(hist.count == 100000 and hist.sum == 5000050000 and hist.max == 100000, "hist: {}", hist)
+    for _, q in ipairs({ { "p50", 50000 }, { "p90", 90000 }, { "p99", 99000 }, { "p999", 99900 } }) do
+        local v = hist[q[1]]
+        check(v >= q[2] and v <= q[2] * 17 / 16, "{}: {}", q[1], v)
+    end
+    log_info("[metrics_test] hist 1..100000 p50:{} p90:{} p99:{} p999:{}", hist.p50, hist.p90, hist.p99, hist.p999)
+end
+
+--单线程: 原生写入和ProxyAgent:statistics
+function MetricsTest:bench()
+    local hid   = metrics.histogram("qtest:bench")
+    local start = lclock_us()
+    for i = 1, BENCH_COUNT do
+        mobserve(hid, i & 0xfff)
+    end
+    local observe_cost = lclock_us() - start
+    proxy_agent.statis_status = true
+    start = lclock_us()
+    for i = 1, BENCH_COUNT do
+        proxy_agent:statistics("on_rpc_send", "rpc_qtest_bench", i & 0xfff)
+    end
+    local statis_cost = lclock_us() - start
+    proxy_agent.statis_status = false
+    local stat = msnapshot("on_rpc_send:rpc_qtest_bench")["on_rpc_send:rpc_qtest_bench"]
+    check(stat and stat.count == BENCH_COUNT, "statistics: {}", stat)
+    log_info("[metrics_test] observe:{}ns/event statistics:{}ns/event", sformat("%.1f", observe_cost * 1000 / BENCH_COUNT),
+        sformat("%.1f", statis_cost * 1000 / BENCH_COUNT))
+end
+
+function MetricsTest:startup()
+    local names = {}
+    for i = 1, THREADS do
+        local name = sformat("metrics_%d", i)
+        scheduler:startup(name, "qtest.metrics_worker")
+        names[#names + 1] = name
+    end
+    --等待worker加载完成
+    local deadline = lclock_ms() + 3000
+    while lclock_ms() < deadline do
+        scheduler:update(lclock_ms())
+    end
+    return names
+end
+
+--旧方式: 每条统计一次跨线程消息, 统计到接收方处理完
+function MetricsTest:bench_message(name)
+    self.drained = nil
+    local start = lclock_us()
+    for i = 1, MSG_COUNT do
+        scheduler:send(name, "on_rpc_send", "rpc_qtest_bench", i & 0xfff)
+    end
+    local send_cost = lclock_us() - start
+    scheduler:send(name, "rpc_metrics_drain")
+    self:wait(function() return self.drained end)
+    local cost = lclock_us() - start
+    check(self.drained == MSG_COUNT, "drained: {}", self.drained)
+    log_info("[metrics_test] message send:{}ns/event drained:{}ns/event", sformat("%.1f", send_cost * 1000 / MSG_COUNT),
+        sformat("%.1f", cost * 1000 / MSG_COUNT))
+end
+
+--多线程同时写入, 主线程聚合
+function MetricsTest:bench_threads(names)
+    self.done, self.costs = 0, {}
+    for _, name in ipairs(names) do
+        scheduler:send(name, "rpc_metrics_bench", THREAD_COUNT)
+    end
+    local reads, start = 0, lclock_us()
+    local snapshot_us = 0
+    while self.done < #names and lclock_us() - start < 60000000 do
+        local clock = lclock_us()
+        msnapshot("qtest_thread:", true)
+        snapshot_us, reads = snapshot_us + lclock_us() - clock, reads + 1
+        scheduler:update(lclock_ms())
+    end
+    local total = #names * THREAD_COUNT
+    local stats = msnapshot("qtest_thread:")
+    check(stats["qtest_thread:count"] == total and stats["qtest_thread:latency"].count == total, "threads: {}", stats)
+    local size, shards = metrics.size()
+    for i, cost in ipairs(self.costs) do
+        log_info("[metrics_test] thread {} write {} events {}ns/event", i, THREAD_COUNT * 2, sformat("%.1f", cost * 1000 / (THREAD_COUNT * 2)))
+    end
+    log_info("[metrics_test] metrics:{} shards:{} snapshot while writing:{} times avg:{}us", size, shards, reads, snapshot_us // reads)
+    return total
+end
+
+local test = MetricsTest()
+test:verify()
+test:bench()
+local names = test:startup()
+test:bench_message(names[1])
+local total = test:bench_threads(names)
+--等worker空闲后退出, 分片计数累加到全局
+test:wait(function() return false end, 1000)
+hive.worker_shutdown()
+local stats = msnapshot("qtest_thread:")
+local _, shards = metrics.size()
+check(stats["qtest_thread:count"] == total and stats["qtest_thread:latency"].count == total, "retire: {}", stats)
+log_info("[metrics_test] after shutdown shards:{} count:{}", shards, stats["qtest_thread:count"])
+log_info("[metrics_test] done")
@@ -0,0 +1,42 @@
+--metrics_worker.lua
+--metrics_test的写入线程, 同时作为旧统计方式的消息接收方
+local ltimer    = require("ltimer")
+local lclock_us = ltimer.clock_us
+local madd      = metrics.add
+local mobserve  = metrics.observe
+
+local MetricsWorker = singleton()
+
+function MetricsWorker:__init()
+    self.count = 0
+    local event_mgr = hive.get("event_mgr")
+    event_mgr:add_listener(self, "rpc_metrics_bench")
+    event_mgr:add_listener(self, "rpc_metrics_drain")
+    event_mgr:add_listener(self, "on_rpc_send")
+end
+
+--本线程分片写入count次
+function MetricsWorker:rpc_metrics_bench(count)
+    local hid   = metrics.histogram("qtest_thread:latency")
+    local cid   = metrics.counter("qtest_thread:count")
+    local start = lclock_us()
+    for i = 1, count do
+        mobserve(hid, i % 1000)
+        madd(cid, 1)
+    end
+    hive.send_master("rpc_metrics_done", lclock_us() - start)
+end
+
+--旧方式: 每条统计一次跨线程消息
+function MetricsWorker:on_rpc_send(rpc, send_len)
+    self.count = self.count + 1
+end
+
+function MetricsWorker:rpc_metrics_drain()
+    hive.send_master("rpc_metrics_drained", self.count)
+    self.count = 0
+end
+
+hive.startup(function()
+    hive.metrics_worker = MetricsWorker()
+end)
@@ -0,0 +1,142 @@
+-- mgobulk_test.lua
+-- mongo批量写: 本地模拟mongo服务解析OP_MSG文档序列, 对比逐条写和bulk_write的吞吐
+local MongoDB    = import("driver/mongo.lua")
+local TestUtil   = import("qtest/test_util.lua")
+
+local log_info   = logger.info
+local check      = TestUtil.checker("mgobulk_test")
+
+local thread_mgr = hive.get("thread_mgr")
+
+local PORT       = 16381
+local COUNT      = 2000
+
+--模拟服务: 支持 insert/update/delete, 文档以id为主键, bad=true的文档返回写错误
+local Standin = { store = {}, sequences = 0 }
+
+function Standin:write_error(errors, index)
+    errors[#errors + 1] = { index = index - 1, code = 11000, errmsg = "bad document" }
+end
+
+function Standin:insert(docs, reply)
+    local errors = {}
+    for i, doc in ipairs(docs) do
+        if doc.bad then
+            self:write_error(errors, i)
+        else
+            self.store[doc.id] = doc
+            reply.n            = reply.n + 1
+        end
+    end
+    return errors
+end
+
+function Standin:update(docs, reply)
+    local errors, upserted = {}, {}
+    for i, doc in ipairs(docs) do
+        if doc.u.bad then
+            self:write_error(errors, i)
+        else
+            local id = doc.q.id
+            if not self.store[id] then
+                upserted[#upserted + 1] = { index = i - 1, _id = id }
+            elseif self.store[id].value ~= doc.u.value then
+                reply.nModified = reply.nModified + 1
+            end
+            self.store[id] = doc.u
+            reply.n        = reply.n + 1
+        end
+    end
+    if #upserted > 0 then
+        reply.upserted = upserted
+    end
+    return errors
+end
+
+function Standin:delete(docs, reply)
+    for _, doc in ipairs(docs) do
+        if self.store[doc.q.id] then
+            self.store[doc.q.id] = nil
+            reply.n              = reply.n + 1
+        end
+    end
+    return {}
+end
+
+function Standin:execute(socket, body, sections)
+    for _ in pairs(sections) do
+        self.sequences = self.sequences + 1
+    end
+    local reply = { ok = 1, n = 0, nModified = 0 }
+    for _, cmd in ipairs({ "insert", "update", "delete" }) do
+        if body[cmd] then
+            local ident  = cmd == "insert" and "documents" or (cmd .. "s")
+            local docs   = sections[ident] or body[ident] or {}
+            local errors = self[cmd](self, docs, reply)
+            if #errors > 0 then
+                reply.writeErrors = errors
+            end
+            return reply
+        end
+    end
+    return reply
+end
+
+local server = TestUtil.mongo_standin(PORT, Standin)
+
+local function bench_single(db)
+    local start = hive.clock_ms
+    for i = 1, COUNT do
+        db:insert("single", { id = i, value = i })
+    end
+    return hive.clock_ms - start
+end
+
+local function bench_bulk(db)
+    local start, ops = hive.clock_ms, {}
+    for i = 1, COUNT do
+        ops[i] = { "insert", { id = COUNT + i, value = i } }
+    end
+    local ok, res = db:bulk_write("bulk", ops)
+    check(ok and res.nInserted == COUNT, "bulk insert: {}", res)
+    return hive.clock_ms - start
+end
+
+local function verify(db)
+    local ok, res = db:bulk_write("verify", {
+        { "insert", { id = "a", value = 1 } }, { "insert", { id = "b", value = 2 } },
+        { "update", { id = "a", value = 10 }, { id = "a" }, true }, { "update", { id = "c", value = 3 }, { id = "c" }, true },
+        { "delete", { id = "b" }, true },
+    })
+    check(ok and res.nInserted == 2 and res.nModified == 1 and res.nMatched == 1 and res.nUpserted == 1 and res.nRemoved == 1, "mixed: {}", res)
+    check(Standin.store.a.value == 10 and Standin.store.c and not Standin.store.b, "mixed store")
+    --有序写遇到错误即停止
+    local bad_ops = { { "insert", { id = "d" } }, { "insert", { id = "e", bad = true } }, { "insert", { id = "f" } }, { "delete", { id = "a" } } }
+    local ook, oerr, ores = db:bulk_write("verify", bad_ops)
+    check(not ook and oerr == "bad document" and ores.writeErrors[1].index == 2 and Standin.store.a, "ordered: {}", ores)
+    --无序写继续执行, 错误下标为全局下标
+    local uok, _, ures = db:bulk_write("verify", bad_ops, false)
+    check(not uok and #ures.writeErrors == 1 and ures.writeErrors[1].index == 2 and ures.nRemoved == 1 and not Standin.store.a, "unordered: {}", ures)
+    check(Standin.sequences == 6, "sequences: {}", Standin.sequences)
+end
+
+thread_mgr:fork(function()
+    if not server:listen() then
+        return
+    end
+    local db = MongoDB({ db = "mgobulk", user = "", passwd = "", opts = {}, hosts = { { "127.0.0.1", PORT } } })
+    while not db:available() do
+        thread_mgr:sleep(100)
+    end
+    db:set_executer()
+    --预热, 首个请求包含进程启动期的开销
+    db:runCommand("ping")
+    verify(db)
+    local single = bench_single(db)
+    local bulk   = bench_bulk(db)
+    log_info("[mgobulk_test] {} docs single:{}ms {} docs/s", COUNT, single, COUNT * 1000 // math.max(single, 1))
+    log_info("[mgobulk_test] {} docs bulk_write:{}ms {} docs/s", COUNT, bulk, COUNT * 1000 // math.max(bulk, 1))
+    check(Standin.store[COUNT * 2] and Standin.store[COUNT * 2].value == COUNT, "bulk store")
+    db:close()
+    server:close()
+end)
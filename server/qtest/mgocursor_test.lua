@@ -0,0 +1,176 @@
+-- mgocursor_test.lua
+-- mongo游标: 本地模拟mongo服务分批返回, 对比游标遍历和find全量拉取的内存峰值
+local MongoDB    = import("driver/mongo.lua")
+local TestUtil   = import("qtest/test_util.lua")
+
+local log_info   = logger.info
+local check      = TestUtil.checker("mgocursor_test")
+local sformat    = string.format
+local smatch     = string.match
+local tonumber   = tonumber
+
+local thread_mgr = hive.get("thread_mgr")
+
+local PORT       = 16383
+local TOTAL      = 1000000
+local BATCH      = 1000
+
+--模拟服务: 集合名形如 "docs_<数量>", 文档按id顺序生成, 支持 find/getMore/killCursors
+local Standin = { cursors = {}, cursor_id = 0, killed = 0, sessions = {} }
+
+--测试中会主动full gc, 需要持有连接
+function Standin:on_accept(socket)
+    self.sessions[socket] = true
+end
+
+function Standin:on_error(socket)
+    self.sessions[socket] = nil
+end
+
+local function make_doc(i)
+    return { _id = i, name = sformat("player_%d", i), level = i % 100, gold = i * 7, items = { i, i + 1, i + 2 } }
+end
+
+function Standin:next_batch(cursor, size)
+    local docs = {}
+    local last = cursor.last
+    if size > 0 and cursor.pos + size - 1 < last then
+        last = cursor.pos + size - 1
+    end
+    for i = cursor.pos, last do
+        docs[#docs + 1] = make_doc(i)
+    end
+    cursor.pos = last + 1
+    if cursor.pos > cursor.last then
+        self.cursors[cursor.id] = nil
+        return docs, 0
+    end
+    return docs, cursor.id
+end
+
+function Standin:execute(socket, body)
+    if body.find then
+        local total = tonumber(smatch(body.find, "docs_(%d+)"))
+        local last  = total
+        if body.limit and body.limit > 0 and body.skip + body.limit < total then
+            last = body.skip + body.limit
+        end
+        self.cursor_id = self.cursor_id + 1
+        local cursor   = { id = self.cursor_id, pos = body.skip + 1, last = last, ns = body.find }
+        self.cursors[cursor.id] = cursor
+        local docs, id = self:next_batch(cursor, body.batchSize or 101)
+        return { ok = 1, cursor = { id = id, ns = body.find, firstBatch = docs } }
+    elseif body.getMore then
+        local cursor = self.cursors[body.getMore]
+        if not cursor then
+            return { ok = 0, errmsg = "cursor not found" }
+        end
+        local docs, id = self:next_batch(cursor, body.batchSize or 0)
+        return { ok = 1, cursor = { id = id, ns = cursor.ns, nextBatch = docs } }
+    elseif body.killCursors then
+        for _, id in ipairs(body.cursors) do
+            if self.cursors[id] then
+                self.cursors[id] = nil
+                self.killed      = self.killed + 1
+            end
+        end
+        return { ok = 1 }
+    end
+    return { ok = 1 }
+end
+
+local server = TestUtil.mongo_standin(PORT, Standin)
+
+--进程内存峰值(VmHWM), 单位KB
+local function peak_rss()
+    local file = io.open("/proc/self/status", "r")
+    if not file then
+        return 0
+    end
+    local peak = smatch(file:read("a"), "VmHWM:%s*(%d+)")
+    file:close()
+    return tonumber(peak) or 0
+end
+
+local function verify(db)
+    local ok, cursor = db:cursor("docs_2500", {}, nil, nil, nil, nil, BATCH)
+    check(ok, "cursor: {}", cursor)
+    local count, ordered = 0, true
+    for doc in cursor:iterator() do
+        count   = count + 1
+        ordered = ordered and doc._id == count
+    end
+    check(count == 2500 and ordered and not cursor:alive() and not cursor:get_err(), "iterate: {}", count)
+    --find仍返回完整结果, 受limit限制
+    local fok, docs = db:find("docs_2500", {}, nil, nil, 1200)
+    check(fok and #docs == 1200 and docs[1200]._id == 1200, "find limit: {}", fok and #docs)
+    --提前结束遍历, 关闭时释放服务端游标
+    local _, early = db:cursor("docs_2500", {}, nil, nil, nil, 10, 100)
+    for doc in early:iterator() do
+        if doc._id == 50 then
+            break
+        end
+    end
+    early:close()
+    --killCursors不等待应答, 同一连接上的ping返回时服务端已处理
+    db:runCommand("ping")
+    check(Standin.killed == 1 and not next(Standin.cursors), "kill cursor: {}", Standin.killed)
+    --getMore失败时结束遍历并记录错误
+    local _, lost = db:cursor("docs_2500", {}, nil, nil, nil, nil, 100)
+    Standin.cursors = {}
+    local lcount    = 0
+    for _ in lost:iterator() do
+        lcount = lcount + 1
+    end
+    check(lcount == 100 and lost:get_err() == "cursor not found", "lost cursor: {} {}", lcount, lost:get_err())
+end
+
+local function bench_cursor(db)
+    collectgarbage("collect")
+    local start, base, peak = hive.clock_ms, collectgarbage("count"), 0
+    local _, cursor = db:cursor(sformat("docs_%d", TOTAL), {}, nil, nil, nil, nil, BATCH)
+    local count, gold = 0, 0
+    for doc in cursor:iterator() do
+        count = count + 1
+        gold  = gold + doc.gold
+        if count % BATCH == 0 then
+            local mem = collectgarbage("count")
+            if mem > peak then
+                peak = mem
+            end
+        end
+    end
+    check(count == TOTAL and gold == 7 * TOTAL * (TOTAL + 1) // 2, "cursor count: {}", count)
+    return hive.clock_ms - start, (peak - base) // 1024, peak_rss() // 1024
+end
+
+local function bench_find(db)
+    collectgarbage("collect")
+    local start, base = hive.clock_ms, collectgarbage("count")
+    local ok, docs    = db:find(sformat("docs_%d", TOTAL), {}, nil, nil, TOTAL)
+    check(ok and #docs == TOTAL, "find count: {}", ok and #docs)
+    local peak = collectgarbage("count")
+    return hive.clock_ms - start, (peak - base) // 1024, peak_rss() // 1024
+end
+
+thread_mgr:fork(function()
+    if not server:listen() then
+        return
+    end
+    local db = MongoDB({ db = "mgocursor", user = "", passwd = "", opts = {}, hosts = { { "127.0.0.1", PORT } } })
+    while not db:available() do
+        thread_mgr:sleep(100)
+    end
+    db:set_executer(1)
+    --预热, 首个请求包含进程启动期的开销
+    db:runCommand("ping")
+    verify(db)
+    --VmHWM只增不减, 先测游标
+    local rss = peak_rss() // 1024
+    local ctime, cmem, crss = bench_cursor(db)
+    log_info("[mgocursor_test] cursor {} docs batch:{} time:{}ms lua peak:+{}MB rss peak:{}MB -> {}MB", TOTAL, BATCH, ctime, cmem, rss, crss)
+    local ftime, fmem, frss = bench_find(db)
+    log_info("[mgocursor_test] find   {} docs batch:{} time:{}ms lua peak:+{}MB rss peak:{}MB -> {}MB", TOTAL, BATCH, ftime, fmem, crss, frss)
+    db:close()
+    server:close()
+end)
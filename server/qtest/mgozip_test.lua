@@ -0,0 +1,155 @@
+-- mgozip_test.lua
+-- mongo OP_COMPRESSED: 压缩算法正确性, 以及模拟带宽受限链路下不同压缩算法的流量和耗时
+local MongoDB     = import("driver/mongo.lua")
+local TestUtil    = import("qtest/test_util.lua")
+
+local log_info    = logger.info
+local check       = TestUtil.checker("mgozip_test")
+local sformat     = string.format
+local srep        = string.rep
+local schar       = string.char
+local tconcat     = table.concat
+local oclock      = os.clock
+local bencode     = bson.encode
+local bcompress   = bson.compress
+local buncompress = bson.uncompress
+
+local thread_mgr  = hive.get("thread_mgr")
+local timer_mgr   = hive.get("timer_mgr")
+
+local PORT        = 16382
+local ROUNDS      = 10
+--模拟跨机房链路带宽: 10Mbps, 每毫秒字节数(定时器精度20ms, 带宽不宜过高)
+local BANDWIDTH   = 10 * 1000 * 1000 // 8 // 1000
+local ZIP_IDS     = { noop = 0, snappy = 1, zlib = 2 }
+
+--玩家存档: 大量结构相似的背包/任务/邮件记录
+local function build_player(uid, version)
+    local items, tasks, mails = {}, {}, {}
+    for i = 1, 2000 do
+        items[i] = { id = 10000 + i, count = i % 99 + 1, bind = i % 3 == 0, expire = 1700000000 + i * 60, attrs = { atk = i % 50, def = i % 30, crit = i % 7 } }
+    end
+    for i = 1, 300 do
+        tasks[i] = { id = 2000 + i, state = i % 4, progress = { i % 10, i % 5, version }, accept_time = 1700000000 + i }
+    end
+    for i = 1, 100 do
+        mails[i] = { id = i, title = "系统邮件", content = srep("恭喜获得活动奖励", 8), attach = { { 10001, 5 }, { 10002, i } }, read = false }
+    end
+    return { id = uid, version = version, name = sformat("player_%d", uid), level = 80, items = items, tasks = tasks, mails = mails }
+end
+
+local function test_codec()
+    local seed, random = 12345, {}
+    for i = 1, 70000 do
+        seed      = (seed * 1103515245 + 12345) % 2147483648
+        random[i] = schar(seed % 256)
+    end
+    local player = bencode(build_player(1, 1))
+    local cases  = { "", "a", srep("abcd", 3), tconcat(random), srep("0123456789", 20000), player }
+    for name in pairs(ZIP_IDS) do
+        for i, data in ipairs(cases) do
+            local zdata = bcompress(name, data)
+            check(buncompress(name, zdata, #data) == data, "{} case {} roundtrip", name, i)
+        end
+        local zplayer = bcompress(name, player)
+        log_info("[mgozip_test] {} player doc {} -> {} bytes", name, #player, #zplayer)
+    end
+    --截断/长度不符的数据必须报错
+    local zdata = bcompress("snappy", player)
+    check(not pcall(buncompress, "snappy", zdata:sub(1, #zdata // 2), #player), "snappy truncated")
+    check(not pcall(buncompress, "zlib", bcompress("zlib", player), #player + 1), "zlib size mismatch")
+end
+
+--模拟服务: 支持isMaster协商压缩, update/find, 按带宽延迟应答
+local Standin = { store = {}, sessions = {}, supports = { snappy = true, zlib = true } }
+
+function Standin:on_accept(socket)
+    self.sessions[socket] = { stat = { up = 0, down = 0 } }
+end
+
+function Standin:on_error(socket)
+    self.sessions[socket] = nil
+end
+
+function Standin:execute(socket, body)
+    if body.isMaster then
+        local reply = { ok = 1, ismaster = true, maxWireVersion = 17 }
+        for _, name in ipairs(body.compression or {}) do
+            if self.supports[name] then
+                reply.compression = { name }
+                break
+            end
+        end
+        return reply
+    elseif body.update then
+        local update     = body.updates[1]
+        self.store[update.q.id] = update.u
+        return { ok = 1, n = 1, nModified = 1 }
+    elseif body.find then
+        return { ok = 1, cursor = { id = 0, ns = body.find, firstBatch = { self.store[body.filter.id] } } }
+    end
+    return { ok = 1 }
+end
+
+--统计流量, 往返都按带宽计算传输时间
+function Standin:send(socket, data, len)
+    local stat  = self.sessions[socket].stat
+    stat.up     = stat.up + len
+    stat.down   = stat.down + #data
+    local delay = (len + #data) // BANDWIDTH
+    if delay > 0 then
+        timer_mgr:once(delay, function()
+            socket:send(data)
+        end)
+    else
+        socket:send(data)
+    end
+end
+
+function Standin:reset_stat(stat)
+    for _, session in pairs(self.sessions) do
+        session.stat = stat
+    end
+end
+
+local server = TestUtil.mongo_standin(PORT, Standin)
+
+local function bench(compressor)
+    local opts = compressor and { compressors = compressor } or {}
+    local db   = MongoDB({ db = "mgozip", user = "", passwd = "", opts = opts, hosts = { { "127.0.0.1", PORT } } })
+    while not db:available() do
+        thread_mgr:sleep(100)
+    end
+    db:set_executer(1)
+    db:runCommand("ping")
+    local stat = { up = 0, down = 0 }
+    Standin:reset_stat(stat)
+    local start, cpu, pass = hive.now_ms, oclock(), true
+    for i = 1, ROUNDS do
+        local player = build_player(i, i)
+        local ok     = db:update("player", player, { id = i }, true)
+        local fok, doc = db:find_one("player", { id = i })
+        if not (ok and fok and doc.version == i and #doc.items == 2000 and doc.mails[100].title == "系统邮件") then
+            pass = false
+        end
+    end
+    local wall = hive.now_ms - start
+    check(pass, "{} roundtrip", compressor)
+    log_info("[mgozip_test] {} rounds:{} pass:{} up:{}KB down:{}KB wall:{}ms({}ms/round) cpu:{}ms", compressor or "none", ROUNDS, pass,
+        stat.up // 1024, stat.down // 1024, wall, wall // ROUNDS, sformat("%.1f", (oclock() - cpu) * 1000))
+    db:close()
+end
+
+thread_mgr:fork(function()
+    test_codec()
+    if not server:listen() then
+        return
+    end
+    bench(nil)
+    bench("snappy")
+    bench("zlib")
+    --服务端不支持时回退为不压缩
+    Standin.supports = {}
+    bench("snappy,zlib")
+    server:close()
+end)
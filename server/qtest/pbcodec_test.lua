@@ -0,0 +1,124 @@
+-- pbcodec_test.lua
+-- pb协议编解码: 本地连接收发客户端常见的小包, 统计编码和解码的包量; 重新加载协议后按新定义解码
+local TestUtil    = import("qtest/test_util.lua")
+
+local log_info    = logger.info
+local check       = TestUtil.checker("pbcodec_test")
+local sformat     = string.format
+local oclock      = os.clock
+local eproto_type = luabus.eproto_type
+
+local thread_mgr  = hive.get("thread_mgr")
+
+local PORT        = 16384
+local TOTAL       = 300000
+local BATCH       = 2000
+
+local pb_message  = TestUtil.pb_message
+
+local function pb_schema(x_name)
+    return TestUtil.pb_file("qtest_pb.proto", "qtest_pb", {
+        pb_message("pos_info", { { x_name, 1, 5 }, { "y", 2, 5 } }),
+        pb_message("move_req", { { "role_id", 1, 4 }, { "pos", 2, 11, 1, ".qtest_pb.pos_info" }, { "dir", 3, 5 }, { "stamp", 4, 13 } }),
+        pb_message("chat_req", { { "channel", 1, 13 }, { "text", 2, 9 }, { "targets", 3, 4, 3 } }),
+        pb_message("heartbeat_req", { { "serial", 1, 13 }, { "time", 2, 13 } }),
+    })
+end
+
+local CMDS = {
+    { 9001, "qtest_pb.move_req", { role_id = 10086, pos = { x = 1024, y = -512 }, dir = 3, stamp = 123456 } },
+    { 9002, "qtest_pb.chat_req", { channel = 2, text = "hello world", targets = { 10001, 10002, 10003 } } },
+    { 9003, "qtest_pb.heartbeat_req", { serial = 99, time = 1700000000 } },
+}
+
+local function load_schema(x_name)
+    local ok = protobuf.load(pb_schema(x_name))
+    for _, cmd in ipairs(CMDS) do
+        protobuf.bind_cmd(cmd[1], cmd[2])
+    end
+    return ok
+end
+
+--codec由lua持有, socket只保存指针
+local PbcodecTest = { count = 0, bad = 0, codecs = { protobuf.pbcodec(), protobuf.pbcodec() } }
+
+function PbcodecTest:listen()
+    self.listener = luabus.listen("127.0.0.1", PORT, eproto_type.pb)
+    self.listener.set_codec(self.codecs[1])
+    self.listener.on_accept = function(session)
+        self.session            = session
+        session.on_call_pb      = function(recv_len, cmd_id, flag, session_id, seq_id, data)
+            self.count = self.count + 1
+            self.last  = data
+            if cmd_id == 9001 and data.pos.y ~= -512 then
+                self.bad = self.bad + 1
+            end
+            return 0
+        end
+        session.on_error        = function(token, err)
+        end
+    end
+end
+
+function PbcodecTest:connect()
+    local socket = luabus.connect("127.0.0.1", PORT, 2000, eproto_type.pb)
+    socket.set_codec(self.codecs[2])
+    socket.on_connect = function(res)
+        self.connected = (res == "ok")
+    end
+    socket.on_error   = function(token, err)
+    end
+    self.socket       = socket
+    while not self.connected or not self.session do
+        thread_mgr:sleep(10)
+    end
+end
+
+--分批发送, 每批等对端解码完成, 避免超出单连接每帧的处理时间被断开
+--编码耗时只统计call_pb, 其余为收包解码和回调
+function PbcodecTest:bench()
+    self.count, self.bad            = 0, 0
+    local socket                    = self.socket
+    local start, cpu, encode_cpu    = hive.clock_ms, oclock(), 0
+    for i = 1, TOTAL, BATCH do
+        local clock = oclock()
+        for j = i, i + BATCH - 1 do
+            local cmd = CMDS[j % 3 + 1]
+            socket.call_pb(cmd[1], 0, 0, 0, cmd[3])
+        end
+        encode_cpu = encode_cpu + oclock() - clock
+        while self.count < i + BATCH - 1 and hive.clock_ms - start < 30000 do
+            thread_mgr:sleep(1)
+        end
+    end
+    check(self.count == TOTAL and self.bad == 0, "recv: {} bad: {}", self.count, self.bad)
+    local decode_cpu = oclock() - cpu - encode_cpu
+    log_info("[pbcodec_test] {} pkts encode:{}ms {}K pkts/s, recv+decode:{}ms {}K pkts/s, wall:{}ms", TOTAL,
+        sformat("%.1f", encode_cpu * 1000), TOTAL // (encode_cpu * 1000), sformat("%.1f", decode_cpu * 1000), TOTAL // (decode_cpu * 1000), hive.clock_ms - start)
+end
+
+--重新加载协议后, 缓存的类型失效, 按新定义解码
+function PbcodecTest:reload()
+    protobuf.clear()
+    check(load_schema("px"), "reload schema")
+    self.count = 0
+    self.socket.call_pb(9001, 0, 0, 0, { role_id = 1, pos = { px = 7, y = 8 } })
+    while self.count < 1 do
+        thread_mgr:sleep(5)
+    end
+    check(self.last.pos.px == 7 and self.last.pos.x == nil, "reload decode: {}", self.last)
+end
+
+thread_mgr:fork(function()
+    if not check(load_schema("x"), "load schema") then
+        return
+    end
+    PbcodecTest:listen()
+    PbcodecTest:connect()
+    PbcodecTest:bench()
+    PbcodecTest:bench()
+    PbcodecTest:reload()
+    PbcodecTest.socket.close()
+    PbcodecTest.listener.close()
+    log_info("[pbcodec_test] done")
+end)
@@ -0,0 +1,148 @@
+-- pbzip_test.lua
+-- pb协议压缩: 校验压缩阈值/扩展包长/加密压缩组合, 对比背包列表类协议压缩前后的包大小和收发耗时
+local TestUtil    = import("qtest/test_util.lua")
+
+local log_info    = logger.info
+local check       = TestUtil.checker("pbzip_test")
+local sformat     = string.format
+local oclock      = os.clock
+local eproto_type = luabus.eproto_type
+
+local thread_mgr  = hive.get("thread_mgr")
+
+local PORT        = 16385
+local TOTAL       = 10000
+local BATCH       = 200
+local FLAG_ENC    = 0x04
+local FLAG_ZIP    = 0x08
+
+local pb_message  = TestUtil.pb_message
+
+local function pb_schema()
+    return TestUtil.pb_file("qtest_zip.proto", "qtest_zip", {
+        pb_message("item", { { "id", 1, 13 }, { "count", 2, 13 }, { "name", 3, 9 } }),
+        pb_message("bag_ntf", { { "serial", 1, 13 }, { "items", 2, 11, 3, ".qtest_zip.item" } }),
+    })
+end
+
+local function bag_ntf(serial, count)
+    local items = {}
+    for i = 1, count do
+        items[i] = { id = 100000 + i, count = i % 99 + 1, name = "item_" .. (i % 50) }
+    end
+    return { serial = serial, items = items }
+end
+
+--codec由lua持有, socket只保存指针
+local PbzipTest = { count = 0, bad = 0, recv_bytes = 0, codecs = { protobuf.pbcodec(), protobuf.pbcodec() } }
+
+function PbzipTest:listen()
+    self.listener = luabus.listen("127.0.0.1", PORT, eproto_type.pb)
+    self.listener.set_codec(self.codecs[1])
+    self.listener.on_accept = function(session)
+        self.session            = session
+        session.on_call_pb      = function(recv_len, cmd_id, flag, session_id, seq_id, data)
+            self.count      = self.count + 1
+            self.recv_bytes = self.recv_bytes + recv_len
+            self.last       = { recv_len = recv_len, flag = flag, data = data }
+            if #data.items ~= self.expect then
+                self.bad = self.bad + 1
+            end
+            return 0
+        end
+        session.on_error        = function(token, err)
+        end
+    end
+end
+
+function PbzipTest:connect()
+    local socket = luabus.connect("127.0.0.1", PORT, 2000, eproto_type.pb)
+    socket.set_codec(self.codecs[2])
+    socket.on_connect = function(res)
+        self.connected = (res == "ok")
+    end
+    socket.on_error   = function(token, err)
+    end
+    self.socket       = socket
+    while not self.connected or not self.session do
+        thread_mgr:sleep(10)
+    end
+end
+
+function PbzipTest:send_one(flag, count)
+    self.count, self.expect = 0, count
+    local send_len = self.socket.call_pb(9101, flag, 0, 0, bag_ntf(1, count))
+    while self.count < 1 do
+        thread_mgr:sleep(5)
+    end
+    local last = self.last
+    local items = last.data.items
+    check(#items == count and items[count].id == 100000 + count and items[count].name == "item_" .. (count % 50), "items: {}", count)
+    return send_len, last
+end
+
+function PbzipTest:verify()
+    --小于阈值不压缩, 清除压缩标记
+    local _, small = self:send_one(FLAG_ZIP, 4)
+    check(small.flag & FLAG_ZIP == 0, "small flag: {}", small.flag)
+    --压缩后包长不超过uint16
+    local zip_len, zip = self:send_one(FLAG_ZIP, 5000)
+    check(zip.flag & FLAG_ZIP ~= 0 and zip_len < 0xffff, "zip len: {}", zip_len)
+    --不压缩的大包使用扩展包长
+    local big_len, big = self:send_one(0, 5000)
+    check(big.flag & FLAG_ZIP == 0 and big_len > 0xffff and big.recv_len + 16 == big_len, "big len: {}", big_len)
+    --加密和压缩同时使用
+    local enc_len, enc = self:send_one(FLAG_ZIP | FLAG_ENC, 20000)
+    check(enc.flag == FLAG_ZIP | FLAG_ENC and enc_len > 0, "encrypt zip len: {}", enc_len)
+    --超出单包上限
+    check(self.socket.call_pb(9101, 0, 0, 0, bag_ntf(1, 300000)) < 0, "packet max")
+    log_info("[pbzip_test] bag 5000 items raw:{} zip:{}", big_len, zip_len)
+    local stats = protobuf.zip_stats()[9101]
+    check(stats and stats.zip_count == 2 and stats.unzip_count == 2, "zip stats: {}", stats)
+end
+
+--分批发送, 每批等对端解码完成, 避免超出单连接每帧的处理时间被断开
+function PbzipTest:bench(flag, items)
+    self.count, self.bad, self.recv_bytes, self.expect = 0, 0, 0, items
+    local socket                                       = self.socket
+    local data                                         = bag_ntf(1, items)
+    local start, cpu, encode_cpu                       = hive.clock_ms, oclock(), 0
+    for i = 1, TOTAL, BATCH do
+        local clock = oclock()
+        for j = i, i + BATCH - 1 do
+            data.serial = j
+            socket.call_pb(9101, flag, 0, 0, data)
+        end
+        encode_cpu = encode_cpu + oclock() - clock
+        while self.count < i + BATCH - 1 and hive.clock_ms - start < 30000 do
+            thread_mgr:sleep(1)
+        end
+    end
+    check(self.count == TOTAL and self.bad == 0, "recv: {} bad: {}", self.count, self.bad)
+    local decode_cpu = oclock() - cpu - encode_cpu
+    log_info("[pbzip_test] {} pkts {} items zip:{} bytes:{} encode:{}ms recv+decode:{}ms wall:{}ms", TOTAL, items, flag & FLAG_ZIP ~= 0, self.recv_bytes,
+        sformat("%.1f", encode_cpu * 1000), sformat("%.1f", decode_cpu * 1000), hive.clock_ms - start)
+end
+
+thread_mgr:fork(function()
+    if not check(protobuf.load(pb_schema()), "load schema") then
+        return
+    end
+    protobuf.bind_cmd(9101, "qtest_zip.bag_ntf")
+    protobuf.zip_init(512)
+    protobuf.zip_stats()
+    PbzipTest:listen()
+    PbzipTest:connect()
+    PbzipTest:verify()
+    for _, items in ipairs({ 50, 200 }) do
+        PbzipTest:bench(0, items)
+        PbzipTest:bench(FLAG_ZIP, items)
+    end
+    for cmd_id, stat in pairs(protobuf.zip_stats()) do
+        log_info("[pbzip_test] cmd:{} zip:{} ratio:{} zip_cost:{}ns unzip_cost:{}ns", cmd_id, stat.zip_count, sformat("%.3f", stat.zip_bytes / stat.zip_raw),
+            stat.zip_ns // (stat.zip_count + stat.zip_skip), stat.unzip_ns // stat.unzip_count)
+    end
+    PbzipTest.socket.close()
+    PbzipTest.listener.close()
+    log_info("[pbzip_test] done")
+end)
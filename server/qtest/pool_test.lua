@@ -0,0 +1,72 @@
+-- pool_test.lua
+-- 任务池: 1/2/4个成员执行不均匀的计算任务, 统计吞吐和窃取次数
+local ltimer     = require("ltimer")
+local log_info   = logger.info
+local log_err    = logger.err
+local sformat    = string.format
+
+local lclock_ms  = ltimer.clock_ms
+local lclock_us  = ltimer.clock_us
+
+local scheduler  = hive.get("scheduler")
+local thread_mgr = hive.get("thread_mgr")
+
+local JOB_COUNT  = 2000
+local JOB_COST   = 20000   --单个任务的循环次数
+local MEMBERS    = { 1, 2, 4 }
+
+local function expect(cost)
+    local sum = 0
+    for i = 1, cost do
+        sum = (sum + i * i) % 1000000007
+    end
+    return sum
+end
+
+local function run_pool(members)
+    local name = sformat("pool_%d", members)
+    if not scheduler:startup_pool(name, "qtest.pool_worker", members) then
+        return
+    end
+    --等待成员加载完成
+    local deadline = lclock_ms() + 3000
+    while lclock_ms() < deadline do
+        scheduler:update(lclock_ms())
+    end
+    local results = { [JOB_COST] = expect(JOB_COST), [JOB_COST * 8] = expect(JOB_COST * 8) }
+    local done, failed, threads = 0, 0, {}
+    local start = lclock_us()
+    for i = 1, JOB_COUNT do
+        --每8个任务有1个重任务, 轮询分配后各成员负载不均
+        local cost = (i % 8 == 0) and JOB_COST * 8 or JOB_COST
+        thread_mgr:fork(function()
+            local ok, sum, title = scheduler:submit(name, "rpc_pool_job", cost)
+            if ok and sum == results[cost] then
+                threads[title] = (threads[title] or 0) + 1
+            else
+                failed = failed + 1
+            end
+            done = done + 1
+        end)
+    end
+    deadline = lclock_ms() + 120000
+    while done < JOB_COUNT and lclock_ms() < deadline do
+        scheduler:update(lclock_ms())
+        luabus.wait(lclock_ms(), 10)
+    end
+    local cost = lclock_us() - start
+    local stat = hive.worker_stats()[name]
+    log_info("[pool_test] members:{} jobs:{}/{} failed:{} {} jobs/s steals:{} pending:{}",
+        members, done, JOB_COUNT, failed, sformat("%.0f", done * 1000000 / cost), stat.steals, stat.pending)
+    for title, count in pairs(threads) do
+        log_info("[pool_test] members:{} {} executed:{}", members, title, count)
+    end
+    hive.worker_shutdown()
+end
+
+if expect(3) ~= 14 then
+    log_err("[pool_test] expect failed")
+end
+for _, members in ipairs(MEMBERS) do
+    run_pool(members)
+end
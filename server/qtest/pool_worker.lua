@@ -0,0 +1,21 @@
+--pool_worker.lua
+--pool_test的任务池成员
+local PoolWorker = singleton()
+
+function PoolWorker:__init()
+    local event_mgr = hive.get("event_mgr")
+    event_mgr:add_listener(self, "rpc_pool_job")
+end
+
+--模拟无状态的计算任务, 返回计算结果和执行线程
+function PoolWorker:rpc_pool_job(cost)
+    local sum = 0
+    for i = 1, cost do
+        sum = (sum + i * i) % 1000000007
+    end
+    return sum, hive.title
+end
+
+hive.startup(function()
+    hive.pool_worker = PoolWorker()
+end)
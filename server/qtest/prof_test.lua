@@ -0,0 +1,172 @@
+-- prof_test.lua
+-- 采样分析: 校验self/total比例/协程和worker的栈/停止后不再采样, 对比开启前后的执行耗时
+local TestUtil   = import("qtest/test_util.lua")
+
+local log_info   = logger.info
+local check      = TestUtil.checker("prof_test")
+local sformat    = string.format
+local sfind      = string.find
+local oclock     = os.clock
+
+local event_mgr  = hive.get("event_mgr")
+local thread_mgr = hive.get("thread_mgr")
+local scheduler  = hive.get("scheduler")
+local prof_mgr   = hive.get("prof_mgr")
+
+local WORKER     = "prof_1"
+local BURN       = 2000000
+
+--热点函数: hot_a的计算量是hot_b的2倍
+local function hot_a(n)
+    local sum = 0
+    for i = 1, n * 2 do
+        sum = sum + (i * i) % 7
+    end
+    return sum
+end
+
+local function hot_b(n)
+    local sum = 0
+    for i = 1, n do
+        sum = sum + (i * i) % 7
+    end
+    return sum
+end
+
+local function hot_deep(depth, n)
+    if depth > 0 then
+        --避免尾调用丢失栈帧
+        local sum = hot_deep(depth - 1, n)
+        return sum
+    end
+    local sum = hot_b(n)
+    return sum
+end
+
+local function workload(rounds)
+    local sum = 0
+    for _ = 1, rounds do
+        sum = sum + hot_a(10000) + hot_b(10000)
+    end
+    return sum
+end
+
+local ProfTest = singleton()
+
+function ProfTest:__init()
+    self.burned = 0
+    event_mgr:add_listener(self, "rpc_prof_burned")
+end
+
+function ProfTest:rpc_prof_burned()
+    self.burned = self.burned + 1
+end
+
+function ProfTest:wait(cond, timeout)
+    local start = hive.clock_ms
+    while not cond() and hive.clock_ms - start < (timeout or 10000) do
+        thread_mgr:sleep(10)
+    end
+end
+
+function ProfTest:find(funcs, prefix)
+    for _, func in ipairs(funcs) do
+        if sfind(func.name, prefix, 1, true) == 1 then
+            return func
+        end
+    end
+    return { self = 0, total = 0 }
+end
+
+function ProfTest:verify()
+    --采样不替换已有的钩子, 停止后恢复
+    local hooks = 0
+    local function user_hook()
+        hooks = hooks + 1
+    end
+    debug.sethook(user_hook, "", 1000)
+    check(prof_mgr:start(200), "start")
+    scheduler:broadcast("rpc_prof_start", 200)
+    thread_mgr:sleep(100)
+    check(profiler.running(), "running")
+    workload(1000)
+    --协程中的栈
+    local co_done = false
+    thread_mgr:fork(function()
+        hot_deep(10, 2000000)
+        co_done = true
+    end)
+    self:wait(function() return co_done end)
+    scheduler:send(WORKER, "rpc_prof_burn", BURN * 5)
+    self:wait(function() return self.burned == 1 end)
+    local result = prof_mgr:dump(200)
+    local funcs  = result.funcs
+    local a, b   = self:find(funcs, "hot_a"), self:find(funcs, "hot_b")
+    local deep   = self:find(funcs, "hot_deep")
+    --hot_deep下的hot_b不计入比例
+    local b_self = b.self - deep.total
+    local ratio  = b_self > 0 and a.self / b_self or 0
+    local burn   = self:find(funcs, "worker_burn")
+    log_info("[prof_test] samples:{} hot_a:{} hot_b:{} ratio:{} hot_deep total:{} worker_burn:{} file:{}", result.samples,
+        a.self, b.self, sformat("%.2f", ratio), deep.total, burn.self, result.file)
+    check(result.samples > 0 and ratio > 1.2 and ratio < 3, "hot ratio: {}", ratio)
+    --递归只计一次total
+    check(deep.total > 0 and deep.total <= b.total and deep.self == 0, "recursion: {}", deep)
+    --同一函数不因调用处的名字不同拆成多条
+    local hot_b_id = sformat("prof_test.lua:%d)", debug.getinfo(hot_b, "S").linedefined)
+    local entries  = 0
+    for _, func in ipairs(funcs) do
+        if sfind(func.name, hot_b_id, 1, true) then
+            entries = entries + 1
+        end
+    end
+    check(entries == 1, "hot_b entries: {}", entries)
+    check(burn.self > 0, "worker stack: {}", burn)
+    local file    = io.open(result.file)
+    local folded  = file and file:read("a") or ""
+    if file then
+        file:close()
+    end
+    check(sfind(folded, "hive;[coroutine];", 1, true) and sfind(folded, WORKER .. ";", 1, true), "folded")
+    --停止后不再采样
+    prof_mgr:stop()
+    scheduler:broadcast("rpc_prof_stop")
+    thread_mgr:sleep(100)
+    profiler.reset()
+    workload(50)
+    local _, samples = profiler.dump()
+    check(not profiler.running() and samples == 0, "stop: {}", samples)
+    local hook, mask, count = debug.gethook()
+    check(hook == user_hook and mask == "" and count == 1000 and hooks > 0, "user hook: {} {} {}", mask, count, hooks)
+    debug.sethook()
+    for i = 1, 10 do
+        log_info("[prof_test] top{} {}", i, funcs[i])
+    end
+end
+
+--开启采样前后的耗时
+function ProfTest:bench()
+    local clock = oclock()
+    workload(1000)
+    local base = oclock() - clock
+    for _, interval in ipairs({ 1000, 100 }) do
+        prof_mgr:start(interval)
+        clock = oclock()
+        workload(1000)
+        local cost = oclock() - clock
+        prof_mgr:stop()
+        local _, samples = profiler.dump()
+        profiler.reset()
+        log_info("[prof_test] workload base:{}ms interval:{}us cost:{}ms overhead:{}% samples:{}", sformat("%.1f", base * 1000),
+            interval, sformat("%.1f", cost * 1000), sformat("%.2f", (cost - base) * 100 / base), samples)
+    end
+end
+
+local test = ProfTest()
+scheduler:startup(WORKER, "qtest.prof_worker")
+thread_mgr:fork(function()
+    thread_mgr:sleep(2000)
+    test:verify()
+    test:bench()
+    log_info("[prof_test] done")
+end)
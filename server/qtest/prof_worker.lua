@@ -0,0 +1,24 @@
+--prof_worker.lua
+--prof_test的worker线程, 收到消息后执行固定计算量
+local ProfWorker = singleton()
+
+function ProfWorker:__init()
+    local event_mgr = hive.get("event_mgr")
+    event_mgr:add_listener(self, "rpc_prof_burn")
+end
+
+local function worker_burn(n)
+    local sum = 0
+    for i = 1, n do
+        sum = sum + (i * i) % 7
+    end
+    return sum
+end
+
+function ProfWorker:rpc_prof_burn(n)
+    hive.send_master("rpc_prof_burned", worker_burn(n))
+end
+
+hive.startup(function()
+    hive.prof_worker = ProfWorker()
+end)
@@ -0,0 +1,105 @@
+-- rdsparse_test.lua
+-- redis应答在任意位置拆包时的解析: worker线程模拟redis服务, 随机切分应答分段发送
+local Socket     = import("driver/socket.lua")
+
+local log_info   = logger.info
+local log_err    = logger.err
+local sformat    = string.format
+local srep       = string.rep
+local oclock     = os.clock
+local rediscodec = codec.rediscodec
+local jsoncodec  = json.jsoncodec
+
+local event_mgr  = hive.get("event_mgr")
+local thread_mgr = hive.get("thread_mgr")
+local scheduler  = hive.get("scheduler")
+
+local PORT       = 16379
+local ROUNDS     = 5
+local FIELDS     = 8000
+
+--与rdsparse_worker中的应答一致
+local BIG_VALUE  = srep("a\r\nb", 256 * 1024)
+local CASES      = { "hgetall", "get", "hello", "attr", "blob", "push" }
+
+local RdsparseTest = singleton()
+
+function RdsparseTest:__init()
+    self.pushes = {}
+    self.socket = Socket(self)
+    event_mgr:add_listener(self, "rpc_rdsparse_ready")
+    scheduler:startup("rdsparse", "qtest.rdsparse_worker")
+    scheduler:send("rdsparse", "rpc_rdsparse_serve", PORT)
+end
+
+function RdsparseTest:rpc_rdsparse_ready()
+    thread_mgr:fork(function()
+        local ok, err = self.socket:connect("127.0.0.1", PORT)
+        if not ok then
+            log_err("[rdsparse_test] connect failed: {}", err)
+            return
+        end
+        self.socket:set_codec(rediscodec(jsoncodec()))
+        self:run()
+        self.socket:close()
+    end)
+end
+
+function RdsparseTest:request(cmd)
+    local session_id = thread_mgr:build_session_id()
+    self.socket:send_data(session_id, cmd)
+    return thread_mgr:yield(session_id, "rdsparse", 30000)
+end
+
+function RdsparseTest:on_socket_recv(socket, session_id, succ, res)
+    if session_id > 0 then
+        thread_mgr:response(session_id, succ, res)
+        return
+    end
+    self.pushes[#self.pushes + 1] = res
+end
+
+function RdsparseTest:on_socket_error(socket, token, err)
+    log_err("[rdsparse_test] socket error: {}", err)
+end
+
+function RdsparseTest:check(cmd, ok, res)
+    if cmd == "hgetall" then
+        return ok and #res == FIELDS * 2 and res[FIELDS * 2] == sformat("%06d:%s", FIELDS, srep("v", 100))
+    elseif cmd == "get" then
+        return ok and res == BIG_VALUE
+    elseif cmd == "hello" then
+        local misc = res.misc
+        return ok and res.name == "hello" and res.flags[1] == true and res.flags[2] == false
+            and misc[1] == nil and misc[2] == 3.5 and misc[3] == "12345678901234567890" and misc[4] == "abcd" and misc[5] == -7
+    elseif cmd == "attr" then
+        return ok and res == "OK"
+    elseif cmd == "blob" then
+        return ok == false and res == "ERR failure"
+    elseif cmd == "push" then
+        local push = self.pushes[#self.pushes]
+        return ok and res == "PONG" and push and push[1] == "message" and push[3] == "msg"
+    end
+end
+
+--cpu为进程耗时, 服务线程大部分时间在sleep, 基本是客户端收包和解析的开销
+function RdsparseTest:run()
+    for i, cmd in ipairs(CASES) do
+        local cost, wall, pass = 0, 0, true
+        local rounds = i <= 2 and ROUNDS or 1
+        for _ = 1, rounds do
+            local cpu, start = oclock(), hive.now_ms
+            local ok, res = self:request(cmd)
+            cost = cost + (oclock() - cpu)
+            wall = wall + (hive.now_ms - start)
+            if not self:check(cmd, ok, res) then
+                pass = false
+                log_err("[rdsparse_test] {} check failed: {}, {}", cmd, ok, res)
+            end
+        end
+        log_info("[rdsparse_test] {} rounds:{} pass:{} cpu:{}ms wall:{}ms", cmd, rounds, pass,
+            sformat("%.1f", cost * 1000 / rounds), wall // rounds)
+    end
+end
+
+RdsparseTest()
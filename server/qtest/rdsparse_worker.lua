@@ -0,0 +1,92 @@
+--rdsparse_worker.lua
+--rdsparse_test的模拟redis服务线程: 阻塞收发, 应答随机切分后逐段发送
+local ltimer     = require("ltimer")
+local smatch     = string.match
+local ssub       = string.sub
+local srep       = string.rep
+local sformat    = string.format
+local tconcat    = table.concat
+local mrandom    = math.random
+local lsleep     = ltimer.sleep
+
+local CHUNK_MAX  = 16 * 1024
+local FIELDS     = 8000
+
+local function bulk(str)
+    return sformat("$%d\r\n%s\r\n", #str, str)
+end
+
+--HGETALL形式的应答: 2*FIELDS个字符串, 约1M
+local function hgetall_reply()
+    local parts = { sformat("*%d\r\n", FIELDS * 2) }
+    for i = 1, FIELDS do
+        parts[#parts + 1] = bulk(sformat("field:%06d", i))
+        parts[#parts + 1] = bulk(sformat("%06d:%s", i, srep("v", 100)))
+    end
+    return tconcat(parts)
+end
+
+--字符串内容包含\r\n, 只能按长度截取
+local BIG_VALUE  = srep("a\r\nb", 256 * 1024)
+
+local RESP3_REPLY = tconcat({
+    "%3\r\n",
+    "+name\r\n", "$5\r\nhello\r\n",
+    "+flags\r\n", "~2\r\n#t\r\n#f\r\n",
+    "+misc\r\n", "*5\r\n_\r\n,3.5\r\n(12345678901234567890\r\n=8\r\ntxt:abcd\r\n:-7\r\n",
+})
+
+local REPLIES = {
+    hgetall = hgetall_reply(),
+    get = bulk(BIG_VALUE),
+    hello = RESP3_REPLY,
+    attr = "|1\r\n+ttl\r\n:100\r\n+OK\r\n",
+    blob = "!11\r\nERR failure\r\n",
+    push = ">3\r\n+message\r\n+chan\r\n$3\r\nmsg\r\n+PONG\r\n",
+}
+
+local RdsparseWorker = singleton()
+
+function RdsparseWorker:__init()
+    local event_mgr = hive.get("event_mgr")
+    event_mgr:add_listener(self, "rpc_rdsparse_serve")
+end
+
+local function send_chunks(client, data)
+    local pos = 1
+    local chunk_max = #data > CHUNK_MAX and CHUNK_MAX or 3
+    while pos <= #data do
+        local len = mrandom(1, chunk_max)
+        local chunk = ssub(data, pos, pos + len - 1)
+        client.send(chunk, #chunk)
+        pos = pos + len
+        --让出CPU, 保证每段单独到达客户端
+        lsleep(1)
+    end
+end
+
+--按请求的命令名回复, 客户端断开后结束
+function RdsparseWorker:rpc_rdsparse_serve(port)
+    local tcp = luabus.tcp()
+    tcp.listen("127.0.0.1", port)
+    hive.send_master("rpc_rdsparse_ready")
+    local client
+    while not client do
+        client = tcp.accept(1000)
+    end
+    while true do
+        local ok, buf = client.recv(1000)
+        if ok then
+            local cmd = smatch(buf, "\r\n(%a+)\r\n$")
+            send_chunks(client, REPLIES[cmd])
+        elseif buf ~= "timeout" then
+            break
+        end
+    end
+    client.close()
+    tcp.close()
+end
+
+hive.startup(function()
+    hive.rdsparse_worker = RdsparseWorker()
+end)
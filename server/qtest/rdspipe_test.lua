@@ -0,0 +1,209 @@
+-- rdspipe_test.lua
+-- redis管道/事务: 本地模拟redis服务, 对比逐条提交和批量提交的吞吐
+local Socket     = import("driver/socket.lua")
+local RedisDB    = import("driver/redis.lua")
+local TestUtil   = import("qtest/test_util.lua")
+
+local log_info   = logger.info
+local check      = TestUtil.checker("rdspipe_test")
+local sformat    = string.format
+local sfind      = string.find
+local ssub       = string.sub
+local supper     = string.upper
+local tconcat    = table.concat
+local tonumber   = tonumber
+
+local thread_mgr = hive.get("thread_mgr")
+
+local PORT       = 16380
+local COUNT      = 2000
+local BATCH      = 50
+
+--模拟服务: 支持 PING/SET/GET/INCR/DEL/MULTI/EXEC/DISCARD, PUSHME在应答前插入一条RESP3的push消息
+--class模板按文件区分, 这里用普通表作为socket的host
+local Standin = { store = {}, sessions = {} }
+
+function Standin:listen()
+    self.listener = Socket(self)
+    return self.listener:listen("127.0.0.1", PORT)
+end
+
+function Standin:on_socket_accept(socket)
+    self.sessions[socket] = { queue = nil }
+end
+
+function Standin:on_socket_error(socket)
+    self.sessions[socket] = nil
+end
+
+local function bulk(value)
+    if value == nil then
+        return "$-1\r\n"
+    end
+    return sformat("$%d\r\n%s\r\n", #value, value)
+end
+
+function Standin:execute(args)
+    local cmd, key = supper(args[1]), args[2]
+    if cmd == "PING" then
+        return "+PONG\r\n"
+    elseif cmd == "PUSHME" then
+        return ">2\r\n$7\r\nmessage\r\n" .. bulk(key) .. "+OK\r\n"
+    elseif cmd == "SET" then
+        self.store[key] = args[3]
+        return "+OK\r\n"
+    elseif cmd == "GET" then
+        return bulk(self.store[key])
+    elseif cmd == "INCR" then
+        local value = (tonumber(self.store[key]) or 0) + 1
+        self.store[key] = tostring(value)
+        return sformat(":%d\r\n", value)
+    elseif cmd == "DEL" then
+        local exist = self.store[key] and 1 or 0
+        self.store[key] = nil
+        return sformat(":%d\r\n", exist)
+    end
+    return sformat("-ERR unknown command '%s'\r\n", args[1])
+end
+
+function Standin:dispatch(session, args)
+    local cmd = supper(args[1])
+    if cmd == "MULTI" then
+        session.queue = {}
+        return "+OK\r\n"
+    elseif cmd == "DISCARD" then
+        session.queue = nil
+        return "+OK\r\n"
+    elseif cmd == "EXEC" then
+        local queue = session.queue or {}
+        session.queue = nil
+        local replies = { sformat("*%d\r\n", #queue) }
+        for _, qargs in ipairs(queue) do
+            replies[#replies + 1] = self:execute(qargs)
+        end
+        return tconcat(replies)
+    end
+    if session.queue then
+        session.queue[#session.queue + 1] = args
+        return "+QUEUED\r\n"
+    end
+    return self:execute(args)
+end
+
+--解析一条完整的请求, 不完整时返回nil
+local function read_request(buf, pos)
+    local s, e, argc = sfind(buf, "^%*(%d+)\r\n", pos)
+    if not s then
+        return
+    end
+    local args = {}
+    pos = e + 1
+    for i = 1, tonumber(argc) do
+        local s2, e2, len = sfind(buf, "^%$(%d+)\r\n", pos)
+        if not s2 then
+            return
+        end
+        len = tonumber(len)
+        if e2 + len + 2 > #buf then
+            return
+        end
+        args[i] = ssub(buf, e2 + 1, e2 + len)
+        pos = e2 + len + 3
+    end
+    return args, pos
+end
+
+function Standin:on_socket_recv(socket)
+    local session = self.sessions[socket]
+    local buf, pos = socket.recvbuf, 1
+    local replies = {}
+    while true do
+        local args, npos = read_request(buf, pos)
+        if not args then
+            break
+        end
+        replies[#replies + 1] = self:dispatch(session, args)
+        pos = npos
+    end
+    socket:pop(pos - 1)
+    if #replies > 0 then
+        socket:send(tconcat(replies))
+    end
+end
+
+local function bench_sequential(db)
+    local start = hive.clock_ms
+    for i = 1, COUNT do
+        db:execute("set", sformat("seq:%d", i), i)
+    end
+    return hive.clock_ms - start
+end
+
+local function bench_pipeline(db)
+    local start = hive.clock_ms
+    for i = 1, COUNT, BATCH do
+        local cmds = {}
+        for j = i, i + BATCH - 1 do
+            cmds[#cmds + 1] = { "set", sformat("pipe:%d", j), j }
+        end
+        db:pipeline(cmds)
+    end
+    return hive.clock_ms - start
+end
+
+local function verify(db)
+    local ok, res, errs = db:pipeline({
+        { "set", "k1", "v1" }, { "get", "k1" }, { "incr", "counter" }, { "bogus", "x" }, { "get", "missing" },
+    })
+    check(ok and res[1] == "OK" and res[2] == "v1" and res[3] == 1, "pipeline results: {}", res)
+    check(errs and errs[4] and not errs[1] and res[4] == errs[4], "pipeline errs: {}", errs)
+    check(res[5] == nil, "pipeline nil: {}", res[5])
+    local mok, mres = db:multi({ { "incr", "counter" }, { "incr", "counter" }, { "get", "k1" } })
+    check(mok and mres[1] == 2 and mres[2] == 3 and mres[3] == "v1", "multi results: {}", mres)
+    --批量和单条交错时session对应正确
+    thread_mgr:fork(function()
+        local ok2, res2 = db:execute("get", "k1")
+        check(ok2 and res2 == "v1", "interleave single: {}", res2)
+    end)
+    local pok, pres = db:pipeline({ { "get", "k1" }, { "ping" } })
+    check(pok and pres[1] == "v1" and pres[2] == "PONG", "interleave pipeline: {}", pres)
+    --单条命令的管道同样返回结果数组
+    local sok, sres, serrs = db:pipeline({ { "get", "k1" } })
+    check(sok and type(sres) == "table" and sres[1] == "v1" and not serrs, "single pipeline: {}", sres)
+    sok, sres, serrs = db:pipeline({ { "bogus", "x" } })
+    check(sok and serrs and serrs[1] and sres[1] == serrs[1], "single pipeline err: {}", serrs)
+    --push消息不计入批量应答数, 单独或随批量应答交给订阅处理
+    local pushes = {}
+    db.do_socket_recv = function(_, res)
+        if type(res) == "table" and res[1] == "message" then
+            pushes[#pushes + 1] = res[2]
+        end
+    end
+    db.subscrible = true
+    local bok, bres = db:pipeline({ { "get", "k1" }, { "pushme", "mid" }, { "ping" } })
+    check(bok and bres[1] == "v1" and bres[2] == "OK" and bres[3] == "PONG" and #bres == 3, "push mid batch: {}", bres)
+    bok, bres = db:pipeline({ { "pushme", "head" }, { "get", "k1" } })
+    check(bok and bres[1] == "OK" and bres[2] == "v1" and #bres == 2, "push before batch: {}", bres)
+    thread_mgr:sleep(100)
+    db.subscrible = false
+    check(#pushes == 2 and pushes[1] == "mid" and pushes[2] == "head", "pushes: {}", pushes)
+end
+
+thread_mgr:fork(function()
+    if not Standin:listen() then
+        return
+    end
+    local db = RedisDB({ db = "rdspipe", passwd = "", opts = {}, hosts = { { "127.0.0.1", PORT } } })
+    while not db:available() do
+        thread_mgr:sleep(100)
+    end
+    verify(db)
+    local seq = bench_sequential(db)
+    local pipe = bench_pipeline(db)
+    log_info("[rdspipe_test] {} cmds sequential:{}ms {} ops/s", COUNT, seq, COUNT * 1000 // math.max(seq, 1))
+    log_info("[rdspipe_test] {} cmds pipeline({}):{}ms {} ops/s", COUNT, BATCH, pipe, COUNT * 1000 // math.max(pipe, 1))
+    local ok, res = db:execute("get", sformat("pipe:%d", COUNT))
+    check(ok and res == tostring(COUNT), "pipeline write: {}", res)
+    db:close()
+    Standin.listener:close()
+end)
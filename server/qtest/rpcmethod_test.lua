@@ -0,0 +1,133 @@
+-- rpcmethod_test.lua
+-- rpc方法编号: 校验协商/新方法登记/混发名字和编号, 对比100万次调用的包头字节和发送+分发耗时
+local TestUtil   = import("qtest/test_util.lua")
+
+local log_info   = logger.info
+local check      = TestUtil.checker("rpcmethod_test")
+local sformat    = string.format
+local oclock     = os.clock
+
+local thread_mgr = hive.get("thread_mgr")
+
+local PORT       = 16387
+local TOTAL      = 1000000
+local BATCH      = 20000
+local FLAG_REQ   = hive.enum("FlagMask", "REQ")
+local METHODS    = {
+    "rpc_cache_update", "rpc_cache_flush", "rpc_player_login", "rpc_player_logout",
+    "rpc_sync_attrs", "rpc_heartbeat", "rpc_router_update", "rpc_mongo_find",
+}
+
+local RpcmethodTest = { count = 0, bytes = 0, bad = 0, recvs = {} }
+
+function RpcmethodTest:listen()
+    self.listener = luabus.listen("127.0.0.1", PORT)
+    self.listener.on_accept = function(session)
+        self.session = session
+        session.on_call  = function(recv_len, session_id, rpc_flag, source, rpc, a, b, c)
+            self.count = self.count + 1
+            self.bytes = self.bytes + recv_len
+            self.last  = { rpc = rpc, flag = rpc_flag, a = a, b = b, c = c }
+            if rpc_flag ~= FLAG_REQ or b ~= "hero" then
+                self.bad = self.bad + 1
+            end
+        end
+        session.on_error = function(token, err)
+            self.server_error = err
+        end
+    end
+end
+
+function RpcmethodTest:connect()
+    local socket = luabus.connect("127.0.0.1", PORT, 2000)
+    socket.on_connect = function(res)
+        self.connected = (res == "ok")
+    end
+    socket.on_call    = function(recv_len, session_id, rpc_flag, source, rpc, ...)
+        self.recvs[#self.recvs + 1] = { rpc = rpc, flag = rpc_flag, args = { ... } }
+    end
+    socket.on_error   = function(token, err)
+        self.client_error = err
+    end
+    self.socket = socket
+    while not self.connected or not self.session do
+        thread_mgr:sleep(10)
+    end
+end
+
+function RpcmethodTest:wait(count)
+    local start = hive.clock_ms
+    while self.count < count and hive.clock_ms - start < 10000 do
+        thread_mgr:sleep(1)
+    end
+end
+
+function RpcmethodTest:send(rpc, a)
+    local send_len = self.socket.call(0, FLAG_REQ, hive.id, rpc, a, "hero", { 1, 2, 3 })
+    self:wait(self.count + 1)
+    local last = self.last
+    check(last.rpc == rpc and last.a == a and last.c[3] == 3, "send {}: {}", rpc, last)
+    return send_len
+end
+
+function RpcmethodTest:verify()
+    --未协商时发送方法名
+    local name_len = self:send("rpc_cache_update", 1)
+    --服务端开启后回发, 客户端收到编号后自动开启
+    self.session.set_method_intern(true)
+    self.session.call(0, FLAG_REQ, 0, "on_heartbeat", 1, 2)
+    self.session.call(0, FLAG_REQ, 0, "on_heartbeat", 3, 4)
+    local start = hive.clock_ms
+    while #self.recvs < 2 and hive.clock_ms - start < 5000 do
+        thread_mgr:sleep(5)
+    end
+    local recvs = self.recvs
+    check(#recvs == 2 and recvs[1].rpc == "on_heartbeat" and recvs[2].args[2] == 4 and recvs[2].flag == FLAG_REQ, "server call: {}", recvs)
+    --首次发送带方法名, 之后只发编号
+    local define_len = self:send("rpc_cache_update", 2)
+    local id_len     = self:send("rpc_cache_update", 3)
+    check(define_len >= name_len and id_len < name_len, "len name:{} define:{} id:{}", name_len, define_len, id_len)
+    log_info("[rpcmethod_test] rpc_cache_update bytes name:{} define:{} id:{}", name_len, define_len, id_len)
+    --超长方法名和非字符串方法名按原样发送
+    local long = "rpc_" .. string.rep("x", 60)
+    self:send(long, 4)
+    self:send(long, 5)
+    for i, rpc in ipairs(METHODS) do
+        self:send(rpc, i)
+    end
+    self:send("rpc_cache_update", 6)
+    check(self.bad == 0 and not self.server_error, "bad:{} err:{}", self.bad, self.server_error)
+end
+
+function RpcmethodTest:bench(intern)
+    self.socket.set_method_intern(intern)
+    self.count, self.bytes, self.bad = 0, 0, 0
+    local socket, count = self.socket, #METHODS
+    local start, cpu, send_cpu = hive.clock_ms, oclock(), 0
+    for i = 1, TOTAL, BATCH do
+        local clock = oclock()
+        for j = i, i + BATCH - 1 do
+            socket.call(0, FLAG_REQ, 0, METHODS[j % count + 1], j, "hero", 3)
+        end
+        send_cpu = send_cpu + oclock() - clock
+        self:wait(i + BATCH - 1)
+    end
+    local dispatch_cpu = oclock() - cpu - send_cpu
+    check(self.count == TOTAL and self.bad == 0, "recv:{} bad:{}", self.count, self.bad)
+    log_info("[rpcmethod_test] {} calls intern:{} payload:{}bytes send:{}ms recv+dispatch:{}ms wall:{}ms", TOTAL, intern, self.bytes,
+        sformat("%.1f", send_cpu * 1000), sformat("%.1f", dispatch_cpu * 1000), hive.clock_ms - start)
+    return self.bytes, send_cpu + dispatch_cpu
+end
+
+thread_mgr:fork(function()
+    RpcmethodTest:listen()
+    RpcmethodTest:connect()
+    RpcmethodTest:verify()
+    local name_bytes, name_cpu     = RpcmethodTest:bench(false)
+    local intern_bytes, intern_cpu = RpcmethodTest:bench(true)
+    log_info("[rpcmethod_test] per 1M calls saved {} bytes ({}%) cpu {}ms", name_bytes - intern_bytes,
+        sformat("%.1f", (name_bytes - intern_bytes) * 100 / name_bytes), sformat("%.1f", (name_cpu - intern_cpu) * 1000))
+    RpcmethodTest.socket.close()
+    RpcmethodTest.listener.close()
+    log_info("[rpcmethod_test] done")
+end)
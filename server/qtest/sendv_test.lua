@@ -0,0 +1,74 @@
+-- sendv_test.lua
+-- rpc发送路径的系统调用次数和吞吐
+local ltimer    = require("ltimer")
+local log_info  = logger.info
+local log_err   = logger.err
+local sformat   = string.format
+local srep      = string.rep
+
+local oclock    = os.clock
+local lclock_ms = ltimer.clock_ms
+
+local PORT      = 8703
+local MSG_COUNT = 100000
+local BATCH     = { 1, 16, 256 }
+local PAYLOADS  = { 64, 1024 }
+
+local listener  = luabus.listen("127.0.0.1", PORT)
+if not listener then
+    log_err("[sendv_test] listen failed")
+    return
+end
+
+local received  = 0
+local session   = nil
+listener.on_accept = function(ss)
+    session = ss
+    session.on_call = function()
+        received = received + 1
+    end
+end
+
+local function pump(check, timeout)
+    local deadline = lclock_ms() + timeout
+    while not check() and lclock_ms() < deadline do
+        luabus.wait(lclock_ms(), 1)
+    end
+end
+
+local connected = false
+local client = luabus.connect("127.0.0.1", PORT, 5000)
+client.on_connect = function(res)
+    connected = (res == "ok")
+end
+pump(function() return connected and session end, 5000)
+
+--每帧发送batch条消息
+local function bench(batch, size)
+    local payload = srep("x", size)
+    received = 0
+    local calls, bytes = luabus.send_stats()
+    local start = oclock()
+    local sent = 0
+    while sent < MSG_COUNT do
+        for _ = 1, math.min(batch, MSG_COUNT - sent) do
+            client.call(0, 0, 0, "on_sendv", payload)
+            sent = sent + 1
+        end
+        luabus.wait(lclock_ms(), 0)
+    end
+    pump(function() return received >= MSG_COUNT end, 20000)
+    local cost = oclock() - start
+    local ncalls, nbytes = luabus.send_stats()
+    calls, bytes = ncalls - calls, nbytes - bytes
+    log_info("[sendv_test] batch:{} size:{} recv:{} syscalls:{} ({} msg/call) {} msg/s {} MB/s",
+        batch, size, received, calls, sformat("%.1f", MSG_COUNT / calls),
+        sformat("%.0f", MSG_COUNT / cost), sformat("%.1f", bytes / cost / 1048576))
+end
+
+for _, size in ipairs(PAYLOADS) do
+    for _, batch in ipairs(BATCH) do
+        bench(batch, size)
+    end
+end
+client.close()
@@ -0,0 +1,76 @@
+-- shard_test.lua
+-- io线程收发的rpc回显吞吐: ./hive ./conf/qtest.conf --io_threads=4
+local ltimer    = require("ltimer")
+local log_info  = logger.info
+local log_err   = logger.err
+local sformat   = string.format
+local srep      = string.rep
+
+local lclock_ms = ltimer.clock_ms
+
+local PORT      = 8704
+local CONN      = 16
+local MSG_COUNT = 200000
+local BATCH     = 64
+local PAYLOAD   = srep("x", 256)
+
+local listener  = luabus.listen("127.0.0.1", PORT)
+if not listener then
+    log_err("[shard_test] listen failed")
+    return
+end
+
+local sessions  = {}
+listener.on_accept = function(session)
+    sessions[#sessions + 1] = session
+    session.on_call = function(recv_len, session_id, rpc_flag, source, rpc, data)
+        session.call(0, 0, 0, "on_echo", data)
+    end
+end
+
+local function pump(check, timeout)
+    local deadline = lclock_ms() + timeout
+    while not check() and lclock_ms() < deadline do
+        luabus.wait(lclock_ms(), 1)
+    end
+end
+
+local received  = 0
+local connected = 0
+local clients   = {}
+for _ = 1, CONN do
+    local client = luabus.connect("127.0.0.1", PORT, 5000)
+    client.on_connect = function(res)
+        if res == "ok" then
+            connected = connected + 1
+        end
+    end
+    client.on_call = function()
+        received = received + 1
+    end
+    clients[#clients + 1] = client
+end
+pump(function() return connected == CONN and #sessions == CONN end, 5000)
+
+local start = lclock_ms()
+local sent  = 0
+while sent < MSG_COUNT do
+    --限制在途消息数
+    if sent - received < CONN * BATCH then
+        for _, client in ipairs(clients) do
+            for _ = 1, BATCH do
+                client.call(0, 0, 0, "on_shard", PAYLOAD)
+            end
+        end
+        sent = sent + CONN * BATCH
+    end
+    luabus.wait(lclock_ms(), 0)
+end
+pump(function() return received >= sent end, 20000)
+local cost = lclock_ms() - start
+local calls, bytes = luabus.send_stats()
+log_info("[shard_test] io_threads:{} conn:{} echo:{}/{} cost:{}ms {} msg/s syscalls:{} bytes:{}",
+    environ.number("HIVE_IO_THREADS", 0), CONN, received, sent, cost, sformat("%.0f", received * 1000 / cost), calls, bytes)
+for _, client in pairs(clients) do
+    client.close()
+end
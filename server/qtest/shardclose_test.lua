@@ -0,0 +1,103 @@
+-- shardclose_test.lua
+-- 处理返回非0时服务端关闭连接: 对端收到断开, 服务端连接释放
+-- 对端不收包时发送队列超过上限, 服务端关闭连接
+-- io线程模式: ./hive ./conf/qtest.conf --io_threads=2
+local TestUtil    = import("qtest/test_util.lua")
+
+local log_info    = logger.info
+local check       = TestUtil.checker("shardclose_test")
+local sfind       = string.find
+local sformat     = string.format
+local srep        = string.rep
+local eproto_type = luabus.eproto_type
+
+local thread_mgr  = hive.get("thread_mgr")
+
+local PORT        = 16390
+local CMD_ID      = 9103
+local FLAG_REQ    = hive.enum("FlagMask", "REQ")
+
+local function pb_schema()
+    return TestUtil.pb_file("qtest_close.proto", "qtest_close", { TestUtil.pb_message("close_req", { { "text", 1, 9 } }) })
+end
+
+--服务端口上未关闭的连接数(ESTABLISHED/CLOSE_WAIT), 监听socket不计
+local function conn_count()
+    local file = io.open("/proc/net/tcp")
+    if not file then
+        return 0
+    end
+    local count = 0
+    local local_port = sformat(":%04X ", PORT)
+    for line in file:lines() do
+        local addr, state = line:match("^%s*%d+: (%x+:%x+) %x+:%x+ (%x+)")
+        if addr and sfind(addr .. " ", local_port, 1, true) and (state == "01" or state == "08") then
+            count = count + 1
+        end
+    end
+    file:close()
+    return count
+end
+
+local function wait(cond, timeout)
+    local start = hive.clock_ms
+    while not cond() and hive.clock_ms - start < timeout do
+        thread_mgr:sleep(10)
+    end
+    return cond()
+end
+
+thread_mgr:fork(function()
+    if not check(protobuf.load(pb_schema()), "load schema") then
+        return
+    end
+    protobuf.bind_cmd(CMD_ID, "qtest_close.close_req")
+    local codecs   = { protobuf.pbcodec(), protobuf.pbcodec() }
+    local listener = luabus.listen("127.0.0.1", PORT, eproto_type.pb)
+    listener.set_codec(codecs[1])
+    local session, server_err
+    listener.on_accept = function(ss)
+        session = ss
+        --拒绝所有消息
+        ss.on_call_pb = function()
+            return 1
+        end
+        ss.on_error   = function(token, err)
+            server_err = err
+        end
+    end
+    local connected, client_err
+    local client    = luabus.connect("127.0.0.1", PORT, 2000, eproto_type.pb)
+    client.set_codec(codecs[2])
+    client.on_connect = function(res)
+        connected = (res == "ok")
+    end
+    client.on_call_pb = function()
+        return 0
+    end
+    client.on_error   = function(token, err)
+        client_err = err
+    end
+    check(wait(function() return connected and session end, 3000), "connect")
+    check(conn_count() == 1, "accepted conns: {}", conn_count())
+    client.call_pb(CMD_ID, FLAG_REQ, 0, 0, { text = "bad" })
+    --服务端回调错误并关闭连接, 对端收到断开
+    check(wait(function() return server_err and client_err end, 3000), "disconnect server:{} client:{}", server_err, client_err)
+    check(wait(function() return conn_count() == 0 end, 3000), "server conns: {}", conn_count())
+    log_info("[shardclose_test] io_threads:{} server:{} client:{}", environ.number("HIVE_IO_THREADS", 0), server_err, client_err)
+    --对端只连接不读取, 持续发送直到超过发送队列上限
+    session, server_err = nil, nil
+    os.execute(sformat("bash -c 'exec 3<>/dev/tcp/127.0.0.1/%d; sleep 5' &", PORT))
+    check(wait(function() return session end, 3000), "slow peer connect")
+    local text  = srep("x", 1024 * 1024)
+    local sends = 0
+    while session and not server_err and sends < 64 do
+        session.call_pb(CMD_ID, FLAG_REQ, 0, 0, { text = text })
+        sends = sends + 1
+    end
+    check(server_err and sfind(server_err, "send-buffer-full", 1, true), "slow peer sends:{} err:{}", sends, server_err)
+    check(wait(function() return conn_count() == 0 end, 3000), "slow peer conns: {}", conn_count())
+    log_info("[shardclose_test] slow peer sends:{} err:{}", sends, server_err)
+    listener.close()
+    log_info("[shardclose_test] done")
+end)
@@ -0,0 +1,78 @@
+-- socket_wait_test.lua
+-- 空闲连接下luabus.wait的帧开销
+-- 连接数受HIVE_MAX_CONN和ulimit -n限制: ./hive ./conf/qtest.conf --max_conn=60000
+local ltimer    = require("ltimer")
+local log_info  = logger.info
+local log_err   = logger.err
+local sformat   = string.format
+
+local oclock    = os.clock
+local lclock_ms = ltimer.clock_ms
+
+local PORT      = 8701
+local LOOP      = 10000
+local counts    = { 1000, 10000, 50000 }
+
+local listener  = luabus.listen("127.0.0.1", PORT)
+if not listener then
+    log_err("[socket_wait_test] listen failed")
+    return
+end
+
+local sessions  = {}
+local accepted  = 0
+listener.on_accept = function(session)
+    accepted = accepted + 1
+    session.set_timeout(60000)
+    sessions[#sessions + 1] = session
+end
+
+local function bench(count)
+    --每条连接两端各占一个socket
+    local pairs_num = count // 2
+    local clients   = {}
+    local connected = 0
+    accepted        = 0
+    for i = 1, pairs_num do
+        local socket = luabus.connect("127.0.0.1", PORT, 5000)
+        if not socket then
+            log_err("[socket_wait_test] connect failed at {}", i)
+            break
+        end
+        socket.on_connect = function(res)
+            if res == "ok" then
+                connected = connected + 1
+            end
+        end
+        socket.set_timeout(60000)
+        clients[#clients + 1] = socket
+    end
+    local deadline = lclock_ms() + 10000
+    while (connected < #clients or accepted < #clients) and lclock_ms() < deadline do
+        luabus.wait(lclock_ms(), 1)
+    end
+    --预热
+    for _ = 1, 10 do
+        luabus.wait(lclock_ms(), 0)
+    end
+    local start = oclock()
+    for _ = 1, LOOP do
+        luabus.wait(lclock_ms(), 0)
+    end
+    local cost = (oclock() - start) * 1000000 / LOOP
+    log_info("[socket_wait_test] sockets:{} connected:{} accepted:{} wait avg:{}us", #clients * 2, connected, accepted, sformat("%.2f", cost))
+    for _, socket in pairs(clients) do
+        socket.close()
+    end
+    for _, session in pairs(sessions) do
+        session.close()
+    end
+    sessions = {}
+    for _ = 1, 10 do
+        luabus.wait(lclock_ms(), 1)
+    end
+end
+
+for _, count in ipairs(counts) do
+    bench(count)
+end
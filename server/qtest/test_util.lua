@@ -0,0 +1,192 @@
+-- test_util.lua
+-- qtest公共函数
+local Socket      = import("driver/socket.lua")
+
+local log_err     = logger.err
+local sformat     = string.format
+local schar       = string.char
+local spack       = string.pack
+local sunpack     = string.unpack
+local tconcat     = table.concat
+local tunpack     = table.unpack
+local bencode     = bson.encode
+local bdecode     = bson.decode
+local bcompress   = bson.compress
+local buncompress = bson.uncompress
+
+local OP_MSG      = 2013
+local OP_ZIP      = 2012
+local ZIP_NAMES   = { [0] = "noop", [1] = "snappy", [2] = "zlib" }
+
+local TestUtil = {}
+
+--断言: 失败时输出"[tag] check failed: msg", 返回cond
+function TestUtil.checker(tag)
+    local prefix = sformat("[%s] check failed: ", tag)
+    return function(cond, msg, ...)
+        if not cond then
+            log_err(prefix .. msg, ...)
+        end
+        return cond
+    end
+end
+
+--手工生成FileDescriptorSet, 不依赖protoc
+local function varint(value)
+    local out = {}
+    repeat
+        local byte = value & 0x7f
+        value      = value >> 7
+        out[#out + 1] = schar(value ~= 0 and byte | 0x80 or byte)
+    until value == 0
+    return tconcat(out)
+end
+
+local function field_str(number, value)
+    return varint(number << 3 | 2) .. varint(#value) .. value
+end
+
+local function field_int(number, value)
+    return varint(number << 3) .. varint(value)
+end
+
+--type: 4-uint64 5-int32 9-string 11-message 13-uint32; label: 1-optional 3-repeated
+local function pb_field(name, number, type, label, type_name)
+    local body = field_str(1, name) .. field_int(3, number) .. field_int(4, label or 1) .. field_int(5, type)
+    return type_name and body .. field_str(6, type_name) or body
+end
+
+--fields: { { name, number, type, label, type_name }, ... }
+local function pb_message(name, fields)
+    local body = field_str(1, name)
+    for _, field in ipairs(fields) do
+        body = body .. field_str(2, pb_field(tunpack(field)))
+    end
+    return body
+end
+
+--proto3文件, messages为pb_message的结果
+local function pb_file(name, package, messages)
+    local body = field_str(1, name) .. field_str(2, package)
+    for _, message in ipairs(messages) do
+        body = body .. field_str(4, message)
+    end
+    body = body .. field_str(12, "proto3")
+    return field_str(1, body)
+end
+
+TestUtil.varint     = varint
+TestUtil.field_str  = field_str
+TestUtil.field_int  = field_int
+TestUtil.pb_field   = pb_field
+TestUtil.pb_message = pb_message
+TestUtil.pb_file    = pb_file
+
+--模拟mongo服务: 解析OP_MSG(含kind1文档序列)和OP_COMPRESSED请求, 按请求的压缩方式应答
+--handler:execute(socket, body, sections)返回应答文档, sections为{ 序列名 = 文档列表 }
+--可选handler:on_accept(socket), handler:on_error(socket), handler:send(socket, data, req_len)
+--class模板按文件区分, 这里用普通表作为socket的host
+local MongoStandin = {}
+MongoStandin.__index = MongoStandin
+
+function MongoStandin:listen()
+    self.listener = Socket(self)
+    return self.listener:listen("127.0.0.1", self.port)
+end
+
+function MongoStandin:close()
+    self.listener:close()
+end
+
+function MongoStandin:on_socket_accept(socket)
+    local handler = self.handler
+    if handler.on_accept then
+        handler:on_accept(socket)
+    end
+end
+
+function MongoStandin:on_socket_error(socket)
+    local handler = self.handler
+    if handler.on_error then
+        handler:on_error(socket)
+    end
+end
+
+--解析一条请求: 头部 + [压缩头] + kind0 + 若干kind1文档序列
+function MongoStandin:read_msg(buf, pos)
+    if #buf - pos + 1 < 16 then
+        return
+    end
+    local len, req_id, _, opcode, off = sunpack("<I4I4I4I4", buf, pos)
+    if #buf - pos + 1 < len then
+        return
+    end
+    local payload, zid = buf:sub(off, pos + len - 1), nil
+    if opcode == OP_ZIP then
+        local origin, size, cid, zoff = sunpack("<I4I4B", payload)
+        zid     = cid
+        opcode  = origin
+        payload = buncompress(ZIP_NAMES[cid], payload:sub(zoff), size)
+    end
+    local _, kind, boff = sunpack("<I4B", payload)
+    if opcode ~= OP_MSG or kind ~= 0 then
+        log_err("[MongoStandin] unexpected opcode {} kind {}", opcode, kind)
+    end
+    local blen     = sunpack("<I4", payload, boff)
+    local body     = bdecode(payload:sub(boff, boff + blen - 1))
+    local sections = {}
+    boff           = boff + blen
+    while boff <= #payload do
+        local skind, slen, ident, doff = sunpack("<BI4z", payload, boff)
+        local send = boff + 1 + slen
+        local docs = {}
+        while doff < send do
+            local dlen      = sunpack("<I4", payload, doff)
+            docs[#docs + 1] = bdecode(payload:sub(doff, doff + dlen - 1))
+            doff            = doff + dlen
+        end
+        if skind == 1 then
+            sections[ident] = docs
+        end
+        boff = send
+    end
+    return req_id, body, sections, zid, pos + len, len
+end
+
+function MongoStandin:reply(req_id, doc, zid)
+    local payload = spack("<I4B", 0, 0) .. bencode(doc)
+    if zid then
+        local zdata = bcompress(ZIP_NAMES[zid], payload)
+        return spack("<I4I4I4I4I4I4B", 25 + #zdata, 0, req_id, OP_ZIP, OP_MSG, #payload, zid) .. zdata
+    end
+    return spack("<I4I4I4I4", 16 + #payload, 0, req_id, OP_MSG) .. payload
+end
+
+function MongoStandin:on_socket_recv(socket)
+    local handler  = self.handler
+    local buf, pos = socket.recvbuf, 1
+    while true do
+        local req_id, body, sections, zid, npos, len = self:read_msg(buf, pos)
+        if not req_id then
+            break
+        end
+        pos       = npos
+        local doc = handler:execute(socket, body, sections)
+        --session为0的请求(如killCursors)不需要应答
+        if req_id > 0 then
+            local data = self:reply(req_id, doc, zid)
+            if handler.send then
+                handler:send(socket, data, len)
+            else
+                socket:send(data)
+            end
+        end
+    end
+    socket:pop(pos - 1)
+end
+
+function TestUtil.mongo_standin(port, handler)
+    return setmetatable({ port = port, handler = handler }, MongoStandin)
+end
+
+return TestUtil
@@ -0,0 +1,137 @@
+-- timerwheel_test.lua
+-- 时间轮: 校验触发/周期/取消/重设/回调中增删, 压测100万定时器每秒10%增删的耗时
+local TestUtil   = import("qtest/test_util.lua")
+
+local log_info   = logger.info
+local check      = TestUtil.checker("timerwheel_test")
+local sformat    = string.format
+local mrandom    = math.random
+local oclock     = os.clock
+
+local timer_mgr  = hive.get("timer_mgr")
+local thread_mgr = hive.get("thread_mgr")
+
+local TIMERS     = 1000000
+local CHURN      = 0.1
+local SECONDS    = 10
+local TICKS      = 50   --20ms精度下每秒刻度数
+
+--独立的时间轮, 手动推进刻度
+local function verify_wheel()
+    local wheel  = timer.wheel()
+    local fires  = {}
+    local function dispatch(timer_id)
+        fires[timer_id] = (fires[timer_id] or 0) + 1
+    end
+    local once   = wheel.insert(5, 0)
+    local loop   = wheel.insert(3, 3)
+    local cancel = wheel.insert(2, 0)
+    local far    = wheel.insert(100000, 0)
+    check(wheel.cancel(cancel) and not wheel.cancel(cancel), "cancel twice")
+    wheel.update(4, dispatch)
+    check(not fires[once] and fires[loop] == 1, "before expire")
+    wheel.update(5, dispatch)
+    --周期定时器在update结束后按当前时间续期: 第4刻度续期到7
+    check(fires[once] == 1 and fires[loop] == 2 and not fires[cancel], "expire: {}", fires)
+    --单次触发后回收, 旧id复用节点后也不会误删
+    local reuse = wheel.insert(1, 0)
+    check(not wheel.cancel(once) and not wheel.cancel(cancel) and wheel.size() == 3, "stale id")
+    check(wheel.reset(reuse, 10, 0), "reset")
+    wheel.update(5, dispatch)
+    check(not fires[reuse], "reset delay")
+    check(wheel.set_period(loop, 10) and wheel.update(10, dispatch) > 0 and fires[reuse] == 1, "set period")
+    --跨越多层的定时器准时触发, 期间周期定时器每次update只触发一次
+    local ticks = 24
+    local loops = fires[loop]
+    while not fires[far] and ticks < 200000 do
+        wheel.update(1000, dispatch)
+        ticks = ticks + 1000
+    end
+    check(fires[far] == 1 and ticks == 100024, "far timer: {}", ticks)
+    check(fires[loop] - loops == 100, "stall loop: {}", fires[loop] - loops)
+    --回调中取消同一刻度的其他定时器, 插入新的定时器
+    local a, b  = wheel.insert(1, 0), wheel.insert(1, 0)
+    local added
+    check(wheel.cancel(loop), "cancel loop")
+    wheel.update(1, function(timer_id)
+        dispatch(timer_id)
+        if timer_id == a then
+            wheel.cancel(b)
+            added = wheel.insert(0, 0)
+        end
+    end)
+    wheel.update(0, dispatch)
+    check(fires[a] == 1 and not fires[b] and fires[added] == 1 and wheel.size() == 0, "reentry")
+    --回调出错不影响其他定时器
+    local c, d  = wheel.insert(1, 0), wheel.insert(1, 0)
+    local ok    = pcall(wheel.update, 1, function(timer_id)
+        dispatch(timer_id)
+        error("timer error")
+    end)
+    check(not ok and fires[c] == 1 and fires[d] == 1 and wheel.size() == 0, "error")
+end
+
+local function verify_mgr()
+    local onces, loops, regs = 0, 0, 0
+    timer_mgr:once(100, function() onces = onces + 1 end)
+    local cancel = timer_mgr:once(100, function() onces = onces + 100 end)
+    timer_mgr:unregister(cancel)
+    local loop = timer_mgr:loop(100, function() loops = loops + 1 end)
+    timer_mgr:register(100, 100, 3, function() regs = regs + 1 end)
+    thread_mgr:sleep(650)
+    timer_mgr:unregister(loop)
+    local stop = loops
+    thread_mgr:sleep(300)
+    check(onces == 1 and regs == 3 and loops >= 5 and loops == stop, "timer_mgr once:{} loop:{} register:{}", onces, loops, regs)
+end
+
+--100万周期定时器(1~60秒), 每秒随机取消10%并插入同样数量
+local function bench()
+    local wheel   = timer.wheel()
+    local insert  = wheel.insert
+    local cancel  = wheel.cancel
+    local update  = wheel.update
+    local fires   = 0
+    local function dispatch()
+        fires = fires + 1
+    end
+    local live    = {}
+    collectgarbage("collect")
+    local mem     = collectgarbage("count")
+    local clock   = oclock()
+    for i = 1, TIMERS do
+        local period = mrandom(TICKS, TICKS * 60)
+        live[i]      = insert(mrandom(1, period), period)
+    end
+    local insert_cost = oclock() - clock
+    local churn       = TIMERS * CHURN // TICKS
+    local churn_cost, update_cost = 0, 0
+    for _ = 1, SECONDS * TICKS do
+        clock = oclock()
+        for _ = 1, churn do
+            local i      = mrandom(1, TIMERS)
+            local period = mrandom(TICKS, TICKS * 60)
+            cancel(live[i])
+            live[i] = insert(mrandom(1, period), period)
+        end
+        churn_cost  = churn_cost + oclock() - clock
+        clock       = oclock()
+        update(1, dispatch)
+        update_cost = update_cost + oclock() - clock
+    end
+    local ops = churn * SECONDS * TICKS
+    check(wheel.size() == TIMERS, "size: {}", wheel.size())
+    log_info("[timerwheel_test] {} timers insert:{}ms ({}ns/op) lua mem:{}MB", TIMERS, sformat("%.1f", insert_cost * 1000),
+        sformat("%.0f", insert_cost * 1e9 / TIMERS), sformat("%.1f", (collectgarbage("count") - mem) / 1024))
+    log_info("[timerwheel_test] {}s churn {} cancel+insert:{}ms ({}ns/op) update {} fires:{}ms ({}ns/fire) per second:{}ms",
+        SECONDS, ops, sformat("%.1f", churn_cost * 1000), sformat("%.0f", churn_cost * 1e9 / ops), fires,
+        sformat("%.1f", update_cost * 1000), sformat("%.0f", update_cost * 1e9 / fires),
+        sformat("%.1f", (churn_cost + update_cost) * 1000 / SECONDS))
+end
+
+thread_mgr:fork(function()
+    verify_wheel()
+    verify_mgr()
+    bench()
+    log_info("[timerwheel_test] done")
+end)
@@ -0,0 +1,214 @@
+-- wsframe_test.lua
+-- websocket帧解析: 客户端手工构造带掩码的帧, 校验分片重组/控制帧插入/permessage-deflate/超长消息; 统计小帧解析帧率和大帧解掩码吞吐
+local WebSocket   = import("driver/websocket.lua")
+local TestUtil    = import("qtest/test_util.lua")
+
+local log_info    = logger.info
+local check       = TestUtil.checker("wsframe_test")
+local sformat     = string.format
+local spack       = string.pack
+local sunpack     = string.unpack
+local srep        = string.rep
+local ssub        = string.sub
+local sbyte       = string.byte
+local schar       = string.char
+local sfind       = string.find
+local tconcat     = table.concat
+local oclock      = os.clock
+local zcompress   = bson.compress
+local eproto_type = luabus.eproto_type
+
+local thread_mgr  = hive.get("thread_mgr")
+
+local PORT        = 16386
+local MASK_KEY    = "\x3a\x5c\x96\xe1"
+local SMALL_TOTAL = 50000
+local SMALL_BATCH = 500
+local BIG_SIZE    = 1024 * 1024
+local BIG_TOTAL   = 64
+
+--按4字节异或掩码
+local function mask_payload(payload)
+    local key32  = sunpack("<I4", MASK_KEY)
+    local out    = {}
+    local len    = #payload
+    local blocks = len // 4
+    for i = 0, blocks - 1 do
+        out[#out + 1] = spack("<I4", sunpack("<I4", payload, i * 4 + 1) ~ key32)
+    end
+    for i = blocks * 4 + 1, len do
+        out[#out + 1] = schar(sbyte(payload, i) ~ sbyte(MASK_KEY, (i - 1) % 4 + 1))
+    end
+    return tconcat(out)
+end
+
+local function frame(opcode, payload, fin, rsv1)
+    local head = (fin == false and 0 or 0x80) | (rsv1 and 0x40 or 0) | opcode
+    local len  = #payload
+    local hdr
+    if len < 126 then
+        hdr = spack("BB", head, 0x80 | len)
+    elseif len <= 0xffff then
+        hdr = spack(">BBI2", head, 0x80 | 126, len)
+    else
+        hdr = spack(">BBI8", head, 0x80 | 127, len)
+    end
+    return hdr .. MASK_KEY .. mask_payload(payload)
+end
+
+--zlib格式去掉2字节头和4字节校验即为raw deflate
+local function deflate(payload)
+    local data = zcompress("zlib", payload)
+    return ssub(data, 3, -5)
+end
+
+--服务端的host
+local WsframeTest = { count = 0, bytes = 0, echo = false, pongs = 0, replies = {} }
+
+function WsframeTest:on_socket_accept(socket, token)
+    self.server_socket = socket
+end
+
+function WsframeTest:on_socket_error(socket, token, err)
+    self.server_error = err or "closed"
+end
+
+function WsframeTest:on_socket_recv(socket, token, message)
+    self.count = self.count + 1
+    self.bytes = self.bytes + #message
+    self.last  = message
+    if self.echo then
+        socket:send_frame(message)
+    end
+end
+
+function WsframeTest:listen()
+    self.server = WebSocket(self)
+    self.server:set_deflate(true)
+    check(self.server:listen("127.0.0.1", PORT), "listen")
+end
+
+--握手时不设置codec收原始应答, 完成后客户端换成wsscodec解析服务端的帧
+function WsframeTest:connect()
+    local socket = luabus.connect("127.0.0.1", PORT, 2000, eproto_type.text)
+    self.ccodec  = codec.wsscodec(json.jsoncodec(), 0, true)
+    socket.on_connect   = function(res)
+        self.connected = (res == "ok")
+    end
+    socket.on_call_text = function(recv_len, data)
+        self.handshake = data
+    end
+    socket.on_call_data = function(recv_len, method, opcode, message)
+        if method == "WSS" then
+            if opcode == 0xA then
+                self.pongs = self.pongs + 1
+            else
+                self.replies[#self.replies + 1] = message
+            end
+        end
+    end
+    socket.on_error     = function(token, err)
+        self.client_error = err
+    end
+    self.socket = socket
+    while not self.connected do
+        thread_mgr:sleep(10)
+    end
+    socket.set_codec(nil)
+    socket.call_text(tconcat({
+        "GET /ws HTTP/1.1", "Host: 127.0.0.1", "Upgrade: websocket", "Connection: Upgrade", "Sec-WebSocket-Version: 13",
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==", "Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits", "", ""
+    }, "\r\n"))
+    while not self.handshake do
+        thread_mgr:sleep(10)
+    end
+    check(sfind(self.handshake, "101", 1, true) and sfind(self.handshake, "permessage-deflate", 1, true), "handshake: {}", self.handshake)
+    socket.set_codec(self.ccodec)
+    --服务端下一帧切换codec
+    thread_mgr:sleep(200)
+end
+
+function WsframeTest:send(data, count)
+    local expect = self.count + (count or 1)
+    self.socket.call_text(data)
+    local start = hive.clock_ms
+    while self.count < expect and hive.clock_ms - start < 5000 do
+        thread_mgr:sleep(1)
+    end
+    return self.last
+end
+
+function WsframeTest:verify()
+    check(self:send(frame(0x1, "hello")) == "hello", "small frame")
+    local mid = srep("0123456789", 30)
+    check(self:send(frame(0x1, mid)) == mid, "126 frame")
+    --分片中间插入ping, 只在最后一片收完后回调一次
+    local parts = { srep("a", 1000), srep("b", 2001), srep("c", 7) }
+    local data  = frame(0x1, parts[1], false) .. frame(0x9, "PING") .. frame(0x0, parts[2], false) .. frame(0x0, parts[3])
+    local count = self.count
+    check(self:send(data) == tconcat(parts) and self.count == count + 1, "fragments: {}", self.count - count)
+    --压缩消息, 以及压缩后再分片
+    local text = srep("{\"role\":10086,\"name\":\"hero\",\"items\":[1,2,3]}", 200)
+    local zip  = deflate(text)
+    check(self:send(frame(0x1, zip, true, true)) == text, "deflate")
+    local half = #zip // 2
+    check(self:send(frame(0x1, ssub(zip, 1, half), false, true) .. frame(0x0, ssub(zip, half + 1))) == text, "deflate fragments")
+    --回显: 服务端压缩, 客户端解压
+    self.echo = true
+    self:send(frame(0x1, text))
+    self:send(frame(0x1, "short"))
+    self.echo = false
+    local start = hive.clock_ms
+    while (#self.replies < 2 or self.pongs < 1) and hive.clock_ms - start < 5000 do
+        thread_mgr:sleep(5)
+    end
+    check(self.replies[1] == text and self.replies[2] == "short" and self.pongs == 1, "echo: {} pongs: {}", #self.replies, self.pongs)
+end
+
+--小帧: 分批发送, 每批等待服务端回调完成
+function WsframeTest:bench_small()
+    local payload = srep("x", 64)
+    local batch   = srep(frame(0x1, payload), SMALL_BATCH)
+    self.count    = 0
+    local clock, start = oclock(), hive.clock_ms
+    for i = 1, SMALL_TOTAL // SMALL_BATCH do
+        self:send(batch, SMALL_BATCH)
+    end
+    local cost = oclock() - clock
+    check(self.count == SMALL_TOTAL, "small count: {}", self.count)
+    log_info("[wsframe_test] {} frames(64B) cpu:{}ms {}K frames/s wall:{}ms", SMALL_TOTAL, sformat("%.1f", cost * 1000), SMALL_TOTAL // (cost * 1000), hive.clock_ms - start)
+end
+
+--大帧: 解掩码后交给lua, 统计吞吐
+function WsframeTest:bench_big()
+    local data = frame(0x1, srep("0123456789abcdef", BIG_SIZE // 16))
+    self.count, self.bytes = 0, 0
+    local clock = oclock()
+    for i = 1, BIG_TOTAL do
+        self:send(data)
+    end
+    local cost = oclock() - clock
+    check(self.count == BIG_TOTAL and self.bytes == BIG_SIZE * BIG_TOTAL, "big count: {}", self.count)
+    log_info("[wsframe_test] {} frames(1MB) cpu:{}ms {}MB/s", BIG_TOTAL, sformat("%.1f", cost * 1000), sformat("%.1f", BIG_TOTAL / cost))
+end
+
+--超出消息上限时断开连接
+function WsframeTest:oversize()
+    self.socket.call_text(spack(">BBI8", 0x81, 0x80 | 127, 64 * 1024 * 1024) .. MASK_KEY)
+    local start = hive.clock_ms
+    while not self.server_error and hive.clock_ms - start < 5000 do
+        thread_mgr:sleep(10)
+    end
+    check(self.server_error, "oversize not closed")
+end
+
+thread_mgr:fork(function()
+    WsframeTest:listen()
+    WsframeTest:connect()
+    WsframeTest:verify()
+    WsframeTest:bench_small()
+    WsframeTest:bench_big()
+    WsframeTest:oversize()
+    WsframeTest.socket.close()
+    log_info("[wsframe_test] done")
+end)
@@ -3,6 +3,8 @@ local LinuxStatis          = import("feature/linux.lua")
 local InfluxDB             = import("driver/influx.lua")
 
 local tsort                = table.sort
+local ssub                 = string.sub
+local sformat              = string.format
 local tinsert              = table.insert
 local tremove_out          = table_ext.tremove_out
 local tkvarray             = table_ext.kvarray
@@ -10,11 +12,10 @@ local log_warn             = logger.warn
 local log_err              = logger.err
 local env_get              = environ.get
 local env_addr             = environ.addr
-local event_mgr            = hive.get("event_mgr")
+local msnapshot            = metrics.snapshot
 local update_mgr           = hive.get("update_mgr")
 
 local PeriodTime           = enum("PeriodTime")
-local MaxMessageLen<const> = 32 * 1024
 
 local StatisMgr            = singleton()
 local prop                 = property(StatisMgr)
@@ -27,16 +28,12 @@ prop:reader("rpc_recv_count", nil)
 prop:reader("msg_send_count", nil)
 prop:reader("msg_recv_count", nil)
 prop:reader("local_counts", {})         --本地计数
+prop:reader("networks", {})             --网络指标
 
 function StatisMgr:__init()
     local statis_status = environ.status("HIVE_STATIS")
     if statis_status then
         self.statis_status = statis_status
-        --事件监听
-        event_mgr:add_listener(self, "on_rpc_send")
-        event_mgr:add_listener(self, "on_rpc_recv")
-        event_mgr:add_listener(self, "on_proto_recv")
-        event_mgr:add_listener(self, "on_proto_send")
         --定时处理
         update_mgr:attach_second(self)
         update_mgr:attach_minute(self)
@@ -52,6 +49,11 @@ function StatisMgr:__init()
         self.rpc_recv_count = hive.make_sampling("rpc_recv")
         self.msg_send_count = hive.make_sampling("msg_send")
         self.msg_recv_count = hive.make_sampling("msg_recv")
+        --各线程ProxyAgent:statistics写入的指标, 名字为"事件:协议"
+        self:add_network("on_proto_recv", "proto_recv", "recv_msg", self.msg_recv_count)
+        self:add_network("on_proto_send", "proto_send", "send_msg", self.msg_send_count)
+        self:add_network("on_rpc_send", "rpc_send", "send_rpc", self.rpc_send_count)
+        self:add_network("on_rpc_recv", "rpc_recv", "recv_rpc", self.rpc_recv_count)
 
         local timer_mgr     = hive.get("timer_mgr")
         timer_mgr:loop(PeriodTime.MINUTE_5_MS, function()
@@ -59,8 +61,10 @@ function StatisMgr:__init()
         end)
     end
     self.local_counts = { recv_msg = {}, send_msg = {}, recv_rpc = {}, send_rpc = {} }
+end
 
-
+function StatisMgr:add_network(event, type, local_name, counter)
+    self.networks[event] = { prefix = event .. ":", type = type, local_name = local_name, counter = counter, lasts = {} }
 end
 
 function StatisMgr:init_influx()
@@ -88,74 +92,53 @@ end
 
 -- 发送给influx
 function StatisMgr:write(measurement, name, type, fields)
-    local measure = self.statis[measurement]
+    local key     = name and sformat("%s:%s:%s", measurement, type, name) or measurement
+    local measure = self.statis[key]
     if not measure then
-        measure                  = {
-            tags       = {
+        measure          = {
+            measurement = measurement,
+            tags        = {
                 name    = name,
                 type    = type,
                 index   = hive.index,
                 service = hive.service_name
             },
-            field_list = {}
+            field_list  = {}
         }
-        self.statis[measurement] = measure
+        self.statis[key] = measure
     end
     measure.field_list[#measure.field_list + 1] = fields
 end
 
--- 统计proto协议发送(KB)
-function StatisMgr:on_proto_recv(cmd_id, recv_len)
-    if self.statis_status then
-        if self.influx then
-            local fields = { count = recv_len }
-            self:write("network", cmd_id, "proto_recv", fields)
-        end
-        self.msg_recv_count:count_increase()
-    end
-    self:add_local_count("recv_msg", cmd_id, recv_len)
-end
-
--- 统计proto协议接收(KB)
-function StatisMgr:on_proto_send(cmd_id, send_len)
-    if send_len > MaxMessageLen then
-        log_err("[StatisMgr][on_proto_send] the msg is very long,cmd_id:{},len:{}", cmd_id, send_len)
-    end
-    if self.statis_status then
-        if self.influx then
-            local fields = { count = send_len }
-            self:write("network", cmd_id, "proto_send", fields)
-        end
-        self.msg_send_count:count_increase()
-    end
-    self:add_local_count("send_msg", cmd_id, send_len)
-end
-
--- 统计rpc协议发送(KB)
-function StatisMgr:on_rpc_send(rpc, send_len)
-    if self.statis_status then
-        if self.influx then
-            local fields = { count = send_len }
-            self:write("network", rpc, "rpc_send", fields)
+-- 汇总各线程的网络指标, 按秒计算增量(字节)
+function StatisMgr:collect_network()
+    for _, network in pairs(self.networks) do
+        local lasts, total = network.lasts, 0
+        local offset       = #network.prefix + 1
+        for mname, hist in pairs(msnapshot(network.prefix)) do
+            local count, len = hist.count, hist.sum
+            local last       = lasts[mname]
+            if last then
+                count, len = count - last.count, len - last.sum
+            end
+            lasts[mname] = hist
+            if count > 0 then
+                local name = ssub(mname, offset)
+                if self.influx then
+                    self:write("network", name, network.type, { count = count, len = len })
+                end
+                self:add_local_count(network.local_name, name, count, len)
+                total = total + count
+            end
         end
-        self.rpc_send_count:count_increase()
+        network.counter:count_add(total)
     end
-    self:add_local_count("send_rpc", rpc, send_len)
 end
 
--- 统计rpc协议接收(KB)
-function StatisMgr:on_rpc_recv(rpc, recv_len)
+function StatisMgr:on_second()
     if self.statis_status then
-        if self.influx then
-            local fields = { count = recv_len }
-            self:write("network", rpc, "rpc_recv", fields)
-        end
-        self.rpc_recv_count:count_increase()
+        self:collect_network()
     end
-    self:add_local_count("recv_rpc", rpc, recv_len)
-end
-
-function StatisMgr:on_second()
     self:flush()
 end
 
@@ -194,12 +177,12 @@ function StatisMgr:_calc_cpu_rate()
 end
 
 -- 添加本地计数
-function StatisMgr:add_local_count(name, cmd, len)
+function StatisMgr:add_local_count(name, cmd, count, len)
     local recv_msg = self.local_counts[name][cmd]
     if not recv_msg then
-        self.local_counts[name][cmd] = { count = 1, len = len }
+        self.local_counts[name][cmd] = { count = count, len = len }
     else
-        recv_msg.count = recv_msg.count + 1
+        recv_msg.count = recv_msg.count + count
         recv_msg.len   = recv_msg.len + len
     end
 end
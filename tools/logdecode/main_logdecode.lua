@@ -0,0 +1,54 @@
+--main_logdecode.lua
+--二进制日志(.blog)解码为文本日志(.log)
+local lstdfs     = require('lstdfs')
+local lualog     = require("lualog")
+
+local ldir       = lstdfs.dir
+local lmkdir     = lstdfs.mkdir
+local lappend    = lstdfs.append
+local lfilename  = lstdfs.filename
+local lextension = lstdfs.extension
+local lstem      = lstdfs.stem
+local lcurdir    = lstdfs.current_path
+local hgetenv    = os.getenv
+
+local function decode(blog_dir, log_dir)
+    local dir_files = ldir(blog_dir)
+    for _, file in pairs(dir_files) do
+        local fullname = file.name
+        local fname    = lfilename(fullname)
+        if file.type == "directory" then
+            local new_dir = lappend(log_dir, fname)
+            lmkdir(new_dir)
+            decode(fullname, new_dir)
+            goto continue
+        end
+        if lextension(fname) ~= ".blog" then
+            goto continue
+        end
+        local outfile = lappend(log_dir, lstem(fname) .. ".log")
+        local count   = lualog.decode(fullname, outfile)
+        print(string.format("decode %s -> %s lines:%d", fullname, outfile, count))
+        :: continue ::
+    end
+end
+
+local input     = lcurdir()
+local output    = lcurdir()
+local env_input = hgetenv("HIVE_INPUT")
+if not env_input or #env_input == 0 then
+    print("input dir not config!")
+else
+    input = lappend(input, env_input)
+end
+local env_output = hgetenv("HIVE_OUTPUT")
+if not env_output or #env_output == 0 then
+    print("output dir not config!")
+else
+    output = lappend(output, env_output)
+    lmkdir(output)
+end
+
+decode(input, output)
+
+os.exit()